@@ -29,6 +29,12 @@ AM_CONDITIONAL([ENABLE_PREFIX_COMMANDS],
 AM_CONDITIONAL([ENABLE_DEBUGGER],
                 [test "$enable_debugger" = "yes"])
 
+AM_CONDITIONAL([ENABLE_ASYNC_STREAMS],
+                [test "$enable_async_streams" = "yes"])
+
+AM_CONDITIONAL([ENABLE_ASYNC_AUTOSAVE],
+                [test "$enable_async_autosave" = "yes"])
+
 AM_CONDITIONAL([FIZMO_DIST_VERSION],
                 [test "x$fizmo_dist_version" != "x"])
 
@@ -5,3 +5,12 @@ AS_IF([test "x$enable_babel" != "xno"], [
   libfizmo_reqs="libxml-2.0"
 ])
 
+AS_IF([test "x$enable_async_streams" = "xyes" || \
+       test "x$enable_async_autosave" = "xyes"], [
+  AC_CHECK_LIB([pthread], [pthread_create], [],
+   [AC_MSG_ERROR([--enable-async-streams and --enable-async-autosave \
+require pthreads])])
+  libfizmo_async_libs="-lpthread"
+])
+AC_SUBST([ASYNC_STREAMS_LIBS], $libfizmo_async_libs)
+
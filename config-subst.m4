@@ -7,5 +7,5 @@
 # pre-defined by fizmo-dist.
 
 AC_SUBST([libfizmo_CFLAGS], "-I$build_prefix_cflags $xml2_CFLAGS")
-AC_SUBST([libfizmo_LIBS], "-L$build_prefix_libs -lfizmo $xml2_LIBS -lm")
+AC_SUBST([libfizmo_LIBS], "-L$build_prefix_libs -lfizmo $xml2_LIBS $libfizmo_async_libs -lm")
 
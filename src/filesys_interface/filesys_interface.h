@@ -47,6 +47,13 @@
 #define FILEACCESS_WRITE 1
 #define FILEACCESS_APPEND 2
 
+// Describes one buffer for the vectored "readv" and "writev" functions.
+struct z_iovec
+{
+  void *base;
+  size_t len;
+};
+
 
 struct z_filesys_interface
 {
@@ -89,6 +96,35 @@ struct z_filesys_interface
   int (*make_dir)(char *path);
 
   bool (*is_filename_directory)(char *filename);
+
+  // The following bulk functions are optional and may be NULL, in which
+  // case the fsi_* functions from tools/filesys.h fall back to the
+  // per-character functions above. Parsers should always use these
+  // fsi_* wrappers instead of calling the functions directly.
+
+  // Reads into / writes from the given buffers in order, starting at the
+  // current file position. Returns the total number of bytes transferred.
+  size_t (*readv)(struct z_iovec *iov, int iovcnt, z_file *fileref);
+  size_t (*writev)(struct z_iovec *iov, int iovcnt, z_file *fileref);
+
+  // Returns the complete file contents, regardless of the current file
+  // position, in a newly malloc()ed buffer which is terminated by an
+  // additional zero byte not included in "length". Returns NULL on error.
+  char* (*readfile)(z_file *fileref, size_t *length);
+
+  // Maps the complete file into memory. The mapping has to be private:
+  // it may be written to, but changes must never reach the file. Returns
+  // NULL on error. Memory obtained this way has to be released using
+  // "unmapfile". Both functions have to be provided for mapping to be used
+  // at all.
+  void* (*mapfile)(z_file *fileref, size_t *length);
+  int (*unmapfile)(void *addr, size_t length);
+
+  // Renames "old_filename" to "new_filename", replacing a file already
+  // existing under the new name. Return 0 on success. In case these are
+  // NULL, files can't be replaced or removed and the fsi_* wrappers fail.
+  int (*rename_file)(char *old_filename, char *new_filename);
+  int (*remove_file)(char *filename);
 };
 
 #endif /* filesys_interface_h_INCLUDED */
@@ -0,0 +1,381 @@
+
+/* allocator.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef allocator_c_INCLUDED
+#define allocator_c_INCLUDED
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../tools/tracelog.h"
+#include "../tools/i18n.h"
+#include "../tools/unused.h"
+#include "allocator.h"
+#include "config.h"
+#include "fizmo.h"
+#include "turnstat.h"
+#include "../locales/libfizmo_locales.h"
+
+
+static void *heap_allocate(size_t size, void *UNUSED(context))
+{
+  return malloc(size);
+}
+
+
+static void *heap_reallocate(void *ptr, size_t size, void *UNUSED(context))
+{
+  return realloc(ptr, size);
+}
+
+
+static void heap_release(void *ptr, void *UNUSED(context))
+{
+  free(ptr);
+}
+
+
+static struct z_allocator heap_allocator =
+{
+  &heap_allocate,
+  &heap_reallocate,
+  &heap_release,
+  NULL
+};
+
+static struct z_allocator *session_allocator = &heap_allocator;
+
+
+void fizmo_register_session_allocator(struct z_allocator *new_allocator)
+{
+  session_allocator = new_allocator != NULL ? new_allocator : &heap_allocator;
+}
+
+
+void *fizmo_session_try_malloc(size_t size)
+{
+  turn_statistics_count_allocation();
+  return session_allocator->allocate(size, session_allocator->context);
+}
+
+
+void *fizmo_session_try_realloc(void *ptr, size_t size)
+{
+  turn_statistics_count_allocation();
+  return session_allocator->reallocate(ptr, size, session_allocator->context);
+}
+
+
+void *fizmo_session_malloc(size_t size)
+{
+  void *result;
+
+  if ((result = fizmo_session_try_malloc(size)) == NULL)
+    i18n_translate_and_exit(
+        libfizmo_module_name,
+        i18n_libfizmo_FUNCTION_CALL_MALLOC_P0D_RETURNED_NULL_PROBABLY_OUT_OF_MEMORY,
+        -1,
+        size);
+
+  return result;
+}
+
+
+void *fizmo_session_realloc(void *ptr, size_t size)
+{
+  void *result;
+
+  if ((result = fizmo_session_try_realloc(ptr, size)) == NULL)
+    i18n_translate_and_exit(
+        libfizmo_module_name,
+        i18n_libfizmo_FUNCTION_CALL_REALLOC_P0D_RETURNED_NULL_PROBABLY_OUT_OF_MEMORY,
+        -1,
+        size);
+
+  return result;
+}
+
+
+void fizmo_session_free(void *ptr)
+{
+  if (ptr != NULL)
+    session_allocator->release(ptr, session_allocator->context);
+}
+
+
+// All allocations from the arena are aligned to the size of this union.
+union arena_alignment
+{
+  long double ld;
+  long long ll;
+  void *p;
+  void (*f)(void);
+};
+
+#define ARENA_ALIGN(size) \
+  (((size) + sizeof(union arena_alignment) - 1) \
+   / sizeof(union arena_alignment) * sizeof(union arena_alignment))
+
+// Every allocation is preceded by this header, which is required to find
+// the allocation's size and block when reallocating or releasing it.
+struct arena_allocation_header
+{
+  size_t size;
+  struct session_arena_block *block;
+};
+
+#define ARENA_HEADER_SIZE ARENA_ALIGN(sizeof(struct arena_allocation_header))
+
+// Allocations larger than half the arena's block size get a block of their
+// own, which is resized and freed directly.
+struct session_arena_block
+{
+  struct session_arena_block *previous;
+  struct session_arena_block *next;
+  size_t size;
+  size_t used;
+  size_t last_allocation;
+  bool is_dedicated;
+  union arena_alignment data[];
+};
+
+
+static struct session_arena_block *new_arena_block(SESSION_ARENA *arena,
+    size_t size, bool is_dedicated)
+{
+  struct session_arena_block *result;
+
+  if ((result = malloc(sizeof(struct session_arena_block) + size)) == NULL)
+    return NULL;
+
+  result->size = size;
+  result->used = 0;
+  result->last_allocation = 0;
+  result->is_dedicated = is_dedicated;
+  arena->bytes_allocated += size;
+
+  // The current block for small allocations is always kept at the front of
+  // the list, dedicated blocks are inserted behind it.
+  if ( (is_dedicated == true) && (arena->blocks != NULL) )
+  {
+    result->previous = arena->blocks;
+    result->next = arena->blocks->next;
+    arena->blocks->next = result;
+  }
+  else
+  {
+    result->previous = NULL;
+    result->next = arena->blocks;
+    arena->blocks = result;
+  }
+
+  if (result->next != NULL)
+    result->next->previous = result;
+
+  TRACE_LOG("New arena block at %p, %ld bytes.\n", result, (long)size);
+
+  return result;
+}
+
+
+static void free_arena_block(SESSION_ARENA *arena,
+    struct session_arena_block *block)
+{
+  if (block->previous != NULL)
+    block->previous->next = block->next;
+  else
+    arena->blocks = block->next;
+
+  if (block->next != NULL)
+    block->next->previous = block->previous;
+
+  arena->bytes_allocated -= block->size;
+  free(block);
+}
+
+
+static void *arena_allocate(size_t size, void *context)
+{
+  SESSION_ARENA *arena = (SESSION_ARENA*)context;
+  struct session_arena_block *block = arena->blocks;
+  struct arena_allocation_header *header;
+  size_t required_size = ARENA_HEADER_SIZE + ARENA_ALIGN(size);
+
+  if (required_size > arena->block_size / 2)
+  {
+    if ((block = new_arena_block(arena, required_size, true)) == NULL)
+      return NULL;
+  }
+  else if (
+      (block == NULL)
+      ||
+      (block->is_dedicated == true)
+      ||
+      (block->size - block->used < required_size)
+      )
+  {
+    if ((block = new_arena_block(arena, arena->block_size, false)) == NULL)
+      return NULL;
+  }
+
+  header = (struct arena_allocation_header*)((char*)block->data + block->used);
+  header->size = size;
+  header->block = block;
+  block->last_allocation = block->used;
+  block->used += required_size;
+
+  return (char*)header + ARENA_HEADER_SIZE;
+}
+
+
+static void arena_release(void *ptr, void *context)
+{
+  SESSION_ARENA *arena = (SESSION_ARENA*)context;
+  struct arena_allocation_header *header
+    = (struct arena_allocation_header*)((char*)ptr - ARENA_HEADER_SIZE);
+  struct session_arena_block *block = header->block;
+
+  if (block->is_dedicated == true)
+    free_arena_block(arena, block);
+  else if ((char*)header == (char*)block->data + block->last_allocation)
+  {
+    // Only the most recent allocation can be given back directly. Space
+    // of all others will be reclaimed when the arena is destroyed.
+    block->used = block->last_allocation;
+  }
+}
+
+
+static void *arena_reallocate(void *ptr, size_t size, void *context)
+{
+  SESSION_ARENA *arena = (SESSION_ARENA*)context;
+  struct arena_allocation_header *header;
+  struct session_arena_block *block, *new_block;
+  size_t required_size = ARENA_HEADER_SIZE + ARENA_ALIGN(size);
+  void *result;
+
+  if (ptr == NULL)
+    return arena_allocate(size, context);
+
+  header = (struct arena_allocation_header*)((char*)ptr - ARENA_HEADER_SIZE);
+  block = header->block;
+
+  if (block->is_dedicated == true)
+  {
+    if ((new_block = realloc(
+            block, sizeof(struct session_arena_block) + required_size))
+        == NULL)
+      return NULL;
+
+    arena->bytes_allocated += required_size - new_block->size;
+    new_block->size = required_size;
+    new_block->used = required_size;
+
+    if (new_block->previous != NULL)
+      new_block->previous->next = new_block;
+    else
+      arena->blocks = new_block;
+    if (new_block->next != NULL)
+      new_block->next->previous = new_block;
+
+    header = (struct arena_allocation_header*)new_block->data;
+    header->size = size;
+    header->block = new_block;
+    return (char*)header + ARENA_HEADER_SIZE;
+  }
+
+  if (
+      ((char*)header == (char*)block->data + block->last_allocation)
+      &&
+      (block->size - block->last_allocation >= required_size)
+     )
+  {
+    // The most recent allocation can grow and shrink in place.
+    header->size = size;
+    block->used = block->last_allocation + required_size;
+    return ptr;
+  }
+
+  if ((result = arena_allocate(size, context)) == NULL)
+    return NULL;
+
+  memcpy(result, ptr, header->size < size ? header->size : size);
+  arena_release(ptr, context);
+
+  return result;
+}
+
+
+SESSION_ARENA *create_session_arena(size_t block_size)
+{
+  SESSION_ARENA *result;
+
+  if ((result = malloc(sizeof(SESSION_ARENA))) == NULL)
+    return NULL;
+
+  result->blocks = NULL;
+  result->block_size
+    = block_size != 0 ? block_size : SESSION_ARENA_DEFAULT_BLOCK_SIZE;
+  result->bytes_allocated = 0;
+  result->allocator.allocate = &arena_allocate;
+  result->allocator.reallocate = &arena_reallocate;
+  result->allocator.release = &arena_release;
+  result->allocator.context = result;
+
+  return result;
+}
+
+
+struct z_allocator *get_session_arena_allocator(SESSION_ARENA *arena)
+{
+  return &arena->allocator;
+}
+
+
+void destroy_session_arena(SESSION_ARENA *arena)
+{
+  struct session_arena_block *block;
+
+  if (session_allocator == &arena->allocator)
+    session_allocator = &heap_allocator;
+
+  while ((block = arena->blocks) != NULL)
+  {
+    arena->blocks = block->next;
+    free(block);
+  }
+
+  free(arena);
+}
+
+#endif /* allocator_c_INCLUDED */
+
@@ -0,0 +1,94 @@
+
+/* allocator.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef allocator_h_INCLUDED
+#define allocator_h_INCLUDED
+
+#include <stddef.h>
+
+#include "../tools/types.h"
+
+// Memory which lives only as long as a single interpreter session -- story
+// memory, the Z-stack, undo frames, output history and the upper window
+// buffer -- is allocated via the session allocator. By default, this is
+// the process heap. Hosts may register their own allocator, but only while
+// no session is active, since memory has to be released by the allocator
+// which provided it.
+//
+// All functions have to return NULL on failure. "reallocate" is called with
+// a NULL pointer to allocate new memory, "release" is never called with
+// a NULL pointer.
+struct z_allocator
+{
+  void *(*allocate)(size_t size, void *context);
+  void *(*reallocate)(void *ptr, size_t size, void *context);
+  void (*release)(void *ptr, void *context);
+  void *context;
+};
+
+
+// The arena is a session allocator which hands out memory from large
+// blocks. Releasing single allocations only reclaims space if it's the
+// most recent one, everything else is reclaimed at once when the arena
+// is destroyed after the session has ended. This avoids heap fragmentation
+// from many short sessions, but long sessions with many undo steps will
+// keep growing.
+struct session_arena_block;
+
+typedef struct
+{
+  struct session_arena_block *blocks;
+  size_t block_size;
+  size_t bytes_allocated;
+  struct z_allocator allocator;
+} SESSION_ARENA;
+
+
+// Registers "new_allocator" for session memory, NULL restores the default.
+void fizmo_register_session_allocator(struct z_allocator *new_allocator);
+
+// The "try" variants return NULL on failure, the others will abort the
+// interpreter the same way fizmo_malloc() does.
+void *fizmo_session_try_malloc(size_t size);
+void *fizmo_session_try_realloc(void *ptr, size_t size);
+void *fizmo_session_malloc(size_t size);
+void *fizmo_session_realloc(void *ptr, size_t size);
+void fizmo_session_free(void *ptr);
+
+// A block_size of 0 selects SESSION_ARENA_DEFAULT_BLOCK_SIZE. Returns NULL
+// in case the arena could not be allocated.
+SESSION_ARENA *create_session_arena(size_t block_size);
+struct z_allocator *get_session_arena_allocator(SESSION_ARENA *arena);
+void destroy_session_arena(SESSION_ARENA *arena);
+
+#endif /* allocator_h_INCLUDED */
+
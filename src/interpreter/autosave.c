@@ -0,0 +1,407 @@
+
+/* autosave.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef autosave_c_INCLUDED
+#define autosave_c_INCLUDED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "../tools/tracelog.h"
+#include "../tools/types.h"
+#include "../tools/filesys.h"
+#include "../tools/unused.h"
+#include "autosave.h"
+#include "savegame.h"
+#include "fizmo.h"
+
+
+// A savegame which is serialized and written to a temporary file by the
+// background thread and renamed to "filename" once the write has been
+// completed. On the interpreter's thread, only the game state is copied
+// into the snapshot and the temporary file is opened and closed using the
+// filesys interface. The background thread builds the savegame using
+// malloc() -- reporting exhausted memory as failed write instead of
+// exiting -- and accesses the file only through its descriptor, except
+// for the final rename.
+struct autosave_write
+{
+  struct savegame_snapshot *snapshot;
+  uint8_t *data;
+  size_t size;
+  char *filename;
+  char *tmp_filename;
+  char *directory_name;
+  z_file *tmp_file;
+  int fd;
+  int result;
+};
+
+static pthread_t autosave_thread;
+static pthread_mutex_t autosave_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t autosave_state_changed = PTHREAD_COND_INITIALIZER;
+static bool autosave_thread_running = false;
+static bool terminate_autosave_thread = false;
+static bool atexit_handler_registered = false;
+static struct autosave_write *pending_write = NULL;
+static struct autosave_write *write_in_progress = NULL;
+static struct autosave_write *completed_write = NULL;
+
+// The original dynamic memory is read from the story file only once and
+// shared by all snapshots.
+static uint8_t *original_memory = NULL;
+static bool original_memory_loaded = false;
+
+
+// Runs on the background thread. Writes and syncs the data using only the
+// file descriptor, returning -1 on failure and 0 otherwise.
+static int write_autosave_data(struct autosave_write *write_to_do)
+{
+  uint8_t *data = write_to_do->data;
+  size_t bytes_left = write_to_do->size;
+  ssize_t bytes_written;
+
+  while (bytes_left > 0)
+  {
+    if ((bytes_written = write(write_to_do->fd, data, bytes_left)) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+
+    data += bytes_written;
+    bytes_left -= bytes_written;
+  }
+
+  return fsync(write_to_do->fd) == 0 ? 0 : -1;
+}
+
+
+// Runs on the background thread. Makes the rename of the temporary file
+// durable, returning -1 on failure and 0 otherwise.
+static int sync_directory(char *directory_name)
+{
+  int fd;
+  int result;
+
+  if ((fd = open(directory_name, O_RDONLY)) < 0)
+    return -1;
+
+  result = fsync(fd) == 0 ? 0 : -1;
+
+  if (close(fd) != 0)
+    result = -1;
+
+  return result;
+}
+
+
+// Runs on the background thread. Builds the savegame from the snapshot,
+// writes it and replaces the previous autosave. Since the rename replaces
+// the previous autosave atomically, a crash at any point leaves either the
+// old or the new savegame intact, but never a partially written one.
+static int do_autosave_write(struct autosave_write *write_to_do)
+{
+  if ((write_to_do->data = serialize_savegame_snapshot(
+          write_to_do->snapshot, &write_to_do->size)) == NULL)
+    return -1;
+
+  if (write_autosave_data(write_to_do) != 0)
+    return -1;
+
+  if (fsi_rename_file(write_to_do->tmp_filename, write_to_do->filename)
+      != 0)
+    return -1;
+
+  return sync_directory(write_to_do->directory_name);
+}
+
+
+// Releases a write which has either been completed or not been started at
+// all. In case it hasn't succeeded, the temporary file is removed. Returns
+// the write's result.
+static int finish_write(struct autosave_write *write_done)
+{
+  int result = write_done->result;
+
+  if (fsi->closefile(write_done->tmp_file) != 0)
+    result = -1;
+
+  if (result != 0)
+    fsi_remove_file(write_done->tmp_filename);
+
+  TRACE_LOG("Wrote %ld bytes of autosave to \"%s\", result: %d.\n",
+      (long)write_done->size, write_done->filename, result);
+
+  free_savegame_snapshot(write_done->snapshot);
+  if (write_done->data != NULL)
+    free(write_done->data);
+  free(write_done->filename);
+  free(write_done->tmp_filename);
+  free(write_done->directory_name);
+  free(write_done);
+
+  return result;
+}
+
+
+static void *autosave_thread_function(void *UNUSED(parameter))
+{
+  struct autosave_write *write_to_do;
+
+  pthread_mutex_lock(&autosave_mutex);
+
+  for (;;)
+  {
+    // A new write is only started once the previous one has been finished
+    // by the interpreter's thread, so a failed write is always noticed
+    // before the next one replaces the autosave.
+    while (
+        ( (pending_write == NULL) || (completed_write != NULL) )
+        && (terminate_autosave_thread == false) )
+      pthread_cond_wait(&autosave_state_changed, &autosave_mutex);
+
+    if (terminate_autosave_thread == true)
+      break;
+
+    write_to_do = pending_write;
+    pending_write = NULL;
+    write_in_progress = write_to_do;
+    pthread_mutex_unlock(&autosave_mutex);
+
+    write_to_do->result = do_autosave_write(write_to_do);
+
+    pthread_mutex_lock(&autosave_mutex);
+    write_in_progress = NULL;
+    completed_write = write_to_do;
+    pthread_cond_broadcast(&autosave_state_changed);
+  }
+
+  pthread_mutex_unlock(&autosave_mutex);
+  return NULL;
+}
+
+
+// Finishes a write completed by the background thread since the last call.
+// Returns -1 in case it has failed, 0 otherwise.
+static int finish_completed_write(void)
+{
+  struct autosave_write *write_done;
+
+  pthread_mutex_lock(&autosave_mutex);
+  write_done = completed_write;
+  completed_write = NULL;
+  pthread_cond_broadcast(&autosave_state_changed);
+  pthread_mutex_unlock(&autosave_mutex);
+
+  return write_done != NULL ? finish_write(write_done) : 0;
+}
+
+
+// Returns the newly allocated name of the directory containing "filename".
+static char *get_directory_name(char *filename)
+{
+  char *separator = strrchr(filename, '/');
+  char *result;
+
+  if (separator == NULL)
+    return fizmo_strdup(".");
+
+  if (separator == filename)
+    return fizmo_strdup("/");
+
+  result = fizmo_malloc(separator - filename + 1);
+  memcpy(result, filename, separator - filename);
+  result[separator - filename] = 0;
+
+  return result;
+}
+
+
+int queue_background_autosave(char *filename, uint16_t length)
+{
+  struct autosave_write *new_write;
+  struct autosave_write *stale_write;
+
+  if (bool_equal(autosave_thread_running, false))
+  {
+    terminate_autosave_thread = false;
+
+    if (pthread_create(&autosave_thread, NULL, autosave_thread_function, NULL)
+        != 0)
+    {
+      TRACE_LOG("Could not start autosave thread.\n");
+      return -1;
+    }
+
+    autosave_thread_running = true;
+
+    // Interfaces and error handlers may exit() without returning from the
+    // interpreter, which shouldn't lose the last autosave either.
+    if (bool_equal(atexit_handler_registered, false))
+    {
+      atexit(stop_background_autosave);
+      atexit_handler_registered = true;
+    }
+  }
+
+  // In case the last background write has failed, this autosave is written
+  // synchronously, which reports the error.
+  if (finish_completed_write() != 0)
+    return -1;
+
+  if (bool_equal(original_memory_loaded, false))
+  {
+    original_memory = read_original_dynamic_memory(length);
+    original_memory_loaded = true;
+  }
+
+  new_write = fizmo_malloc(sizeof(struct autosave_write));
+
+  if ((new_write->tmp_file = fsi_open_temp_file(
+          filename, FILETYPE_SAVEGAME, &new_write->tmp_filename)) == NULL)
+  {
+    free(new_write);
+    return -1;
+  }
+
+  if ((new_write->fd = fsi->get_fileno(new_write->tmp_file)) < 0)
+  {
+    // Without a file descriptor the write can't be done in the
+    // background.
+    fsi->closefile(new_write->tmp_file);
+    fsi_remove_file(new_write->tmp_filename);
+    free(new_write->tmp_filename);
+    free(new_write);
+    return -1;
+  }
+
+  new_write->snapshot = create_savegame_snapshot(length, original_memory);
+  new_write->data = NULL;
+  new_write->size = 0;
+  new_write->filename = fizmo_strdup(filename);
+  new_write->directory_name = get_directory_name(filename);
+  new_write->result = -1;
+
+  pthread_mutex_lock(&autosave_mutex);
+  stale_write = pending_write;
+  pending_write = new_write;
+  pthread_cond_broadcast(&autosave_state_changed);
+  pthread_mutex_unlock(&autosave_mutex);
+
+  if (stale_write != NULL)
+  {
+    // The writer hasn't picked up the previous autosave yet, which is
+    // stale now and skipped.
+    TRACE_LOG("Replacing pending autosave.\n");
+    (void)finish_write(stale_write);
+  }
+
+  return 0;
+}
+
+
+int wait_for_background_autosave(void)
+{
+  struct autosave_write *write_done;
+  int result = 0;
+
+  if (bool_equal(autosave_thread_running, false))
+    return 0;
+
+  pthread_mutex_lock(&autosave_mutex);
+
+  for (;;)
+  {
+    if (completed_write != NULL)
+    {
+      write_done = completed_write;
+      completed_write = NULL;
+      pthread_cond_broadcast(&autosave_state_changed);
+      pthread_mutex_unlock(&autosave_mutex);
+
+      if (finish_write(write_done) != 0)
+        result = -1;
+
+      pthread_mutex_lock(&autosave_mutex);
+      continue;
+    }
+
+    if ( (pending_write == NULL) && (write_in_progress == NULL) )
+      break;
+
+    pthread_cond_wait(&autosave_state_changed, &autosave_mutex);
+  }
+
+  pthread_mutex_unlock(&autosave_mutex);
+
+  return result;
+}
+
+
+void stop_background_autosave(void)
+{
+  if (bool_equal(autosave_thread_running, true))
+  {
+    // Waiting for the thread from itself would never return. This can't
+    // happen as long as the thread doesn't exit(), but since this is
+    // also an atexit handler, it's better to be safe here.
+    if (pthread_equal(pthread_self(), autosave_thread) != 0)
+      return;
+
+    (void)wait_for_background_autosave();
+
+    pthread_mutex_lock(&autosave_mutex);
+    terminate_autosave_thread = true;
+    pthread_cond_broadcast(&autosave_state_changed);
+    pthread_mutex_unlock(&autosave_mutex);
+
+    pthread_join(autosave_thread, NULL);
+    autosave_thread_running = false;
+  }
+
+  if (original_memory != NULL)
+  {
+    free(original_memory);
+    original_memory = NULL;
+  }
+  original_memory_loaded = false;
+}
+
+#endif /* autosave_c_INCLUDED */
+
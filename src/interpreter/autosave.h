@@ -0,0 +1,53 @@
+
+/* autosave.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef autosave_h_INCLUDED
+#define autosave_h_INCLUDED
+
+#include "../tools/types.h"
+
+// Copies the current game state and hands it to a background thread which
+// builds the savegame and writes it to "filename". A savegame still waiting
+// to be written is replaced, so only the most recent state is saved. Returns 0
+// on success and -1 in case the caller should save synchronously instead,
+// which is also the case when the previous background write has failed.
+int queue_background_autosave(char *filename, uint16_t length);
+
+// Waits until all queued savegames have been written. Returns -1 in case
+// any of them could not be written, 0 otherwise.
+int wait_for_background_autosave(void);
+
+// Writes any pending snapshot and terminates the background thread.
+void stop_background_autosave(void);
+
+#endif /* autosave_h_INCLUDED */
+
@@ -0,0 +1,418 @@
+
+/* bgwriter.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef bgwriter_c_INCLUDED
+#define bgwriter_c_INCLUDED
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+
+#include "../tools/tracelog.h"
+#include "../tools/types.h"
+#include "../tools/filesys.h"
+#include "bgwriter.h"
+#include "fizmo.h"
+
+
+// Has to be called with the writer's mutex locked. Hands the chunk in
+// progress to the writer thread, waiting for space in the queue if
+// necessary. After a write has failed, the chunk is appended to the
+// unwritten chunks instead, or dropped once BG_WRITER_MAXIMUM_UNWRITTEN_CHUNKS
+// are kept. The writer thread only calls this as long as no error has
+// occurred, so the list is only ever grown by the producer.
+static void enqueue_current_chunk(BG_WRITER *writer)
+{
+  int queue_index;
+
+  if (writer->current_chunk_length == 0)
+    return;
+
+  while ( (writer->queue_length == BG_WRITER_QUEUE_SIZE)
+      && (writer->error_occurred == false) )
+    pthread_cond_wait(&writer->queue_changed, &writer->mutex);
+
+  if (
+      (writer->error_occurred == true)
+      &&
+      (writer->nof_unwritten_chunks == BG_WRITER_MAXIMUM_UNWRITTEN_CHUNKS)
+     )
+  {
+    if (writer->nof_dropped_bytes == 0)
+    {
+      TRACE_LOG("Background writer for %p dropping data.\n", writer->file);
+    }
+    writer->nof_dropped_bytes += writer->current_chunk_length;
+    free(writer->current_chunk);
+    writer->current_chunk = NULL;
+    writer->current_chunk_length = 0;
+    return;
+  }
+
+  if (writer->error_occurred == true)
+  {
+    writer->unwritten_chunks = fizmo_realloc(
+        writer->unwritten_chunks,
+        sizeof(struct bg_writer_chunk) * (writer->nof_unwritten_chunks + 1));
+    writer->unwritten_chunks[writer->nof_unwritten_chunks].data
+      = writer->current_chunk;
+    writer->unwritten_chunks[writer->nof_unwritten_chunks].length
+      = writer->current_chunk_length;
+    writer->nof_unwritten_chunks++;
+
+    writer->current_chunk = NULL;
+    writer->current_chunk_length = 0;
+    return;
+  }
+
+  queue_index
+    = (writer->queue_front_index + writer->queue_length)
+    % BG_WRITER_QUEUE_SIZE;
+
+  writer->queue[queue_index].data = writer->current_chunk;
+  writer->queue[queue_index].length = writer->current_chunk_length;
+  writer->queue_length++;
+
+  writer->current_chunk = NULL;
+  writer->current_chunk_length = 0;
+
+  pthread_cond_broadcast(&writer->queue_changed);
+}
+
+
+static void *bg_writer_thread(void *parameter)
+{
+  BG_WRITER *writer = (BG_WRITER*)parameter;
+  struct bg_writer_chunk chunk;
+  struct timeval now;
+  struct timespec timeout;
+  bool write_failed;
+
+  pthread_mutex_lock(&writer->mutex);
+
+  for (;;)
+  {
+    if (writer->error_occurred == true)
+    {
+      // Everything left is written by bg_writer_destroy.
+      if (writer->terminate == true)
+        break;
+
+      pthread_cond_wait(&writer->queue_changed, &writer->mutex);
+      continue;
+    }
+
+    if (writer->queue_length == 0)
+    {
+      if (writer->terminate == true)
+        break;
+
+      gettimeofday(&now, NULL);
+      timeout.tv_sec = now.tv_sec + BG_WRITER_FLUSH_INTERVAL / 1000;
+      timeout.tv_nsec
+        = (now.tv_usec + (BG_WRITER_FLUSH_INTERVAL % 1000) * 1000) * 1000;
+      if (timeout.tv_nsec >= 1000000000)
+      {
+        timeout.tv_sec++;
+        timeout.tv_nsec -= 1000000000;
+      }
+
+      if (
+          (pthread_cond_timedwait(
+            &writer->queue_changed, &writer->mutex, &timeout) == ETIMEDOUT)
+          &&
+          (writer->queue_length == 0)
+         )
+      {
+        // Nothing was handed over for a while, so we'll take care of the
+        // partially filled chunk ourselves.
+        enqueue_current_chunk(writer);
+      }
+
+      continue;
+    }
+
+    chunk = writer->queue[writer->queue_front_index];
+    writer->queue_front_index
+      = (writer->queue_front_index + 1) % BG_WRITER_QUEUE_SIZE;
+    writer->queue_length--;
+    writer->chunk_in_progress = true;
+    pthread_cond_broadcast(&writer->queue_changed);
+
+    // The file is only ever accessed from this thread while the writer
+    // exists, so it's safe to write without holding the lock.
+    pthread_mutex_unlock(&writer->mutex);
+    write_failed
+      = (fsi->writechars(chunk.data, chunk.length, writer->file)
+          != chunk.length);
+    pthread_mutex_lock(&writer->mutex);
+
+    writer->chunk_in_progress = false;
+
+    if (write_failed == true)
+    {
+      TRACE_LOG("Background write to %p failed.\n", writer->file);
+      writer->failed_chunk = chunk;
+      writer->error_occurred = true;
+    }
+    else
+      free(chunk.data);
+
+    pthread_cond_broadcast(&writer->queue_changed);
+  }
+
+  pthread_mutex_unlock(&writer->mutex);
+
+  return NULL;
+}
+
+
+// Invokes the error function on the caller's thread the first time a
+// failed write is noticed. Must not be called with the mutex locked, since
+// the error function may well decide to destroy the writer.
+static void report_error(BG_WRITER *writer)
+{
+  if (writer->error_reported == true)
+    return;
+
+  writer->error_reported = true;
+  if (writer->error_function != NULL)
+    writer->error_function(writer->file);
+}
+
+
+// Writes all data kept after a failed write, in the order it was handed
+// over. Returns -1 in case the data still cannot be written or some of it
+// had to be dropped, 0 otherwise.
+static int write_unwritten_chunks(BG_WRITER *writer)
+{
+  int result = writer->nof_dropped_bytes > 0 ? -1 : 0;
+  int i;
+
+  if ( (writer->failed_chunk.data != NULL)
+      && (fsi->writechars(writer->failed_chunk.data,
+          writer->failed_chunk.length, writer->file)
+        != writer->failed_chunk.length) )
+    result = -1;
+  free(writer->failed_chunk.data);
+  writer->failed_chunk.data = NULL;
+
+  while (writer->queue_length > 0)
+  {
+    if ( (result == 0)
+        && (fsi->writechars(
+            writer->queue[writer->queue_front_index].data,
+            writer->queue[writer->queue_front_index].length,
+            writer->file)
+          != writer->queue[writer->queue_front_index].length) )
+      result = -1;
+    free(writer->queue[writer->queue_front_index].data);
+    writer->queue_front_index
+      = (writer->queue_front_index + 1) % BG_WRITER_QUEUE_SIZE;
+    writer->queue_length--;
+  }
+
+  for (i=0; i<writer->nof_unwritten_chunks; i++)
+  {
+    if ( (result == 0)
+        && (fsi->writechars(
+            writer->unwritten_chunks[i].data,
+            writer->unwritten_chunks[i].length,
+            writer->file)
+          != writer->unwritten_chunks[i].length) )
+      result = -1;
+    free(writer->unwritten_chunks[i].data);
+  }
+
+  free(writer->unwritten_chunks);
+  writer->unwritten_chunks = NULL;
+  writer->nof_unwritten_chunks = 0;
+
+  return result;
+}
+
+
+// Creates a new background writer for the given file. Until the writer is
+// destroyed, the file must not be accessed by anything else. In case a
+// write fails, error_function -- if not NULL -- is invoked once from the
+// thread calling the next bg_writer_write, bg_writer_flush or
+// bg_writer_destroy. Up to BG_WRITER_MAXIMUM_UNWRITTEN_CHUNKS of the data
+// not written yet are kept and written again by bg_writer_destroy; anything
+// beyond that is dropped and makes bg_writer_destroy return -1.
+BG_WRITER *bg_writer_new(z_file *file, void (*error_function)(z_file *file))
+{
+  BG_WRITER *result = fizmo_malloc(sizeof(BG_WRITER));
+
+  result->file = file;
+  result->error_function = error_function;
+  result->queue_front_index = 0;
+  result->queue_length = 0;
+  result->chunk_in_progress = false;
+  result->current_chunk = NULL;
+  result->current_chunk_length = 0;
+  result->failed_chunk.data = NULL;
+  result->failed_chunk.length = 0;
+  result->unwritten_chunks = NULL;
+  result->nof_unwritten_chunks = 0;
+  result->nof_dropped_bytes = 0;
+  result->terminate = false;
+  result->error_occurred = false;
+  result->error_reported = false;
+
+  pthread_mutex_init(&result->mutex, NULL);
+  pthread_cond_init(&result->queue_changed, NULL);
+
+  if (pthread_create(&result->thread, NULL, bg_writer_thread, result) != 0)
+  {
+    TRACE_LOG("Could not create background writer thread.\n");
+    pthread_cond_destroy(&result->queue_changed);
+    pthread_mutex_destroy(&result->mutex);
+    free(result);
+    return NULL;
+  }
+
+  TRACE_LOG("Created background writer for %p.\n", file);
+
+  return result;
+}
+
+
+// Returns -1 in case a previous write has failed, 0 otherwise. The data is
+// accepted in both cases, but may be dropped after a failure as described
+// for bg_writer_new.
+int bg_writer_write(BG_WRITER *writer, char *data, size_t length)
+{
+  size_t bytes_to_copy;
+  int result;
+
+  pthread_mutex_lock(&writer->mutex);
+
+  while (length > 0)
+  {
+    if (writer->current_chunk == NULL)
+      writer->current_chunk = fizmo_malloc(BG_WRITER_CHUNK_SIZE);
+
+    bytes_to_copy = BG_WRITER_CHUNK_SIZE - writer->current_chunk_length;
+    if (bytes_to_copy > length)
+      bytes_to_copy = length;
+
+    memcpy(writer->current_chunk + writer->current_chunk_length,
+        data, bytes_to_copy);
+    writer->current_chunk_length += bytes_to_copy;
+    data += bytes_to_copy;
+    length -= bytes_to_copy;
+
+    if (writer->current_chunk_length == BG_WRITER_CHUNK_SIZE)
+      enqueue_current_chunk(writer);
+  }
+
+  result = writer->error_occurred == true ? -1 : 0;
+  pthread_mutex_unlock(&writer->mutex);
+
+  if (result != 0)
+    report_error(writer);
+
+  return result;
+}
+
+
+// Waits until all data written so far has been passed to the file. Returns
+// -1 in case any write has failed, 0 otherwise.
+int bg_writer_flush(BG_WRITER *writer)
+{
+  int result;
+
+  pthread_mutex_lock(&writer->mutex);
+
+  enqueue_current_chunk(writer);
+
+  while (
+      ( (writer->queue_length != 0) && (writer->error_occurred == false) )
+      || (writer->chunk_in_progress == true) )
+    pthread_cond_wait(&writer->queue_changed, &writer->mutex);
+
+  result = writer->error_occurred == true ? -1 : 0;
+  pthread_mutex_unlock(&writer->mutex);
+
+  if (result != 0)
+    report_error(writer);
+
+  return result;
+}
+
+
+bool bg_writer_error_occurred(BG_WRITER *writer)
+{
+  bool result;
+
+  pthread_mutex_lock(&writer->mutex);
+  result = writer->error_occurred;
+  pthread_mutex_unlock(&writer->mutex);
+
+  return result;
+}
+
+
+// Writes all pending data and stops the writer thread. In case a write
+// has failed before, the data kept since is written again from the calling
+// thread. The file is not closed. Returns -1 in case not all data could be
+// written or some was dropped, 0 otherwise.
+int bg_writer_destroy(BG_WRITER *writer)
+{
+  int result = 0;
+
+  pthread_mutex_lock(&writer->mutex);
+  enqueue_current_chunk(writer);
+  writer->terminate = true;
+  pthread_cond_broadcast(&writer->queue_changed);
+  pthread_mutex_unlock(&writer->mutex);
+
+  pthread_join(writer->thread, NULL);
+
+  if (writer->error_occurred == true)
+  {
+    report_error(writer);
+    result = write_unwritten_chunks(writer);
+  }
+
+  pthread_cond_destroy(&writer->queue_changed);
+  pthread_mutex_destroy(&writer->mutex);
+  free(writer);
+
+  TRACE_LOG("Destroyed background writer.\n");
+
+  return result;
+}
+
+#endif /* bgwriter_c_INCLUDED */
+
@@ -0,0 +1,98 @@
+
+/* bgwriter.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef bgwriter_h_INCLUDED
+#define bgwriter_h_INCLUDED
+
+#include <pthread.h>
+
+#include "../tools/types.h"
+
+// Output is collected in chunks of BG_WRITER_CHUNK_SIZE bytes. Full chunks
+// are handed over to the writer thread, which will keep at most
+// BG_WRITER_QUEUE_SIZE chunks before the producer has to wait. Partially
+// filled chunks are written after BG_WRITER_FLUSH_INTERVAL milliseconds.
+// Once a write has failed, the thread stops writing and the data not yet
+// written is kept until the writer is destroyed. At most
+// BG_WRITER_MAXIMUM_UNWRITTEN_CHUNKS are kept this way, any further data
+// is dropped.
+#define BG_WRITER_CHUNK_SIZE 8192
+#define BG_WRITER_QUEUE_SIZE 16
+#define BG_WRITER_MAXIMUM_UNWRITTEN_CHUNKS 64
+#define BG_WRITER_FLUSH_INTERVAL 500
+
+
+struct bg_writer_chunk
+{
+  char *data;
+  size_t length;
+};
+
+
+typedef struct
+{
+  z_file *file;
+  void (*error_function)(z_file *file);
+
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t queue_changed;
+
+  struct bg_writer_chunk queue[BG_WRITER_QUEUE_SIZE];
+  int queue_front_index;
+  int queue_length;
+  bool chunk_in_progress;
+
+  char *current_chunk;
+  size_t current_chunk_length;
+
+  // The chunk which could not be written and all chunks which were handed
+  // over after the failure.
+  struct bg_writer_chunk failed_chunk;
+  struct bg_writer_chunk *unwritten_chunks;
+  int nof_unwritten_chunks;
+  size_t nof_dropped_bytes;
+
+  bool terminate;
+  bool error_occurred;
+  bool error_reported;
+} BG_WRITER;
+
+
+BG_WRITER *bg_writer_new(z_file *file, void (*error_function)(z_file *file));
+int bg_writer_write(BG_WRITER *writer, char *data, size_t length);
+int bg_writer_flush(BG_WRITER *writer);
+int bg_writer_destroy(BG_WRITER *writer);
+bool bg_writer_error_occurred(BG_WRITER *writer);
+
+#endif /* bgwriter_h_INCLUDED */
+
@@ -38,6 +38,8 @@
 
 #include "blockbuf.h"
 #include "fizmo.h"
+#include "allocator.h"
+#include "memstat.h"
 #include "../tools/types.h"
 #include "../tools/tracelog.h"
 #include "../tools/i18n.h"
@@ -52,7 +54,7 @@ BLOCKBUF *create_blockbuffer(z_style default_style, z_font default_font,
   TRACE_LOG("New blockbuffer, foreground:%d, background: %d.\n",
       default_foreground_colour, default_background_colour);
 
-  result = (BLOCKBUF*)fizmo_malloc(sizeof(BLOCKBUF));
+  result = (BLOCKBUF*)fizmo_session_malloc(sizeof(BLOCKBUF));
 
   result->width = 0;
   result->height = 0;
@@ -75,8 +77,8 @@ BLOCKBUF *create_blockbuffer(z_style default_style, z_font default_font,
 void destroy_blockbuffer(BLOCKBUF *blockbuffer)
 {
   if (blockbuffer->content != NULL)
-    free(blockbuffer->content);
-  free(blockbuffer);
+    fizmo_session_free(blockbuffer->content);
+  fizmo_session_free(blockbuffer);
 }
 
 
@@ -171,6 +173,30 @@ void set_blockbuf_font(BLOCKBUF *buffer, z_font font)
 }
 
 
+// Fills the whole buffer with spaces in the default colours, as it's done
+// for erase_window.
+void blockbuf_clear(BLOCKBUF *buffer)
+{
+  struct blockbuf_char *ptr = buffer->content;
+  int i;
+
+  TRACE_LOG("Clearing blockbuffer.\n");
+
+  for (i=0; i<buffer->width * buffer->height; i++)
+  {
+    ptr->character = Z_UCS_SPACE;
+    ptr->foreground_colour = buffer->default_foreground_colour;
+    ptr->background_colour = buffer->default_background_colour;
+    ptr->style = buffer->default_style;
+    ptr->font = buffer->default_font;
+    ptr++;
+  }
+
+  buffer->xpos = 0;
+  buffer->ypos = 0;
+}
+
+
 // The buffer will only enlarge itself, but never shrink. This is due to
 // the fact that many older games are not designed for resizes, and will
 // keep printing into the old sized lines. If we only enlarge the buffer
@@ -203,7 +229,7 @@ void blockbuf_resize(BLOCKBUF *buffer, int new_width, int new_height)
   TRACE_LOG("Resizing blockbuffer to %d*%d (%zd bytes).\n",
       new_width, new_height, new_buffer_size);
 
-  buffer->content = (struct blockbuf_char*)fizmo_realloc(
+  buffer->content = (struct blockbuf_char*)fizmo_session_realloc(
       buffer->content, new_buffer_size);
 
   // Realign existing lines.
@@ -268,6 +294,8 @@ void blockbuf_resize(BLOCKBUF *buffer, int new_width, int new_height)
 
   TRACE_LOG("New blockbuffer dimensions: %d * %d.\n",
       buffer->width,  buffer->height);
+
+  update_subsystem_memory_stats(MEMORY_STATS_BLOCKBUFFER);
 }
 
 
@@ -76,6 +76,7 @@ void set_blockbuf_style(BLOCKBUF *buffer, z_style style);
 void set_blockbuf_foreground_colour(BLOCKBUF *buffer, z_colour new_colour);
 void set_blockbuf_background_colour(BLOCKBUF *buffer, z_colour new_colour);
 void set_blockbuf_font(BLOCKBUF *buffer, z_font font);
+void blockbuf_clear(BLOCKBUF *buffer);
 void blockbuf_resize(BLOCKBUF *buffer, int new_width, int new_height);
 size_t count_allocated_blockbuf_memory(BLOCKBUF *buffer);
 
@@ -74,14 +74,18 @@ struct configuration_option configuration_options[] = {
   { "input-command-filename", NULL },
   { "locale", NULL },
   { "max-undo-steps", NULL },
+  { "memory-stats-filename", NULL },
   { "random-mode", NULL },
+  { "random-seed", NULL },
   { "record-command-filename", NULL },
   { "save-text-history-paragraphs", NULL },
   { "savegame-default-filename", NULL },
+  { "savegame-page-store", NULL },
   { "savegame-path", NULL },
   { "stream-2-left-margin", NULL },
   { "stream-2-line-width", NULL },
   { "transcript-filename", NULL },
+  { "warm-image-filename", NULL },
   { "z-code-path", NULL },
   { "z-code-root-path", NULL },
 
@@ -103,6 +107,12 @@ struct configuration_option configuration_options[] = {
   { "start-script-when-story-starts", NULL },
   { "sync-transcript", NULL },
   { "flush-output-on-newline", NULL },
+  { "async-stream-writes", NULL },
+  { "fast-replay", NULL },
+  { "replay-suppress-output", NULL },
+  { "compress-text-history", NULL },
+  { "background-autosave", NULL },
+  { "virtual-clock", NULL },
 
   // NULL terminates the option list.
   { NULL, NULL }
@@ -313,6 +323,25 @@ int set_configuration_value(char *key, char* new_unexpanded_value)
         else
           return -1;
       }
+      else if (strcmp(key, "random-seed") == 0)
+      {
+        if ( (new_value == NULL) || (strlen(new_value) == 0) )
+        {
+          free(new_value);
+          return -1;
+        }
+        strtol(new_value, &endptr, 10);
+        if (*endptr != 0)
+        {
+          free(new_value);
+          return -1;
+        }
+        if (configuration_options[i].value != NULL)
+          free(configuration_options[i].value);
+        configuration_options[i].value = new_value;
+        seed_random_generator();
+        return 0;
+      }
       else if (strcmp(key, "i18n-search-path") == 0)
       {
         // Forward to i18n, since this is in tools and cannot access the
@@ -332,6 +361,10 @@ int set_configuration_value(char *key, char* new_unexpanded_value)
           ||
           (strcmp(key, "savegame-path") == 0)
           ||
+          (strcmp(key, "savegame-page-store") == 0)
+          ||
+          (strcmp(key, "memory-stats-filename") == 0)
+          ||
           (strcmp(key, "savegame-default-filename") == 0)
           ||
           (strcmp(key, "transcript-filename") == 0)
@@ -339,6 +372,8 @@ int set_configuration_value(char *key, char* new_unexpanded_value)
           (strcmp(key, "input-command-filename") == 0)
           ||
           (strcmp(key, "record-command-filename") == 0)
+          ||
+          (strcmp(key, "warm-image-filename") == 0)
           )
       {
         if (configuration_options[i].value != NULL)
@@ -448,6 +483,18 @@ int set_configuration_value(char *key, char* new_unexpanded_value)
           (strcmp(key, "dont-set-locale-from-config") == 0)
           ||
           (strcmp(key, "flush-output-on-newline") == 0)
+          ||
+          (strcmp(key, "async-stream-writes") == 0)
+          ||
+          (strcmp(key, "fast-replay") == 0)
+          ||
+          (strcmp(key, "replay-suppress-output") == 0)
+          ||
+          (strcmp(key, "compress-text-history") == 0)
+          ||
+          (strcmp(key, "background-autosave") == 0)
+          ||
+          (strcmp(key, "virtual-clock") == 0)
           )
       {
         if (
@@ -604,6 +651,18 @@ char *get_configuration_value(char *key)
             (strcmp(key, "dont-set-locale-from-config") == 0)
             ||
             (strcmp(key, "flush-output-on-newline") == 0)
+            ||
+            (strcmp(key, "async-stream-writes") == 0)
+            ||
+            (strcmp(key, "fast-replay") == 0)
+            ||
+            (strcmp(key, "replay-suppress-output") == 0)
+            ||
+            (strcmp(key, "compress-text-history") == 0)
+            ||
+            (strcmp(key, "background-autosave") == 0)
+            ||
+            (strcmp(key, "virtual-clock") == 0)
            )
         {
           if (configuration_options[i].value == NULL)
@@ -622,6 +681,8 @@ char *get_configuration_value(char *key)
         else if (
             (strcmp(key, "random-mode") == 0)
             ||
+            (strcmp(key, "random-seed") == 0)
+            ||
             (strcmp(key, "z-code-path") == 0)
             ||
             (strcmp(key, "z-code-root-path") == 0)
@@ -630,6 +691,10 @@ char *get_configuration_value(char *key)
             ||
             (strcmp(key, "savegame-path") == 0)
             ||
+            (strcmp(key, "savegame-page-store") == 0)
+            ||
+            (strcmp(key, "memory-stats-filename") == 0)
+            ||
             (strcmp(key, "savegame-default-filename") == 0)
             ||
             (strcmp(key, "transcript-filename") == 0)
@@ -638,6 +703,8 @@ char *get_configuration_value(char *key)
             ||
             (strcmp(key, "record-command-filename") == 0)
             ||
+            (strcmp(key, "warm-image-filename") == 0)
+            ||
             (strcmp(key, "background-color") == 0)
             ||
             (strcmp(key, "foreground-color") == 0)
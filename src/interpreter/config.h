@@ -83,6 +83,21 @@
 
 #define STREAM_2_PRELOAD_BUFFER_SIZE 1024
 
+// Tokenised input is cached for repeated commands. Inputs longer than
+// TOKENISE_CACHE_MAXIMUM_INPUT_LENGTH or resulting in more than
+// TOKENISE_CACHE_MAXIMUM_WORDS parsed words are not cached.
+#define TOKENISE_CACHE_SIZE 32
+#define TOKENISE_CACHE_MAXIMUM_INPUT_LENGTH 64
+#define TOKENISE_CACHE_MAXIMUM_WORDS 32
+
+// Size of the blocks session arenas allocate from the heap, see
+// allocator.h.
+#define SESSION_ARENA_DEFAULT_BLOCK_SIZE 262144
+
+// Dynamic memory is split into pages of this size when saving to a
+// content-addressed page store (see "savegame-page-store").
+#define PAGE_STORE_PAGE_SIZE 1024
+
 //#define THROW_SIGFAULT_ON_ERROR 1
 
 struct configuration_option
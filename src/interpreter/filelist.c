@@ -82,10 +82,17 @@ static long storyfile_timestamp_input;
 static int length_input;
 static uint16_t checksum_input;
 static int version_input;
-static z_file *in;
-static bool in_zfile_open = false;
+// The story list is parsed from memory obtained via fsi_map_file.
+static char *in_data = NULL;
+static size_t in_length;
+static char *in_ptr;
+static char *in_end;
 static int nof_files_searched;
 static bool show_progress = false;
+// Babel data, loaded on first use by "detect_and_add_single_z_file" or
+// "preload_babel_info".
+static struct babel_info *cached_babel = NULL;
+static bool cached_babel_loaded = false;
 
 
 // 1,268,210 files in 243,656 directories.
@@ -221,10 +228,10 @@ void abort_entry_input()
 
   free_unquote_buffers();
 
-  if (in_zfile_open == true)
+  if (in_data != NULL)
   {
-    fsi->closefile(in);
-    in_zfile_open = false;
+    fsi_unmap_file(in_data, in_length);
+    in_data = NULL;
   }
 }
 
@@ -267,18 +274,45 @@ void free_z_story_list(struct z_story_list *story_list)
 }
 
 
+static int next_list_char()
+{
+  return in_ptr < in_end ? (uint8_t)*(in_ptr++) : EOF;
+}
+
+
+// Copies the tab-terminated field at the current position into *buf and
+// advances the position beyond the tab. Returns -1 in case no tab was found.
+static int read_list_field(char **buf, int *buf_size)
+{
+  char *tab_index;
+  size_t size;
+
+  if ((tab_index = memchr(in_ptr, '\t', in_end - in_ptr)) == NULL)
+    return -1;
+
+  size = tab_index - in_ptr;
+  if (ensure_mem_size(buf, buf_size, size + 2) == -1)
+    return -1;
+
+  memcpy(*buf, in_ptr, size);
+  (*buf)[size] = '\0';
+  in_ptr = tab_index + 1;
+
+  return 0;
+}
+
+
 int parse_next_story_entry()
 {
   int index;
   int data;
-  long offset;
-  long size;
+  char *newline_index;
 
   index = 0;
   release_input = 0;
   while (index < 5)
   {
-    if ((data = fsi->readchar(in)) == EOF)
+    if ((data = next_list_char()) == EOF)
     {
       if (index == 0) break;
       else { abort_entry_input(); TRACE_LOG("#0\n"); return -1; }
@@ -290,30 +324,18 @@ int parse_next_story_entry()
     index++;
   }
 
-  if ( (index == 5) && (fsi->readchar(in) != '\t') )
+  if ( (index == 5) && (next_list_char() != '\t') )
   { abort_entry_input(); TRACE_LOG("#1\n"); return -1; }
 
-  offset = fsi->getfilepos(in);
-  while ((data = fsi->readchar(in)) != '\t')
-    if (data == EOF)
-    { abort_entry_input(); TRACE_LOG("#2\n"); return -1; }
-  size = fsi->getfilepos(in) - offset - 1;
-  if (ensure_mem_size(&serial_input, &serial_input_size, size + 2) == -1)
-  { abort_entry_input(); TRACE_LOG("#3\n"); return -1; }
-  if (size > 0)
-  {
-    fsi->setfilepos(in, -(size+1), SEEK_CUR);
-    if (fsi->readchars(serial_input, size+1, in) != (size_t)size+1)
-    { abort_entry_input(); TRACE_LOG("#4\n"); return -1; }
-  }
-  serial_input[size] = '\0';
+  if (read_list_field(&serial_input, &serial_input_size) == -1)
+  { abort_entry_input(); TRACE_LOG("#2\n"); return -1; }
   unquoted_serial_input = unquote_special_chars(serial_input);
 
   index = 0;
   length_input = 0;
   do
   {
-    if ((data = fsi->readchar(in)) == EOF)
+    if ((data = next_list_char()) == EOF)
     { abort_entry_input(); TRACE_LOG("#5\n"); return -1; }
     if (data != '\t')
     {
@@ -328,7 +350,7 @@ int parse_next_story_entry()
   checksum_input = 0;
   while (index < 5)
   {
-    if ((data = fsi->readchar(in)) == EOF)
+    if ((data = next_list_char()) == EOF)
     { abort_entry_input(); TRACE_LOG("#6\n"); return -1; }
     if (data == '\t') break;
     if (isdigit(data) == 0) { TRACE_LOG("#7\n"); return -1; }
@@ -338,10 +360,10 @@ int parse_next_story_entry()
   }
   TRACE_LOG("cs:%d\n", checksum_input);
 
-  if ( (index == 5) && (fsi->readchar(in) != '\t') )
+  if ( (index == 5) && (next_list_char() != '\t') )
   { abort_entry_input(); TRACE_LOG("#8\n"); return -1; }
 
-  if ((data = fsi->readchar(in)) == EOF)
+  if ((data = next_list_char()) == EOF)
   { abort_entry_input(); TRACE_LOG("#9\n"); return -1; }
   TRACE_LOG("data:%c\n", data);
   if (isdigit(data) == 0)
@@ -349,131 +371,49 @@ int parse_next_story_entry()
   version_input = data - '0';
   TRACE_LOG("versioninput:%c\n", version_input);
 
-  if (fsi->readchar(in) != '\t')
+  if (next_list_char() != '\t')
   { abort_entry_input(); TRACE_LOG("#11\n"); return -1; }
 
-  offset = fsi->getfilepos(in);
-  while ((data = fsi->readchar(in)) != '\t')
-    if (data == EOF)
-    { abort_entry_input(); TRACE_LOG("#12\n"); return -1; }
-  size = fsi->getfilepos(in) - offset - 1;
-  if (ensure_mem_size(&title_input, &title_input_size, size + 2) == -1)
-  { abort_entry_input(); TRACE_LOG("#13\n"); return -1; }
-  if (size > 0)
-  {
-    fsi->setfilepos(in, -(size+1), SEEK_CUR);
-    if (fsi->readchars(title_input, size+1, in) != (size_t)size+1)
-    { abort_entry_input(); TRACE_LOG("#14\n"); return -1; }
-  }
-  title_input[size] = '\0';
+  if (read_list_field(&title_input, &title_input_size) == -1)
+  { abort_entry_input(); TRACE_LOG("#12\n"); return -1; }
   unquoted_title_input = unquote_special_chars(title_input);
   //printf("title:[%s]\n", title_input);
 
-  offset = fsi->getfilepos(in);
-  while ((data = fsi->readchar(in)) != '\t')
-    if (data == EOF) { abort_entry_input(); TRACE_LOG("#15\n"); return -1; }
-  size = fsi->getfilepos(in) - offset - 1;
-  if (ensure_mem_size(&author_input, &author_input_size, size + 2) == -1)
-  { abort_entry_input(); TRACE_LOG("#16\n"); return -1; }
-  if (size > 0)
-  {
-    fsi->setfilepos(in, -(size+1), SEEK_CUR);
-    if (fsi->readchars(author_input, size+1, in) != (size_t)size+1)
-    { abort_entry_input(); TRACE_LOG("#17\n"); return -1; }
-  }
-  author_input[size] = '\0';
+  if (read_list_field(&author_input, &author_input_size) == -1)
+  { abort_entry_input(); TRACE_LOG("#15\n"); return -1; }
   unquoted_author_input = unquote_special_chars(author_input);
   //printf("author:[%s]\n", author_input);
 
-  offset = fsi->getfilepos(in);
-  while ((data = fsi->readchar(in)) != '\t')
-    if (data == EOF) { abort_entry_input(); TRACE_LOG("#15\n"); return -1; }
-  size = fsi->getfilepos(in) - offset - 1;
-  if (ensure_mem_size(&language_input, &language_input_size, size + 2) == -1)
-  { abort_entry_input(); TRACE_LOG("#16\n"); return -1; }
-  if (size > 0)
-  {
-    fsi->setfilepos(in, -(size+1), SEEK_CUR);
-    if (fsi->readchars(language_input, size+1, in) != (size_t)size+1)
-    { abort_entry_input(); TRACE_LOG("#17\n"); return -1; }
-  }
-  language_input[size] = '\0';
+  if (read_list_field(&language_input, &language_input_size) == -1)
+  { abort_entry_input(); TRACE_LOG("#15\n"); return -1; }
   unquoted_language_input = unquote_special_chars(language_input);
   //printf("language:[%s]\n", language_input);
 
-  offset = fsi->getfilepos(in);
-  while ((data = fsi->readchar(in)) != '\t')
-    if (data == EOF)
-    { abort_entry_input(); TRACE_LOG("#18\n"); return -1; }
-  size = fsi->getfilepos(in) - offset - 1;
-  if (ensure_mem_size(&description_input, &description_input_size, size+2)==-1)
-  { abort_entry_input(); TRACE_LOG("#19\n"); return -1; }
-  if (size > 0)
-  {
-    fsi->setfilepos(in, -(size+1), SEEK_CUR);
-    if (fsi->readchars(description_input, size+1, in) != (size_t)size+1)
-    { abort_entry_input(); TRACE_LOG("#20\n"); return -1; }
-  }
-  description_input[size] = '\0';
+  if (read_list_field(&description_input, &description_input_size) == -1)
+  { abort_entry_input(); TRACE_LOG("#18\n"); return -1; }
   unquoted_description_input = unquote_special_chars(description_input);
   //printf("desc:[%s]\n", description_input);
 
-  offset = fsi->getfilepos(in);
-  while ((data = fsi->readchar(in)) != '\t')
-    if (data == EOF)
-    { abort_entry_input(); TRACE_LOG("#21\n"); return -1; }
-  size = fsi->getfilepos(in) - offset - 1;
-  if (ensure_mem_size(&filename_input, &filename_input_size, size + 2) == -1)
-  { abort_entry_input(); TRACE_LOG("#22\n"); return -1; }
-  if (size > 0)
-  {
-    fsi->setfilepos(in, -(size+1), SEEK_CUR);
-    if (fsi->readchars(filename_input, size+1, in) != (size_t)size+1)
-    { abort_entry_input(); TRACE_LOG("#23\n"); return -1; }
-  }
-  filename_input[size] = '\0';
+  if (read_list_field(&filename_input, &filename_input_size) == -1)
+  { abort_entry_input(); TRACE_LOG("#21\n"); return -1; }
   unquoted_filename_input = unquote_special_chars(filename_input);
 
-  offset = fsi->getfilepos(in);
-  while ((data = fsi->readchar(in)) != '\t')
-    if (data == EOF)
-    { abort_entry_input(); TRACE_LOG("#24\n"); return -1; }
-  size = fsi->getfilepos(in) - offset - 1;
-  if (ensure_mem_size(&blorbfile_input, &blorbfile_input_size, size + 2) == -1)
-  { abort_entry_input(); TRACE_LOG("#25\n"); return -1; }
-  if (size > 0)
-  {
-    fsi->setfilepos(in, -(size+1), SEEK_CUR);
-    if (fsi->readchars(blorbfile_input, size+1, in) != (size_t)size+1)
-    { abort_entry_input(); TRACE_LOG("#26\n"); return -1; }
-  }
-  blorbfile_input[size] = '\0';
+  if (read_list_field(&blorbfile_input, &blorbfile_input_size) == -1)
+  { abort_entry_input(); TRACE_LOG("#24\n"); return -1; }
   unquoted_blorbfile_input = unquote_special_chars(blorbfile_input);
 
-  offset = fsi->getfilepos(in);
-  while ((data = fsi->readchar(in)) != '\t')
-    if (data == EOF)
-    { abort_entry_input(); TRACE_LOG("#27\n"); return -1; }
-  size = fsi->getfilepos(in) - offset - 1;
-  if (ensure_mem_size(&filetype_input, &filetype_input_size, size + 2) == -1)
-  { abort_entry_input(); TRACE_LOG("#28\n"); return -1; }
-  if (size > 0)
-  {
-    fsi->setfilepos(in, -(size+1), SEEK_CUR);
-    if (fsi->readchars(filetype_input, size+1, in) != (size_t)size+1)
-    { abort_entry_input(); TRACE_LOG("#29\n"); return -1; }
-  }
-  filetype_input[size] = '\0';
+  if (read_list_field(&filetype_input, &filetype_input_size) == -1)
+  { abort_entry_input(); TRACE_LOG("#27\n"); return -1; }
   unquoted_filetype_input = unquote_special_chars(filetype_input);
 
   index = 0;
   storyfile_timestamp_input = 0;
   while (index < 16)
   {
-    if ((data = fsi->readchar(in)) == EOF)
+    if ((data = next_list_char()) == EOF)
     { abort_entry_input(); TRACE_LOG("#30\n"); return -1; }
     if (data == '\n')
-    { fsi->unreadchar(data, in); break; }
+    { in_ptr--; break; }
     if (isdigit(data) == 0) { break; }
     storyfile_timestamp_input *= 10;
     storyfile_timestamp_input += (data - '0');
@@ -487,8 +427,10 @@ int parse_next_story_entry()
       filename_input);
   */
 
-  while ((data = fsi->readchar(in)) != '\n')
-    if (data == EOF) break;
+  if ((newline_index = memchr(in_ptr, '\n', in_end - in_ptr)) != NULL)
+    in_ptr = newline_index + 1;
+  else
+    in_ptr = in_end;
 
   return 0;
 }
@@ -529,6 +471,27 @@ static z_file *open_story_list(bool write_enabled)
 }
 
 
+// Maps the complete story list into memory for parsing. Returns false in
+// case there's no story list or it could not be read.
+static bool map_story_list()
+{
+  z_file *in;
+
+  if ((in = open_story_list(false)) == NULL)
+    return false;
+
+  in_data = fsi_map_file(in, &in_length);
+  fsi->closefile(in);
+
+  if (in_data == NULL)
+    return false;
+
+  in_ptr = in_data;
+  in_end = in_data + in_length;
+  return true;
+}
+
+
 struct z_story_list_entry *store_current_entry()
 {
   struct z_story_list_entry *result;
@@ -657,22 +620,18 @@ struct z_story_list *get_empty_z_story_list()
 
 struct z_story_list *get_z_story_list()
 {
-  int data;
   struct z_story_list *result = get_empty_z_story_list();
 
-  if ((in = open_story_list(false)) == NULL)
+  if (map_story_list() == false)
     return result;
-  in_zfile_open = true;
 
   for(;;)
   {
-    if ((data = fsi->readchar(in)) == EOF)
+    if (in_ptr == in_end)
     {
       abort_entry_input();
       return result;
     }
-    else
-      fsi->unreadchar(data, in);
 
     if (parse_next_story_entry() == -1)
     {
@@ -749,21 +708,17 @@ struct z_story_list_entry *get_z_story_entry_from_list(char *serial,
     uint16_t release, uint16_t checksum)
 {
   struct z_story_list_entry *result;
-  int data;
 
-  if ((in = open_story_list(false)) == NULL)
+  if (map_story_list() == false)
     return NULL;
-  in_zfile_open = true;
 
   for(;;)
   {
-    if ((data = fsi->readchar(in)) == EOF)
+    if (in_ptr == in_end)
     {
       abort_entry_input();
       return NULL;
     }
-    else
-      fsi->unreadchar(data, in);
 
     if (parse_next_story_entry() == -1)
     {
@@ -814,8 +769,11 @@ int remove_entry_from_list(struct z_story_list *story_list,
 }
 
 
+// "*babel" may be NULL, in which case the babel data is loaded only if
+// it's actually required -- that is, if the story is not yet part of the
+// list or has changed -- and returned in "*babel".
 static int detect_and_add_z_file(char *filename, char *blorb_filename,
-    struct babel_info *babel, struct z_story_list *story_list)
+    struct babel_info **babel, struct z_story_list *story_list)
 {
   z_file *infile;
   uint8_t buf[30];
@@ -912,7 +870,6 @@ static int detect_and_add_z_file(char *filename, char *blorb_filename,
       chunk_length = get_last_chunk_length();
       file_babel = load_babel_info_from_blorb(
           infile, chunk_length, abs_filename, storyfile_timestamp);
-      babel = file_babel;
     }
 
     find_chunk("ZCOD", infile);
@@ -998,9 +955,20 @@ static int detect_and_add_z_file(char *filename, char *blorb_filename,
     // In case new file is a zblorb and we have save a raw file, remove the
     // raw and keep the blorb (so we can get images and sound). We'll also
     // re-read the file contents if the file has changed (metadata might
-    // have been altered).
+    // have been altered) or has been moved. A raw file which is already
+    // listed under its own name is left alone, since re-adding it on
+    // every start would force loading the babel data and rewriting the
+    // list for nothing.
     if (
-        (strcmp(entry->filetype, filetype_raw) == 0)
+        (
+         (strcmp(entry->filetype, filetype_raw) == 0)
+         &&
+         (
+          (file_is_zblorb == true)
+          ||
+          (strcmp(entry->filename, abs_filename) != 0)
+         )
+        )
         ||
         (storyfile_timestamp > entry->storyfile_timestamp)
        )
@@ -1021,8 +989,13 @@ static int detect_and_add_z_file(char *filename, char *blorb_filename,
 
   ptr2 = NULL;
 
+  if ( (file_babel == NULL) && (*babel == NULL) )
+    *babel = load_babel_info();
+
   if ((b_info = get_babel_story_info(
-          release, serial, checksum, babel, file_is_zblorb)) != NULL)
+          release, serial, checksum,
+          file_babel != NULL ? file_babel : *babel,
+          file_is_zblorb)) != NULL)
   {
     title = (b_info->title == NULL ? empty_string : b_info->title);
     author = (b_info->author == NULL ? empty_string : b_info->author);
@@ -1228,7 +1201,7 @@ static int search_dir(char *abs_dir_name,
     {
       if ( (show_progress == true) && (update_func != NULL) )
         update_func(z_dir_entry.d_name, NULL);
-      detect_and_add_z_file(dirname, NULL, babel, story_list);
+      detect_and_add_z_file(dirname, NULL, &babel, story_list);
       }
   }
 
@@ -1260,7 +1233,7 @@ void build_filelist(char *root_dir, struct z_story_list *story_list,
     TRACE_LOG("Building filelist for rootdir: \"%s\".\n", root_dir);
 
     if ((fsi->ch_dir(root_dir)) == -1)
-      detect_and_add_z_file(root_dir, NULL, babel, story_list);
+      detect_and_add_z_file(root_dir, NULL, &babel, story_list);
     else
     {
       // Avoid relative names like "./zork1.z3".
@@ -1481,21 +1454,44 @@ struct z_story_list *update_fizmo_story_list()
 }
 
 
+void preload_babel_info()
+{
+  if (cached_babel_loaded == false)
+  {
+    cached_babel = load_babel_info();
+    cached_babel_loaded = true;
+  }
+}
+
+
+void free_filelist_memory()
+{
+  free_babel_info(cached_babel);
+  cached_babel = NULL;
+  cached_babel_loaded = false;
+}
+
+
+// Since this is invoked on every start, the babel data is only loaded and
+// the list is only rewritten in case the story is new or has changed.
 void detect_and_add_single_z_file(char *input_filename, char *blorb_filename)
 {
   struct z_story_list *z_story_list = get_z_story_list();
-  struct babel_info *babel = load_babel_info();
 
   TRACE_LOG("noffiles: %d\n", z_story_list->nof_entries);
 
-  detect_and_add_z_file(input_filename, blorb_filename, babel, z_story_list);
+  if (detect_and_add_z_file(
+        input_filename, blorb_filename, &cached_babel, z_story_list) == 0)
+  {
+    TRACE_LOG("noffiles: %d\n", z_story_list->nof_entries);
+    save_story_list(z_story_list);
+    store_babel_info_timestamps(cached_babel);
+  }
 
-  TRACE_LOG("noffiles: %d\n", z_story_list->nof_entries);
+  if (cached_babel != NULL)
+    cached_babel_loaded = true;
 
-  save_story_list(z_story_list);
-  store_babel_info_timestamps(babel);
   free_z_story_list(z_story_list);
-  free_babel_info(babel);
 }
 
 
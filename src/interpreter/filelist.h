@@ -66,6 +66,8 @@ struct z_story_list_entry *get_z_story_entry_from_list(char *serial,
     uint16_t release, uint16_t checksum);
 struct z_story_list *update_fizmo_story_list();
 void detect_and_add_single_z_file(char *input_filename, char *blorb_filename);
+void preload_babel_info();
+void free_filelist_memory();
 void search_directory(char *absolute_dirname, bool recursive);
 
 #endif /* filelist_h_INCLUDED */
@@ -56,9 +56,14 @@
 #include "routine.h"
 #include "variable.h"
 #include "undo.h"
+#include "turnstat.h"
+#include "memstat.h"
 #include "blorb.h"
 #include "hyphenation.h"
 #include "undo.h"
+#include "allocator.h"
+#include "warmimage.h"
+#include "storyidx.h"
 #include "../tools/z_ucs.h"
 #include "../tools/types.h"
 #include "../tools/i18n.h"
@@ -71,6 +76,10 @@
 #include "history.h"
 #endif // DISABLE_OUTPUT_HISTORY
 
+#ifdef ENABLE_ASYNC_AUTOSAVE
+#include "autosave.h"
+#endif // ENABLE_ASYNC_AUTOSAVE
+
 #ifndef DISABLE_BLOCKBUFFER
 #include "blockbuf.h"
 #endif // DISABLE_BLOCKBUFFER
@@ -117,8 +126,17 @@ void (*paragraph_removal_function)(int parameter1, int parameter2) = NULL;
 
 
 
+// The warm image the active story's memory is mapped from, if any.
+static struct warm_image *active_warm_image = NULL;
+
+
 // "load_z_story" returns malloc()ed z_story, may be freed using free_z_story().
-static struct z_story *load_z_story(z_file *story_stream, z_file *blorb_stream)
+// In case the story is read from the story file, the first
+// WARM_IMAGE_HEADER_SIZE bytes are stored in "original_header". The story
+// list lookup's results are stored in "image_metadata", which has to be
+// freed by the caller.
+static struct z_story *load_z_story(z_file *story_stream, z_file *blorb_stream,
+    struct warm_image_metadata *image_metadata, uint8_t *original_header)
 {
   struct z_story *result;
   int z_file_version;
@@ -130,6 +148,7 @@ static struct z_story *load_z_story(z_file *story_stream, z_file *blorb_stream)
   char *story_filename;
   uint8_t buf[30];
   uint32_t val;
+  char *warm_image_filename;
 #ifndef DISABLE_FILELIST
   struct z_story_list_entry *story_data;
 #endif
@@ -307,32 +326,62 @@ static struct z_story *load_z_story(z_file *story_stream, z_file *blorb_stream)
         (long int)maximum_z_story_size[result->version-1] * 1024l);
   */
 
-  result->memory = (uint8_t*)fizmo_malloc((size_t)story_size);
+  image_metadata->title = NULL;
+  image_metadata->blorb_filename = NULL;
+  image_metadata->language = NULL;
+
+  if ((warm_image_filename = get_configuration_value("warm-image-filename"))
+      != NULL)
+    active_warm_image = load_warm_image(
+        warm_image_filename,
+        result->z_story_file,
+        result->story_file_exec_offset,
+        story_size,
+        image_metadata);
+
+  if (active_warm_image != NULL)
+    result->memory = active_warm_image->memory;
+  else
+  {
+    result->memory = (uint8_t*)fizmo_session_malloc((size_t)story_size);
 
-  *(result->memory) = result->version;
+    *(result->memory) = result->version;
 
-  TRACE_LOG("Loading %li bytes from \"%s\".\n",
-      story_size-1, story_stream->filename);
+    TRACE_LOG("Loading %li bytes from \"%s\".\n",
+        story_size-1, story_stream->filename);
 
-  if (fsi->readchars(
-        result->memory+1, (size_t)(story_size - 1), result->z_story_file)
-      != (size_t)(story_size - 1))
-  {
-    story_filename = strdup(story_stream->filename);
+    // Checking the warm image may have moved the file position.
+    if (
+        (fsi->setfilepos(
+          result->z_story_file, result->story_file_exec_offset + 1, SEEK_SET)
+         != 0)
+        ||
+        (fsi->readchars(
+          result->memory+1, (size_t)(story_size - 1), result->z_story_file)
+         != (size_t)(story_size - 1))
+       )
+    {
+      story_filename = strdup(story_stream->filename);
 
-    if (fsi->closefile(result->z_story_file) == EOF)
-      (void)i18n_translate(
+      if (fsi->closefile(result->z_story_file) == EOF)
+        (void)i18n_translate(
+            libfizmo_module_name,
+            i18n_libfizmo_ERROR_WHILE_CLOSING_FILE_P0S,
+            -0x0107,
+            story_stream->filename);
+
+      i18n_translate_and_exit(
           libfizmo_module_name,
-          i18n_libfizmo_ERROR_WHILE_CLOSING_FILE_P0S,
-          -0x0107,
-          story_stream->filename);
+          i18n_libfizmo_ERROR_WHILE_READING_FILE_P0S,
+          -0x0106,
+          story_filename);
+      free(story_filename);
+    }
 
-    i18n_translate_and_exit(
-        libfizmo_module_name,
-        i18n_libfizmo_ERROR_WHILE_READING_FILE_P0S,
-        -0x0106,
-        story_filename);
-    free(story_filename);
+    // The header is patched below, the image has to keep the original.
+    memcpy(original_header, result->memory,
+        story_size < WARM_IMAGE_HEADER_SIZE
+        ? (size_t)story_size : WARM_IMAGE_HEADER_SIZE);
   }
 
   result->high_memory_end = result->memory + story_size - 1;
@@ -480,42 +529,54 @@ static struct z_story *load_z_story(z_file *story_stream, z_file *blorb_stream)
     result->max_nof_color_pairs = 0;
 
 #ifndef DISABLE_FILELIST
-  detect_and_add_single_z_file(
-      story_stream->filename,
-      blorb_stream != NULL ? blorb_stream->filename : NULL);
-
-  if ((story_data = get_z_story_entry_from_list(
-        result->serial_code,
-        result->release_code,
-        result->checksum)) != NULL)
+  // The story list lookup is what makes up most of the startup time, so
+  // its results are part of the warm image.
+  if (active_warm_image == NULL)
   {
-    if (
-        (result->blorb_file == NULL)
-        &&
-        (story_data->blorbfile != NULL)
-        &&
-        (strlen(story_data->blorbfile) != 0)
-       )
+    detect_and_add_single_z_file(
+        story_stream->filename,
+        blorb_stream != NULL ? blorb_stream->filename : NULL);
+
+    if ((story_data = get_z_story_entry_from_list(
+          result->serial_code,
+          result->release_code,
+          result->checksum)) != NULL)
     {
-      TRACE_LOG("Load blorb: %s\n", story_data->blorbfile);
-
-      if ((result->blorb_file = open_simple_iff_file(
-              story_data->blorbfile, IFF_MODE_READ)) != NULL)
-        result->blorb_map
-          = active_blorb_interface->init_blorb_map(result->blorb_file);
+      image_metadata->title = fizmo_strdup(story_data->title);
+      if (
+          (story_data->blorbfile != NULL)
+          &&
+          (strlen(story_data->blorbfile) != 0)
+         )
+        image_metadata->blorb_filename = fizmo_strdup(story_data->blorbfile);
+      if (story_data->language != NULL)
+        image_metadata->language = fizmo_strdup(story_data->language);
+      free_z_story_list_entry(story_data);
     }
-    result->title = fizmo_strdup(story_data->title);
-    if (story_data->language != NULL)
-      set_configuration_value("locale", story_data->language);
-    free_z_story_list_entry(story_data);
   }
-  else
+#endif
+
+  if (
+      (result->blorb_file == NULL)
+      &&
+      (image_metadata->blorb_filename != NULL)
+     )
   {
-    result->title = NULL;
+    TRACE_LOG("Load blorb: %s\n", image_metadata->blorb_filename);
+
+    if ((result->blorb_file = open_simple_iff_file(
+            image_metadata->blorb_filename, IFF_MODE_READ)) != NULL)
+      result->blorb_map
+        = active_blorb_interface->init_blorb_map(result->blorb_file);
   }
-#else
-  result->title = NULL;
-#endif
+
+  if (image_metadata->language != NULL)
+    set_configuration_value("locale", image_metadata->language);
+
+  result->title
+    = image_metadata->title != NULL
+    ? fizmo_strdup(image_metadata->title)
+    : NULL;
 
   return result;
 }
@@ -523,7 +584,13 @@ static struct z_story *load_z_story(z_file *story_stream, z_file *blorb_stream)
 
 static void free_z_story(struct z_story *story)
 {
-  free(story->memory);
+  if (active_warm_image != NULL)
+  {
+    free_warm_image(active_warm_image);
+    active_warm_image = NULL;
+  }
+  else
+    fizmo_session_free(story->memory);
   if (story->title != NULL)
     free(story->title);
   if (story->blorb_map != NULL)
@@ -588,6 +655,8 @@ void *fizmo_malloc(size_t size)
 {
   void *result;
 
+  turn_statistics_count_allocation();
+
   if ((result = malloc(size)) == NULL)
     i18n_translate_and_exit(
         libfizmo_module_name,
@@ -603,6 +672,8 @@ void *fizmo_realloc(void *ptr, size_t size)
 {
   void *result;
 
+  turn_statistics_count_allocation();
+
   if ((result = realloc(ptr, size)) == NULL)
     i18n_translate_and_exit(
         libfizmo_module_name,
@@ -755,6 +826,11 @@ void fizmo_new_screen_size(uint16_t width, uint16_t height)
         upper_window_buffer->height);
 #endif // DISABLE_BLOCKBUFFER
 
+#ifndef DISABLE_OUTPUT_HISTORY
+  if (outputhistory[0] != NULL)
+    set_history_screen_size(outputhistory[0], (int)width, (int)height);
+#endif /* DISABLE_OUTPUT_HISTORY */
+
   if (ver >= 4)
   {
     TRACE_LOG("Writing %d to $20, %d to $21.\n", height, width);
@@ -777,6 +853,24 @@ void fizmo_new_screen_size(uint16_t width, uint16_t height)
 }
 
 
+// Hyphenation patterns and babel data are loaded on first use. Interfaces
+// which would rather pay for this before the story starts -- or at some
+// other convenient moment -- may load them explicitly using one or more of
+// the FIZMO_PRELOAD_* flags. Since patterns are loaded for the current
+// locale and search path, this should be called after the configuration
+// has been set up.
+void fizmo_preload(int subsystems)
+{
+  if ((subsystems & FIZMO_PRELOAD_HYPHENATION) != 0)
+    (void)preload_hyphenation_patterns();
+
+#ifndef DISABLE_FILELIST
+  if ((subsystems & FIZMO_PRELOAD_BABEL) != 0)
+    preload_babel_info();
+#endif // DISABLE_FILELIST
+}
+
+
 void write_interpreter_info_into_header()
 {
   uint16_t width, height;
@@ -1197,6 +1291,11 @@ void fizmo_start(z_file* story_stream, z_file *blorb_stream,
   uint8_t flags2;
   int val;
   char *str, *default_savegame_filename = DEFAULT_SAVEGAME_FILENAME;
+  z_file *memory_stats_file;
+  struct warm_image_metadata image_metadata;
+  uint8_t original_header[WARM_IMAGE_HEADER_SIZE];
+  uint8_t *index_data;
+  size_t index_data_length;
 
   if (active_interface == NULL)
   {
@@ -1204,7 +1303,9 @@ void fizmo_start(z_file* story_stream, z_file *blorb_stream,
     return;
   }
 
+  reset_turn_statistics();
   init_config_default_values();
+  reset_memory_stats();
 
   register_i18n_stream_output_function(
       streams_z_ucs_output);
@@ -1231,12 +1332,19 @@ void fizmo_start(z_file* story_stream, z_file *blorb_stream,
   if (get_configuration_value("random-mode") == NULL)
     set_configuration_value("random-mode", "random");
 
+  startup_phase_completed("configuration");
+
   //set_configuration_value("disable-external-streams", "true");
 
   open_streams();
   init_signal_handlers();
 
-  active_z_story = load_z_story(story_stream, blorb_stream);
+  startup_phase_completed("streams");
+
+  active_z_story = load_z_story(
+      story_stream, blorb_stream, &image_metadata, original_header);
+
+  startup_phase_completed("story");
 
   if (
       (active_z_story->release_code == 2)
@@ -1250,6 +1358,33 @@ void fizmo_start(z_file* story_stream, z_file *blorb_stream,
 
   ver = active_z_story->version;
 
+  if (active_warm_image != NULL)
+    (void)use_story_index_data(
+        active_warm_image->index_data,
+        active_warm_image->index_data_length);
+  else
+    build_story_indexes();
+  update_subsystem_memory_stats(MEMORY_STATS_STORY);
+
+  if (
+      (active_warm_image == NULL)
+      &&
+      ((str = get_configuration_value("warm-image-filename")) != NULL)
+      &&
+      ((index_data = get_story_index_data(&index_data_length)) != NULL)
+     )
+    (void)save_warm_image(
+        str,
+        z_mem,
+        active_z_story->story_file_exec_offset,
+        active_z_story->high_memory_end - z_mem + 1,
+        original_header,
+        index_data,
+        index_data_length,
+        &image_metadata);
+
+  free_warm_image_metadata(&image_metadata);
+
 #ifdef ENABLE_DEBUGGER
   debugger_story_has_been_loaded();
 #endif // ENABLE_DEBUGGER
@@ -1278,6 +1413,8 @@ void fizmo_start(z_file* story_stream, z_file *blorb_stream,
   current_foreground_colour = default_foreground_colour;
   current_background_colour = default_background_colour;
 
+  startup_phase_completed("interpreter");
+
   /*
   active_interface->set_colour(
       default_foreground_colour, default_background_colour, -1);
@@ -1298,7 +1435,11 @@ void fizmo_start(z_file* story_stream, z_file *blorb_stream,
     active_sound_interface->init_sound();
   }
 
+  startup_phase_completed("interface");
+
   write_interpreter_info_into_header();
+  init_zscii_unicode_tables();
+  invalidate_tokenise_cache();
 
   // REVISIT: Implement general initalization for restore / restart etc.
   active_window_number = 0;
@@ -1312,6 +1453,7 @@ void fizmo_start(z_file* story_stream, z_file *blorb_stream,
           Z_FONT_NORMAL,
           current_foreground_colour,
           current_background_colour);
+  update_subsystem_memory_stats(MEMORY_STATS_BLOCKBUFFER);
 #endif // DISABLE_BLOCKBUFFER
 
 #ifndef DISABLE_OUTPUT_HISTORY
@@ -1324,8 +1466,15 @@ void fizmo_start(z_file* story_stream, z_file *blorb_stream,
         default_background_colour,
         Z_FONT_NORMAL,
         Z_STYLE_ROMAN);
+  set_history_screen_size(
+      outputhistory[0],
+      active_interface->get_screen_width_in_characters(),
+      active_interface->get_screen_height_in_lines());
+  update_subsystem_memory_stats(MEMORY_STATS_HISTORY);
 #endif /* DISABLE_OUTPUT_HISTORY */
 
+  startup_phase_completed("screen");
+
   terminate_interpreter = INTERPRETER_QUIT_NONE;
 
   if ( (ver <= 8) && (ver != 6) )
@@ -1421,6 +1570,9 @@ void fizmo_start(z_file* story_stream, z_file *blorb_stream,
         z_mem[0x11] &= 0xfc;
         z_mem[0x11] |= flags2;
 
+        init_zscii_unicode_tables();
+        dynamic_memory_replaced();
+
         terminate_interpreter = INTERPRETER_QUIT_NONE;
       }
     }
@@ -1438,11 +1590,30 @@ void fizmo_start(z_file* story_stream, z_file *blorb_stream,
   if (active_sound_interface != NULL)
     active_sound_interface->close_sound();
 
+#ifdef ENABLE_ASYNC_AUTOSAVE
+  // Make sure the last autosave is written completely before quitting.
+  stop_background_autosave();
+#endif // ENABLE_ASYNC_AUTOSAVE
+
+  if ((str = get_configuration_value("memory-stats-filename")) != NULL)
+  {
+    if ((memory_stats_file = fsi->openfile(
+            str, FILETYPE_DATA, FILEACCESS_WRITE)) != NULL)
+    {
+      dump_memory_stats(memory_stats_file);
+      fsi->closefile(memory_stats_file);
+    }
+  }
+
   // Close all streams, this will also close the active interface.
   close_streams(NULL);
   free_undo_memory();
+  free_z_stack_memory();
   free_hyphenation_memory();
   free_i18n_memory();
+#ifndef DISABLE_FILELIST
+  free_filelist_memory();
+#endif // DISABLE_FILELIST
 
 #ifndef DISABLE_BLOCKBUFFER
   if (upper_window_buffer != NULL)
@@ -1452,8 +1623,10 @@ void fizmo_start(z_file* story_stream, z_file *blorb_stream,
 
 #ifndef DISABLE_OUTPUT_HISTORY
   destroy_outputhistory(outputhistory[0]);
+  outputhistory[0] = NULL;
 #endif // DISABLE_OUTPUT_HISTORY
 
+  free_story_indexes();
   free_z_story(active_z_story);
   active_z_story = NULL;
   z_mem = NULL;
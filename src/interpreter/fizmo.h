@@ -68,6 +68,9 @@ From: http://www.logicalshift.demon.co.uk/unix/zoom/manual/configXwin.html
 #define OBEYS_SPEC_MAJOR_REVISION_NUMER 1
 #define OBEYS_SPEC_MINOR_REVISION_NUMER 0
 
+#define FIZMO_PRELOAD_HYPHENATION 0x1
+#define FIZMO_PRELOAD_BABEL 0x2
+
 
 int fizmo_register_screen_interface(
     struct z_screen_interface *screen_interface);
@@ -85,6 +88,7 @@ void fizmo_register_paragraph_removal_function(
 void fizmo_start(z_file* story_stream, z_file *blorb_stream,
     z_file *restore_on_start_file);
 void fizmo_new_screen_size(uint16_t width, uint16_t height);
+void fizmo_preload(int subsystems);
 
 void write_interpreter_info_into_header();
 int close_interface(z_ucs *error_message);
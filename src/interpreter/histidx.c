@@ -0,0 +1,569 @@
+
+/* histidx.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// A trigram index over the text stored in an output history, so that
+// scrollback can be searched without walking the whole buffer. Every
+// paragraph gets a number, and for each trigram of its text -- ignoring
+// case and metadata -- the paragraph's number is added to the bucket the
+// trigram hashes to. A search only has to look at the paragraphs found in
+// the buckets of all the pattern's trigrams, and since different trigrams
+// may share a bucket, these candidates are then verified against the text
+// in the buffer. Once the ring buffer has overwritten a paragraph, it's
+// dropped from the index.
+
+#ifndef histidx_c_INCLUDED
+#define histidx_c_INCLUDED
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../tools/tracelog.h"
+#include "../tools/types.h"
+#include "../tools/z_ucs.h"
+#include "histidx.h"
+#include "history.h"
+#include "fizmo.h"
+#include "allocator.h"
+
+
+// Only ASCII and Latin-1 letters are folded, which covers the characters
+// of the standard Z-Machine alphabets.
+static z_ucs fold_case(z_ucs c)
+{
+  if ( ( (c >= 'A') && (c <= 'Z') )
+      || ( (c >= 0xc0) && (c <= 0xde) && (c != 0xd7) ) )
+    return c + 0x20;
+  else
+    return c;
+}
+
+
+static uint32_t get_trigram_bucket(z_ucs c1, z_ucs c2, z_ucs c3)
+{
+  uint32_t hash = ((c1 * 0x9e3779b1u + c2) * 0x85ebca77u + c3) * 0xc2b2ae3du;
+
+  return hash >> (32 - HISTORY_INDEX_BUCKET_BITS);
+}
+
+
+static uint64_t get_paragraph_start(struct history_index *index,
+    uint32_t paragraph)
+{
+  return index->paragraph_starts[paragraph - index->first_stored_paragraph];
+}
+
+
+// Returns the position of the oldest char still in the buffer.
+static uint64_t get_back_position(OUTPUTHISTORY *h)
+{
+  if (h->nof_wraparounds != 0)
+    return get_history_position(h, h->z_history_buffer_back_index);
+  else
+    return h->nof_chars_stored
+      - (h->z_history_buffer_front_index - h->z_history_buffer_start);
+}
+
+
+static void add_posting(struct history_index *index, uint32_t bucket,
+    uint32_t paragraph)
+{
+  struct history_index_postings *postings = &index->buckets[bucket];
+
+  // Paragraphs are indexed in ascending order, so a duplicate can only be
+  // the last entry.
+  if ( (postings->len > 0)
+      && (postings->paragraphs[postings->len - 1] == paragraph) )
+    return;
+
+  if (postings->len == postings->size)
+  {
+    postings->size = postings->size == 0 ? 4 : postings->size * 2;
+    postings->paragraphs = fizmo_session_realloc(
+        postings->paragraphs,
+        sizeof(uint32_t) * postings->size);
+  }
+
+  postings->paragraphs[postings->len++] = paragraph;
+}
+
+
+static void add_paragraph(struct history_index *index, uint64_t start)
+{
+  size_t nof_stored
+    = index->last_paragraph - index->first_stored_paragraph + 1;
+
+  if (nof_stored == index->paragraph_starts_size)
+  {
+    index->paragraph_starts_size *= 2;
+    index->paragraph_starts = fizmo_session_realloc(
+        index->paragraph_starts,
+        sizeof(uint64_t) * index->paragraph_starts_size);
+  }
+
+  index->paragraph_starts[nof_stored] = start;
+  index->last_paragraph++;
+}
+
+
+// Returns the index of the first entry in "postings" which is not smaller
+// than "paragraph".
+static uint32_t find_posting(struct history_index_postings *postings,
+    uint32_t paragraph)
+{
+  uint32_t low = 0, high = postings->len, middle;
+
+  while (low < high)
+  {
+    middle = low + (high - low) / 2;
+    if (postings->paragraphs[middle] < paragraph)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  return low;
+}
+
+
+// Sets up an index containing a single, empty paragraph starting at
+// "start".
+static void clear_history_index(struct history_index *index, uint64_t start)
+{
+  int i;
+
+  for (i=0; i<HISTORY_INDEX_NOF_BUCKETS; i++)
+    index->buckets[i].len = 0;
+
+  index->first_stored_paragraph = 0;
+  index->first_paragraph = 0;
+  index->last_paragraph = 0;
+  index->nof_paragraphs_pruned = 0;
+  index->paragraph_starts[0] = start;
+  index->window_len = 0;
+  index->metadata_chars_to_skip = 0;
+}
+
+
+// Indexes everything currently stored in the history's buffer.
+static void index_history_buffer(OUTPUTHISTORY *h)
+{
+  clear_history_index(h->search_index, get_back_position(h));
+
+  if (h->z_history_buffer_size == 0)
+    return;
+
+  if (h->nof_wraparounds == 0)
+    index_history_data(
+        h,
+        h->z_history_buffer_start,
+        h->z_history_buffer_front_index - h->z_history_buffer_start,
+        get_back_position(h));
+  else
+  {
+    index_history_data(
+        h,
+        h->z_history_buffer_front_index,
+        h->z_history_buffer_end - h->z_history_buffer_front_index + 1,
+        get_back_position(h));
+    index_history_data(
+        h,
+        h->z_history_buffer_start,
+        h->z_history_buffer_front_index - h->z_history_buffer_start,
+        get_back_position(h)
+        + (h->z_history_buffer_end - h->z_history_buffer_front_index + 1));
+  }
+}
+
+
+// Starts maintaining a search index for "h", indexing the text which is
+// already stored. Since the index may take up more memory than the text
+// in the buffer, it has to be enabled explicitly.
+int enable_history_search_index(OUTPUTHISTORY *h)
+{
+  struct history_index *index;
+  int i;
+
+  if (h->search_index != NULL)
+    return 0;
+
+  TRACE_LOG("Enabling search index for history %p.\n", h);
+
+  if ((index = fizmo_session_try_malloc(sizeof(struct history_index)))
+      == NULL)
+    return -1;
+
+  if ((index->buckets = fizmo_session_try_malloc(
+          sizeof(struct history_index_postings) * HISTORY_INDEX_NOF_BUCKETS))
+      == NULL)
+  {
+    fizmo_session_free(index);
+    return -1;
+  }
+
+  for (i=0; i<HISTORY_INDEX_NOF_BUCKETS; i++)
+  {
+    index->buckets[i].paragraphs = NULL;
+    index->buckets[i].size = 0;
+    index->buckets[i].len = 0;
+  }
+
+  index->paragraph_starts_size = 64;
+  index->paragraph_starts = fizmo_session_malloc(
+      sizeof(uint64_t) * index->paragraph_starts_size);
+  index->text = NULL;
+  index->text_size = 0;
+
+  h->search_index = index;
+  index_history_buffer(h);
+
+  return 0;
+}
+
+
+void destroy_history_index(struct history_index *index)
+{
+  int i;
+
+  for (i=0; i<HISTORY_INDEX_NOF_BUCKETS; i++)
+    fizmo_session_free(index->buckets[i].paragraphs);
+
+  fizmo_session_free(index->buckets);
+  fizmo_session_free(index->paragraph_starts);
+  fizmo_session_free(index->text);
+  fizmo_session_free(index);
+}
+
+
+// Adds "len" chars from "data", which will be stored in the history at
+// "position", to the index. This is invoked for everything passed to
+// "store_data_in_history", so metadata has to be skipped here.
+void index_history_data(OUTPUTHISTORY *h, z_ucs *data, size_t len,
+    uint64_t position)
+{
+  struct history_index *index = h->search_index;
+  z_ucs c;
+  size_t i;
+
+  for (i=0; i<len; i++)
+  {
+    c = data[i];
+
+    if (index->metadata_chars_to_skip != 0)
+    {
+      // A negative value means that the metadata type follows.
+      if (index->metadata_chars_to_skip < 0)
+        index->metadata_chars_to_skip
+          = ( (c == HISTORY_METADATA_TYPE_COLOUR)
+              || (c == HISTORY_METADATA_TYPE_PARAGRAPHATTRIBUTE) )
+          ? 2
+          : 1;
+      else
+        index->metadata_chars_to_skip--;
+    }
+    else if (c == HISTORY_METADATA_ESCAPE)
+      index->metadata_chars_to_skip = -1;
+    else if (c == Z_UCS_NEWLINE)
+    {
+      add_paragraph(index, position + i + 1);
+      index->window_len = 0;
+    }
+    else
+    {
+      c = fold_case(c);
+
+      if (index->window_len == 2)
+        add_posting(
+            index,
+            get_trigram_bucket(index->window[0], index->window[1], c),
+            index->last_paragraph);
+      else
+        index->window_len++;
+
+      index->window[0] = index->window[1];
+      index->window[1] = c;
+    }
+  }
+}
+
+
+// Drops all paragraphs which have been completely overwritten. The oldest
+// paragraph remaining may have lost its start, its text is then searched
+// from the buffer back on. Stale postings are removed once as many
+// paragraphs have been dropped as are still indexed, so that the cost of
+// removing them is spread over the paragraphs stored in between.
+void prune_history_index(OUTPUTHISTORY *h)
+{
+  struct history_index *index = h->search_index;
+  uint64_t back_position = get_back_position(h);
+  struct history_index_postings *postings;
+  uint32_t first_valid;
+  size_t nof_stored;
+  int i;
+
+  while ( (index->first_paragraph < index->last_paragraph)
+      && (get_paragraph_start(index, index->first_paragraph + 1)
+        <= back_position) )
+  {
+    index->first_paragraph++;
+    index->nof_paragraphs_pruned++;
+  }
+
+  if (index->nof_paragraphs_pruned
+      <= index->last_paragraph - index->first_paragraph + 1)
+    return;
+
+  TRACE_LOG("Removing postings for %ld pruned paragraphs.\n",
+      (long)index->nof_paragraphs_pruned);
+
+  for (i=0; i<HISTORY_INDEX_NOF_BUCKETS; i++)
+  {
+    postings = &index->buckets[i];
+    first_valid = find_posting(postings, index->first_paragraph);
+
+    if (first_valid > 0)
+    {
+      memmove(
+          postings->paragraphs,
+          postings->paragraphs + first_valid,
+          sizeof(uint32_t) * (postings->len - first_valid));
+      postings->len -= first_valid;
+    }
+  }
+
+  nof_stored = index->last_paragraph - index->first_paragraph + 1;
+  memmove(
+      index->paragraph_starts,
+      index->paragraph_starts
+      + (index->first_paragraph - index->first_stored_paragraph),
+      sizeof(uint64_t) * nof_stored);
+  index->first_stored_paragraph = index->first_paragraph;
+  index->nof_paragraphs_pruned = 0;
+}
+
+
+// Used when the history's contents have been replaced as a whole.
+void reset_history_index(OUTPUTHISTORY *h)
+{
+  index_history_buffer(h);
+}
+
+
+// Copies the text of "paragraph" into the index's text buffer and returns
+// its length.
+static size_t get_paragraph_text(OUTPUTHISTORY *h, uint32_t paragraph)
+{
+  struct history_index *index = h->search_index;
+  uint64_t start = get_paragraph_start(index, paragraph);
+  uint64_t back_position = get_back_position(h);
+  z_ucs *end;
+
+  if (start < back_position)
+    start = back_position;
+
+  // In a wrapped-around buffer the front also is the back, so an empty
+  // paragraph at the front has to be caught here.
+  if (start >= h->nof_chars_stored)
+    return 0;
+
+  return copy_history_paragraph_text(
+      h,
+      get_history_pointer(h, start),
+      &index->text,
+      &index->text_size,
+      &end);
+}
+
+
+// Removing chars from the history's front may have removed paragraph
+// breaks and the chars remembered for the next trigram, so both are taken
+// from what remains in the buffer. Postings of removed text are left in
+// place, they're filtered out when verifying search candidates.
+void update_history_index_after_removal(OUTPUTHISTORY *h)
+{
+  struct history_index *index = h->search_index;
+  struct history_index_postings *postings;
+  bool paragraphs_removed = false;
+  size_t len;
+  int i;
+
+  while ( (index->last_paragraph > index->first_paragraph)
+      && (get_paragraph_start(index, index->last_paragraph)
+        > h->nof_chars_stored) )
+  {
+    index->last_paragraph--;
+    paragraphs_removed = true;
+  }
+
+  // Paragraph numbers are about to be used again, so these have to be
+  // removed to keep the posting lists in ascending order.
+  if (paragraphs_removed == true)
+    for (i=0; i<HISTORY_INDEX_NOF_BUCKETS; i++)
+    {
+      postings = &index->buckets[i];
+      while ( (postings->len > 0)
+          && (postings->paragraphs[postings->len - 1]
+            > index->last_paragraph) )
+        postings->len--;
+    }
+
+  len = get_paragraph_text(h, index->last_paragraph);
+
+  index->window_len = len < 2 ? (int)len : 2;
+  if (len >= 2)
+    index->window[0] = fold_case(index->text[len - 2]);
+  if (len >= 1)
+    index->window[1] = fold_case(index->text[len - 1]);
+  index->metadata_chars_to_skip = 0;
+}
+
+
+static bool paragraph_contains(OUTPUTHISTORY *h, uint32_t paragraph,
+    z_ucs *pattern, size_t pattern_len)
+{
+  size_t len = get_paragraph_text(h, paragraph);
+  z_ucs *text = h->search_index->text;
+  size_t i, j;
+
+  for (i=0; i+pattern_len<=len; i++)
+  {
+    for (j=0; j<pattern_len; j++)
+      if (fold_case(text[i+j]) != pattern[j])
+        break;
+    if (j == pattern_len)
+      return true;
+  }
+
+  return false;
+}
+
+
+// Searches the history for paragraphs containing "pattern", ignoring case.
+// The start positions of up to "max_results" matching paragraphs are
+// stored in "results", starting with the most recent one. The positions
+// are the ones returned by "get_rewound_paragraph_position", so a match
+// can be displayed by rewinding a history output until it's found. Returns
+// the number of results, or -1 in case the history has no search index.
+int search_history(OUTPUTHISTORY *h, z_ucs *pattern, uint64_t *results,
+    int max_results)
+{
+  struct history_index *index = h->search_index;
+  struct history_index_postings **postings = NULL;
+  struct history_index_postings *shortest;
+  size_t pattern_len, nof_trigrams, i, j;
+  z_ucs *folded_pattern;
+  uint32_t paragraph, entry, first_entry;
+  int nof_results = 0;
+  uint64_t start, back_position;
+
+  if (index == NULL)
+    return -1;
+
+  if ( ((pattern_len = z_ucs_len(pattern)) == 0) || (max_results < 1) )
+    return 0;
+
+  TRACE_LOG("Searching history %p for \"", h);
+  TRACE_LOG_Z_UCS(pattern);
+  TRACE_LOG("\".\n");
+
+  folded_pattern = fizmo_malloc(sizeof(z_ucs) * pattern_len);
+  for (i=0; i<pattern_len; i++)
+    folded_pattern[i] = fold_case(pattern[i]);
+
+  back_position = get_back_position(h);
+
+  if (pattern_len < 3)
+  {
+    // No trigram to look up, so every paragraph is a candidate.
+    paragraph = index->last_paragraph + 1;
+    while ( (paragraph-- > index->first_paragraph)
+        && (nof_results < max_results) )
+      if (paragraph_contains(h, paragraph, folded_pattern, pattern_len)
+          == true)
+      {
+        start = get_paragraph_start(index, paragraph);
+        results[nof_results++]
+          = start < back_position ? back_position : start;
+      }
+  }
+  else
+  {
+    nof_trigrams = pattern_len - 2;
+    postings = fizmo_malloc(
+        sizeof(struct history_index_postings*) * nof_trigrams);
+    shortest = NULL;
+
+    for (i=0; i<nof_trigrams; i++)
+    {
+      postings[i] = &index->buckets[get_trigram_bucket(
+          folded_pattern[i], folded_pattern[i+1], folded_pattern[i+2])];
+      if ( (shortest == NULL) || (postings[i]->len < shortest->len) )
+        shortest = postings[i];
+    }
+
+    // Walk the shortest list from the most recent paragraph on and only
+    // verify the paragraphs found in all other lists, too.
+    first_entry = find_posting(shortest, index->first_paragraph);
+    entry = shortest->len;
+    while ( (entry-- > first_entry) && (nof_results < max_results) )
+    {
+      paragraph = shortest->paragraphs[entry];
+
+      for (j=0; j<nof_trigrams; j++)
+        if (postings[j] != shortest)
+        {
+          i = find_posting(postings[j], paragraph);
+          if ( (i == postings[j]->len)
+              || (postings[j]->paragraphs[i] != paragraph) )
+            break;
+        }
+
+      if ( (j == nof_trigrams)
+          && (paragraph_contains(
+              h, paragraph, folded_pattern, pattern_len) == true) )
+      {
+        start = get_paragraph_start(index, paragraph);
+        results[nof_results++]
+          = start < back_position ? back_position : start;
+      }
+    }
+
+    free(postings);
+  }
+
+  free(folded_pattern);
+
+  TRACE_LOG("Found %d matching paragraphs.\n", nof_results);
+
+  return nof_results;
+}
+
+#endif /* histidx_c_INCLUDED */
@@ -0,0 +1,90 @@
+
+/* histidx.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef histidx_h_INCLUDED
+#define histidx_h_INCLUDED
+
+#include "../tools/types.h"
+#include "../tools/z_ucs.h"
+#include "history.h"
+
+#define HISTORY_INDEX_BUCKET_BITS 16
+#define HISTORY_INDEX_NOF_BUCKETS (1 << HISTORY_INDEX_BUCKET_BITS)
+
+
+// Ascending numbers of the paragraphs containing any of the trigrams which
+// hash to this bucket. Entries for paragraphs which have already been
+// overwritten are removed in bulk once enough of them have accumulated.
+struct history_index_postings
+{
+  uint32_t *paragraphs;
+  uint32_t size;
+  uint32_t len;
+};
+
+
+struct history_index
+{
+  struct history_index_postings *buckets;
+
+  // Start positions of the paragraphs still in the buffer. Paragraph
+  // numbers count up from 0 for the first paragraph indexed, the start of
+  // paragraph "n" is stored at "paragraph_starts[n - first_stored_paragraph]".
+  uint64_t *paragraph_starts;
+  size_t paragraph_starts_size;
+  uint32_t first_stored_paragraph;
+  uint32_t first_paragraph;
+  uint32_t last_paragraph;
+  uint32_t nof_paragraphs_pruned;
+
+  // Trigrams may span several calls to "store_data_in_history", so the
+  // last two chars of the current paragraph are kept here.
+  z_ucs window[2];
+  int window_len;
+  int metadata_chars_to_skip;
+
+  z_ucs *text;
+  size_t text_size;
+};
+
+
+int enable_history_search_index(OUTPUTHISTORY *h);
+void destroy_history_index(struct history_index *index);
+void index_history_data(OUTPUTHISTORY *h, z_ucs *data, size_t len,
+    uint64_t position);
+void prune_history_index(OUTPUTHISTORY *h);
+void reset_history_index(OUTPUTHISTORY *h);
+void update_history_index_after_removal(OUTPUTHISTORY *h);
+int search_history(OUTPUTHISTORY *h, z_ucs *pattern, uint64_t *results,
+    int max_results);
+
+#endif /* histidx_h_INCLUDED */
@@ -65,6 +65,14 @@
  * "rewound_paragraph_was_newline_terminated" to false in case the very
  * last paragraph in the buffer is not yet followed by a newline char.
  *
+ * For redrawing after a resize, "output_rewind_lines" rewinds just enough
+ * paragraphs to fill the screen and keeps their line breaks for each width
+ * in a small cache, so paragraphs are only wrapped again once they become
+ * visible at a new width.
+ *
+ * Once "enable_history_search_index" has been called, the text stored is
+ * also added to a trigram index, see histidx.c.
+ *
  * Please note: The buffer size must have at least the size of the largest
  * metadata entry, which is 4 z_ucs-chars.
  */
@@ -83,13 +91,18 @@
 #include "../locales/libfizmo_locales.h"
 #include "history.h"
 #include "fizmo.h"
+#include "allocator.h"
 #include "config.h"
+#include "linewrap.h"
+#include "wordwrap.h"
+#include "histidx.h"
+#include "memstat.h"
 
 
 #define REPEAT_PARAGRAPH_BUF_SIZE 1280
 
 
-outputhistory_ptr outputhistory[]
+outputhistory_ptr outputhistory[OUTPUTHISTORY_NUMBER_OF_WINDOWS]
  = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
 
 
@@ -100,7 +113,7 @@ OUTPUTHISTORY *create_outputhistory(int window_number,
 {
   OUTPUTHISTORY *result;
 
-  if ((result = malloc(sizeof(OUTPUTHISTORY))) == NULL)
+  if ((result = fizmo_session_try_malloc(sizeof(OUTPUTHISTORY))) == NULL)
     return NULL;
 
   result->window_number = window_number;
@@ -130,14 +143,47 @@ OUTPUTHISTORY *create_outputhistory(int window_number,
   result->history_buffer_front_index_foreground = foreground_colour;
   result->history_buffer_front_index_background = background_color;
 
+  result->nof_chars_stored = 0;
+  result->layout_cache = NULL;
+  result->layout_generation = 0;
+  result->layout_screen_width = -1;
+  result->layout_margin = 0;
+  result->layout_hyphenation_enabled = true;
+  result->layout_wrapper = NULL;
+  result->layout_glyph_width = NULL;
+  result->layout_glyph_width_parameter = NULL;
+  result->layout_text = NULL;
+  result->layout_text_size = 0;
+  result->layout_output = NULL;
+  result->layout_output_size = 0;
+  result->layout_in_progress = NULL;
+  result->search_index = NULL;
+
   return result;
 }
 
 
 void destroy_outputhistory(OUTPUTHISTORY *h)
 {
-  free(h->z_history_buffer_start);
-  free(h);
+  int i;
+
+  if (h->layout_cache != NULL)
+  {
+    for (i=0; i<HISTORY_LAYOUT_CACHE_SIZE; i++)
+      fizmo_session_free(h->layout_cache[i].lines);
+    fizmo_session_free(h->layout_cache);
+  }
+
+  if (h->layout_wrapper != NULL)
+    linewrap_destroy_wrapper(h->layout_wrapper);
+
+  if (h->search_index != NULL)
+    destroy_history_index(h->search_index);
+
+  fizmo_session_free(h->layout_text);
+  fizmo_session_free(h->layout_output);
+  fizmo_session_free(h->z_history_buffer_start);
+  fizmo_session_free(h);
 }
 
 
@@ -194,7 +240,8 @@ static void process_buffer_back(OUTPUTHISTORY *h, long nof_zucs_chars)
           : current_index + 1;
         nof_zucs_chars--;
 
-        h->history_buffer_back_index_font = (z_font)*current_index;
+        h->history_buffer_back_index_font
+          = (z_font)(*current_index - HISTORY_METADATA_DATA_OFFSET);
       }
       else if (*current_index == HISTORY_METADATA_TYPE_STYLE)
       {
@@ -205,7 +252,8 @@ static void process_buffer_back(OUTPUTHISTORY *h, long nof_zucs_chars)
           : current_index + 1;
         nof_zucs_chars--;
 
-        h->history_buffer_back_index_style = (z_style)*current_index;
+        h->history_buffer_back_index_style
+          = (z_style)(*current_index - HISTORY_METADATA_DATA_OFFSET);
       }
       else if (*current_index == HISTORY_METADATA_TYPE_COLOUR)
       {
@@ -217,7 +265,7 @@ static void process_buffer_back(OUTPUTHISTORY *h, long nof_zucs_chars)
         nof_zucs_chars--;
 
         h->history_buffer_back_index_foreground
-          = (z_colour)*current_index;
+          = (z_colour)(*current_index - HISTORY_METADATA_DATA_OFFSET);
 
         // Advance to background data.
         current_index
@@ -227,7 +275,7 @@ static void process_buffer_back(OUTPUTHISTORY *h, long nof_zucs_chars)
         nof_zucs_chars--;
 
         h->history_buffer_back_index_background
-          = (z_colour)*current_index;
+          = (z_colour)(*current_index - HISTORY_METADATA_DATA_OFFSET);
       }
       else if (*current_index == HISTORY_METADATA_TYPE_PARAGRAPHATTRIBUTE) {
         // do nothing but catch the case so we're not running into the
@@ -370,7 +418,7 @@ static void try_to_enlarge_buffer(OUTPUTHISTORY *h, size_t desired_z_ucs_size)
   TRACE_LOG("Trying to enlarge history buffer to %ld bytes.\n",
       (long int)(sizeof(z_ucs) * desired_z_ucs_size));
 
-  if ((ptr = realloc(
+  if ((ptr = fizmo_session_try_realloc(
           h->z_history_buffer_start,
           sizeof(z_ucs) * (desired_z_ucs_size + 1))) != NULL)
           //sizeof(z_ucs) * desired_z_ucs_size)) != NULL)
@@ -391,6 +439,8 @@ static void try_to_enlarge_buffer(OUTPUTHISTORY *h, size_t desired_z_ucs_size)
 
     h->z_history_buffer_start
       = ptr;
+
+    update_subsystem_memory_stats(MEMORY_STATS_HISTORY);
   }
 }
 
@@ -445,6 +495,11 @@ void store_data_in_history(OUTPUTHISTORY *h, z_ucs *data, size_t len,
     return;
 
   TRACE_LOG("Trying to store %ld z_ucs-chars in history.\n", (long int)len);
+
+  if (h->search_index != NULL)
+    index_history_data(h, data, len, h->nof_chars_stored);
+
+  h->nof_chars_stored += len;
   /*  Not usable, since data doesn't have to be null-terminated.
   TRACE_LOG("store_history: \"");
   TRACE_LOG_Z_UCS(data);
@@ -485,6 +540,12 @@ void store_data_in_history(OUTPUTHISTORY *h, z_ucs *data, size_t len,
     h->z_history_buffer_back_index
       = h->z_history_buffer_end;
 
+    // Since this discards everything, no paragraph layout remains valid.
+    h->layout_generation++;
+
+    if (h->search_index != NULL)
+      reset_history_index(h);
+
     // At this point, we're already done.
   }
   else
@@ -558,8 +619,9 @@ void store_data_in_history(OUTPUTHISTORY *h, z_ucs *data, size_t len,
       }
 
       data += len_to_write;
+      len -= len_to_write;
 
-      if (len_to_write == len)
+      if (len == 0)
       {
         /*
         TRACE_LOG("history:\n---\n");
@@ -575,6 +637,9 @@ void store_data_in_history(OUTPUTHISTORY *h, z_ucs *data, size_t len,
             h->z_history_buffer_front_index,
             h->z_history_buffer_back_index);
 
+        if (h->search_index != NULL)
+          prune_history_index(h);
+
         if (evaluate_state_block == true)
           write_metadata_state_block_if_necessary(h);
 
@@ -639,11 +704,23 @@ void store_data_in_history(OUTPUTHISTORY *h, z_ucs *data, size_t len,
       h->z_history_buffer_front_index,
       h->z_history_buffer_back_index);
 
+  if (h->search_index != NULL)
+    prune_history_index(h);
+
   if (evaluate_state_block == true)
     write_metadata_state_block_if_necessary(h);
 }
 
 
+void store_z_ucs_view_in_history(OUTPUTHISTORY *h, z_ucs_view output)
+{
+  if ( (output.ptr == NULL) || (output.len == 0) )
+    return;
+
+  store_data_in_history(h, output.ptr, output.len, true);
+}
+
+
 void store_z_ucs_output_in_history(OUTPUTHISTORY *h, z_ucs *z_ucs_output)
 {
   size_t len;
@@ -864,12 +941,42 @@ int get_paragraph_y_positions(OUTPUTHISTORY *history, int screen_width,
 */
 
 
+// Invalidates the layouts of all paragraphs reaching up to "position" or
+// beyond, the ones before remain valid.
+static void invalidate_paragraph_layouts(OUTPUTHISTORY *h, uint64_t position)
+{
+  int i;
+
+  if (h->layout_cache == NULL)
+    return;
+
+  for (i=0; i<HISTORY_LAYOUT_CACHE_SIZE; i++)
+    if (
+        (h->layout_cache[i].line_width != -1)
+        &&
+        (h->layout_cache[i].paragraph_end >= position)
+       )
+      h->layout_cache[i].line_width = -1;
+}
+
+
+// Returns the width available for text, or -1 in case the screen size is
+// not known yet.
+static int get_layout_line_width(OUTPUTHISTORY *h)
+{
+  return h->layout_screen_width > 0
+    ? h->layout_screen_width - h->layout_margin
+    : -1;
+}
+
+
 // Used to remove preloaded input:
 int remove_chars_from_history(OUTPUTHISTORY *history, int nof_chars)
 {
   z_ucs *ptr = history->z_history_buffer_front_index;
   unsigned int nof_wraparounds = history->nof_wraparounds;
   z_ucs last_data = 0;
+  long nof_zucs_removed = 0;
 
   TRACE_LOG("Removing %d chars from history at %p.\n", nof_chars, ptr);
 
@@ -880,6 +987,8 @@ int remove_chars_from_history(OUTPUTHISTORY *history, int nof_chars)
       // Can't rewind any more. Don't change current pointer.
       return -1;
 
+    nof_zucs_removed++;
+
     if ( (*ptr == HISTORY_METADATA_ESCAPE) && (last_data != 0) )
     {
       nof_chars
@@ -897,6 +1006,11 @@ int remove_chars_from_history(OUTPUTHISTORY *history, int nof_chars)
 
   history->z_history_buffer_front_index = ptr;
   history->nof_wraparounds = nof_wraparounds;
+  history->nof_chars_stored -= nof_zucs_removed;
+  invalidate_paragraph_layouts(history, history->nof_chars_stored);
+
+  if (history->search_index != NULL)
+    update_history_index_after_removal(history);
 
   TRACE_LOG("History went to %p.\n", ptr);
 
@@ -1024,6 +1138,9 @@ history_output *init_history_output(OUTPUTHISTORY *h, history_output_target *t,
   result->last_used_metadata_state_background = Z_COLOUR_UNDEFINED;
   result->last_read_paragraph_attribute_index = NULL;
   result->dont_skip_newline = false;
+  result->insert_line_breaks
+    = (output_init_flags & Z_HISTORY_OUTPUT_WITH_LINE_BREAKS) == 0
+    ? false : true;
 
   if ((output_init_flags & Z_HISTORY_OUTPUT_FROM_BUFFERBACK) == 0) {
     TRACE_LOG("Init from buffer front.\n");
@@ -1533,6 +1650,77 @@ bool is_output_at_frontindex(history_output *output) {
 }
 
 
+static void append_repeated_char(history_output *output, z_ucs *output_buf,
+    int *buf_index, z_ucs c)
+{
+  if (*buf_index == REPEAT_PARAGRAPH_BUF_SIZE - 1)
+  {
+    output_buf[*buf_index] = 0;
+    output->target->z_ucs_output(output_buf);
+    *buf_index = 0;
+  }
+
+  output_buf[(*buf_index)++] = c;
+}
+
+
+static void append_repeated_line_break(history_output *output,
+    z_ucs *output_buf, int *buf_index, struct history_layout_line *line)
+{
+  if (line->hyphenated == true)
+    append_repeated_char(output, output_buf, buf_index, Z_UCS_MINUS);
+  append_repeated_char(output, output_buf, buf_index, Z_UCS_NEWLINE);
+}
+
+
+// Appends "c", which is the char at "*text_offset" of the paragraph laid
+// out in "layout", or its terminating newline. Breaks are inserted where
+// the layout's lines start, spaces at a break are dropped.
+static void append_repeated_char_with_line_breaks(history_output *output,
+    z_ucs *output_buf, int *buf_index, z_ucs c,
+    struct history_paragraph_layout *layout, int *next_line,
+    long *text_offset)
+{
+  struct history_layout_line *lines = layout->lines;
+  long offset;
+
+  if (c == Z_UCS_NEWLINE)
+  {
+    // Spaces at the paragraph's end may still start an empty line.
+    while (*next_line < layout->nof_lines)
+      append_repeated_line_break(
+          output, output_buf, buf_index, &lines[(*next_line)++ - 1]);
+  }
+  else
+  {
+    offset = (*text_offset)++;
+
+    if (
+        (*next_line < layout->nof_lines)
+        &&
+        (offset >= lines[*next_line - 1].end)
+        &&
+        (offset < lines[*next_line].start)
+       )
+      return;
+
+    while (
+        (*next_line < layout->nof_lines)
+        &&
+        (offset == lines[*next_line].start)
+        )
+      append_repeated_line_break(
+          output, output_buf, buf_index, &lines[(*next_line)++ - 1]);
+  }
+
+  append_repeated_char(output, output_buf, buf_index, c);
+}
+
+
+// In case "output" has been initialized with
+// Z_HISTORY_OUTPUT_WITH_LINE_BREAKS and the screen size is known,
+// paragraphs are sent broken into lines according to their cached layouts,
+// so the front-end doesn't have to wrap or hyphenate them again.
 int output_repeat_paragraphs(history_output *output, int n,
     bool include_metadata, bool advance_history_pointer)
 {
@@ -1540,11 +1728,24 @@ int output_repeat_paragraphs(history_output *output, int n,
   z_ucs *output_ptr = output->current_paragraph_index;
   int buf_index;
   int metadata_type = -1, parameter, parameter2;
+  struct history_paragraph_layout *layout = NULL;
+  z_ucs *paragraph_start = NULL;
+  int line_width = -1, next_line = 1;
+  long text_offset = 0;
 
   if (output->validation_disabled == false) {
     validate_outputhistory(output);
   }
 
+  if (output->insert_line_breaks == true)
+  {
+    line_width = get_layout_line_width(output->history);
+
+    // Only a rewound output is known to be at a paragraph's start.
+    if (output->first_iteration_done == true)
+      paragraph_start = output_ptr;
+  }
+
   if (include_metadata == true)
     evaluate_metadata_for_paragraph(output);
 
@@ -1662,7 +1863,32 @@ int output_repeat_paragraphs(history_output *output, int n,
       }
 
       if (metadata_type == -1) {
-        output_buf[buf_index++] = *output_ptr;
+        if (line_width < 1) {
+          output_buf[buf_index++] = *output_ptr;
+        }
+        else {
+          if (paragraph_start != NULL) {
+            layout = get_history_paragraph_layout(
+                output->history, paragraph_start, line_width);
+            paragraph_start = NULL;
+            next_line = 1;
+            text_offset = 0;
+          }
+
+          if (layout != NULL)
+            append_repeated_char_with_line_breaks(output, output_buf,
+                &buf_index, *output_ptr, layout, &next_line, &text_offset);
+          else
+            append_repeated_char(output, output_buf, &buf_index, *output_ptr);
+
+          if (*output_ptr == Z_UCS_NEWLINE) {
+            paragraph_start
+              = output_ptr == output->history->z_history_buffer_end
+              ? output->history->z_history_buffer_start
+              : output_ptr + 1;
+            layout = NULL;
+          }
+        }
       }
       else {
         metadata_type = -1;
@@ -1798,6 +2024,17 @@ size_t get_allocated_text_history_size(OUTPUTHISTORY *h)
 }
 
 
+// Returns the number of bytes allocated for the history "h", including
+// the structure itself.
+size_t get_allocated_text_history_size_bytes(OUTPUTHISTORY *h)
+{
+  return sizeof(OUTPUTHISTORY)
+    + (h->z_history_buffer_start != NULL
+        ? (h->z_history_buffer_size + 1) * sizeof(z_ucs)
+        : 0);
+}
+
+
 bool is_history_empty(OUTPUTHISTORY *h) {
   if ( (h == NULL) || (h->z_history_buffer_size == 0) ) {
     return true;
@@ -1808,5 +2045,538 @@ bool is_history_empty(OUTPUTHISTORY *h) {
 }
 
 
+// Returns the position of the char at "ptr" in the stream of all chars
+// stored in the history. Unlike the pointer itself, the position stays the
+// same when the buffer wraps around or is reallocated.
+uint64_t get_history_position(OUTPUTHISTORY *h, z_ucs *ptr)
+{
+  if (ptr < h->z_history_buffer_front_index)
+    return h->nof_chars_stored - (h->z_history_buffer_front_index - ptr);
+  else
+    return h->nof_chars_stored
+      - (h->z_history_buffer_size - (ptr - h->z_history_buffer_front_index));
+}
+
+
+// The inverse of "get_history_position", "position" has to refer to a char
+// which is still stored in the buffer.
+z_ucs *get_history_pointer(OUTPUTHISTORY *h, uint64_t position)
+{
+  z_ucs *result
+    = h->z_history_buffer_front_index - (h->nof_chars_stored - position);
+
+  if (result < h->z_history_buffer_start)
+    result += h->z_history_buffer_size;
+
+  return result;
+}
+
+
+// Copies the text of the paragraph starting at "index" without metadata
+// into "*buf", which is enlarged as required and always has room for two
+// more chars behind the text. Returns the length of the text. "*end" is set
+// to the paragraph's terminating newline, or to NULL in case the paragraph
+// reaches up to the buffer front.
+size_t copy_history_paragraph_text(OUTPUTHISTORY *h, z_ucs *index,
+    z_ucs **buf, size_t *buf_size, z_ucs **end)
+{
+  z_ucs *front = h->z_history_buffer_front_index;
+  z_ucs *next;
+  size_t len = 0;
+  int nof_zucs_to_skip;
+  bool at_front;
+
+  *end = NULL;
+  at_front = ( (index == front) && (h->nof_wraparounds == 0) );
+
+  if (*buf_size < 2)
+  {
+    *buf_size = 256;
+    *buf = fizmo_session_realloc(*buf, sizeof(z_ucs) * *buf_size);
+  }
+
+  while (at_front == false)
+  {
+    if (*index == '\n')
+    {
+      *end = index;
+      break;
+    }
+
+    if (*index == HISTORY_METADATA_ESCAPE)
+    {
+      next = index == h->z_history_buffer_end
+        ? h->z_history_buffer_start : index + 1;
+      nof_zucs_to_skip
+        = ( (*next == HISTORY_METADATA_TYPE_COLOUR)
+            || (*next == HISTORY_METADATA_TYPE_PARAGRAPHATTRIBUTE) )
+        ? 4
+        : 3;
+    }
+    else
+    {
+      if (len + 3 > *buf_size)
+      {
+        *buf_size *= 2;
+        *buf = fizmo_session_realloc(*buf, sizeof(z_ucs) * *buf_size);
+      }
+      (*buf)[len++] = *index;
+      nof_zucs_to_skip = 1;
+    }
+
+    while (nof_zucs_to_skip-- > 0)
+    {
+      index = index == h->z_history_buffer_end
+        ? h->z_history_buffer_start : index + 1;
+      if (index == front)
+      {
+        at_front = true;
+        break;
+      }
+    }
+  }
+
+  return len;
+}
+
+
+static int get_layout_glyph_width(z_ucs c, void *parameter)
+{
+  OUTPUTHISTORY *h = (OUTPUTHISTORY*)parameter;
+
+  return h->layout_glyph_width(c, h->layout_glyph_width_parameter);
+}
+
+
+static void add_layout_line(OUTPUTHISTORY *h, long line_start)
+{
+  struct history_paragraph_layout *layout = h->layout_in_progress;
+  struct history_layout_line *line;
+
+  if (layout->nof_lines == layout->lines_size)
+  {
+    layout->lines_size
+      = layout->lines_size == 0 ? 8 : layout->lines_size * 2;
+    layout->lines = fizmo_session_realloc(
+        layout->lines,
+        sizeof(struct history_layout_line) * layout->lines_size);
+  }
+
+  line = &layout->lines[layout->nof_lines++];
+  line->start = line_start;
+  line->end = line_start;
+  line->hyphenated = false;
+}
+
+
+// The wrapper sends text straight from the input wherever possible, so
+// the line start is simply the position of the line's first span. Only
+// lines starting with text from the wrapper's own buffers fall back to the
+// end of the last span seen in the input.
+static void layout_text_output(z_ucs *text, size_t len, void *parameter)
+{
+  OUTPUTHISTORY *h = (OUTPUTHISTORY*)parameter;
+
+  if ( (text >= h->layout_text)
+      && (text < h->layout_text + h->layout_text_size) )
+  {
+    if (h->layout_line_open == false)
+      add_layout_line(h, text - h->layout_text);
+    h->layout_text_end = text + len - h->layout_text;
+  }
+  else if (h->layout_line_open == false)
+    add_layout_line(h, h->layout_text_end);
+
+  h->layout_line_open = true;
+}
+
+
+static void layout_line_end(bool line_was_wrapped, void *parameter)
+{
+  OUTPUTHISTORY *h = (OUTPUTHISTORY*)parameter;
+
+  (void)line_was_wrapped;
+
+  if (h->layout_line_open == false)
+    add_layout_line(h, h->layout_text_end);
+
+  h->layout_line_open = false;
+}
+
+
+static void wrap_paragraph_with_linewrap(OUTPUTHISTORY *h,
+    struct history_paragraph_layout *layout, int line_width, size_t len)
+{
+  struct history_layout_line *line;
+  int i;
+
+  if (h->layout_wrapper == NULL)
+    h->layout_wrapper = linewrap_new_wrapper(
+        line_width,
+        &get_layout_glyph_width,
+        &layout_text_output,
+        &layout_line_end,
+        h);
+  else
+    linewrap_adjust_line_width(h->layout_wrapper, line_width);
+
+  h->layout_line_open = false;
+  h->layout_text_end = 0;
+
+  linewrap_wrap_z_ucs_view(h->layout_wrapper, z_ucs_view_of(h->layout_text));
+  linewrap_flush_output(h->layout_wrapper);
+
+  if (layout->nof_lines == 0)
+    add_layout_line(h, 0);
+
+  // Lines end where the next one starts, minus the spaces dropped at the
+  // break.
+  for (i=0; i<layout->nof_lines; i++)
+  {
+    line = &layout->lines[i];
+    line->end
+      = i + 1 < layout->nof_lines
+      ? layout->lines[i + 1].start
+      : (long)len - 1;
+
+    while ( (line->end > line->start)
+        && (h->layout_text[line->end - 1] == Z_UCS_SPACE) )
+      line->end--;
+  }
+}
+
+
+static void layout_wordwrap_output(z_ucs *output, void *parameter)
+{
+  OUTPUTHISTORY *h = (OUTPUTHISTORY*)parameter;
+  size_t len = z_ucs_len(output);
+
+  if (h->layout_output_len + len > h->layout_output_size)
+  {
+    h->layout_output_size = h->layout_output_len + len + 256;
+    h->layout_output = fizmo_session_realloc(
+        h->layout_output, sizeof(z_ucs) * h->layout_output_size);
+  }
+
+  memcpy(h->layout_output + h->layout_output_len, output,
+      sizeof(z_ucs) * len);
+  h->layout_output_len += len;
+}
+
+
+static bool is_verbatim_layout_line(z_ucs *text, size_t len, long start,
+    z_ucs *line, size_t line_len)
+{
+  return
+    ((size_t)start + line_len < len)
+    &&
+    (memcmp(line, text + start, sizeof(z_ucs) * line_len) == 0)
+    ? true
+    : false;
+}
+
+
+static bool is_hyphenated_layout_line(z_ucs *text, size_t len, long start,
+    z_ucs *line, size_t line_len)
+{
+  return
+    (line_len > 1)
+    &&
+    (line[line_len - 1] == Z_UCS_MINUS)
+    &&
+    (is_verbatim_layout_line(text, len, start, line, line_len - 1) == true)
+    ? true
+    : false;
+}
+
+
+// The WORDWRAP sends the paragraph's text with newlines inserted at the
+// breaks. Spaces at a break are dropped -- though not always all of
+// several ones --, while a hyphen replaces the char at a hyphenated break,
+// which is repeated at the start of the next line. So every output line
+// is either a verbatim part of the text, or -- for hyphenated breaks --
+// such a part followed by a hyphen.
+//
+// Where the WORDWRAP breaks depends on the size its input buffer has grown
+// to, so a new one is used for every paragraph, as for a front-end which
+// has just started or been resized.
+static void wrap_paragraph_with_wordwrap(OUTPUTHISTORY *h,
+    struct history_paragraph_layout *layout, int line_width, size_t len)
+{
+  z_ucs *text = h->layout_text;
+  z_ucs *line = h->layout_output, *line_end, *output_end;
+  struct history_layout_line *layout_line;
+  long position = 0, start;
+  size_t line_len;
+  WORDWRAP *wrapper;
+
+  wrapper = wordwrap_new_wrapper(
+      line_width,
+      &layout_wordwrap_output,
+      h,
+      true,
+      0,
+      false,
+      h->layout_hyphenation_enabled);
+
+  h->layout_output_len = 0;
+  wordwrap_wrap_z_ucs(wrapper, text);
+  wordwrap_flush_output(wrapper);
+  wordwrap_destroy_wrapper(wrapper);
+
+  line = h->layout_output;
+  output_end = h->layout_output + h->layout_output_len;
+
+  while (line < output_end)
+  {
+    line_end = line;
+    while ( (line_end < output_end) && (*line_end != Z_UCS_NEWLINE) )
+      line_end++;
+    line_len = line_end - line;
+
+    // Not all of several spaces at a break are dropped, so the line starts
+    // after as many of them as are required to match the text.
+    start = position;
+    while (
+        (is_verbatim_layout_line(text, len, start, line, line_len) == false)
+        &&
+        (is_hyphenated_layout_line(text, len, start, line, line_len)
+         == false)
+        &&
+        (text[start] == Z_UCS_SPACE)
+        )
+      start++;
+
+    add_layout_line(h, start);
+    layout_line = &layout->lines[layout->nof_lines - 1];
+
+    if (is_verbatim_layout_line(text, len, start, line, line_len) == true)
+    {
+      position = start + line_len;
+      layout_line->end = position;
+
+      // The paragraph's own newline ends the last line.
+      if ((size_t)position == len - 1)
+        break;
+    }
+    else
+    {
+      position = start + (line_len > 0 ? line_len - 1 : 0);
+      layout_line->end = position;
+      layout_line->hyphenated = true;
+    }
+
+    line = line_end + 1;
+  }
+
+  if (layout->nof_lines == 0)
+    add_layout_line(h, 0);
+}
+
+
+static void compute_paragraph_layout(OUTPUTHISTORY *h, z_ucs *index,
+    struct history_paragraph_layout *layout, int line_width)
+{
+  z_ucs *end;
+  size_t len;
+
+  len = copy_history_paragraph_text(
+      h, index, &h->layout_text, &h->layout_text_size, &end);
+  layout->newline_terminated = end != NULL ? true : false;
+
+  // Terminating the text with a newline makes the wrappers place the last
+  // word.
+  h->layout_text[len++] = '\n';
+  h->layout_text[len] = 0;
+
+  layout->nof_lines = 0;
+  h->layout_in_progress = layout;
+
+  if (h->layout_glyph_width != NULL)
+    wrap_paragraph_with_linewrap(h, layout, line_width, len);
+  else
+    wrap_paragraph_with_wordwrap(h, layout, line_width, len);
+
+  h->layout_in_progress = NULL;
+
+  layout->line_width = line_width;
+  layout->generation = h->layout_generation;
+  layout->paragraph_end
+    = end != NULL
+    ? get_history_position(h, end)
+    : h->nof_chars_stored;
+}
+
+
+// Sets how paragraphs are laid out: "margin" units of the screen width are
+// not available for text, hyphenation is used as the front-end's WORDWRAP
+// does. In case "glyph_width" is not NULL, paragraphs are wrapped through
+// a LINEWRAP using it to measure glyphs instead, which never hyphenates.
+void set_history_layout_metrics(OUTPUTHISTORY *h, int margin,
+    bool enable_hyphenation, int (*glyph_width)(z_ucs c, void *parameter),
+    void *parameter)
+{
+  h->layout_glyph_width = glyph_width;
+  h->layout_glyph_width_parameter = parameter;
+
+  h->layout_margin = margin;
+
+  if (h->layout_wrapper != NULL)
+    linewrap_set_glyph_width_function(
+        h->layout_wrapper,
+        glyph_width != NULL ? &get_layout_glyph_width : NULL);
+
+  h->layout_hyphenation_enabled = enable_hyphenation;
+
+  h->layout_generation++;
+}
+
+
+// Invoked with the new screen size by "fizmo_new_screen_size". Outputs
+// initialized with Z_HISTORY_OUTPUT_WITH_LINE_BREAKS repeat paragraphs
+// broken into lines for this width minus the margin. In case layouts are
+// in use, the paragraphs filling the screen from the bottom are laid out
+// right away, all others only once they're rewound to or repeated.
+void set_history_screen_size(OUTPUTHISTORY *h, int width, int height)
+{
+  history_output *output;
+
+  h->layout_screen_width = width;
+
+  TRACE_LOG("History screen width is now %d.\n", width);
+
+  if (
+      (h->layout_cache == NULL)
+      ||
+      (get_layout_line_width(h) < 1)
+      ||
+      ((output = init_history_output(h, NULL, 0)) == NULL)
+     )
+    return;
+
+  output_rewind_lines(output, get_layout_line_width(h), height, NULL);
+  destroy_history_output(output);
+}
+
+
+// Returns the position of the paragraph "output" has last been rewound to,
+// which can be compared to the results of "search_history".
+uint64_t get_rewound_paragraph_position(history_output *output)
+{
+  return get_history_position(
+      output->history, output->current_paragraph_index);
+}
+
+
+// Returns the line breaks of the paragraph starting at "index" for
+// "line_width" units. Layouts are cached per paragraph and width, so only
+// paragraphs which have not been displayed at this width before have to be
+// wrapped again. The result remains valid until the next call for the same
+// history.
+struct history_paragraph_layout *get_history_paragraph_layout(
+    OUTPUTHISTORY *h, z_ucs *index, int line_width)
+{
+  struct history_paragraph_layout *layout;
+  uint64_t position;
+  int i;
+
+  if ( (line_width < 1) || (is_history_empty(h) == true) )
+    return NULL;
+
+  if (h->layout_cache == NULL)
+  {
+    h->layout_cache = fizmo_session_malloc(
+        sizeof(struct history_paragraph_layout) * HISTORY_LAYOUT_CACHE_SIZE);
+
+    for (i=0; i<HISTORY_LAYOUT_CACHE_SIZE; i++)
+    {
+      h->layout_cache[i].line_width = -1;
+      h->layout_cache[i].lines_size = 0;
+      h->layout_cache[i].lines = NULL;
+    }
+  }
+
+  position = get_history_position(h, index);
+  layout = &h->layout_cache[
+    (position * 31 + line_width) & (HISTORY_LAYOUT_CACHE_SIZE - 1)];
+
+  // The last paragraph may still grow, so its layout is only reused in
+  // case nothing has been stored since.
+  if ( (layout->line_width == line_width)
+      && (layout->paragraph_position == position)
+      && (layout->generation == h->layout_generation)
+      && ( (layout->newline_terminated == true)
+        || (layout->paragraph_end == h->nof_chars_stored) ) )
+  {
+    TRACE_LOG("Using cached layout for paragraph at %ld.\n", (long)position);
+    return layout;
+  }
+
+  TRACE_LOG("Computing layout for paragraph at %ld, width %d.\n",
+      (long)position, line_width);
+
+  layout->paragraph_position = position;
+  compute_paragraph_layout(h, index, layout, line_width);
+
+  return layout;
+}
+
+
+// Returns the line breaks of the paragraph "output" has last been rewound
+// to, see "get_history_paragraph_layout".
+struct history_paragraph_layout *get_rewound_paragraph_layout(
+    history_output *output, int line_width)
+{
+  if (output->validation_disabled == false) {
+    validate_outputhistory(output);
+  }
+
+  if (output->first_iteration_done == false)
+    return NULL;
+
+  return get_history_paragraph_layout(
+      output->history, output->current_paragraph_index, line_width);
+}
+
+
+// Rewinds "output" by as many paragraphs as are required to fill
+// "nof_lines" lines of "line_width" units, so that after a resize only
+// the paragraphs which become visible have to be wrapped for the new
+// width. Front-ends may add a few lines to prepare for scrolling. Returns
+// the number of paragraphs rewound or a negative value on error. In case
+// "lines_above" is not NULL, the number of lines of the topmost paragraph
+// which don't fit any more is stored there.
+int output_rewind_lines(history_output *output, int line_width,
+    int nof_lines, int *lines_above)
+{
+  struct history_paragraph_layout *layout;
+  int nof_paragraphs = 0, nof_lines_found = 0, return_code;
+
+  while (nof_lines_found < nof_lines)
+  {
+    if ((return_code = output_rewind_paragraph(output, NULL, NULL, NULL))
+        != 0)
+    {
+      if (return_code < 0)
+        return return_code;
+      break;
+    }
+
+    nof_paragraphs++;
+
+    if ((layout = get_rewound_paragraph_layout(output, line_width)) == NULL)
+      return -1;
+
+    nof_lines_found += layout->nof_lines;
+  }
+
+  if (lines_above != NULL)
+    *lines_above
+      = nof_lines_found > nof_lines ? nof_lines_found - nof_lines : 0;
+
+  return nof_paragraphs;
+}
+
+
 #endif /* history_c_INCLUDED */
 
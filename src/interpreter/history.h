@@ -36,6 +36,7 @@
 #include "../tools/tracelog.h"
 #include "../tools/types.h"
 #include "../tools/z_ucs.h"
+#include "linewrap.h"
 
 #define HISTORY_METADATA_ESCAPE 0
 
@@ -46,6 +47,8 @@
 
 #define HISTORY_METADATA_DATA_OFFSET 13
 
+#define OUTPUTHISTORY_NUMBER_OF_WINDOWS 9
+
 #define Z_HISTORY_INCREMENT_SIZE 8*1024 // given in units of z_ucs
 #define Z_HISTORY_MAXIMUM_SIZE 128*1024*1024 // given in units of z_ucs
 #define Z_HISTORY_METADATA_STATE_BLOCK_SIZE 16*1024 // given in units of z_ucs
@@ -53,6 +56,42 @@
 #define Z_HISTORY_OUTPUT_WITHOUT_EXTRAS 0
 #define Z_HISTORY_OUTPUT_FROM_BUFFERBACK 1
 #define Z_HISTORY_OUTPUT_WITHOUT_VALIDATION 2
+#define Z_HISTORY_OUTPUT_WITH_LINE_BREAKS 4
+
+#define HISTORY_LAYOUT_CACHE_SIZE 1024 // must be a power of two
+
+
+struct history_index;
+
+
+// A single line of a paragraph layout. "start" is the offset of the line's
+// first char, "end" the offset behind its last one, both counted in
+// non-metadata chars from the start of the paragraph. Spaces between "end"
+// and the next line's start are dropped at the line break. In case
+// "hyphenated" is true, a hyphen is displayed behind "end".
+struct history_layout_line
+{
+  long start;
+  long end;
+  bool hyphenated;
+};
+
+
+// Line breaks of a single paragraph for a given line width. Paragraphs are
+// identified by their position in the stream of all z_ucs chars ever stored
+// in the history, which remains stable while the buffer wraps around or is
+// reallocated.
+struct history_paragraph_layout
+{
+  uint64_t paragraph_position;
+  uint64_t paragraph_end;
+  unsigned int generation;
+  int line_width;
+  bool newline_terminated;
+  int nof_lines;
+  int lines_size;
+  struct history_layout_line *lines;
+};
 
 
 typedef struct
@@ -93,6 +132,34 @@ typedef struct
   z_style history_buffer_front_index_style;
   z_colour history_buffer_front_index_foreground;
   z_colour history_buffer_front_index_background;
+
+  // Number of z_ucs chars stored since the history was created, minus the
+  // ones removed again. Used to identify paragraphs for the layout cache.
+  uint64_t nof_chars_stored;
+
+  // Paragraph layouts, allocated on first use. Increasing "layout_generation"
+  // invalidates all entries. Paragraphs are wrapped like the front-end
+  // does: Through a WORDWRAP in case every char is one unit wide, through
+  // a LINEWRAP in case there's a glyph-width function.
+  struct history_paragraph_layout *layout_cache;
+  unsigned int layout_generation;
+  int layout_screen_width;
+  int layout_margin;
+  bool layout_hyphenation_enabled;
+  LINEWRAP *layout_wrapper;
+  int (*layout_glyph_width)(z_ucs c, void *parameter);
+  void *layout_glyph_width_parameter;
+  z_ucs *layout_text;
+  size_t layout_text_size;
+  z_ucs *layout_output;
+  size_t layout_output_size;
+  size_t layout_output_len;
+  struct history_paragraph_layout *layout_in_progress;
+  bool layout_line_open;
+  long layout_text_end;
+
+  // Trigram index for full-text search, NULL unless enabled.
+  struct history_index *search_index;
 } OUTPUTHISTORY;
 
 typedef struct
@@ -122,6 +189,7 @@ typedef struct
   bool first_iteration_done;
   bool validation_disabled;
   bool dont_skip_newline;
+  bool insert_line_breaks;
 
   bool metadata_at_index_evaluated;
   z_font font_at_index;
@@ -172,6 +240,7 @@ OUTPUTHISTORY *create_outputhistory(int window_number,
 void destroy_outputhistory(OUTPUTHISTORY *history);
 void store_z_ucs_output_in_history(OUTPUTHISTORY *history,
     z_ucs *z_ucs_output);
+void store_z_ucs_view_in_history(OUTPUTHISTORY *history, z_ucs_view output);
 int store_metadata_in_history(OUTPUTHISTORY *history, int metadata_type, ...);
 void store_data_in_history(OUTPUTHISTORY *h, z_ucs *data, size_t len,
     bool evaluate_state_block);
@@ -191,8 +260,24 @@ void destroy_history_output(history_output *output);
 void remember_history_output_position(history_output *output);
 void restore_history_output_position(history_output *output);
 size_t get_allocated_text_history_size(OUTPUTHISTORY *h);
+size_t get_allocated_text_history_size_bytes(OUTPUTHISTORY *h);
 bool is_output_at_frontindex(history_output *output);
 bool is_history_empty(OUTPUTHISTORY *h);
+uint64_t get_history_position(OUTPUTHISTORY *h, z_ucs *ptr);
+z_ucs *get_history_pointer(OUTPUTHISTORY *h, uint64_t position);
+size_t copy_history_paragraph_text(OUTPUTHISTORY *h, z_ucs *index,
+    z_ucs **buf, size_t *buf_size, z_ucs **end);
+uint64_t get_rewound_paragraph_position(history_output *output);
+void set_history_layout_metrics(OUTPUTHISTORY *h, int margin,
+    bool enable_hyphenation, int (*glyph_width)(z_ucs c, void *parameter),
+    void *parameter);
+void set_history_screen_size(OUTPUTHISTORY *h, int width, int height);
+struct history_paragraph_layout *get_history_paragraph_layout(
+    OUTPUTHISTORY *h, z_ucs *index, int line_width);
+struct history_paragraph_layout *get_rewound_paragraph_layout(
+    history_output *output, int line_width);
+int output_rewind_lines(history_output *output, int line_width,
+    int nof_lines, int *lines_above);
 
 #endif /* history_h_INCLUDED */
 
@@ -47,12 +47,15 @@
 #include "config.h"
 #include "fizmo.h"
 #include "hyphenation.h"
+#include "turnstat.h"
+#include "memstat.h"
 
 
 static z_ucs *last_pattern_locale = NULL;
 static z_ucs *pattern_data;
 static z_ucs **patterns;
 static int nof_patterns = 0;
+static size_t allocated_pattern_memory = 0;
 static z_ucs *search_path = NULL;
 //static z_ucs *subword_buffer = NULL;
 //static int subword_buffer_size = 0;
@@ -64,11 +67,11 @@ extern char default_search_path[];
 
 
 
-static z_ucs input_char(z_file *in)
+static z_ucs input_char(char **src, char *end)
 {
   z_ucs input;
 
-  if ((input = parse_utf8_char_from_file(in)) == UEOF)
+  if ((input = parse_utf8_char_from_buffer(src, end)) == UEOF)
   {
     TRACE_LOG("Premature end of file.\n");
     i18n_translate_and_exit(
@@ -170,7 +173,8 @@ static int load_patterns()
   size_t nof_zucs_chars;
   z_ucs *linestart;
   z_ucs input;
-  int in_char;
+  char *file_data, *file_end, *src;
+  size_t file_length;
   z_ucs *data;
   size_t nof_comments;
 #ifdef ENABLE_TRACING
@@ -272,11 +276,24 @@ static int load_patterns()
     // we're storing pattern indexes while reading and a realloc might
     // invalidate these.
 
+    // The whole file is mapped at once so that both passes can work on
+    // memory instead of reading each byte through the filesys interface.
+    if ((file_data = fsi_map_file(patternfile, &file_length)) == NULL)
+    {
+      // exit-point:
+      TRACE_LOG("fsi_map_file() returned NULL.\n");
+      fsi->closefile(patternfile);
+      return -6;
+    }
+    fsi->closefile(patternfile);
+    file_end = file_data + file_length;
+
     nof_zucs_chars = 0;
+    src = file_data;
     for(;;)
     {
       // Parse line.
-      input = parse_utf8_char_from_file(patternfile);
+      input = parse_utf8_char_from_buffer(&src, file_end);
       if (input == UEOF)
         break;
 
@@ -284,29 +301,21 @@ static int load_patterns()
       {
         do
         {
-          input = parse_utf8_char_from_file(patternfile);
+          input = parse_utf8_char_from_buffer(&src, file_end);
         }
-        while (input != Z_UCS_NEWLINE);
+        while ( (input != Z_UCS_NEWLINE) && (input != UEOF) );
       }
       else
       {
         nof_zucs_chars++;
-        while (input != Z_UCS_NEWLINE)
+        while ( (input != Z_UCS_NEWLINE) && (input != UEOF) )
         {
           nof_zucs_chars++;
-          input = parse_utf8_char_from_file(patternfile);
+          input = parse_utf8_char_from_buffer(&src, file_end);
         }
       }
     }
 
-    if (fsi->setfilepos(patternfile, 0, SEEK_SET) == -1)
-    {
-      // exit-point:
-      TRACE_LOG("setfilepos() returned -1.\n");
-      fsi->closefile(patternfile);
-      return -6;
-    }
-
     TRACE_LOG("Allocating space for %ld z_ucs chars.\n", nof_zucs_chars);
 
     // open-resource:
@@ -314,7 +323,7 @@ static int load_patterns()
     {
       // exit-point:
       TRACE_LOG("malloc(%ld) returned NULL.\n", nof_zucs_chars * sizeof(z_ucs));
-      fsi->closefile(patternfile);
+      fsi_unmap_file(file_data, file_length);
       return -7;
     }
     pattern_data = data;
@@ -323,15 +332,15 @@ static int load_patterns()
     lines = create_list();
     //printf("new list created: %p\n", lines);
 
-    in_char = fsi->readchar(patternfile);
-    while (in_char != EOF)
+    src = file_data;
+    while (src < file_end)
     {
-      if (in_char == '%')
+      if (*src == '%')
       {
         TRACE_LOG("Start comment.\n");
         do
         {
-          input = input_char(patternfile);
+          input = input_char(&src, file_end);
         }
         while (input != Z_UCS_NEWLINE);
         nof_comments++;
@@ -339,14 +348,12 @@ static int load_patterns()
       else
       {
         // Found a new line.
-        fsi->unreadchar(in_char, patternfile);
-
         linestart = data;
 
         TRACE_LOG("Start pattern.\n");
         for (;;)
         {
-          input = input_char(patternfile);
+          input = input_char(&src, file_end);
 
           if (input == Z_UCS_NEWLINE)
           {
@@ -364,12 +371,13 @@ static int load_patterns()
 
         //messages_processed++;
       }
-
-      in_char = fsi->readchar(patternfile);
     }
-    fsi->closefile(patternfile);
+    fsi_unmap_file(file_data, file_length);
     nof_patterns = get_list_size(lines);
     patterns = (z_ucs**)delete_list_and_get_ptrs(lines);
+    allocated_pattern_memory
+      = nof_zucs_chars * sizeof(z_ucs) + nof_patterns * sizeof(z_ucs*);
+    update_subsystem_memory_stats(MEMORY_STATS_HYPHENATION);
     TRACE_LOG("Read %d patterns, %ld comments.\n", nof_patterns, nof_comments);
 
     sort_patterndata(0, nof_patterns - 1);
@@ -434,6 +442,21 @@ static z_ucs *get_pattern(z_ucs *subword)
 }
 
 
+// Patterns are loaded on first use, this allows loading them in advance.
+// Returns 0 if the patterns for the current locale are available.
+int preload_hyphenation_patterns(void)
+{
+  if (
+      (last_pattern_locale == NULL)
+      ||
+      (z_ucs_cmp(last_pattern_locale, get_current_locale_name()) != 0)
+     )
+    return load_patterns() < 0 ? -1 : 0;
+
+  return 0;
+}
+
+
 z_ucs *hyphenate(z_ucs *word_to_hyphenate)
 {
   int i, j, k, l, start_offset, end_offset;
@@ -453,19 +476,13 @@ z_ucs *hyphenate(z_ucs *word_to_hyphenate)
     return NULL;
   }
 
-  if (
-      (last_pattern_locale == NULL)
-      ||
-      (z_ucs_cmp(last_pattern_locale, get_current_locale_name()) != 0)
-     )
+  if (preload_hyphenation_patterns() < 0)
   {
-    if (load_patterns() < 0)
-    {
-      TRACE_LOG("Couldn't load patterns.\n");
-      return NULL;
-    }
+    TRACE_LOG("Couldn't load patterns.\n");
+    return NULL;
   }
 
+  turn_statistics_count_allocation();
   if ((result_buf = malloc(
           sizeof(z_ucs) * (word_to_hyphenate_len * 2 + 1))) == NULL)
     return NULL;
@@ -476,6 +493,7 @@ z_ucs *hyphenate(z_ucs *word_to_hyphenate)
     return result_buf;
   }
 
+  turn_statistics_count_allocation();
   if ((word_buf = malloc(
           sizeof(z_ucs) * (word_to_hyphenate_len + 3))) == NULL)
   {
@@ -589,8 +607,17 @@ z_ucs *hyphenate(z_ucs *word_to_hyphenate)
 }
 
 
+size_t get_hyphenation_memory_size(void)
+{
+  return allocated_pattern_memory;
+}
+
+
 void free_hyphenation_memory(void)
 {
+  allocated_pattern_memory = 0;
+  update_subsystem_memory_stats(MEMORY_STATS_HYPHENATION);
+
   if (last_pattern_locale != NULL)
   {
     free(last_pattern_locale);
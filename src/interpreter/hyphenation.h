@@ -34,6 +34,8 @@
 #define hyphenation_h_INCLUDED
 
 z_ucs *hyphenate(z_ucs *word_to_hyphenate);
+int preload_hyphenation_patterns(void);
+size_t get_hyphenation_memory_size(void);
 void free_hyphenation_memory(void);
 
 #endif /* hyphenation_h_INCLUDED */
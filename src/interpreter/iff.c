@@ -58,17 +58,9 @@ static int last_chunk_length;
 
 static int read_four_chars(z_file *iff_file)
 {
-  int data;
-  int i;
-
   four_chars[4] = '\0';
-  for (i=0; i<4; i++)
-  {
-    data = fsi->readchar(iff_file);
-    if (data == EOF)
-      return -1;
-    four_chars[i] = (char)data;
-  }
+  if (fsi->readchars(four_chars, 4, iff_file) != 4)
+    return -1;
 
   return 0;
 }
@@ -179,10 +171,12 @@ int read_chunk_length(z_file *iff_file)
 
 int start_new_chunk(char *id, z_file *iff_file)
 {
-  if (fsi->writechars(id, 4, iff_file) != 4)
-    return -1;
+  struct z_iovec chunk_header[2] = {
+    { id, 4 },
+    { "\0\0\0\0", 4 }
+  };
 
-  if (fsi->writechars("\0\0\0\0", 4, iff_file) != 4)
+  if (fsi_writev(chunk_header, 2, iff_file) != 8)
     return -1;
 
   if ((current_chunk_offset = fsi->getfilepos(iff_file)) == -1)
@@ -194,16 +188,14 @@ int start_new_chunk(char *id, z_file *iff_file)
 
 int write_four_byte_number(uint32_t number, z_file *iff_file)
 {
-  if (fsi->writechar((int)(number >> 24), iff_file) == EOF)
-    return -1;
+  uint8_t data[4];
 
-  if (fsi->writechar((int)(number >> 16), iff_file) == EOF)
-    return -1;
+  data[0] = (uint8_t)(number >> 24);
+  data[1] = (uint8_t)(number >> 16);
+  data[2] = (uint8_t)(number >>  8);
+  data[3] = (uint8_t)(number      );
 
-  if (fsi->writechar((int)(number >>  8), iff_file) == EOF)
-    return -1;
-
-  if (fsi->writechar((int)(number      ), iff_file) == EOF)
+  if (fsi->writechars(data, 4, iff_file) != 4)
     return -1;
 
   return 0;
@@ -336,23 +328,16 @@ int find_chunk(char *id, z_file *iff_file)
 
 uint32_t read_four_byte_number(z_file *iff_file)
 {
-  int data;
-  int i;
-  uint32_t result = 0;
+  uint8_t data[4];
 
-  for (i=0; i<4; i++)
+  if (fsi->readchars(data, 4, iff_file) != 4)
   {
-    data = fsi->readchar(iff_file);
-    if (data == EOF)
-    {
-      (void)fsi->closefile(iff_file);
-      return -1;
-    }
-    result |= ((uint8_t)data)
-      << /*@-shiftnegative@*/ 8*(3-i) /*@-shiftnegative@*/ ;
+    (void)fsi->closefile(iff_file);
+    return -1;
   }
 
-  return result;
+  return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16)
+    | ((uint32_t)data[2] << 8) | (uint32_t)data[3];
 }
 
 
@@ -0,0 +1,637 @@
+
+/* linewrap.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// A word wrapper for front-ends which measure text in units of their own,
+// for example pixels for proportional fonts or two cells for wide East
+// Asian characters. In contrast to the wordwrapper, text is scanned only
+// once: Whenever a word is complete it is placed on the current line or
+// the next one, and the words on a line are passed on as a single span
+// straight from the caller's buffer. Only spaces and the start of a word
+// which continues in the next call are kept back. Lines are broken at
+// spaces and behind dashes, words longer than a line are broken at the
+// line end. There's no hyphenation.
+//
+// Widths are queried from the "glyph_width" function when the text is
+// received and cached, so a front-end changing fonts (and thus widths)
+// together with the text style should set the function or invalidate the
+// cache by calling "linewrap_set_glyph_width_function" at the same point
+// it inserts the style's metadata. Without a width function every
+// character is one unit wide.
+
+#ifndef linewrap_c_INCLUDED
+#define linewrap_c_INCLUDED
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
+
+#include "../tools/tracelog.h"
+#include "../tools/types.h"
+#include "../tools/z_ucs.h"
+#include "linewrap.h"
+#include "fizmo.h"
+#include "memstat.h"
+
+#define LINEWRAP_PENDING_WORD_INCREMENT 64
+#define LINEWRAP_METADATA_INCREMENT 32
+
+static z_ucs spaces[] = {
+  Z_UCS_SPACE, Z_UCS_SPACE, Z_UCS_SPACE, Z_UCS_SPACE,
+  Z_UCS_SPACE, Z_UCS_SPACE, Z_UCS_SPACE, Z_UCS_SPACE,
+  Z_UCS_SPACE, Z_UCS_SPACE, Z_UCS_SPACE, Z_UCS_SPACE,
+  Z_UCS_SPACE, Z_UCS_SPACE, Z_UCS_SPACE, Z_UCS_SPACE };
+
+// Sum of all wrappers' memory, including the ones created by interfaces.
+static size_t allocated_linewrap_memory = 0;
+
+
+static void reset_width_cache(LINEWRAP *wrapper)
+{
+  int i;
+
+  for (i=0; i<LINEWRAP_WIDTH_CACHE_SIZE; i++)
+    wrapper->width_cache[i] = -1;
+
+  // Zero never makes it into the wide cache, so it marks empty entries.
+  for (i=0; i<LINEWRAP_WIDE_CACHE_SIZE; i++)
+    wrapper->wide_cache_chars[i] = 0;
+}
+
+
+LINEWRAP *linewrap_new_wrapper(int line_width,
+    int (*glyph_width)(z_ucs c, void *parameter),
+    void (*text_output)(z_ucs *text, size_t len, void *parameter),
+    void (*line_end)(bool line_was_wrapped, void *parameter),
+    void *destination_parameter)
+{
+  LINEWRAP *result = fizmo_malloc(sizeof(LINEWRAP));
+
+  result->line_width = line_width;
+  result->glyph_width = glyph_width;
+  result->text_output = text_output;
+  result->line_end = line_end;
+  result->destination_parameter = destination_parameter;
+  reset_width_cache(result);
+  result->line_position = 0;
+  result->line_was_wrapped = false;
+  result->span = NULL;
+  result->span_len = 0;
+  result->pending_spaces = 0;
+  result->pending_spaces_in_input = 0;
+  result->pending_word = NULL;
+  result->pending_word_len = 0;
+  result->pending_word_size = 0;
+  result->pending_word_width = 0;
+  result->metadata = NULL;
+  result->metadata_size = 0;
+  result->metadata_index = 0;
+  result->metadata_offset = 0;
+
+  allocated_linewrap_memory += sizeof(LINEWRAP);
+  update_subsystem_memory_stats(MEMORY_STATS_WORDWRAP);
+
+  return result;
+}
+
+
+void linewrap_destroy_wrapper(LINEWRAP *wrapper_to_destroy)
+{
+  allocated_linewrap_memory
+    -= sizeof(LINEWRAP)
+    + wrapper_to_destroy->pending_word_size * sizeof(z_ucs)
+    + wrapper_to_destroy->metadata_size * sizeof(struct linewrap_metadata);
+
+  if (wrapper_to_destroy->pending_word != NULL)
+    free(wrapper_to_destroy->pending_word);
+  if (wrapper_to_destroy->metadata != NULL)
+    free(wrapper_to_destroy->metadata);
+  free(wrapper_to_destroy);
+
+  update_subsystem_memory_stats(MEMORY_STATS_WORDWRAP);
+}
+
+
+size_t linewrap_get_total_allocated_memory_size(void)
+{
+  return allocated_linewrap_memory;
+}
+
+
+static int get_glyph_width(LINEWRAP *wrapper, z_ucs c)
+{
+  int index;
+
+  if (c < LINEWRAP_WIDTH_CACHE_SIZE)
+  {
+    if (wrapper->width_cache[c] < 0)
+      wrapper->width_cache[c]
+        = wrapper->glyph_width(c, wrapper->destination_parameter);
+    return wrapper->width_cache[c];
+  }
+
+  index = c % LINEWRAP_WIDE_CACHE_SIZE;
+  if (wrapper->wide_cache_chars[index] != c)
+  {
+    wrapper->wide_cache_chars[index] = c;
+    wrapper->wide_cache_widths[index]
+      = wrapper->glyph_width(c, wrapper->destination_parameter);
+  }
+  return wrapper->wide_cache_widths[index];
+}
+
+
+static int get_text_width(LINEWRAP *wrapper, z_ucs *text, size_t len)
+{
+  int width = 0;
+
+  if (wrapper->glyph_width == NULL)
+    return (int)len;
+
+  while (len-- > 0)
+    width += get_glyph_width(wrapper, *(text++));
+
+  return width;
+}
+
+
+// Returns the first space, newline or dash in "text", or "end" in case
+// there's none.
+#ifdef __SSE2__
+static z_ucs *find_break(z_ucs *text, z_ucs *end)
+{
+  __m128i space = _mm_set1_epi32(Z_UCS_SPACE);
+  __m128i newline = _mm_set1_epi32(Z_UCS_NEWLINE);
+  __m128i minus = _mm_set1_epi32(Z_UCS_MINUS);
+  __m128i block;
+  int mask;
+
+  while (end - text >= 4)
+  {
+    block = _mm_loadu_si128((__m128i*)text);
+
+    if ((mask = _mm_movemask_epi8(_mm_or_si128(
+              _mm_or_si128(
+                _mm_cmpeq_epi32(block, space),
+                _mm_cmpeq_epi32(block, newline)),
+              _mm_cmpeq_epi32(block, minus)))) != 0)
+#ifdef __GNUC__
+      // Four mask bits per character.
+      return text + (__builtin_ctz(mask) >> 2);
+#else
+      break;
+#endif // __GNUC__
+
+    text += 4;
+  }
+
+  while ( (text < end) && (*text != Z_UCS_SPACE)
+      && (*text != Z_UCS_NEWLINE) && (*text != Z_UCS_MINUS) )
+    text++;
+
+  return text;
+}
+#else
+static z_ucs *find_break(z_ucs *text, z_ucs *end)
+{
+  while ( (text < end) && (*text != Z_UCS_SPACE)
+      && (*text != Z_UCS_NEWLINE) && (*text != Z_UCS_MINUS) )
+    text++;
+
+  return text;
+}
+#endif // __SSE2__
+
+
+static void flush_span(LINEWRAP *wrapper)
+{
+  if (wrapper->span_len > 0)
+  {
+    wrapper->text_output(
+        wrapper->span, wrapper->span_len, wrapper->destination_parameter);
+    wrapper->span_len = 0;
+  }
+}
+
+
+static void output_span(LINEWRAP *wrapper, z_ucs *text, size_t len)
+{
+  if (len == 0)
+    return;
+
+  if (
+      (wrapper->span_len > 0)
+      &&
+      (wrapper->span + wrapper->span_len == text)
+     )
+    wrapper->span_len += len;
+  else
+  {
+    flush_span(wrapper);
+    wrapper->span = text;
+    wrapper->span_len = len;
+  }
+}
+
+
+// Executes all metadata up to and including "pending_index".
+static void output_metadata(LINEWRAP *wrapper, size_t pending_index)
+{
+  struct linewrap_metadata *metadata_entry;
+
+  if (
+      (wrapper->metadata_offset < wrapper->metadata_index)
+      &&
+      (wrapper->metadata[wrapper->metadata_offset].pending_index
+       <= pending_index)
+     )
+    flush_span(wrapper);
+
+  while (
+      (wrapper->metadata_offset < wrapper->metadata_index)
+      &&
+      (wrapper->metadata[wrapper->metadata_offset].pending_index
+       <= pending_index)
+      )
+  {
+    metadata_entry = &wrapper->metadata[wrapper->metadata_offset];
+
+    TRACE_LOG("Output metadata prm %d at %ld.\n",
+        metadata_entry->int_parameter, (long)pending_index);
+
+    metadata_entry->metadata_output_function(
+        metadata_entry->ptr_parameter,
+        metadata_entry->int_parameter);
+
+    wrapper->metadata_offset++;
+  }
+}
+
+
+static void end_line(LINEWRAP *wrapper, bool line_was_wrapped)
+{
+  flush_span(wrapper);
+  wrapper->line_end(line_was_wrapped, wrapper->destination_parameter);
+  wrapper->line_position = 0;
+  wrapper->line_was_wrapped = line_was_wrapped;
+}
+
+
+// Outputs text which has already been placed. "pending_index" is the
+// text's position relative to the pending spaces. Characters exceeding
+// the line are moved to a new line if "break_at_line_end" is true and
+// dropped otherwise.
+static void output_text(LINEWRAP *wrapper, z_ucs *text, size_t len,
+    int width, size_t pending_index, bool break_at_line_end)
+{
+  size_t start = 0, i;
+  int glyph_width;
+
+  // Common case: No metadata inside the text and it fits on the line.
+  if (
+      (
+       (wrapper->metadata_offset == wrapper->metadata_index)
+       ||
+       (wrapper->metadata[wrapper->metadata_offset].pending_index
+        >= pending_index + len)
+      )
+      &&
+      (wrapper->line_position + width <= wrapper->line_width)
+     )
+  {
+    output_span(wrapper, text, len);
+    wrapper->line_position += width;
+    return;
+  }
+
+  for (i=0; i<len; i++)
+  {
+    if (
+        (wrapper->metadata_offset < wrapper->metadata_index)
+        &&
+        (wrapper->metadata[wrapper->metadata_offset].pending_index
+         <= pending_index + i)
+       )
+    {
+      output_span(wrapper, text + start, i - start);
+      start = i;
+      output_metadata(wrapper, pending_index + i);
+    }
+
+    glyph_width
+      = wrapper->glyph_width == NULL ? 1 : get_glyph_width(wrapper, text[i]);
+
+    if (
+        (wrapper->line_position + glyph_width > wrapper->line_width)
+        &&
+        (wrapper->line_position > 0)
+       )
+    {
+      output_span(wrapper, text + start, i - start);
+
+      if (break_at_line_end == false)
+      {
+        output_metadata(wrapper, pending_index + len - 1);
+        return;
+      }
+
+      TRACE_LOG("Breaking word at line end.\n");
+      end_line(wrapper, true);
+      start = i;
+    }
+
+    wrapper->line_position += glyph_width;
+  }
+
+  output_span(wrapper, text + start, len - start);
+}
+
+
+// Outputs the pending spaces. In case they're found in the input right
+// before "input_ptr" they're sent from there.
+static void output_spaces(LINEWRAP *wrapper, z_ucs *input_ptr)
+{
+  size_t nof_spaces = wrapper->pending_spaces, index = 0, len;
+
+  if (wrapper->pending_spaces_in_input == nof_spaces)
+  {
+    output_text(wrapper, input_ptr - nof_spaces, nof_spaces,
+        get_text_width(wrapper, spaces, 1) * (int)nof_spaces, 0, false);
+    return;
+  }
+
+  while (index < nof_spaces)
+  {
+    len = nof_spaces - index;
+    if (len > sizeof(spaces) / sizeof(z_ucs))
+      len = sizeof(spaces) / sizeof(z_ucs);
+
+    output_text(wrapper, spaces, len,
+        get_text_width(wrapper, spaces, len), index, false);
+    index += len;
+  }
+}
+
+
+static void clear_pending(LINEWRAP *wrapper)
+{
+  output_metadata(wrapper,
+      wrapper->pending_spaces + wrapper->pending_word_len);
+
+  wrapper->pending_spaces = 0;
+  wrapper->pending_spaces_in_input = 0;
+  wrapper->pending_word_len = 0;
+  wrapper->pending_word_width = 0;
+  wrapper->metadata_index = 0;
+  wrapper->metadata_offset = 0;
+}
+
+
+// Places the pending spaces and the word made up of the pending word
+// start and "tail", either on the current line or the next one.
+static void place_word(LINEWRAP *wrapper, z_ucs *tail, size_t tail_len)
+{
+  int tail_width = get_text_width(wrapper, tail, tail_len);
+  int word_width = wrapper->pending_word_width + tail_width;
+  int space_width = get_text_width(wrapper, spaces, 1)
+    * (int)wrapper->pending_spaces;
+  size_t word_index = wrapper->pending_spaces;
+
+  if (
+      (wrapper->line_position > 0)
+      &&
+      (wrapper->line_position + space_width + word_width
+       > wrapper->line_width)
+     )
+  {
+    end_line(wrapper, true);
+    output_metadata(wrapper, word_index);
+  }
+  else if ( (wrapper->line_position == 0) && (wrapper->line_was_wrapped) )
+    // Spaces at the start of a wrapped line are dropped.
+    output_metadata(wrapper, word_index);
+  else if (wrapper->pending_word_len > 0)
+    output_spaces(wrapper, NULL);
+  else
+    output_spaces(wrapper, tail);
+
+  output_text(wrapper, wrapper->pending_word, wrapper->pending_word_len,
+      wrapper->pending_word_width, word_index, true);
+  output_text(wrapper, tail, tail_len, tail_width,
+      word_index + wrapper->pending_word_len, true);
+
+  clear_pending(wrapper);
+}
+
+
+static void store_pending_word(LINEWRAP *wrapper, z_ucs *text, size_t len)
+{
+  size_t new_size;
+
+  // The span may still refer to the pending word's previous contents.
+  flush_span(wrapper);
+  wrapper->pending_spaces_in_input = 0;
+
+  if (wrapper->pending_word_len + len > wrapper->pending_word_size)
+  {
+    new_size = wrapper->pending_word_len + len
+      + LINEWRAP_PENDING_WORD_INCREMENT;
+    wrapper->pending_word = fizmo_realloc(
+        wrapper->pending_word, new_size * sizeof(z_ucs));
+    allocated_linewrap_memory
+      += (new_size - wrapper->pending_word_size) * sizeof(z_ucs);
+    wrapper->pending_word_size = new_size;
+    update_subsystem_memory_stats(MEMORY_STATS_WORDWRAP);
+  }
+
+  memcpy(wrapper->pending_word + wrapper->pending_word_len, text,
+      len * sizeof(z_ucs));
+  wrapper->pending_word_len += len;
+  wrapper->pending_word_width += get_text_width(wrapper, text, len);
+}
+
+
+void linewrap_wrap_z_ucs(LINEWRAP *wrapper, z_ucs *input)
+{
+  linewrap_wrap_z_ucs_view(wrapper, z_ucs_view_of(input));
+}
+
+
+void linewrap_wrap_z_ucs_view(LINEWRAP *wrapper, z_ucs_view input)
+{
+  z_ucs *ptr = input.ptr, *end = input.ptr + input.len, *word_end;
+  int width;
+
+  while (ptr < end)
+  {
+    if (*ptr == Z_UCS_SPACE)
+    {
+      if (wrapper->pending_word_len > 0)
+        place_word(wrapper, NULL, 0);
+      wrapper->pending_spaces++;
+      wrapper->pending_spaces_in_input++;
+      ptr++;
+    }
+    else if (*ptr == Z_UCS_NEWLINE)
+    {
+      if (wrapper->pending_word_len > 0)
+        place_word(wrapper, NULL, 0);
+      output_spaces(wrapper, ptr);
+      clear_pending(wrapper);
+      end_line(wrapper, false);
+      ptr++;
+    }
+    else
+    {
+      word_end = find_break(ptr, end);
+
+      if (word_end == end)
+      {
+        // The word may continue with the next input.
+        store_pending_word(wrapper, ptr, word_end - ptr);
+        break;
+      }
+
+      // Lines may be broken behind a dash.
+      if (*word_end == Z_UCS_MINUS)
+        word_end++;
+
+      // Common case: The word and the spaces before it are all in the
+      // input, there's no metadata to take care of and the word fits on
+      // the current line, so the span is simply extended.
+      if (
+          (wrapper->pending_word_len == 0)
+          &&
+          (wrapper->metadata_index == 0)
+          &&
+          (wrapper->pending_spaces_in_input == wrapper->pending_spaces)
+          &&
+          ( (wrapper->line_position > 0) || (!wrapper->line_was_wrapped) )
+         )
+      {
+        width
+          = get_text_width(wrapper, ptr - wrapper->pending_spaces,
+              word_end - ptr + wrapper->pending_spaces);
+
+        if (wrapper->line_position + width <= wrapper->line_width)
+        {
+          output_span(wrapper, ptr - wrapper->pending_spaces,
+              word_end - ptr + wrapper->pending_spaces);
+          wrapper->line_position += width;
+          wrapper->pending_spaces = 0;
+          wrapper->pending_spaces_in_input = 0;
+          ptr = word_end;
+          continue;
+        }
+      }
+
+      place_word(wrapper, ptr, word_end - ptr);
+      ptr = word_end;
+    }
+  }
+
+  flush_span(wrapper);
+  wrapper->pending_spaces_in_input = 0;
+}
+
+
+void linewrap_flush_output(LINEWRAP *wrapper)
+{
+  if (wrapper->pending_word_len > 0)
+    place_word(wrapper, NULL, 0);
+
+  output_spaces(wrapper, NULL);
+  clear_pending(wrapper);
+  flush_span(wrapper);
+}
+
+
+void linewrap_insert_metadata(LINEWRAP *wrapper,
+    void (*metadata_output)(void *ptr_parameter, uint32_t int_parameter),
+    void *ptr_parameter, uint32_t int_parameter)
+{
+  struct linewrap_metadata *metadata_entry;
+
+  // In case nothing is kept back, everything before the metadata has
+  // already been sent and it may be output right away.
+  if ( (wrapper->pending_spaces == 0) && (wrapper->pending_word_len == 0) )
+  {
+    metadata_output(ptr_parameter, int_parameter);
+    return;
+  }
+
+  if (wrapper->metadata_index == wrapper->metadata_size)
+  {
+    wrapper->metadata = (struct linewrap_metadata*)fizmo_realloc(
+        wrapper->metadata,
+        (wrapper->metadata_size + LINEWRAP_METADATA_INCREMENT)
+        * sizeof(struct linewrap_metadata));
+    wrapper->metadata_size += LINEWRAP_METADATA_INCREMENT;
+    allocated_linewrap_memory
+      += LINEWRAP_METADATA_INCREMENT * sizeof(struct linewrap_metadata);
+    update_subsystem_memory_stats(MEMORY_STATS_WORDWRAP);
+  }
+
+  metadata_entry = &wrapper->metadata[wrapper->metadata_index++];
+  metadata_entry->pending_index
+    = wrapper->pending_spaces + wrapper->pending_word_len;
+  metadata_entry->metadata_output_function = metadata_output;
+  metadata_entry->ptr_parameter = ptr_parameter;
+  metadata_entry->int_parameter = int_parameter;
+}
+
+
+void linewrap_adjust_line_width(LINEWRAP *wrapper, int new_line_width)
+{
+  wrapper->line_width = new_line_width;
+}
+
+
+void linewrap_set_line_position(LINEWRAP *wrapper, int new_line_position)
+{
+  TRACE_LOG("Setting line position to %d.\n", new_line_position);
+  wrapper->line_position = new_line_position;
+  wrapper->line_was_wrapped = false;
+}
+
+
+void linewrap_set_glyph_width_function(LINEWRAP *wrapper,
+    int (*glyph_width)(z_ucs c, void *parameter))
+{
+  wrapper->glyph_width = glyph_width;
+  reset_width_cache(wrapper);
+}
+
+#endif /* linewrap_c_INCLUDED */
+
@@ -0,0 +1,111 @@
+
+/* linewrap.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef linewrap_h_INCLUDED
+#define linewrap_h_INCLUDED
+
+#include <stddef.h>
+
+#include "../tools/types.h"
+#include "../tools/z_ucs.h"
+
+#define LINEWRAP_WIDTH_CACHE_SIZE 256
+#define LINEWRAP_WIDE_CACHE_SIZE 64
+
+
+struct linewrap_metadata
+{
+  size_t pending_index;
+  void (*metadata_output_function)(void *ptr_parameter, uint32_t int_parameter);
+  void *ptr_parameter;
+  uint32_t int_parameter;
+};
+
+
+typedef struct
+{
+  int line_width;
+  int (*glyph_width)(z_ucs c, void *parameter);
+  void (*text_output)(z_ucs *text, size_t len, void *parameter);
+  void (*line_end)(bool line_was_wrapped, void *parameter);
+  void *destination_parameter;
+
+  // Widths returned by "glyph_width", -1 where not yet known. Characters
+  // outside the Latin-1 range share a small direct-mapped cache.
+  int16_t width_cache[LINEWRAP_WIDTH_CACHE_SIZE];
+  z_ucs wide_cache_chars[LINEWRAP_WIDE_CACHE_SIZE];
+  int16_t wide_cache_widths[LINEWRAP_WIDE_CACHE_SIZE];
+
+  int line_position;
+  bool line_was_wrapped;
+
+  // Text placed on the current line but not yet sent, so that adjacent
+  // words are sent in a single span.
+  z_ucs *span;
+  size_t span_len;
+
+  // Spaces and the start of a word which could not be placed yet since
+  // the rest of the word has not been received.
+  size_t pending_spaces;
+  size_t pending_spaces_in_input;
+  z_ucs *pending_word;
+  size_t pending_word_len;
+  size_t pending_word_size;
+  int pending_word_width;
+
+  struct linewrap_metadata *metadata;
+  int metadata_size;
+  int metadata_index;
+  int metadata_offset;
+} LINEWRAP;
+
+
+LINEWRAP *linewrap_new_wrapper(int line_width,
+    int (*glyph_width)(z_ucs c, void *parameter),
+    void (*text_output)(z_ucs *text, size_t len, void *parameter),
+    void (*line_end)(bool line_was_wrapped, void *parameter),
+    void *destination_parameter);
+void linewrap_destroy_wrapper(LINEWRAP *wrapper_to_destroy);
+size_t linewrap_get_total_allocated_memory_size(void);
+void linewrap_wrap_z_ucs(LINEWRAP *wrapper, z_ucs *input);
+void linewrap_wrap_z_ucs_view(LINEWRAP *wrapper, z_ucs_view input);
+void linewrap_flush_output(LINEWRAP *wrapper);
+void linewrap_insert_metadata(LINEWRAP *wrapper,
+    void (*metadata_output)(void *ptr_parameter, uint32_t int_parameter),
+    void *ptr_parameter, uint32_t int_parameter);
+void linewrap_adjust_line_width(LINEWRAP *wrapper, int new_line_width);
+void linewrap_set_line_position(LINEWRAP *wrapper, int new_line_position);
+void linewrap_set_glyph_width_function(LINEWRAP *wrapper,
+    int (*glyph_width)(z_ucs c, void *parameter));
+
+#endif /* linewrap_h_INCLUDED */
+
@@ -227,8 +227,17 @@ void seed_random_generator(void)
 {
   unsigned long init[RANDOM_SEED_SIZE];
   time_t seconds;
+  char *seed;
   int i;
 
+  // A fixed seed makes the "random" mode reproducible, which is what
+  // batch replays of recorded sessions need.
+  if ((seed = get_configuration_value("random-seed")) != NULL)
+  {
+    init_genrand((unsigned long)strtol(seed, NULL, 10));
+    return;
+  }
+
   if ((seconds = time(NULL)) == (time_t)-1)
     i18n_translate_and_exit(
         libfizmo_module_name,
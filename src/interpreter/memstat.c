@@ -0,0 +1,249 @@
+
+/* memstat.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef memstat_c_INCLUDED
+#define memstat_c_INCLUDED
+
+#include <string.h>
+
+#include "../tools/tracelog.h"
+#include "../tools/types.h"
+#include "../tools/filesys.h"
+#include "../tools/i18n.h"
+#include "memstat.h"
+#include "fizmo.h"
+#include "stack.h"
+#include "undo.h"
+#include "streams.h"
+#include "text.h"
+#include "hyphenation.h"
+#include "wordwrap.h"
+#include "linewrap.h"
+#include "storyidx.h"
+
+#ifndef DISABLE_OUTPUT_HISTORY
+#include "history.h"
+#endif // DISABLE_OUTPUT_HISTORY
+
+#ifndef DISABLE_BLOCKBUFFER
+#include "blockbuf.h"
+#endif // DISABLE_BLOCKBUFFER
+
+
+static struct z_memory_stats memory_stats;
+
+static char *subsystem_names[NUMBER_OF_MEMORY_STATS_SUBSYSTEMS] =
+{
+  "story",
+  "z-stack",
+  "undo",
+  "history",
+  "blockbuffer",
+  "wordwrap",
+  "i18n",
+  "hyphenation",
+  "caches"
+};
+
+
+static void set_usage(struct z_memory_usage *usage, size_t current_bytes)
+{
+  usage->current_bytes = current_bytes;
+  if (current_bytes > usage->peak_bytes)
+    usage->peak_bytes = current_bytes;
+}
+
+
+static size_t get_subsystem_memory_size(int subsystem)
+{
+  size_t result = 0;
+#ifndef DISABLE_OUTPUT_HISTORY
+  int i;
+#endif // DISABLE_OUTPUT_HISTORY
+
+  switch (subsystem)
+  {
+    case MEMORY_STATS_STORY:
+      if (active_z_story != NULL)
+        result
+          = sizeof(struct z_story)
+          + (active_z_story->high_memory_end - active_z_story->memory + 1)
+          + get_story_index_memory_size();
+      break;
+
+    case MEMORY_STATS_Z_STACK:
+      result = current_z_stack_size * sizeof(uint16_t);
+      break;
+
+    case MEMORY_STATS_UNDO:
+      if (active_z_story != NULL)
+        result = get_allocated_undo_memory_size();
+      break;
+
+    case MEMORY_STATS_HISTORY:
+#ifndef DISABLE_OUTPUT_HISTORY
+      for (i=0; i<OUTPUTHISTORY_NUMBER_OF_WINDOWS; i++)
+      {
+        set_usage(
+            &memory_stats.history_window[i],
+            outputhistory[i] != NULL
+            ? get_allocated_text_history_size_bytes(outputhistory[i])
+            : 0);
+        result += memory_stats.history_window[i].current_bytes;
+      }
+#endif // DISABLE_OUTPUT_HISTORY
+      break;
+
+    case MEMORY_STATS_BLOCKBUFFER:
+#ifndef DISABLE_BLOCKBUFFER
+      if (upper_window_buffer != NULL)
+        result = count_allocated_blockbuf_memory(upper_window_buffer);
+#endif // DISABLE_BLOCKBUFFER
+      break;
+
+    case MEMORY_STATS_WORDWRAP:
+      result
+        = wordwrap_get_total_allocated_memory_size()
+        + linewrap_get_total_allocated_memory_size();
+      break;
+
+    case MEMORY_STATS_I18N:
+      result = get_i18n_memory_size();
+      break;
+
+    case MEMORY_STATS_HYPHENATION:
+      result = get_hyphenation_memory_size();
+      break;
+
+    case MEMORY_STATS_CACHES:
+      result = get_tokenise_cache_size();
+      break;
+  }
+
+  return result;
+}
+
+
+// Has to be called every time the memory allocated by "subsystem" changes,
+// so that peaks are recorded when they occur instead of only when the
+// statistics are looked at.
+void update_subsystem_memory_stats(int subsystem)
+{
+  size_t previous_bytes, current_bytes;
+
+  if ( (subsystem < 0) || (subsystem >= NUMBER_OF_MEMORY_STATS_SUBSYSTEMS) )
+    return;
+
+  previous_bytes = memory_stats.subsystem[subsystem].current_bytes;
+  current_bytes = get_subsystem_memory_size(subsystem);
+
+  set_usage(&memory_stats.subsystem[subsystem], current_bytes);
+  set_usage(
+      &memory_stats.total,
+      memory_stats.total.current_bytes - previous_bytes + current_bytes);
+}
+
+
+static void update_i18n_memory_stats(void)
+{
+  update_subsystem_memory_stats(MEMORY_STATS_I18N);
+}
+
+
+struct z_memory_stats *get_memory_stats()
+{
+  return &memory_stats;
+}
+
+
+char *get_memory_stats_subsystem_name(int subsystem)
+{
+  if ( (subsystem < 0) || (subsystem >= NUMBER_OF_MEMORY_STATS_SUBSYSTEMS) )
+    return NULL;
+
+  return subsystem_names[subsystem];
+}
+
+
+// Writes a table of all subsystems' current and peak usage to "out".
+// Returns 0 on success, -1 otherwise.
+int dump_memory_stats(z_file *out)
+{
+  int i;
+
+  if (fsi->fileprintf(out, "%-16s %12s %12s\n", "subsystem", "current",
+        "peak") < 0)
+    return -1;
+
+  for (i=0; i<NUMBER_OF_MEMORY_STATS_SUBSYSTEMS; i++)
+    if (fsi->fileprintf(out, "%-16s %12lu %12lu\n",
+          subsystem_names[i],
+          (unsigned long)memory_stats.subsystem[i].current_bytes,
+          (unsigned long)memory_stats.subsystem[i].peak_bytes) < 0)
+      return -1;
+
+#ifndef DISABLE_OUTPUT_HISTORY
+  for (i=0; i<OUTPUTHISTORY_NUMBER_OF_WINDOWS; i++)
+    if (memory_stats.history_window[i].peak_bytes != 0)
+      if (fsi->fileprintf(out, "history-%-8d %12lu %12lu\n",
+            i,
+            (unsigned long)memory_stats.history_window[i].current_bytes,
+            (unsigned long)memory_stats.history_window[i].peak_bytes) < 0)
+        return -1;
+#endif // DISABLE_OUTPUT_HISTORY
+
+  if (fsi->fileprintf(out, "%-16s %12lu %12lu\n",
+        "total",
+        (unsigned long)memory_stats.total.current_bytes,
+        (unsigned long)memory_stats.total.peak_bytes) < 0)
+    return -1;
+
+  return 0;
+}
+
+
+// Sets all peaks to the current usage and starts tracking changes of the
+// i18n catalogs, which are loaded by the tools library.
+void reset_memory_stats()
+{
+  int i;
+
+  memset(&memory_stats, 0, sizeof(memory_stats));
+
+  for (i=0; i<NUMBER_OF_MEMORY_STATS_SUBSYSTEMS; i++)
+    update_subsystem_memory_stats(i);
+
+  register_i18n_memory_change_function(update_i18n_memory_stats);
+}
+
+#endif /* memstat_c_INCLUDED */
+
@@ -0,0 +1,73 @@
+
+/* memstat.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef memstat_h_INCLUDED
+#define memstat_h_INCLUDED
+
+#include "../tools/types.h"
+#include "history.h"
+
+#define MEMORY_STATS_STORY 0
+#define MEMORY_STATS_Z_STACK 1
+#define MEMORY_STATS_UNDO 2
+#define MEMORY_STATS_HISTORY 3
+#define MEMORY_STATS_BLOCKBUFFER 4
+#define MEMORY_STATS_WORDWRAP 5
+#define MEMORY_STATS_I18N 6
+#define MEMORY_STATS_HYPHENATION 7
+#define MEMORY_STATS_CACHES 8
+#define NUMBER_OF_MEMORY_STATS_SUBSYSTEMS 9
+
+struct z_memory_usage
+{
+  size_t current_bytes;
+  size_t peak_bytes;
+};
+
+// Every subsystem reports changes of its allocated memory using
+// update_subsystem_memory_stats(), so peaks are exact at any time. The
+// "history" subsystem contains the sum of all windows' histories.
+struct z_memory_stats
+{
+  struct z_memory_usage subsystem[NUMBER_OF_MEMORY_STATS_SUBSYSTEMS];
+  struct z_memory_usage history_window[OUTPUTHISTORY_NUMBER_OF_WINDOWS];
+  struct z_memory_usage total;
+};
+
+void update_subsystem_memory_stats(int subsystem);
+struct z_memory_stats *get_memory_stats();
+char *get_memory_stats_subsystem_name(int subsystem);
+int dump_memory_stats(z_file *out);
+void reset_memory_stats();
+
+#endif /* memstat_h_INCLUDED */
+
@@ -240,6 +240,8 @@ static void set_object_attribute(uint16_t object_number, uint8_t attribute_numbe
   else
     object_address[byte_number] |= attribute_bit_mask;
 
+  dynamic_memory_written(object_address + byte_number, 1);
+
   TRACE_LOG("Final attribute byte value: $%x.\n", object_address[byte_number]);
 }
 
@@ -401,13 +403,23 @@ static void set_object_node_number(uint16_t object_number, uint8_t node_type,
 #endif // STRICT_Z
 
   if (ver <= 3)
+  {
     *(object_address + active_z_story->object_node_number_index + node_type)
       = new_node_number;
-
+    dynamic_memory_written(
+        object_address + active_z_story->object_node_number_index + node_type,
+        1);
+  }
   else
+  {
     store_word
       (object_address + active_z_story->object_node_number_index + node_type*2,
        new_node_number);
+    dynamic_memory_written(
+        object_address + active_z_story->object_node_number_index
+        + node_type*2,
+        2);
+  }
 }
 
 
@@ -582,6 +594,8 @@ void opcode_get_sibling(void)
 
   TRACE_LOG("Opcode: GET_SIBLING.\n");
 
+  flush_stream_3_length();
+
   read_z_result_variable();
 
 #ifdef STRICT_Z
@@ -640,6 +654,8 @@ void opcode_get_child(void)
 
   TRACE_LOG("Opcode: GET_CHILD.\n");
 
+  flush_stream_3_length();
+
   read_z_result_variable();
 
 #ifdef STRICT_Z
@@ -698,6 +714,8 @@ void opcode_get_parent(void)
 
   TRACE_LOG("Opcode: GET_PARENT.\n");
 
+  flush_stream_3_length();
+
   read_z_result_variable();
 
 #ifdef STRICT_Z
@@ -750,6 +768,9 @@ void opcode_get_parent(void)
 void opcode_jin(void)
 {
   TRACE_LOG("Opcode: JIN.\n");
+
+  flush_stream_3_length();
+
   TRACE_LOG("Checking if parent of object %d is %d.\n", op[0], op[1]);
 
 #ifdef STRICT_Z
@@ -818,6 +839,9 @@ void opcode_jin(void)
 void opcode_set_attr(void)
 {
   TRACE_LOG("Opcode: SET_ATTR.\n");
+
+  flush_stream_3_length();
+
   TRACE_LOG("Setting attribute %d in object %d.\n", op[1], op[0]);
 
 #ifdef STRICT_Z
@@ -878,6 +902,9 @@ void opcode_set_attr(void)
 void opcode_test_attr(void)
 {
   TRACE_LOG("Opcode: TEST_ATTR.\n");
+
+  flush_stream_3_length();
+
   TRACE_LOG("Testing object %d for attribute %d.\n", op[0], op[1]);
 
 #ifdef STRICT_Z
@@ -942,6 +969,8 @@ void opcode_insert_obj(void)
 {
   TRACE_LOG("Opcode: INSERT_OBJ.\n");
 
+  flush_stream_3_length();
+
   TRACE_LOG("Inserting object %d as first child in object %d.\n",op[0],op[1]);
 
 #ifdef STRICT_Z
@@ -983,6 +1012,8 @@ void opcode_clear_attr(void)
 {
   TRACE_LOG("Opcode: CLEAR_ATTR.\n");
 
+  flush_stream_3_length();
+
   TRACE_LOG("Clearing attribute %d of object %d.\n", op[1], op[0]);
 
 #ifdef STRICT_Z
@@ -1043,6 +1074,8 @@ void opcode_remove_obj(void)
 {
   TRACE_LOG("Opcode: REMOVE_OBJ.\n");
 
+  flush_stream_3_length();
+
   TRACE_LOG("Removing object %d.\n", op[0]);
 
 #ifdef STRICT_Z
@@ -41,6 +41,7 @@
 #include "zpu.h"
 #include "variable.h"
 #include "config.h"
+#include "streams.h"
 
 #ifndef DISABLE_BLOCKBUFFER
 #include "blockbuf.h"
@@ -145,6 +146,21 @@ void opcode_erase_window(void)
   //
   //FIXME: Implement -2
 
+#ifndef DISABLE_BLOCKBUFFER
+  // Keep the buffer in line with what's visible, so the upper window is
+  // not redrawn with text the story has already erased.
+  if (
+      ( (window_id == -1) || (window_id == -2) || (window_id == 1) )
+      &&
+      (ver >= 3)
+      &&
+      (ver != 6)
+      &&
+      (upper_window_buffer != NULL)
+     )
+    blockbuf_clear(upper_window_buffer);
+#endif // DISABLE_BLOCKBUFFER
+
   if (window_id == -1)
   {
     active_interface->split_window(0);
@@ -261,8 +277,12 @@ void opcode_set_cursor(void)
 void opcode_get_cursor_array(void)
 {
   TRACE_LOG("Opcode: GET_CURSOR\n");
+
+  flush_stream_3_length();
+
   store_word(z_mem + op[0]    , active_interface->get_cursor_row());
   store_word(z_mem + op[0] + 1, active_interface->get_cursor_column());
+  dynamic_memory_written(z_mem + op[0], 4);
 }
 
 
@@ -0,0 +1,357 @@
+
+/* pagestore.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef pagestore_c_INCLUDED
+#define pagestore_c_INCLUDED
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../tools/tracelog.h"
+#include "../tools/types.h"
+#include "../tools/filesys.h"
+#include "pagestore.h"
+#include "fizmo.h"
+#include "config.h"
+#include "iff.h"
+
+
+// Hashes are built from two 64-bit FNV-1a lanes, one running forwards and
+// one running backwards over the page.
+static void hash_page(uint8_t *data, size_t len, uint8_t *hash)
+{
+  uint64_t forward = 0xcbf29ce484222325ULL;
+  uint64_t backward = 0x84222325cbf29ce4ULL;
+  size_t i;
+  int j;
+
+  for (i=0; i<len; i++)
+  {
+    forward = (forward ^ data[i]) * 0x100000001b3ULL;
+    backward = (backward ^ data[len - 1 - i]) * 0x100000001b3ULL;
+  }
+
+  for (j=0; j<8; j++)
+  {
+    hash[j] = (uint8_t)(forward >> (56 - j*8));
+    hash[j+8] = (uint8_t)(backward >> (56 - j*8));
+  }
+}
+
+
+static char *get_page_filename(char *store_path, uint8_t *hash)
+{
+  char *result = fizmo_malloc(strlen(store_path) + PAGE_STORE_HASH_SIZE*2+6);
+  char *ptr;
+  int i;
+
+  strcpy(result, store_path);
+  ptr = result + strlen(result);
+  *(ptr++) = '/';
+
+  for (i=0; i<PAGE_STORE_HASH_SIZE; i++)
+    ptr += sprintf(ptr, "%02x", hash[i]);
+
+  return result;
+}
+
+
+// Returns 0 if the page is available in the store, -1 otherwise.
+static int store_page(uint8_t *data, size_t len, uint8_t *hash,
+    char *store_path)
+{
+  char *filename = get_page_filename(store_path, hash);
+  char *tmp_filename;
+  z_file *page_file;
+  uint8_t *stored_data;
+  size_t stored_len;
+  int result;
+
+  if ((page_file = fsi->openfile(filename, FILETYPE_DATA, FILEACCESS_READ))
+      != NULL)
+  {
+    // The page is already known. Since the hash might collide, the
+    // contents are verified before the page is shared.
+    stored_data = (uint8_t*)fsi_read_whole_file(page_file, &stored_len);
+    fsi->closefile(page_file);
+
+    result
+      = ( (stored_data != NULL)
+          && (stored_len == len)
+          && (memcmp(stored_data, data, len) == 0) )
+      ? 0
+      : -1;
+
+    TRACE_LOG("Page \"%s\" already stored, verify result: %d.\n",
+        filename, result);
+
+    free(stored_data);
+    free(filename);
+    return result;
+  }
+
+  // New pages are written to a temporary file first and renamed when
+  // complete, so that readers never see partially written pages. Since
+  // every writer uses its own temporary file, interpreters storing the
+  // same page at the same time will simply replace each other's copy.
+  result = -1;
+  if ((page_file = fsi_open_temp_file(filename, FILETYPE_DATA,
+          &tmp_filename)) != NULL)
+  {
+    if (fsi->writechars(data, len, page_file) == len)
+      result = 0;
+
+    if (fsi->closefile(page_file) != 0)
+      result = -1;
+
+    if (result == 0)
+      result = fsi_rename_file(tmp_filename, filename);
+
+    if (result != 0)
+      fsi_remove_file(tmp_filename);
+
+    free(tmp_filename);
+  }
+
+  TRACE_LOG("Stored page \"%s\", result: %d.\n", filename, result);
+
+  free(filename);
+  return result;
+}
+
+
+uint8_t *store_pages(uint8_t *memory, uint16_t length, char *store_path)
+{
+  int nof_pages = (length + PAGE_STORE_PAGE_SIZE - 1) / PAGE_STORE_PAGE_SIZE;
+  uint8_t *manifest;
+  size_t page_len;
+  int i;
+
+  if ( (fsi->is_filename_directory(store_path) == false)
+      && (fsi->make_dir(store_path) != 0) )
+  {
+    TRACE_LOG("Can't create page store \"%s\".\n", store_path);
+    return NULL;
+  }
+
+  manifest = fizmo_malloc(nof_pages * PAGE_STORE_HASH_SIZE + 1);
+
+  for (i=0; i<nof_pages; i++)
+  {
+    page_len = length - i * PAGE_STORE_PAGE_SIZE;
+    if (page_len > PAGE_STORE_PAGE_SIZE)
+      page_len = PAGE_STORE_PAGE_SIZE;
+
+    hash_page(
+        memory + i * PAGE_STORE_PAGE_SIZE,
+        page_len,
+        manifest + i * PAGE_STORE_HASH_SIZE);
+
+    if (store_page(
+          memory + i * PAGE_STORE_PAGE_SIZE,
+          page_len,
+          manifest + i * PAGE_STORE_HASH_SIZE,
+          store_path) != 0)
+    {
+      free(manifest);
+      return NULL;
+    }
+  }
+
+  return manifest;
+}
+
+
+int write_page_manifest_chunk(uint8_t *manifest, uint16_t length,
+    z_file *save_file)
+{
+  int nof_pages = (length + PAGE_STORE_PAGE_SIZE - 1) / PAGE_STORE_PAGE_SIZE;
+
+  if (start_new_chunk("FzPg", save_file) != 0)
+    return -1;
+
+  if (write_four_byte_number(PAGE_STORE_PAGE_SIZE, save_file) != 0)
+    return -1;
+
+  if (write_four_byte_number(length, save_file) != 0)
+    return -1;
+
+  if (fsi->writechars(manifest, nof_pages * PAGE_STORE_HASH_SIZE, save_file)
+      != (size_t)(nof_pages * PAGE_STORE_HASH_SIZE))
+    return -1;
+
+  return end_current_chunk(save_file);
+}
+
+
+static int load_pages(uint8_t *dest, uint32_t length, uint32_t page_size,
+    uint8_t *manifest, char *store_path)
+{
+  uint32_t offset;
+  size_t page_len;
+  size_t stored_len;
+  uint8_t *stored_data;
+  uint8_t hash[PAGE_STORE_HASH_SIZE];
+  char *filename;
+  z_file *page_file;
+
+  for (offset=0; offset<length; offset+=page_size)
+  {
+    page_len = length - offset;
+    if (page_len > page_size)
+      page_len = page_size;
+
+    filename = get_page_filename(store_path, manifest);
+    page_file = fsi->openfile(filename, FILETYPE_DATA, FILEACCESS_READ);
+    TRACE_LOG("Loading page \"%s\".\n", filename);
+    free(filename);
+
+    if (page_file == NULL)
+      return -1;
+
+    stored_data = (uint8_t*)fsi_read_whole_file(page_file, &stored_len);
+    fsi->closefile(page_file);
+
+    if ( (stored_data == NULL) || (stored_len != page_len) )
+    {
+      free(stored_data);
+      return -1;
+    }
+
+    hash_page(stored_data, stored_len, hash);
+    if (memcmp(hash, manifest, PAGE_STORE_HASH_SIZE) != 0)
+    {
+      free(stored_data);
+      return -1;
+    }
+
+    memcpy(dest + offset, stored_data, page_len);
+    free(stored_data);
+    manifest += PAGE_STORE_HASH_SIZE;
+  }
+
+  return 0;
+}
+
+
+static uint32_t get_four_byte_number(uint8_t *data)
+{
+  return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16)
+    | ((uint32_t)data[2] << 8) | data[3];
+}
+
+
+// Checks the page size and memory length at the start of an "FzPg" chunk
+// of "chunk_length" bytes. Returns the size of the manifest following
+// them, or 0 in case the chunk can't provide "length" bytes of memory.
+static uint32_t get_manifest_size(uint8_t *header, uint16_t length,
+    uint32_t chunk_length, uint32_t *page_size)
+{
+  uint32_t saved_length;
+  uint32_t manifest_size;
+
+  if (chunk_length < 8)
+    return 0;
+
+  *page_size = get_four_byte_number(header);
+  saved_length = get_four_byte_number(header + 4);
+
+  TRACE_LOG("Page manifest: %u bytes in pages of %u bytes.\n",
+      (unsigned)saved_length, (unsigned)*page_size);
+
+  if ( (*page_size == 0) || (saved_length < length) )
+    return 0;
+
+  manifest_size
+    = (length + *page_size - 1) / *page_size * PAGE_STORE_HASH_SIZE;
+  if (chunk_length - 8 < manifest_size)
+    return 0;
+
+  return manifest_size;
+}
+
+
+int read_page_manifest_chunk(uint8_t *dest, uint16_t length,
+    char *store_path, z_file *iff_file)
+{
+  uint8_t header[8];
+  uint32_t page_size;
+  uint32_t manifest_size;
+  uint8_t *manifest;
+  int chunk_length;
+  int result;
+
+  if (store_path == NULL)
+    return -1;
+
+  if (read_chunk_length(iff_file) == -1)
+    return -1;
+
+  chunk_length = get_last_chunk_length();
+
+  if ( (chunk_length < 8) || (fsi->readchars(header, 8, iff_file) != 8) )
+    return -1;
+
+  if ((manifest_size = get_manifest_size(
+          header, length, (uint32_t)chunk_length, &page_size)) == 0)
+    return -1;
+
+  manifest = fizmo_malloc(manifest_size + 1);
+
+  result
+    = fsi->readchars(manifest, manifest_size, iff_file) == manifest_size
+    ? load_pages(dest, length, page_size, manifest, store_path)
+    : -1;
+
+  free(manifest);
+  return result;
+}
+
+
+int load_page_manifest(uint8_t *dest, uint16_t length, uint8_t *chunk_data,
+    uint32_t chunk_length, char *store_path)
+{
+  uint32_t page_size;
+
+  if (store_path == NULL)
+    return -1;
+
+  if (get_manifest_size(chunk_data, length, chunk_length, &page_size) == 0)
+    return -1;
+
+  return load_pages(dest, length, page_size, chunk_data + 8, store_path);
+}
+
+
+#endif /* pagestore_c_INCLUDED */
+
@@ -0,0 +1,61 @@
+
+/* pagestore.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef pagestore_h_INCLUDED
+#define pagestore_h_INCLUDED
+
+#include "../tools/types.h"
+
+#define PAGE_STORE_HASH_SIZE 16
+
+// Splits the given memory into pages of PAGE_STORE_PAGE_SIZE bytes and
+// stores every page not yet present in the store directory, using the
+// page's hash as filename. Returns a newly allocated manifest containing
+// one hash per page, or NULL in case the store can't be used, which also
+// happens on a hash collision.
+uint8_t *store_pages(uint8_t *memory, uint16_t length, char *store_path);
+
+// Writes a private "FzPg" chunk containing the given manifest.
+int write_page_manifest_chunk(uint8_t *manifest, uint16_t length,
+    z_file *save_file);
+
+// Reads the "FzPg" chunk at the current position -- as left by find_chunk()
+// -- and fills "dest" with "length" bytes from the pages listed.
+int read_page_manifest_chunk(uint8_t *dest, uint16_t length,
+    char *store_path, z_file *iff_file);
+
+// Same as above for the contents of an "FzPg" chunk already in memory.
+int load_page_manifest(uint8_t *dest, uint16_t length, uint8_t *chunk_data,
+    uint32_t chunk_length, char *store_path);
+
+#endif /* pagestore_h_INCLUDED */
+
@@ -38,6 +38,7 @@
 #include "object.h"
 #include "zpu.h"
 #include "streams.h"
+#include "storyidx.h"
 #include "config.h" // for IGNORE_TOO_LONG_PROPERTIES_ERROR
 #include "../locales/libfizmo_locales.h"
 
@@ -395,6 +396,13 @@ static uint16_t get_default_property_value(uint16_t property_number)
   }
 #endif // STRICT_Z
 
+  if (find_indexed_property(object_number, property_number, &property_index)
+      != STORY_INDEX_NOT_INDEXED)
+  {
+    TRACE_LOG("Property index returned %p.\n", property_index);
+    return property_index;
+  }
+
   property_index = get_objects_first_property(object_number);
   if (property_index != NULL)
   {
@@ -657,6 +665,8 @@ static void set_property_value(uint16_t object_number,
         i18n_libfizmo_CANNOT_READ_PROPERTIES_WITH_A_LENGTH_GREATER_THAN_2,
         -1);
 
+  dynamic_memory_written(property_table_index + length_code_size, length);
+
   return;
 }
 
@@ -665,6 +675,8 @@ void opcode_get_prop(void)
 {
   TRACE_LOG("Opcode: GET_PROP.\n");
 
+  flush_stream_3_length();
+
   read_z_result_variable();
 
   TRACE_LOG("Reading property #%x of object %x.\n", op[1], op[0]);
@@ -761,6 +773,9 @@ void opcode_get_prop(void)
 void opcode_put_prop(void)
 {
   TRACE_LOG("Opcode: PUT_PROP.\n");
+
+  flush_stream_3_length();
+
   TRACE_LOG("Putting %x into property %d of object %d.\n",op[2],op[1],op[0]);
 
 #ifdef STRICT_Z
@@ -838,6 +853,9 @@ void opcode_get_prop_addr(void)
   uint8_t *property_address;
 
   TRACE_LOG("Opcode: GET_PROP_ADDR.\n");
+
+  flush_stream_3_length();
+
   TRACE_LOG("Retrieving address of property %d in object %d.\n", op[1], op[0]);
 
   read_z_result_variable();
@@ -939,6 +957,9 @@ void opcode_get_prop_len(void)
   uint16_t result;
 
   TRACE_LOG("Opcode: GET_PROP_LEN.\n");
+
+  flush_stream_3_length();
+
   TRACE_LOG("Reading length of property at address $%x.\n", op[0]);
     
   read_z_result_variable();
@@ -970,6 +991,8 @@ void opcode_get_next_prop(void)
 
   TRACE_LOG("Opcode: GET_NEXT_PROP\n");
 
+  flush_stream_3_length();
+
   read_z_result_variable();
 
 #ifdef STRICT_Z
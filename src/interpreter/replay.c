@@ -0,0 +1,296 @@
+
+/* replay.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// Fast replay for input stream 1: Instead of parsing the command file
+// character by character for every @read, the whole file is loaded at
+// once, split into lines and converted to ZSCII in advance. In case
+// "replay-suppress-output" is set, no stream 1 output is sent to the
+// screen interface until the last command has been read.
+
+#ifndef replay_c_INCLUDED
+#define replay_c_INCLUDED
+
+#include <string.h>
+#include <ctype.h>
+
+#include "../tools/tracelog.h"
+#include "../tools/types.h"
+#include "../tools/filesys.h"
+#include "../tools/z_ucs.h"
+#include "replay.h"
+#include "config.h"
+#include "fizmo.h"
+#include "text.h"
+
+#define REPLAY_COMMANDS_INCREMENT 128
+#define REPLAY_DATA_INCREMENT 4096
+
+
+struct replay_command
+{
+  size_t offset;
+  int length;
+  int delay_tenth_seconds;
+};
+
+bool replay_output_suppressed = false;
+
+static bool replay_loaded = false;
+static struct replay_command *replay_commands = NULL;
+static int nof_replay_commands = 0;
+static int replay_commands_allocated = 0;
+static int next_replay_command = 0;
+static zscii *replay_data = NULL;
+static size_t replay_data_size = 0;
+static size_t replay_data_allocated = 0;
+
+// The delay syntax written to stream 4, where a space matches any amount of
+// whitespace. This mimics fsi->filescanf("(Waited for %d ms)\n", ...) as
+// done in read_command_from_file.
+static char *delay_prefix[] = { "(Waited", "for", NULL };
+static char *delay_suffix = "ms)";
+
+
+static char *skip_whitespace(char *src, char *end)
+{
+  while ( (src < end) && (isspace((unsigned char)*src) != 0) )
+    src++;
+  return src;
+}
+
+
+static bool match_literal(char **src, char *end, char *literal)
+{
+  size_t len = strlen(literal);
+
+  if (((size_t)(end - *src) < len) || (strncmp(*src, literal, len) != 0))
+    return false;
+
+  *src += len;
+  return true;
+}
+
+
+// Parses "(Waited for <n> ms)" followed by any whitespace. Returns true and
+// advances *src only in case the complete delay information was found.
+static bool parse_delay(char **src, char *end, int *milliseconds)
+{
+  char *ptr = *src;
+  bool negative = false;
+  bool digit_found = false;
+  int value = 0;
+  int i;
+
+  for (i=0; delay_prefix[i] != NULL; i++)
+  {
+    if (i > 0)
+      ptr = skip_whitespace(ptr, end);
+    if (match_literal(&ptr, end, delay_prefix[i]) == false)
+      return false;
+  }
+
+  ptr = skip_whitespace(ptr, end);
+  if ( (ptr < end) && ((*ptr == '-') || (*ptr == '+')) )
+    negative = (*(ptr++) == '-');
+
+  while ( (ptr < end) && (isdigit((unsigned char)*ptr) != 0) )
+  {
+    value = value * 10 + (*(ptr++) - '0');
+    digit_found = true;
+  }
+
+  if (digit_found == false)
+    return false;
+
+  ptr = skip_whitespace(ptr, end);
+  if (match_literal(&ptr, end, delay_suffix) == false)
+    return false;
+
+  *milliseconds = negative == true ? -value : value;
+  *src = skip_whitespace(ptr, end);
+  return true;
+}
+
+
+static void append_replay_char(zscii c)
+{
+  if (replay_data_size == replay_data_allocated)
+  {
+    replay_data_allocated += REPLAY_DATA_INCREMENT;
+    replay_data = (zscii*)fizmo_realloc(
+        replay_data, replay_data_allocated * sizeof(zscii));
+  }
+
+  replay_data[replay_data_size++] = c;
+}
+
+
+static void append_replay_command(size_t offset, int delay_tenth_seconds)
+{
+  if (nof_replay_commands == replay_commands_allocated)
+  {
+    replay_commands_allocated += REPLAY_COMMANDS_INCREMENT;
+    replay_commands = (struct replay_command*)fizmo_realloc(
+        replay_commands,
+        replay_commands_allocated * sizeof(struct replay_command));
+  }
+
+  replay_commands[nof_replay_commands].offset = offset;
+  replay_commands[nof_replay_commands].length
+    = (int)(replay_data_size - offset);
+  replay_commands[nof_replay_commands].delay_tenth_seconds
+    = delay_tenth_seconds;
+  nof_replay_commands++;
+}
+
+
+// Loads all commands from the given file, which remains open. Returns the
+// number of commands found or -1 in case the file could not be read.
+int load_replay_commands(z_file *command_file)
+{
+  char *file_data, *src, *end;
+  size_t file_length;
+  size_t offset;
+  int milliseconds;
+  int delay_tenth_seconds;
+  z_ucs unicode_input;
+
+  free_replay_commands();
+
+  if ((file_data = fsi_map_file(command_file, &file_length)) == NULL)
+  {
+    TRACE_LOG("Could not map command file.\n");
+    return -1;
+  }
+
+  src = file_data;
+  end = file_data + file_length;
+
+  while (src < end)
+  {
+    delay_tenth_seconds = 0;
+    if (parse_delay(&src, end, &milliseconds) == true)
+    {
+      delay_tenth_seconds = milliseconds / 100;
+      if (src == end)
+        break;
+    }
+
+    offset = replay_data_size;
+    while ((unicode_input = parse_utf8_char_from_buffer(&src, end)) != UEOF)
+    {
+      if (unicode_input == '\n')
+        break;
+      else if (unicode_input != '\r')
+        append_replay_char(unicode_char_to_zscii_input_char(unicode_input));
+    }
+
+    append_replay_command(offset, delay_tenth_seconds);
+  }
+
+  fsi_unmap_file(file_data, file_length);
+
+  TRACE_LOG("Loaded %d replay commands, %ld chars.\n",
+      nof_replay_commands, (long)replay_data_size);
+
+  replay_loaded = true;
+  next_replay_command = 0;
+  replay_output_suppressed
+    = (nof_replay_commands > 0)
+    && (strcmp(get_configuration_value("replay-suppress-output"), "true")
+        == 0);
+
+  return nof_replay_commands;
+}
+
+
+bool replay_commands_loaded(void)
+{
+  return replay_loaded;
+}
+
+
+int get_nof_remaining_replay_commands(void)
+{
+  return nof_replay_commands - next_replay_command;
+}
+
+
+// Copies the next command into dest, truncating it to max_length chars.
+// Returns the command's resulting length or -1 in case all commands have
+// been read.
+int get_next_replay_command(zscii *dest, int max_length,
+    int *input_delay_tenth_seconds)
+{
+  struct replay_command *command;
+  int length;
+
+  if (next_replay_command >= nof_replay_commands)
+    return -1;
+
+  command = replay_commands + next_replay_command++;
+  length = command->length < max_length ? command->length : max_length;
+  memcpy(dest, replay_data + command->offset, length * sizeof(zscii));
+
+  if (input_delay_tenth_seconds != NULL)
+    *input_delay_tenth_seconds = command->delay_tenth_seconds;
+
+  // Show the response to the last command so the final state is visible.
+  if (next_replay_command == nof_replay_commands)
+    replay_output_suppressed = false;
+
+  TRACE_LOG("Replaying command %d, %d chars.\n", next_replay_command, length);
+
+  return length;
+}
+
+
+void free_replay_commands(void)
+{
+  replay_loaded = false;
+
+  free(replay_commands);
+  replay_commands = NULL;
+  nof_replay_commands = 0;
+  replay_commands_allocated = 0;
+  next_replay_command = 0;
+
+  free(replay_data);
+  replay_data = NULL;
+  replay_data_size = 0;
+  replay_data_allocated = 0;
+
+  replay_output_suppressed = false;
+}
+
+#endif /* replay_c_INCLUDED */
+
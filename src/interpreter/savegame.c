@@ -41,6 +41,7 @@
 #include "../tools/i18n.h"
 #include "../tools/z_ucs.h"
 #include "../tools/filesys.h"
+#include "../tools/lzss.h"
 #include "savegame.h"
 #include "streams.h"
 #include "fizmo.h"
@@ -54,6 +55,11 @@
 #include "history.h"
 #include "output.h"
 #include "config.h"
+#include "turnstat.h"
+#include "pagestore.h"
+#ifdef ENABLE_ASYNC_AUTOSAVE
+#include "autosave.h"
+#endif // ENABLE_ASYNC_AUTOSAVE
 #include "../locales/libfizmo_locales.h"
 
 #define HISTORY_BUFFER_INPUT_SIZE 1024
@@ -64,9 +70,14 @@ static zscii current_savegame_filename_buffer[MAXIMUM_SAVEGAME_NAME_LENGTH + 1];
 //static z_ucs savegame_output_buffer[MAXIMUM_SAVEGAME_NAME_LENGTH + 1];
 
 
-static int save_stack_frame(uint16_t *current_frame_index,
-    uint16_t current_frame_stack_usage, uint8_t current_frame_number_of_locals,
-    z_file *out_file)
+// Serializes the stack frames into "*out" in the Quetzal "Stks" format.
+// The frames are taken from the stack starting at "stack_base", so that
+// copies of the stack may be used as well. Since every word on the stack
+// results in two bytes of output, "*out" has to provide space for twice
+// the number of words used on the stack.
+static void save_stack_frame(uint16_t *stack_base,
+    uint16_t *current_frame_index, uint16_t current_frame_stack_usage,
+    uint8_t current_frame_number_of_locals, uint8_t **out)
 {
   uint8_t previous_result_var;
   uint32_t previous_pc;
@@ -79,9 +90,10 @@ static int save_stack_frame(uint16_t *current_frame_index,
   uint8_t i;
 
   TRACE_LOG("Saving stack frame.\n");
-  TRACE_LOG("Z-Stack at %p.\n", z_stack);
-  TRACE_LOG("Z-Stack-Index: %ld.\n", (long int)(current_frame_index - z_stack));
-  TRACE_LOG("Data-Index: %ld.\n", (long int)(data_index - z_stack));
+  TRACE_LOG("Z-Stack at %p.\n", stack_base);
+  TRACE_LOG("Z-Stack-Index: %ld.\n",
+      (long int)(current_frame_index - stack_base));
+  TRACE_LOG("Data-Index: %ld.\n", (long int)(data_index - stack_base));
   TRACE_LOG("Current frame index: %p.\n", current_frame_index);
   TRACE_LOG("Current frame stack usage: %d.\n", current_frame_stack_usage);
   TRACE_LOG("Current frame number of locals: %d.\n",
@@ -119,17 +131,16 @@ static int save_stack_frame(uint16_t *current_frame_index,
 
   // Save lower stack level first so serialized stack on disk starts
   // with index 0.
-  if (current_frame_index != z_stack)
+  if (current_frame_index != stack_base)
   {
-    if (save_stack_frame(
-          current_frame_index
-          - previous_stack_words_used
-          - previous_number_of_locals,
-          previous_stack_words_used,
-          previous_number_of_locals,
-          out_file)
-        != 0)
-      return -1;
+    save_stack_frame(
+        stack_base,
+        current_frame_index
+        - previous_stack_words_used
+        - previous_number_of_locals,
+        previous_stack_words_used,
+        previous_number_of_locals,
+        out);
   }
 
   flags
@@ -138,29 +149,14 @@ static int save_stack_frame(uint16_t *current_frame_index,
 
   TRACE_LOG("Flags: %x.\n", flags);
 
-  if (fsi->writechar((int)(previous_pc >> 16), out_file) == EOF)
-    return -1;
-
-  if (fsi->writechar((int)(previous_pc >>  8), out_file) == EOF)
-    return -1;
-
-  if (fsi->writechar((int)(previous_pc      ), out_file) == EOF)
-    return -1;
-
-  if (fsi->writechar((int)flags, out_file) == EOF)
-    return -1;
-
-  if (fsi->writechar((int)previous_result_var, out_file) == EOF)
-    return -1;
-
-  if (fsi->writechar((int)previous_argument_mask, out_file) == EOF)
-    return -1;
-
-  if (fsi->writechar((int)(current_frame_stack_usage >> 8), out_file) == EOF)
-    return -1;
-
-  if (fsi->writechar((int)(current_frame_stack_usage & 0xff), out_file) == EOF)
-    return -1;
+  *((*out)++) = (uint8_t)(previous_pc >> 16);
+  *((*out)++) = (uint8_t)(previous_pc >>  8);
+  *((*out)++) = (uint8_t)(previous_pc      );
+  *((*out)++) = flags;
+  *((*out)++) = previous_result_var;
+  *((*out)++) = previous_argument_mask;
+  *((*out)++) = (uint8_t)(current_frame_stack_usage >> 8);
+  *((*out)++) = (uint8_t)(current_frame_stack_usage & 0xff);
 
   TRACE_LOG("Data: (");
   for (i=0; i<current_frame_number_of_locals + current_frame_stack_usage; i++)
@@ -171,17 +167,64 @@ static int save_stack_frame(uint16_t *current_frame_index,
     }
     TRACE_LOG("$%x", data_index[i]);
 
-    if (fsi->writechar((int)(data_index[i] >> 8), out_file) == EOF)
-      return -1;
-
-    if (fsi->writechar((int)(data_index[i]     ), out_file) == EOF)
-      return -1;
+    *((*out)++) = (uint8_t)(data_index[i] >> 8);
+    *((*out)++) = (uint8_t)(data_index[i]     );
   }
   TRACE_LOG(")\n");
 
-  TRACE_LOG("Final stack index: %ld.\n", (long int)(data_index - z_stack));
+  TRACE_LOG("Final stack index: %ld.\n",
+      (long int)(data_index - stack_base));
+}
+
 
-  return 0;
+// Encodes the difference between "memory" and "original" in the Quetzal
+// "CMem" format and returns the encoded size. In the worst case --
+// alternating equal and altered bytes -- every two bytes of memory are
+// encoded using three bytes, so "dest" has to provide space for
+// length + length / 2 + 2 bytes.
+static size_t encode_cmem(uint8_t *memory, uint8_t *original,
+    uint16_t length, uint8_t *dest)
+{
+  uint8_t *memory_end = memory + length;
+  uint8_t *dest_index = dest;
+  uint16_t consecutive_zeros = 0;
+  int data;
+
+  while (memory != memory_end)
+  {
+    data = *(original++) ^ *memory;
+
+    if (data == 0)
+    {
+      consecutive_zeros++;
+    }
+    else
+    {
+      TRACE_LOG("Altered byte, memory-data: %x.\n", *memory);
+
+      while (consecutive_zeros != 0)
+      {
+        *(dest_index++) = 0;
+
+        if (consecutive_zeros > 256)
+        {
+          *(dest_index++) = 0xff;
+          consecutive_zeros -= 256;
+        }
+        else
+        {
+          *(dest_index++) = (uint8_t)(consecutive_zeros - 1);
+          consecutive_zeros = 0;
+        }
+      }
+
+      *(dest_index++) = (uint8_t)data;
+    }
+
+    memory++;
+  }
+
+  return dest_index - dest;
 }
 
 
@@ -502,6 +545,209 @@ static int _handle_save_or_restore_failure(bool evaluate_result,
 }
 
 
+#ifndef DISABLE_OUTPUT_HISTORY
+// The compressed history is stored in the private "FzHs" chunk, which
+// other Quetzal implementations will simply skip. It contains the length
+// of the uncompressed data as a four byte number, followed by the LZSS
+// compressed data. Before compression, every z_ucs char is written as a
+// variable length number, seven bits per byte, least significant first,
+// with bit 7 set on all but the last byte. Since most of the history
+// consists of ASCII chars this already shrinks it to about a quarter.
+static uint8_t *encode_history_chars(uint8_t *dst, z_ucs *src, z_ucs *end)
+{
+  z_ucs c;
+
+  while (src != end)
+  {
+    c = *(src++);
+    while (c >= 0x80)
+    {
+      *(dst++) = (uint8_t)((c & 0x7f) | 0x80);
+      c >>= 7;
+    }
+    *(dst++) = (uint8_t)c;
+  }
+
+  return dst;
+}
+
+
+// Returns the newly allocated contents of an "FzHs" chunk for the given
+// history data, or NULL in case memory is exhausted. Since the history is
+// kept in a ring buffer, the data may be split into two parts. This may be
+// called from the autosave thread, so memory is obtained using malloc().
+static uint8_t *build_compressed_history(z_ucs *part1, z_ucs *part1_end,
+    z_ucs *part2, z_ucs *part2_end, size_t *chunk_size)
+{
+  size_t encoded_size, compressed_size;
+  uint8_t *encoded, *result, *encoded_ptr;
+
+  if ((encoded = malloc(
+          ((part1_end - part1) + (part2_end - part2)) * 5 + 1)) == NULL)
+    return NULL;
+  encoded_ptr = encode_history_chars(encoded, part1, part1_end);
+  encoded_ptr = encode_history_chars(encoded_ptr, part2, part2_end);
+
+  encoded_size = encoded_ptr - encoded;
+  if ((result = malloc(LZSS_MAX_COMPRESSED_SIZE(encoded_size) + 4)) == NULL)
+  {
+    free(encoded);
+    return NULL;
+  }
+  result[0] = (uint8_t)(encoded_size >> 24);
+  result[1] = (uint8_t)(encoded_size >> 16);
+  result[2] = (uint8_t)(encoded_size >>  8);
+  result[3] = (uint8_t)(encoded_size      );
+  compressed_size = lzss_compress(encoded, encoded_size, result + 4);
+  free(encoded);
+
+  TRACE_LOG("Compressed %ld bytes of history to %ld bytes.\n",
+      (long)encoded_size, (long)compressed_size);
+
+  *chunk_size = compressed_size + 4;
+  return result;
+}
+
+
+static int write_compressed_history_chunk(z_ucs *hst_ptr, z_file *save_file)
+{
+  uint8_t *chunk_data;
+  size_t chunk_size;
+  int result = 0;
+
+  // Same traversal as for the uncompressed "TxHs" chunk.
+  if (hst_ptr < outputhistory[0]->z_history_buffer_back_index)
+    chunk_data = build_compressed_history(
+        hst_ptr,
+        outputhistory[0]->z_history_buffer_end,
+        outputhistory[0]->z_history_buffer_start,
+        outputhistory[0]->z_history_buffer_front_index,
+        &chunk_size);
+  else
+    chunk_data = build_compressed_history(
+        hst_ptr,
+        outputhistory[0]->z_history_buffer_front_index,
+        NULL,
+        NULL,
+        &chunk_size);
+
+  if (chunk_data == NULL)
+    return -1;
+
+  if (
+      (start_new_chunk("FzHs", save_file) != 0)
+      ||
+      (fsi->writechars(chunk_data, chunk_size, save_file) != chunk_size)
+      ||
+      (end_current_chunk(save_file) != 0)
+     )
+    result = -1;
+
+  free(chunk_data);
+  return result;
+}
+
+
+// Restores history from an "FzHs" chunk, the file position must be located
+// directly behind the chunk's length. Returns -1 on error, in which case
+// the file has been closed.
+static int restore_compressed_history_chunk(int chunk_length,
+    z_file *iff_file)
+{
+  z_ucs history_buffer[HISTORY_BUFFER_INPUT_SIZE];
+  int history_input_index = 0;
+  uint32_t encoded_number;
+  size_t compressed_size, encoded_size;
+  uint8_t *compressed, *encoded, *encoded_ptr, *encoded_end;
+  z_ucs c;
+  int shift;
+
+  if (chunk_length < 4)
+  {
+    (void)fsi->closefile(iff_file);
+    return -1;
+  }
+
+  // read_four_byte_number has already closed the file in case of -1.
+  if ((encoded_number = read_four_byte_number(iff_file)) == (uint32_t)-1)
+    return -1;
+
+  compressed_size = (size_t)chunk_length - 4;
+  encoded_size = encoded_number;
+
+  // Every z_ucs char is encoded using at most five bytes, and the history
+  // can't hold more than its maximum size.
+  if (
+      (encoded_size > LZSS_MAX_DECOMPRESSED_SIZE(compressed_size))
+      ||
+      (encoded_size / 5 > outputhistory[0]->z_history_maximum_buffer_size)
+     )
+  {
+    TRACE_LOG("Invalid uncompressed history size %ld.\n",
+        (long)encoded_size);
+    (void)fsi->closefile(iff_file);
+    return -1;
+  }
+
+  compressed = fizmo_malloc(compressed_size + 1);
+  encoded = fizmo_malloc(encoded_size + 1);
+
+  if (
+      (fsi->readchars(compressed, compressed_size, iff_file)
+       != compressed_size)
+      ||
+      (lzss_decompress(compressed, compressed_size, encoded, encoded_size)
+       != (long)encoded_size)
+     )
+  {
+    free(encoded);
+    free(compressed);
+    (void)fsi->closefile(iff_file);
+    return -1;
+  }
+  free(compressed);
+
+  encoded_ptr = encoded;
+  encoded_end = encoded + encoded_size;
+
+  while (encoded_ptr < encoded_end)
+  {
+    c = 0;
+    shift = 0;
+    while ( (encoded_ptr < encoded_end) && ((*encoded_ptr & 0x80) != 0) )
+    {
+      c |= (z_ucs)(*(encoded_ptr++) & 0x7f) << shift;
+      shift += 7;
+    }
+
+    if ( (encoded_ptr == encoded_end) || (shift > 28) )
+    {
+      free(encoded);
+      (void)fsi->closefile(iff_file);
+      return -1;
+    }
+
+    c |= (z_ucs)*(encoded_ptr++) << shift;
+    history_buffer[history_input_index++] = c;
+
+    if (
+        (history_input_index == HISTORY_BUFFER_INPUT_SIZE - 1)
+        ||
+        (encoded_ptr == encoded_end)
+       )
+    {
+      store_data_in_history(
+          outputhistory[0], history_buffer, history_input_index, true);
+      history_input_index = 0;
+    }
+  }
+
+  free(encoded);
+  return 0;
+}
+#endif // DISABLE_OUTPUT_HISTORY
+
+
 int get_paragraph_save_amount()
 {
   char *nof_paragraphs_as_string
@@ -522,6 +768,12 @@ void save_game(uint16_t address, uint16_t length, char *filename,
 
   TRACE_LOG("Save %d bytes from address %d.\n", length, address);
 
+#ifdef ENABLE_ASYNC_AUTOSAVE
+  // An autosave still being written in the background might otherwise
+  // replace this savegame afterwards in case both use the same file.
+  (void)wait_for_background_autosave();
+#endif // ENABLE_ASYNC_AUTOSAVE
+
   if (filename != NULL)
   {
     if (bool_equal(skip_asking_for_filename, true))
@@ -573,16 +825,20 @@ void save_game(uint16_t address, uint16_t length, char *filename,
   save_game_to_stream(address, length, save_file, evaluate_result);
 }
 
-/* Returns 0 for failure, 1 for success. 
-   This closes the save_file. */
-int save_game_to_stream(uint16_t address, uint16_t length, z_file *save_file,
-  bool evaluate_result)
+static int _save_game_to_stream(uint16_t address, uint16_t length,
+    z_file *save_file, bool evaluate_result)
 {
   uint32_t pc_on_restore = (uint32_t)(pc - z_mem);
+  uint8_t pc_on_restore_data[3];
+  struct z_iovec ifhd_data[4];
   uint8_t *dynamic_index;
-  uint16_t consecutive_zeros;
-  int data;
-  uint8_t *ptr;
+  uint8_t *original_mem;
+  uint8_t *cmem_data;
+  size_t cmem_size;
+  uint8_t *stks_data;
+  uint8_t *stks_index;
+  char *page_store_path;
+  uint8_t *page_manifest = NULL;
 #ifndef DISABLE_OUTPUT_HISTORY
   z_ucs *hst_ptr;
   int nof_paragraphs_to_save;
@@ -592,6 +848,8 @@ int save_game_to_stream(uint16_t address, uint16_t length, z_file *save_file,
 
   TRACE_LOG("PC at: %x.\n", pc_on_restore);
 
+  flush_stream_3_length();
+
   if (address != 0)
   {
     if ((fsi->writechars(z_mem + address, length, save_file)) != length)
@@ -620,88 +878,53 @@ int save_game_to_stream(uint16_t address, uint16_t length, z_file *save_file,
           i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
     }
 
-    // Save release number
-    if ((fsi->writechar((int)z_mem[0x2], save_file)) == EOF)
-    {
-      return _handle_save_or_restore_failure(evaluate_result,
-          i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
-    }
-    if ((fsi->writechar((int)z_mem[0x3], save_file)) == EOF)
+    // Save release number, serial number, checksum and initial PC on
+    // restore using a single write.
+    pc_on_restore_data[0] = (uint8_t)(pc_on_restore >> 16);
+    pc_on_restore_data[1] = (uint8_t)(pc_on_restore >>  8);
+    pc_on_restore_data[2] = (uint8_t)(pc_on_restore      );
+    ifhd_data[0].base = z_mem + 0x2;
+    ifhd_data[0].len = 2;
+    ifhd_data[1].base = z_mem + 0x12;
+    ifhd_data[1].len = 6;
+    ifhd_data[2].base = z_mem + 0x1c;
+    ifhd_data[2].len = 2;
+    ifhd_data[3].base = pc_on_restore_data;
+    ifhd_data[3].len = 3;
+
+    if (fsi_writev(ifhd_data, 4, save_file) != 13)
     {
       return _handle_save_or_restore_failure(evaluate_result,
           i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
     }
 
-    // Save serial number
-    if ((fsi->writechar((int)z_mem[0x12], save_file)) == EOF)
-    {
-      return _handle_save_or_restore_failure(evaluate_result,
-          i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
-    }
-    if ((fsi->writechar((int)z_mem[0x13], save_file)) == EOF)
-    {
-      return _handle_save_or_restore_failure(evaluate_result,
-          i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
-    }
-    if ((fsi->writechar((int)z_mem[0x14], save_file)) == EOF)
-    {
-      return _handle_save_or_restore_failure(evaluate_result,
-          i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
-    }
-    if ((fsi->writechar((int)z_mem[0x15], save_file)) == EOF)
-    {
-      return _handle_save_or_restore_failure(evaluate_result,
-          i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
-    }
-    if ((fsi->writechar((int)z_mem[0x16], save_file)) == EOF)
-    {
-      return _handle_save_or_restore_failure(evaluate_result,
-          i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
-    }
-    if ((fsi->writechar((int)z_mem[0x17], save_file)) == EOF)
+    if (end_current_chunk(save_file) != 0)
     {
       return _handle_save_or_restore_failure(evaluate_result,
           i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
     }
 
-    // Save checksum
-    if ((fsi->writechar((int)z_mem[0x1c], save_file)) == EOF)
-    {
-      return _handle_save_or_restore_failure(evaluate_result,
-          i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
-    }
-    if ((fsi->writechar((int)z_mem[0x1d], save_file)) == EOF)
-    {
-      return _handle_save_or_restore_failure(evaluate_result,
-          i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
-    }
+    dynamic_index = z_mem + address;
 
-    // Save initial PC on restore
-    if ((fsi->writechar((int)(pc_on_restore >> 16), save_file)) == EOF)
-    {
-      return _handle_save_or_restore_failure(evaluate_result,
-          i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
-    }
-    if ((fsi->writechar((int)(pc_on_restore >>  8), save_file)) == EOF)
-    {
-      return _handle_save_or_restore_failure(evaluate_result,
-          i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
-    }
-    if ((fsi->writechar((int)(pc_on_restore      ), save_file)) == EOF)
-    {
-      return _handle_save_or_restore_failure(evaluate_result,
-          i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
-    }
+    // In case a page store is configured, pages which are already stored
+    // are shared with all other savegames and only the page manifest is
+    // written. If the store is unusable, the regular chunks are written.
+    if ((page_store_path = get_configuration_value("savegame-page-store"))
+        != NULL)
+      page_manifest = store_pages(dynamic_index, length, page_store_path);
 
-    if (end_current_chunk(save_file) != 0)
+    if (page_manifest != NULL)
     {
-      return _handle_save_or_restore_failure(evaluate_result,
-          i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
-    }
-
-    dynamic_index = z_mem + address;
+      if (write_page_manifest_chunk(page_manifest, length, save_file) != 0)
+      {
+        free(page_manifest);
+        return _handle_save_or_restore_failure(evaluate_result,
+            i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
+      }
 
-    if (
+      free(page_manifest);
+    }
+    else if (
         (active_z_story->z_story_file != NULL)
         &&
         ((fsi->setfilepos(
@@ -721,74 +944,34 @@ int save_game_to_stream(uint16_t address, uint16_t length, z_file *save_file,
             i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
       }
 
-      ptr = z_mem + address + length;
-      consecutive_zeros = 0;
+      // Both the original memory and the compressed result are kept in
+      // memory, so the story file is read and the chunk is written in one
+      // piece each.
+      original_mem = fizmo_malloc(length);
+      cmem_data = fizmo_malloc(length + length / 2 + 2);
 
-      while (dynamic_index != ptr)
+      if (fsi->readchars(original_mem, length, active_z_story->z_story_file)
+          != length)
       {
-        if ((data = fsi->readchar(active_z_story->z_story_file)) == EOF)
-        {
-          return _handle_save_or_restore_failure(evaluate_result,
-              i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
-        }
-
-        data ^= *dynamic_index;
-
-        if (data == 0)
-        {
-          consecutive_zeros++;
-        }
-        else
-        {
-          TRACE_LOG("Altered byte at offset %ld.\n",
-              (long int)(dynamic_index - z_mem));
-
-          TRACE_LOG("Memory-Data: %x.\n", *dynamic_index);
-
-          //TRACE_LOG("Skipping %d equal bytes.\n", consecutive_zeros);
-          while (consecutive_zeros != 0)
-          {
-            if (fsi->writechar(0, save_file) == EOF)
-            {
-              return _handle_save_or_restore_failure(evaluate_result,
-                  i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
-            }
+        free(cmem_data);
+        free(original_mem);
+        return _handle_save_or_restore_failure(evaluate_result,
+            i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
+      }
 
-            if (consecutive_zeros > 256)
-            {
-              if (fsi->writechar(0xff, save_file) == EOF)
-              {
-                return _handle_save_or_restore_failure(evaluate_result,
-                    i18n_libfizmo_ERROR_WRITING_SAVE_FILE,
-                    save_file, true);
-              }
-
-              consecutive_zeros -= 256;
-            }
-            else
-            {
-              if (fsi->writechar((int)(consecutive_zeros - 1),save_file) == EOF)
-              {
-                return _handle_save_or_restore_failure(evaluate_result,
-                    i18n_libfizmo_ERROR_WRITING_SAVE_FILE,
-                    save_file, true);
-              }
-
-              consecutive_zeros = 0;
-            }
-          }
+      cmem_size = encode_cmem(dynamic_index, original_mem, length, cmem_data);
 
-          if (fsi->writechar(data, save_file) == EOF)
-          {
-            return _handle_save_or_restore_failure(evaluate_result,
-                i18n_libfizmo_ERROR_WRITING_SAVE_FILE,
-                save_file, true);
-          }
-        }
+      free(original_mem);
 
-        dynamic_index++;
+      if (fsi->writechars(cmem_data, cmem_size, save_file) != cmem_size)
+      {
+        free(cmem_data);
+        return _handle_save_or_restore_failure(evaluate_result,
+            i18n_libfizmo_ERROR_WRITING_SAVE_FILE, save_file, true);
       }
-      TRACE_LOG("... to byte %ld.\n", (long int)(ptr - z_mem));
+
+      free(cmem_data);
+      TRACE_LOG("... to byte %ld.\n", (long int)(address + length));
 
       if (end_current_chunk(save_file) != 0)
       {
@@ -806,16 +989,16 @@ int save_game_to_stream(uint16_t address, uint16_t length, z_file *save_file,
             -0x0100,
             "start_new_chunk");
 
-      while (dynamic_index != active_z_story->static_memory)
+      if (fsi->writechars(
+            dynamic_index,
+            active_z_story->static_memory - dynamic_index,
+            save_file)
+          != (size_t)(active_z_story->static_memory - dynamic_index))
       {
-        if ((fsi->writechar((int)(*dynamic_index), save_file)) == EOF)
-        {
-          return _handle_save_or_restore_failure(
-              evaluate_result,
-              i18n_libfizmo_ERROR_WRITING_SAVE_FILE,
-              save_file, true);
-        }
-        dynamic_index++;
+        return _handle_save_or_restore_failure(
+            evaluate_result,
+            i18n_libfizmo_ERROR_WRITING_SAVE_FILE,
+            save_file, true);
       }
 
       if (end_current_chunk(save_file) != 0)
@@ -841,17 +1024,26 @@ int save_game_to_stream(uint16_t address, uint16_t length, z_file *save_file,
 #endif // ENABLE_TRACING
 
     // Save stack frames
-    if (save_stack_frame(
-          z_stack_index-stack_words_from_active_routine-number_of_locals_active,
-          (uint16_t)stack_words_from_active_routine,
-          number_of_locals_active,
-          save_file) != 0)
+    stks_data = fizmo_malloc((z_stack_index - z_stack) * 2 + 1);
+    stks_index = stks_data;
+    save_stack_frame(
+        z_stack,
+        z_stack_index-stack_words_from_active_routine-number_of_locals_active,
+        (uint16_t)stack_words_from_active_routine,
+        number_of_locals_active,
+        &stks_index);
+
+    if (fsi->writechars(stks_data, stks_index - stks_data, save_file)
+        != (size_t)(stks_index - stks_data))
     {
+      free(stks_data);
       return _handle_save_or_restore_failure(evaluate_result,
           i18n_libfizmo_ERROR_WRITING_SAVE_FILE,
           save_file, true);
     }
 
+    free(stks_data);
+
     if (end_current_chunk(save_file) != 0)
     {
       return _handle_save_or_restore_failure(evaluate_result,
@@ -898,52 +1090,65 @@ int save_game_to_stream(uint16_t address, uint16_t length, z_file *save_file,
       }
       while ( (nof_paragraphs_to_save > 0) && (return_code == 0) );
 
-      if (start_new_chunk("TxHs", save_file) != 0)
+      hst_ptr = history->current_paragraph_index;
+
+      if (strcmp(get_configuration_value("compress-text-history"), "true")
+          == 0)
+      {
+        if (write_compressed_history_chunk(hst_ptr, save_file) != 0)
+        {
+          return _handle_save_or_restore_failure(
+              evaluate_result,
+              i18n_libfizmo_ERROR_WRITING_SAVE_FILE,
+              save_file, true);
+        }
+      }
+      else if (start_new_chunk("TxHs", save_file) != 0)
       {
         return _handle_save_or_restore_failure(
             evaluate_result,
             i18n_libfizmo_ERROR_WRITING_SAVE_FILE,
             save_file, true);
       }
-
-      hst_ptr = history->current_paragraph_index;
-
-      if (hst_ptr < outputhistory[0]->z_history_buffer_back_index)
+      else
       {
-        while (hst_ptr != outputhistory[0]->z_history_buffer_end)
+        if (hst_ptr < outputhistory[0]->z_history_buffer_back_index)
         {
-          if (write_four_byte_number(*hst_ptr, save_file) != 0)
+          while (hst_ptr != outputhistory[0]->z_history_buffer_end)
           {
-            return _handle_save_or_restore_failure(
-                evaluate_result,
-                i18n_libfizmo_ERROR_WRITING_SAVE_FILE,
-                save_file, true);
+            if (write_four_byte_number(*hst_ptr, save_file) != 0)
+            {
+              return _handle_save_or_restore_failure(
+                  evaluate_result,
+                  i18n_libfizmo_ERROR_WRITING_SAVE_FILE,
+                  save_file, true);
+            }
+
+            hst_ptr++;
           }
 
-          hst_ptr++;
+          hst_ptr = outputhistory[0]->z_history_buffer_start;
         }
 
-        hst_ptr = outputhistory[0]->z_history_buffer_start;
-      }
+        while (hst_ptr != outputhistory[0]->z_history_buffer_front_index)
+        {
+          if (write_four_byte_number(*hst_ptr, save_file) != 0)
+          {
+            return _handle_save_or_restore_failure(
+                evaluate_result,
+                i18n_libfizmo_ERROR_WRITING_SAVE_FILE,
+                save_file, true);
+          }
 
-      while (hst_ptr != outputhistory[0]->z_history_buffer_front_index)
-      {
-        if (write_four_byte_number(*hst_ptr, save_file) != 0)
+          hst_ptr++;
+        }
+
+        if (end_current_chunk(save_file) != 0)
         {
-          return _handle_save_or_restore_failure(
-              evaluate_result,
+          return _handle_save_or_restore_failure(evaluate_result,
               i18n_libfizmo_ERROR_WRITING_SAVE_FILE,
               save_file, true);
         }
-
-        hst_ptr++;
-      }
-
-      if (end_current_chunk(save_file) != 0)
-      {
-        return _handle_save_or_restore_failure(evaluate_result,
-            i18n_libfizmo_ERROR_WRITING_SAVE_FILE,
-            save_file, true);
       }
     }
 #endif // DISABLE_OUTPUT_HISTORY
@@ -963,6 +1168,504 @@ int save_game_to_stream(uint16_t address, uint16_t length, z_file *save_file,
 }
 
 
+/* Returns 0 for failure, 1 for success. 
+   This closes the save_file. */
+int save_game_to_stream(uint16_t address, uint16_t length, z_file *save_file,
+  bool evaluate_result)
+{
+  int64_t start_time = turn_statistics_get_timestamp();
+  int result;
+
+  result = _save_game_to_stream(address, length, save_file, evaluate_result);
+  turn_statistics_add_save_time(
+      (long)(turn_statistics_get_timestamp() - start_time));
+
+  return result;
+}
+
+
+// Returns the original dynamic memory from the story file, which is
+// required to encode "CMem" chunks for snapshots and exports, or NULL in
+// case it's not available or "UMem" should be used.
+uint8_t *read_original_dynamic_memory(uint16_t length)
+{
+  uint8_t *result;
+
+  if (
+      (active_z_story->z_story_file == NULL)
+      ||
+      (strcmp(get_configuration_value("quetzal-umem"), "true") == 0)
+      ||
+      (fsi->setfilepos(
+                active_z_story->z_story_file,
+                active_z_story->story_file_exec_offset,
+                SEEK_SET) != 0)
+     )
+    return NULL;
+
+  result = fizmo_malloc(length);
+
+  if (fsi->readchars(result, length, active_z_story->z_story_file) != length)
+  {
+    free(result);
+    return NULL;
+  }
+
+  return result;
+}
+
+
+static uint8_t *append_iff_chunk(uint8_t *dest, char *id, uint8_t *data,
+    size_t length)
+{
+  memcpy(dest, id, 4);
+  dest[4] = (uint8_t)(length >> 24);
+  dest[5] = (uint8_t)(length >> 16);
+  dest[6] = (uint8_t)(length >>  8);
+  dest[7] = (uint8_t)(length      );
+  memcpy(dest + 8, data, length);
+  dest += 8 + length;
+
+  if ((length & 1) != 0)
+    *(dest++) = 0;
+
+  return dest;
+}
+
+
+#ifdef ENABLE_ASYNC_AUTOSAVE
+struct savegame_snapshot *create_savegame_snapshot(uint16_t length,
+    uint8_t *original_memory)
+{
+  struct savegame_snapshot *result;
+  uint32_t pc_on_restore = (uint32_t)(pc - z_mem);
+  char *page_store_path;
+#ifndef DISABLE_OUTPUT_HISTORY
+  z_ucs *hst_ptr;
+  int nof_paragraphs_to_save;
+  history_output *history;
+  int return_code;
+  size_t part1_length;
+#endif // DISABLE_OUTPUT_HISTORY
+
+  flush_stream_3_length();
+
+  result = fizmo_malloc(sizeof(struct savegame_snapshot));
+
+  memcpy(result->ifhd, z_mem + 0x2, 2);
+  memcpy(result->ifhd + 2, z_mem + 0x12, 6);
+  memcpy(result->ifhd + 8, z_mem + 0x1c, 2);
+  result->ifhd[10] = (uint8_t)(pc_on_restore >> 16);
+  result->ifhd[11] = (uint8_t)(pc_on_restore >>  8);
+  result->ifhd[12] = (uint8_t)(pc_on_restore      );
+
+  result->memory = fizmo_malloc(length);
+  memcpy(result->memory, z_mem, length);
+  result->memory_length = length;
+  result->original_memory = original_memory;
+
+  result->stack_words = z_stack_index - z_stack;
+  result->stack = fizmo_malloc(result->stack_words * sizeof(uint16_t) + 1);
+  memcpy(result->stack, z_stack, result->stack_words * sizeof(uint16_t));
+  result->stack_words_from_active_routine
+    = (uint16_t)stack_words_from_active_routine;
+  result->number_of_locals_active = number_of_locals_active;
+
+  // The page store is accessed through the filesys interface, which is
+  // only used from the interpreter's thread, so pages are stored right
+  // away and only the manifest is kept.
+  page_store_path = get_configuration_value("savegame-page-store");
+  result->page_manifest
+    = page_store_path != NULL
+    ? store_pages(result->memory, length, page_store_path)
+    : NULL;
+
+  result->history = NULL;
+  result->history_length = 0;
+  result->compress_history = false;
+
+#ifndef DISABLE_OUTPUT_HISTORY
+  nof_paragraphs_to_save = get_paragraph_save_amount();
+
+  if (
+      (nof_paragraphs_to_save > 0)
+      &&
+      (outputhistory[0] != NULL)
+      &&
+      (outputhistory[0]->z_history_buffer_size > 0)
+     )
+  {
+    history = init_history_output(
+        outputhistory[0], NULL, Z_HISTORY_OUTPUT_WITHOUT_EXTRAS);
+
+    do
+    {
+      return_code = output_rewind_paragraph(history, NULL, NULL, NULL);
+      nof_paragraphs_to_save--;
+    }
+    while ( (nof_paragraphs_to_save > 0) && (return_code == 0) );
+
+    hst_ptr = history->current_paragraph_index;
+    destroy_history_output(history);
+
+    // The history tail is copied into a linear buffer, using the same
+    // traversal as for the "TxHs" chunk.
+    if (hst_ptr < outputhistory[0]->z_history_buffer_back_index)
+    {
+      part1_length = outputhistory[0]->z_history_buffer_end - hst_ptr;
+      result->history_length
+        = part1_length
+        + (outputhistory[0]->z_history_buffer_front_index
+            - outputhistory[0]->z_history_buffer_start);
+      result->history
+        = fizmo_malloc(result->history_length * sizeof(z_ucs) + 1);
+      memcpy(result->history, hst_ptr, part1_length * sizeof(z_ucs));
+      memcpy(
+          result->history + part1_length,
+          outputhistory[0]->z_history_buffer_start,
+          (result->history_length - part1_length) * sizeof(z_ucs));
+    }
+    else
+    {
+      result->history_length
+        = outputhistory[0]->z_history_buffer_front_index - hst_ptr;
+      result->history
+        = fizmo_malloc(result->history_length * sizeof(z_ucs) + 1);
+      memcpy(result->history, hst_ptr,
+          result->history_length * sizeof(z_ucs));
+    }
+
+    result->compress_history
+      = strcmp(get_configuration_value("compress-text-history"), "true") == 0
+      ? true
+      : false;
+  }
+#endif // DISABLE_OUTPUT_HISTORY
+
+  TRACE_LOG("Created savegame snapshot, %d bytes of memory, %ld stack "
+      "words, %ld history chars.\n", length, (long)result->stack_words,
+      (long)result->history_length);
+
+  return result;
+}
+
+
+// Builds a complete Quetzal file from the snapshot in memory. This function
+// doesn't access the interpreter state, only the snapshot, and is run on
+// the autosave thread. Therefore memory is obtained using malloc() instead
+// of fizmo_malloc(), and NULL is returned in case it's exhausted.
+uint8_t *serialize_savegame_snapshot(struct savegame_snapshot *snapshot,
+    size_t *size)
+{
+  size_t max_size;
+  uint8_t *result;
+  uint8_t *result_index;
+  uint8_t *data;
+  uint8_t *data_index;
+  size_t data_size;
+  int nof_pages;
+  char anno[128];
+#ifndef DISABLE_OUTPUT_HISTORY
+  size_t i;
+#endif // DISABLE_OUTPUT_HISTORY
+
+  max_size
+    = 12
+    + 8 + 14
+    + 8 + snapshot->memory_length + snapshot->memory_length / 2 + 3
+    + 8 + snapshot->stack_words * 2 + 1
+    + 8 + sizeof(anno)
+    + 8 + LZSS_MAX_COMPRESSED_SIZE(snapshot->history_length * 5) + 5
+    + snapshot->history_length * 4;
+
+  if ((result = malloc(max_size)) == NULL)
+    return NULL;
+  memcpy(result, "FORM\0\0\0\0IFZS", 12);
+  result_index = append_iff_chunk(result + 12, "IFhd", snapshot->ifhd, 13);
+
+  if (snapshot->page_manifest != NULL)
+  {
+    nof_pages
+      = (snapshot->memory_length + PAGE_STORE_PAGE_SIZE - 1)
+      / PAGE_STORE_PAGE_SIZE;
+    data_size = 8 + nof_pages * PAGE_STORE_HASH_SIZE;
+    if ((data = malloc(data_size)) == NULL)
+    {
+      free(result);
+      return NULL;
+    }
+    data[0] = (uint8_t)(PAGE_STORE_PAGE_SIZE >> 24);
+    data[1] = (uint8_t)(PAGE_STORE_PAGE_SIZE >> 16);
+    data[2] = (uint8_t)(PAGE_STORE_PAGE_SIZE >>  8);
+    data[3] = (uint8_t)(PAGE_STORE_PAGE_SIZE      );
+    data[4] = 0;
+    data[5] = 0;
+    data[6] = (uint8_t)(snapshot->memory_length >> 8);
+    data[7] = (uint8_t)(snapshot->memory_length     );
+    memcpy(data + 8, snapshot->page_manifest,
+        nof_pages * PAGE_STORE_HASH_SIZE);
+    result_index = append_iff_chunk(result_index, "FzPg", data, data_size);
+    free(data);
+  }
+  else if (snapshot->original_memory != NULL)
+  {
+    if ((data = malloc(
+            snapshot->memory_length + snapshot->memory_length / 2 + 2))
+        == NULL)
+    {
+      free(result);
+      return NULL;
+    }
+    data_size = encode_cmem(
+        snapshot->memory,
+        snapshot->original_memory,
+        snapshot->memory_length,
+        data);
+    result_index = append_iff_chunk(result_index, "CMem", data, data_size);
+    free(data);
+  }
+  else
+    result_index = append_iff_chunk(
+        result_index, "UMem", snapshot->memory, snapshot->memory_length);
+
+  if ((data = malloc(snapshot->stack_words * 2 + 1)) == NULL)
+  {
+    free(result);
+    return NULL;
+  }
+  data_index = data;
+  save_stack_frame(
+      snapshot->stack,
+      snapshot->stack
+      + snapshot->stack_words
+      - snapshot->stack_words_from_active_routine
+      - snapshot->number_of_locals_active,
+      snapshot->stack_words_from_active_routine,
+      snapshot->number_of_locals_active,
+      &data_index);
+  result_index = append_iff_chunk(result_index, "Stks", data, data_index-data);
+  free(data);
+
+  snprintf(anno, sizeof(anno),
+      "Interpreter: libfizmo, version: %s.\n", LIBFIZMO_VERSION);
+  result_index = append_iff_chunk(
+      result_index, "ANNO", (uint8_t*)anno, strlen(anno));
+
+#ifndef DISABLE_OUTPUT_HISTORY
+  if (snapshot->history != NULL)
+  {
+    if (bool_equal(snapshot->compress_history, true))
+    {
+      if ((data = build_compressed_history(
+              snapshot->history,
+              snapshot->history + snapshot->history_length,
+              NULL,
+              NULL,
+              &data_size)) == NULL)
+      {
+        free(result);
+        return NULL;
+      }
+      result_index = append_iff_chunk(result_index, "FzHs", data, data_size);
+    }
+    else
+    {
+      data_size = snapshot->history_length * 4;
+      if ((data = malloc(data_size + 1)) == NULL)
+      {
+        free(result);
+        return NULL;
+      }
+      for (i=0; i<snapshot->history_length; i++)
+      {
+        data[i*4    ] = (uint8_t)(snapshot->history[i] >> 24);
+        data[i*4 + 1] = (uint8_t)(snapshot->history[i] >> 16);
+        data[i*4 + 2] = (uint8_t)(snapshot->history[i] >>  8);
+        data[i*4 + 3] = (uint8_t)(snapshot->history[i]      );
+      }
+      result_index = append_iff_chunk(result_index, "TxHs", data, data_size);
+    }
+    free(data);
+  }
+#endif // DISABLE_OUTPUT_HISTORY
+
+  *size = result_index - result;
+  result[4] = (uint8_t)((*size - 8) >> 24);
+  result[5] = (uint8_t)((*size - 8) >> 16);
+  result[6] = (uint8_t)((*size - 8) >>  8);
+  result[7] = (uint8_t)((*size - 8)      );
+
+  return result;
+}
+
+
+void free_savegame_snapshot(struct savegame_snapshot *snapshot)
+{
+  free(snapshot->memory);
+  free(snapshot->stack);
+  if (snapshot->history != NULL)
+    free(snapshot->history);
+  if (snapshot->page_manifest != NULL)
+    free(snapshot->page_manifest);
+  free(snapshot);
+}
+#endif // ENABLE_ASYNC_AUTOSAVE
+
+// Converts the savegame "src_filename", which keeps the dynamic memory in
+// the page store at "store_path", into a standard Quetzal savegame
+// "dst_filename" which can be restored without access to the store. The
+// memory is written as "CMem" chunk, or as "UMem" in case the original
+// story file isn't available or "quetzal-umem" is set. All other chunks
+// are copied unchanged. Since the memory is compared against the active
+// story, the savegame has to belong to it. Returns -1 on error, 0
+// otherwise.
+int export_savegame_to_quetzal(char *src_filename, char *dst_filename,
+    char *store_path)
+{
+  uint16_t length
+    = (uint16_t)(active_z_story->dynamic_memory_end - z_mem + 1);
+  z_file *src_file;
+  z_file *dst_file;
+  uint8_t *data;
+  uint8_t *ptr;
+  uint8_t *end;
+  uint8_t *memory;
+  uint8_t *original_memory;
+  uint8_t *cmem_data;
+  uint8_t *result;
+  uint8_t *result_index;
+  size_t data_len;
+  size_t cmem_size;
+  size_t result_size;
+  uint32_t chunk_length;
+  char chunk_id[5];
+  bool memory_exported = false;
+  int return_code = 0;
+
+  if ((src_file = fsi->openfile(src_filename, FILETYPE_SAVEGAME,
+          FILEACCESS_READ)) == NULL)
+    return -1;
+
+  data = (uint8_t*)fsi_read_whole_file(src_file, &data_len);
+  fsi->closefile(src_file);
+
+  if (data == NULL)
+    return -1;
+
+  if ( (data_len < 12)
+      || (memcmp(data, "FORM", 4) != 0)
+      || (memcmp(data + 8, "IFZS", 4) != 0) )
+  {
+    free(data);
+    return -1;
+  }
+
+  // All chunks but "FzPg" are copied, which is replaced by at most a
+  // "CMem" chunk of the worst case size.
+  result = fizmo_malloc(data_len + 8 + length + length / 2 + 3);
+  memcpy(result, "FORM\0\0\0\0IFZS", 12);
+  result_index = result + 12;
+
+  original_memory = read_original_dynamic_memory(length);
+  memory = fizmo_malloc(length);
+
+  ptr = data + 12;
+  end = data + data_len;
+  chunk_id[4] = 0;
+
+  while ( (return_code == 0) && (end - ptr >= 8) )
+  {
+    memcpy(chunk_id, ptr, 4);
+    chunk_length
+      = ((uint32_t)ptr[4] << 24) | ((uint32_t)ptr[5] << 16)
+      | ((uint32_t)ptr[6] << 8) | (uint32_t)ptr[7];
+    ptr += 8;
+
+    if ((size_t)(end - ptr) < chunk_length)
+    {
+      return_code = -1;
+      break;
+    }
+
+    TRACE_LOG("Exporting chunk \"%s\", %u bytes.\n",
+        chunk_id, (unsigned)chunk_length);
+
+    if (strcmp(chunk_id, "FzPg") == 0)
+    {
+      if (
+          (bool_equal(memory_exported, true))
+          ||
+          (load_page_manifest(memory, length, ptr, chunk_length, store_path)
+           != 0)
+         )
+        return_code = -1;
+      else if (original_memory != NULL)
+      {
+        cmem_data = fizmo_malloc(length + length / 2 + 2);
+        cmem_size = encode_cmem(memory, original_memory, length, cmem_data);
+        result_index = append_iff_chunk(
+            result_index, "CMem", cmem_data, cmem_size);
+        free(cmem_data);
+      }
+      else
+        result_index = append_iff_chunk(result_index, "UMem", memory, length);
+
+      memory_exported = true;
+    }
+    else if (
+        (strcmp(chunk_id, "IFhd") == 0)
+        &&
+        (
+         (chunk_length < 10)
+         ||
+         (memcmp(ptr, z_mem + 0x2, 2) != 0)
+         ||
+         (memcmp(ptr + 2, z_mem + 0x12, 6) != 0)
+         ||
+         (memcmp(ptr + 8, z_mem + 0x1c, 2) != 0)
+        )
+       )
+      return_code = -1;
+    else
+      result_index = append_iff_chunk(
+          result_index, chunk_id, ptr, chunk_length);
+
+    ptr += chunk_length + (chunk_length & 1);
+  }
+
+  free(memory);
+  free(original_memory);
+  free(data);
+
+  if ( (return_code != 0) || (bool_equal(memory_exported, false)) )
+  {
+    free(result);
+    return -1;
+  }
+
+  result_size = result_index - result;
+  result[4] = (uint8_t)((result_size - 8) >> 24);
+  result[5] = (uint8_t)((result_size - 8) >> 16);
+  result[6] = (uint8_t)((result_size - 8) >>  8);
+  result[7] = (uint8_t)((result_size - 8)      );
+
+  if ((dst_file = fsi->openfile(dst_filename, FILETYPE_SAVEGAME,
+          FILEACCESS_WRITE)) == NULL)
+    return_code = -1;
+  else
+  {
+    if (fsi->writechars(result, result_size, dst_file) != result_size)
+      return_code = -1;
+
+    if (fsi->closefile(dst_file) != 0)
+      return_code = -1;
+  }
+
+  free(result);
+  return return_code;
+}
+
+
 void opcode_save_0op(void)
 {
   TRACE_LOG("Opcode: SAVE.\n");
@@ -1048,9 +1751,10 @@ int restore_game_from_stream(uint16_t address, uint16_t length,
   int bytes_read;
   int chunk_length;
   uint16_t stack_word;
-  int data, data2;
+  int data;
   int copylength;
   uint8_t *restored_story_mem;
+  uint8_t *cmem_data;
   uint8_t *ptr;
   struct z_stack_container *saved_stack;
   uint32_t stack_frame_return_pc;
@@ -1074,6 +1778,10 @@ int restore_game_from_stream(uint16_t address, uint16_t length,
 #endif // ENABLE_TRACING
 #endif // DISABLE_OUTPUT_HISTORY
 
+  // Any pending stream 3 length has to go to the current memory now, after
+  // a successful restore it's read again from the restored tables.
+  flush_stream_3_length();
+
   if (find_chunk("IFhd", iff_file) == -1)
     return _handle_save_or_restore_failure(evaluate_result,
         i18n_libfizmo_CANT_FIND_CHUNK_IFHD, iff_file, false);
@@ -1179,92 +1887,76 @@ int restore_game_from_stream(uint16_t address, uint16_t length,
           false);
     }
 
+    // Start with the original dynamic memory and apply the differences
+    // stored in the CMem chunk, which is read in one piece.
+    if (fsi->readchars(restored_story_mem, length,
+          active_z_story->z_story_file) != length)
+    {
+      free(restored_story_mem);
+      return _handle_save_or_restore_failure(evaluate_result,
+          i18n_libfizmo_FATAL_ERROR_READING_STORY_FILE,
+          iff_file, false);
+    }
+
+    cmem_data = fizmo_malloc(chunk_length + 1);
+    if (fsi->readchars(cmem_data, chunk_length, iff_file)
+        != (size_t)chunk_length)
+    {
+      free(cmem_data);
+      free(restored_story_mem);
+      return _handle_save_or_restore_failure(evaluate_result,
+          i18n_libfizmo_ERROR_READING_SAVE_FILE, iff_file, false);
+    }
+
+    ptr = restored_story_mem + length;
     bytes_read = 0;
     while (bytes_read < chunk_length)
     {
-      // Read data from CMem chunk.
-      data = fsi->readchar(iff_file);
-      bytes_read++;
-
-      if (data == EOF)
-      {
-        free(restored_story_mem);
-        return _handle_save_or_restore_failure(evaluate_result,
-            i18n_libfizmo_ERROR_READING_SAVE_FILE, iff_file, false);
-      }
+      data = cmem_data[bytes_read++];
 
       if (data != 0)
       {
-        data2 = fsi->readchar(active_z_story->z_story_file);
         // Found content difference to original story file.
-
-        if (data2 == EOF)
-        {
-          free(restored_story_mem);
-          return _handle_save_or_restore_failure(evaluate_result,
-              i18n_libfizmo_FATAL_ERROR_READING_STORY_FILE,
-              iff_file, false);
-        }
+        if (dynamic_index == ptr)
+          break;
 
         TRACE_LOG("Altered byte at offset %ld.\n",
             (long int)(dynamic_index - restored_story_mem));
 
-        TRACE_LOG("CMem-Data: %x, Story-Data: %x.\n", data, data2);
+        TRACE_LOG("CMem-Data: %x, Story-Data: %x.\n", data, *dynamic_index);
 
-        *dynamic_index = (uint8_t)(data2 ^ data);
+        *dynamic_index ^= (uint8_t)data;
         dynamic_index++;
       }
       else
       {
         // Found block identical to story file.
+        if (bytes_read == chunk_length)
+          break;
 
-        data = fsi->readchar(iff_file);
-        bytes_read++;
-        if (data == EOF)
-        {
-          free(restored_story_mem);
-          return _handle_save_or_restore_failure(evaluate_result,
-              i18n_libfizmo_ERROR_READING_SAVE_FILE,
-              iff_file, false);
-        }
-        copylength = data + 1;
+        copylength = cmem_data[bytes_read++] + 1;
 
         //TRACE_LOG("Skipping %d equal bytes.\n", copylength);
 
-        for (i=0; i<copylength; i++)
-        {
-          data2 = fsi->readchar(active_z_story->z_story_file);
-          if (data2 == EOF)
-          {
-            free(restored_story_mem);
-            return _handle_save_or_restore_failure(evaluate_result,
-                i18n_libfizmo_FATAL_ERROR_READING_STORY_FILE,
-                iff_file, false);
-          }
-          *dynamic_index = (uint8_t)data2;
-          dynamic_index++;
-        }
+        if (copylength > ptr - dynamic_index)
+          break;
+        dynamic_index += copylength;
       }
     }
-    TRACE_LOG("Successfully read %d bytes, uncompressed: %ld.\n",
-        bytes_read, (long int)(dynamic_index - restored_story_mem + 1));
-
-    ptr = restored_story_mem + length;
+    free(cmem_data);
 
-    while (dynamic_index != ptr)
+    if (bytes_read != chunk_length)
     {
-      data = fsi->readchar(active_z_story->z_story_file);
-      if (data == EOF)
-      {
-        free(restored_story_mem);
-        return _handle_save_or_restore_failure(evaluate_result,
-            i18n_libfizmo_FATAL_ERROR_READING_STORY_FILE,
-            iff_file, false);
-      }
-      *dynamic_index = (uint8_t)data;
-      dynamic_index++;
+      free(restored_story_mem);
+      return _handle_save_or_restore_failure(evaluate_result,
+          i18n_libfizmo_ERROR_READING_SAVE_FILE, iff_file, false);
     }
 
+    TRACE_LOG("Successfully read %d bytes, uncompressed: %ld.\n",
+        bytes_read, (long int)(dynamic_index - restored_story_mem + 1));
+
+    dynamic_index = ptr;
+
     TRACE_LOG("Filled undefined memory with source file up to byte: %ld.\n",
         (long int)(dynamic_index - restored_story_mem));
   }
@@ -1289,19 +1981,25 @@ int restore_game_from_stream(uint16_t address, uint16_t length,
     TRACE_LOG("Chunk length: %d, length-to-read: %d.\n",
         chunk_length, length);
 
-    ptr = restored_story_mem + length;
-    while (dynamic_index != ptr)
+    if (fsi->readchars(restored_story_mem, length, iff_file) != length)
     {
-      data = fsi->readchar(iff_file);
-      if (data == EOF)
-      {
-        free(restored_story_mem);
-        return _handle_save_or_restore_failure(evaluate_result,
-            i18n_libfizmo_ERROR_READING_SAVE_FILE,
-            iff_file, false);
-      }
-      *dynamic_index = (uint8_t)data;
-      dynamic_index++;
+      free(restored_story_mem);
+      return _handle_save_or_restore_failure(evaluate_result,
+          i18n_libfizmo_ERROR_READING_SAVE_FILE,
+          iff_file, false);
+    }
+  }
+  else if (find_chunk("FzPg", iff_file) == 0)
+  {
+    if (read_page_manifest_chunk(
+          restored_story_mem,
+          length,
+          get_configuration_value("savegame-page-store"),
+          iff_file) != 0)
+    {
+      free(restored_story_mem);
+      return _handle_save_or_restore_failure(evaluate_result,
+          i18n_libfizmo_ERROR_READING_SAVE_FILE, iff_file, false);
     }
   }
   else
@@ -1489,6 +2187,33 @@ int restore_game_from_stream(uint16_t address, uint16_t length,
   nof_paragraphs_to_save = get_paragraph_save_amount();
 
   if (
+      (nof_paragraphs_to_save > 0)
+      &&
+      (outputhistory[0] != NULL)
+      &&
+      (find_chunk("FzHs", iff_file) == 0)
+     )
+  {
+    if (read_chunk_length(iff_file) == -1)
+    {
+      free(restored_story_mem);
+      return _handle_save_or_restore_failure(evaluate_result,
+          i18n_libfizmo_CANT_READ_CHUNK_LENGTH, iff_file, false);
+    }
+
+    chunk_length = get_last_chunk_length();
+    TRACE_LOG("compressed history size: %d bytes.\n", chunk_length);
+
+    if (restore_compressed_history_chunk(chunk_length, iff_file) != 0)
+    {
+      free(restored_story_mem);
+      return _handle_save_or_restore_failure(evaluate_result,
+          i18n_libfizmo_ERROR_READING_SAVE_FILE, iff_file, false);
+    }
+
+    active_interface->game_was_restored_and_history_modified();
+  }
+  else if (
       (nof_paragraphs_to_save > 0)
       &&
       (outputhistory[0] != NULL)
@@ -1589,6 +2314,9 @@ int restore_game_from_stream(uint16_t address, uint16_t length,
 
   free(restored_story_mem);
 
+  init_zscii_unicode_tables();
+  dynamic_memory_replaced();
+
   fizmo_new_screen_size(
       active_interface->get_screen_width_in_characters(),
       active_interface->get_screen_height_in_lines());
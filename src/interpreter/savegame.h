@@ -53,6 +53,38 @@ int restore_game(uint16_t address, uint16_t length, char *filename,
 bool detect_saved_game(char *file_to_check, char **story_file_to_load);
 #endif // DISABLE_FILELIST
 
+uint8_t *read_original_dynamic_memory(uint16_t length);
+int export_savegame_to_quetzal(char *src_filename, char *dst_filename,
+    char *store_path);
+
+#ifdef ENABLE_ASYNC_AUTOSAVE
+// A copy of all state that goes into a savegame, which can be serialized
+// independently from the running interpreter.
+struct savegame_snapshot
+{
+  uint8_t ifhd[13];
+  uint8_t *memory;
+  uint16_t memory_length;
+  // Not owned by the snapshot, may be NULL in case CMem can't be used.
+  uint8_t *original_memory;
+  uint16_t *stack;
+  size_t stack_words;
+  uint16_t stack_words_from_active_routine;
+  uint8_t number_of_locals_active;
+  z_ucs *history;
+  size_t history_length;
+  bool compress_history;
+  // The hashes of the stored pages, NULL in case the store isn't used.
+  uint8_t *page_manifest;
+};
+
+struct savegame_snapshot *create_savegame_snapshot(uint16_t length,
+    uint8_t *original_memory);
+uint8_t *serialize_savegame_snapshot(struct savegame_snapshot *snapshot,
+    size_t *size);
+void free_savegame_snapshot(struct savegame_snapshot *snapshot);
+#endif // ENABLE_ASYNC_AUTOSAVE
+
 void opcode_save_0op(void);
 void opcode_save_ext(void);
 void opcode_restore_0op(void);
@@ -0,0 +1,757 @@
+
+/* screvenc.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// A screen interface for remote front-ends which encodes the screen
+// output into the event stream described in src/tools/screvent.h. All
+// calls which don't produce output -- capability queries, input,
+// configuration and so on -- are passed on to the host interface, which
+// usually talks to the remote side as well.
+//
+// Text is collected until some other event follows, so that consecutive
+// output ends up in a single TEXT event. Style, font and colour changes
+// are only sent once they're in effect for text, so that changes which
+// are reverted before anything is printed don't show up at all. While
+// the interpreter keeps a blockbuffer of the upper window, output into it
+// is not sent as text; instead, the cells which changed since the last
+// time are sent as an UPPER_WINDOW event whenever events are flushed.
+
+#ifndef screvenc_c_INCLUDED
+#define screvenc_c_INCLUDED
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../tools/tracelog.h"
+#include "../tools/types.h"
+#include "../tools/z_ucs.h"
+#include "../tools/screvent.h"
+#include "screvenc.h"
+#include "fizmo.h"
+#include "blockbuf.h"
+
+// Attribute order for colour events and the "requested_colours" and
+// "sent_colours" arrays.
+#define COLOUR_FOREGROUND 0
+#define COLOUR_BACKGROUND 1
+#define COLOUR_WINDOW 2
+
+static struct z_screen_interface event_interface;
+static struct z_screen_interface *host = NULL;
+static void (*sink)(uint8_t *data, size_t len, void *parameter) = NULL;
+static void *sink_parameter = NULL;
+
+static uint8_t *event_buffer = NULL;
+static size_t event_buffer_size = 0;
+static size_t event_buffer_index = 0;
+
+static z_ucs *pending_text = NULL;
+static size_t pending_text_size = 0;
+static size_t pending_text_len = 0;
+
+static bool attributes_sent = false;
+static z_style requested_style = Z_STYLE_ROMAN;
+static z_style sent_style;
+static z_font requested_font = Z_FONT_NORMAL;
+static z_font sent_font;
+static z_colour requested_colours[3];
+static z_colour sent_colours[3];
+
+static int16_t active_window = 0;
+static int32_t cursor_line = 0;
+static int32_t cursor_column = 0;
+
+#ifndef DISABLE_BLOCKBUFFER
+static struct blockbuf_char *upper_window_snapshot = NULL;
+static int snapshot_width = 0;
+static int snapshot_height = 0;
+#endif // DISABLE_BLOCKBUFFER
+
+
+static uint8_t *reserve_event_space(size_t len)
+{
+  if (event_buffer_index + len > event_buffer_size)
+  {
+    event_buffer_size = event_buffer_index + len + SCREEN_EVENT_FLUSH_SIZE;
+    event_buffer = (uint8_t*)fizmo_realloc(event_buffer, event_buffer_size);
+  }
+
+  return event_buffer + event_buffer_index;
+}
+
+
+static void commit_event(uint8_t *event_end)
+{
+  event_buffer_index = (size_t)(event_end - event_buffer);
+}
+
+
+// Writes a byte count and the UTF-8 form of "text" to "dst", for which
+// SCREEN_EVENT_MAX_VARINT_SIZE + 4 * len bytes have to be available.
+static uint8_t *write_text(uint8_t *dst, z_ucs *text, size_t len)
+{
+  size_t nof_bytes, chars_consumed;
+  uint8_t *text_start;
+
+  nof_bytes = z_ucs_to_utf8(
+      (char*)dst + SCREEN_EVENT_MAX_VARINT_SIZE,
+      4 * len,
+      text,
+      len,
+      &chars_consumed);
+
+  text_start = write_screen_event_varint(dst, (uint32_t)nof_bytes);
+  memmove(text_start, dst + SCREEN_EVENT_MAX_VARINT_SIZE, nof_bytes);
+
+  return text_start + nof_bytes;
+}
+
+
+static void write_unsigned_event(uint8_t type, uint32_t value)
+{
+  uint8_t *ptr = reserve_event_space(1 + SCREEN_EVENT_MAX_VARINT_SIZE);
+
+  *(ptr++) = type;
+  commit_event(write_screen_event_varint(ptr, value));
+}
+
+
+static void write_signed_event(uint8_t type, int nof_values, int32_t value1,
+    int32_t value2, int32_t value3)
+{
+  int32_t values[3] = { value1, value2, value3 };
+  uint8_t *ptr = reserve_event_space(1 + 3 * SCREEN_EVENT_MAX_VARINT_SIZE);
+  int i;
+
+  *(ptr++) = type;
+  for (i=0; i<nof_values; i++)
+    ptr = write_screen_event_signed(ptr, values[i]);
+  commit_event(ptr);
+}
+
+
+static void flush_pending_text(void)
+{
+  uint8_t *ptr;
+
+  if (pending_text_len == 0)
+    return;
+
+  ptr = reserve_event_space(
+      1 + SCREEN_EVENT_MAX_VARINT_SIZE + 4 * pending_text_len);
+  *(ptr++) = SCREEN_EVENT_TEXT;
+  commit_event(write_text(ptr, pending_text, pending_text_len));
+
+  pending_text_len = 0;
+}
+
+
+static void send_requested_attributes(void)
+{
+  if (
+      (attributes_sent == true)
+      &&
+      (requested_style == sent_style)
+      &&
+      (requested_font == sent_font)
+      &&
+      (memcmp(requested_colours, sent_colours, sizeof(sent_colours)) == 0)
+     )
+    return;
+
+  flush_pending_text();
+
+  if ( (attributes_sent == false) || (requested_style != sent_style) )
+    write_unsigned_event(SCREEN_EVENT_STYLE, (uint32_t)requested_style);
+
+  if ( (attributes_sent == false) || (requested_font != sent_font) )
+    write_signed_event(SCREEN_EVENT_FONT, 1, requested_font, 0, 0);
+
+  if (
+      (attributes_sent == false)
+      ||
+      (memcmp(requested_colours, sent_colours, sizeof(sent_colours)) != 0)
+     )
+    write_signed_event(
+        SCREEN_EVENT_COLOUR,
+        3,
+        requested_colours[COLOUR_FOREGROUND],
+        requested_colours[COLOUR_BACKGROUND],
+        requested_colours[COLOUR_WINDOW]);
+
+  sent_style = requested_style;
+  sent_font = requested_font;
+  memcpy(sent_colours, requested_colours, sizeof(sent_colours));
+  attributes_sent = true;
+}
+
+
+// Output is only diffed against the blockbuffer in case the interpreter
+// maintains it for the upper window, see output.c.
+static bool upper_window_diffs_active(void)
+{
+#ifndef DISABLE_BLOCKBUFFER
+  return (upper_window_buffer != NULL) && (ver >= 3) && (ver != 6);
+#else
+  return false;
+#endif // DISABLE_BLOCKBUFFER
+}
+
+
+#ifndef DISABLE_BLOCKBUFFER
+// Marks all cells as unknown to the remote side, so they are all sent
+// with the next UPPER_WINDOW event. The blockbuffer never contains zero
+// characters, so they'll always differ.
+static void invalidate_upper_window_snapshot(void)
+{
+  if (upper_window_snapshot != NULL)
+    memset(upper_window_snapshot, 0,
+        sizeof(struct blockbuf_char) * snapshot_width * snapshot_height);
+}
+
+
+// Same as the blockbuffer after an erase: All spaces in the default
+// colours.
+static void clear_upper_window_snapshot(void)
+{
+  struct blockbuf_char *ptr = upper_window_snapshot;
+  int i;
+
+  for (i=0; i<snapshot_width * snapshot_height; i++)
+  {
+    ptr->character = Z_UCS_SPACE;
+    ptr->foreground_colour = upper_window_buffer->default_foreground_colour;
+    ptr->background_colour = upper_window_buffer->default_background_colour;
+    ptr->style = upper_window_buffer->default_style;
+    ptr->font = upper_window_buffer->default_font;
+    ptr++;
+  }
+}
+
+
+static bool cells_equal(struct blockbuf_char *c1, struct blockbuf_char *c2)
+{
+  return (c1->character == c2->character)
+    && (c1->style == c2->style)
+    && (c1->font == c2->font)
+    && (c1->foreground_colour == c2->foreground_colour)
+    && (c1->background_colour == c2->background_colour);
+}
+
+
+static bool attributes_equal(struct blockbuf_char *c1,
+    struct blockbuf_char *c2)
+{
+  return (c1->style == c2->style)
+    && (c1->font == c2->font)
+    && (c1->foreground_colour == c2->foreground_colour)
+    && (c1->background_colour == c2->background_colour);
+}
+
+
+// Finds the next run of changed cells with equal attributes within one
+// row, starting at *position. Returns false in case there's none left.
+static bool find_changed_run(int *position, int *run_len)
+{
+  struct blockbuf_char *content = upper_window_buffer->content;
+  int nof_cells = snapshot_width * snapshot_height;
+  int row_end;
+
+  while (
+      (*position < nof_cells)
+      &&
+      (cells_equal(content + *position, upper_window_snapshot + *position)
+       == true)
+      )
+    (*position)++;
+
+  if (*position == nof_cells)
+    return false;
+
+  row_end = (*position / snapshot_width + 1) * snapshot_width;
+  *run_len = 1;
+  while (
+      (*position + *run_len < row_end)
+      &&
+      (cells_equal(content + *position + *run_len,
+                   upper_window_snapshot + *position + *run_len) == false)
+      &&
+      (attributes_equal(content + *position,
+                        content + *position + *run_len) == true)
+      )
+    (*run_len)++;
+
+  return true;
+}
+
+
+static void send_upper_window_changes(void)
+{
+  struct blockbuf_char *content, *cell;
+  struct blockbuf_char previous;
+  int position, run_len, nof_runs, nof_run_chars, i;
+  uint8_t *ptr, flags;
+  int32_t last_end;
+
+  if (upper_window_diffs_active() == false)
+    return;
+
+  content = upper_window_buffer->content;
+
+  if (
+      (snapshot_width != upper_window_buffer->width)
+      ||
+      (snapshot_height != upper_window_buffer->height)
+     )
+  {
+    TRACE_LOG("Resizing upper window snapshot to %d*%d.\n",
+        upper_window_buffer->width, upper_window_buffer->height);
+
+    snapshot_width = upper_window_buffer->width;
+    snapshot_height = upper_window_buffer->height;
+    upper_window_snapshot = (struct blockbuf_char*)fizmo_realloc(
+        upper_window_snapshot,
+        sizeof(struct blockbuf_char) * snapshot_width * snapshot_height);
+    invalidate_upper_window_snapshot();
+  }
+
+  // The run count has to be written first, so it's determined before.
+  nof_runs = 0;
+  nof_run_chars = 0;
+  position = 0;
+  while (find_changed_run(&position, &run_len) == true)
+  {
+    nof_runs++;
+    nof_run_chars += run_len;
+    position += run_len;
+  }
+
+  if (nof_runs == 0)
+    return;
+
+  TRACE_LOG("Sending %d runs with %d upper window cells.\n",
+      nof_runs, nof_run_chars);
+
+  flush_pending_text();
+
+  ptr = reserve_event_space(
+      1
+      + 3 * SCREEN_EVENT_MAX_VARINT_SIZE
+      + nof_runs * 7 * SCREEN_EVENT_MAX_VARINT_SIZE
+      + nof_run_chars * 4);
+
+  *(ptr++) = SCREEN_EVENT_UPPER_WINDOW;
+  ptr = write_screen_event_varint(ptr, (uint32_t)snapshot_width);
+  ptr = write_screen_event_varint(ptr, (uint32_t)snapshot_height);
+  ptr = write_screen_event_varint(ptr, (uint32_t)nof_runs);
+
+  memset(&previous, 0, sizeof(previous));
+  last_end = 0;
+  position = 0;
+  while (find_changed_run(&position, &run_len) == true)
+  {
+    cell = content + position;
+
+    flags
+      = (cell->style != previous.style ? SCREEN_EVENT_RUN_STYLE : 0)
+      | (cell->font != previous.font ? SCREEN_EVENT_RUN_FONT : 0)
+      | (cell->foreground_colour != previous.foreground_colour
+          ? SCREEN_EVENT_RUN_FOREGROUND : 0)
+      | (cell->background_colour != previous.background_colour
+          ? SCREEN_EVENT_RUN_BACKGROUND : 0);
+
+    ptr = write_screen_event_varint(ptr, (uint32_t)(position - last_end));
+    ptr = write_screen_event_varint(ptr, flags);
+    if ((flags & SCREEN_EVENT_RUN_STYLE) != 0)
+      ptr = write_screen_event_signed(ptr, cell->style);
+    if ((flags & SCREEN_EVENT_RUN_FONT) != 0)
+      ptr = write_screen_event_signed(ptr, cell->font);
+    if ((flags & SCREEN_EVENT_RUN_FOREGROUND) != 0)
+      ptr = write_screen_event_signed(ptr, cell->foreground_colour);
+    if ((flags & SCREEN_EVENT_RUN_BACKGROUND) != 0)
+      ptr = write_screen_event_signed(ptr, cell->background_colour);
+
+    // The cells' characters are gathered in the pending text buffer,
+    // which is empty at this point.
+    if ((size_t)run_len > pending_text_size)
+    {
+      pending_text_size = (size_t)run_len;
+      pending_text = (z_ucs*)fizmo_realloc(
+          pending_text, sizeof(z_ucs) * pending_text_size);
+    }
+    for (i=0; i<run_len; i++)
+      pending_text[i] = cell[i].character;
+    ptr = write_text(ptr, pending_text, (size_t)run_len);
+
+    previous = *cell;
+    position += run_len;
+    last_end = position;
+  }
+
+  commit_event(ptr);
+
+  memcpy(upper_window_snapshot, content,
+      sizeof(struct blockbuf_char) * snapshot_width * snapshot_height);
+}
+#endif // DISABLE_BLOCKBUFFER
+
+
+// Hands everything encoded so far to the sink.
+void flush_screen_events(void)
+{
+  flush_pending_text();
+#ifndef DISABLE_BLOCKBUFFER
+  send_upper_window_changes();
+#endif // DISABLE_BLOCKBUFFER
+
+  if ( (event_buffer_index > 0) && (sink != NULL) )
+    sink(event_buffer, event_buffer_index, sink_parameter);
+
+  event_buffer_index = 0;
+}
+
+
+static void flush_if_buffer_full(void)
+{
+  if (event_buffer_index >= SCREEN_EVENT_FLUSH_SIZE)
+    flush_screen_events();
+}
+
+
+static void event_z_ucs_output_with_length(z_ucs *z_ucs_output, size_t len)
+{
+  // Text for the upper window is already stored in the blockbuffer.
+  if ( (active_window == 1) && (upper_window_diffs_active() == true) )
+    return;
+
+  if (len == 0)
+    return;
+
+  send_requested_attributes();
+
+  if (pending_text_len + len > pending_text_size)
+  {
+    pending_text_size = pending_text_len + len + 1024;
+    pending_text = (z_ucs*)fizmo_realloc(
+        pending_text, sizeof(z_ucs) * pending_text_size);
+  }
+
+  memcpy(pending_text + pending_text_len, z_ucs_output, sizeof(z_ucs) * len);
+  pending_text_len += len;
+
+  if (pending_text_len >= SCREEN_EVENT_FLUSH_SIZE)
+  {
+    flush_pending_text();
+    flush_if_buffer_full();
+  }
+}
+
+
+static void event_z_ucs_output(z_ucs *z_ucs_output)
+{
+  event_z_ucs_output_with_length(z_ucs_output, z_ucs_len(z_ucs_output));
+}
+
+
+static void event_set_text_style(z_style text_style)
+{
+  requested_style = text_style;
+}
+
+
+static void event_set_colour(z_colour foreground, z_colour background,
+    int16_t window)
+{
+  requested_colours[COLOUR_FOREGROUND] = foreground;
+  requested_colours[COLOUR_BACKGROUND] = background;
+  requested_colours[COLOUR_WINDOW] = window;
+}
+
+
+static void event_set_font(z_font font_type)
+{
+  requested_font = font_type;
+}
+
+
+static void event_set_buffer_mode(uint8_t new_buffer_mode)
+{
+  flush_pending_text();
+  write_unsigned_event(SCREEN_EVENT_BUFFER_MODE, new_buffer_mode);
+  flush_if_buffer_full();
+}
+
+
+static void event_set_cursor(int16_t line, int16_t column, int16_t window)
+{
+  // Cursor movement within the upper window is conveyed by the cells'
+  // positions.
+  if ( (window == 1) && (upper_window_diffs_active() == true) )
+    return;
+
+  flush_pending_text();
+  write_signed_event(SCREEN_EVENT_CURSOR, 3,
+      line - cursor_line, column - cursor_column, window);
+  cursor_line = line;
+  cursor_column = column;
+  flush_if_buffer_full();
+}
+
+
+static void event_split_window(int16_t nof_lines)
+{
+  flush_pending_text();
+  write_signed_event(SCREEN_EVENT_SPLIT_WINDOW, 1, nof_lines, 0, 0);
+  flush_if_buffer_full();
+}
+
+
+static void event_set_window(int16_t window_number)
+{
+  flush_pending_text();
+  write_signed_event(SCREEN_EVENT_SET_WINDOW, 1, window_number, 0, 0);
+  active_window = window_number;
+  flush_if_buffer_full();
+}
+
+
+static void event_erase_window(int16_t window_number)
+{
+  flush_pending_text();
+
+#ifndef DISABLE_BLOCKBUFFER
+  // The blockbuffer has just been cleared as well, see output.c. Changes
+  // made before are dropped, they're no longer visible anyway.
+  if (
+      ( (window_number == 1) || (window_number < 0) )
+      &&
+      (upper_window_snapshot != NULL)
+      &&
+      (upper_window_diffs_active() == true)
+      &&
+      (snapshot_width == upper_window_buffer->width)
+      &&
+      (snapshot_height == upper_window_buffer->height)
+     )
+    clear_upper_window_snapshot();
+#endif // DISABLE_BLOCKBUFFER
+
+  write_signed_event(SCREEN_EVENT_ERASE_WINDOW, 1, window_number, 0, 0);
+  flush_if_buffer_full();
+}
+
+
+static void event_erase_line_value(uint16_t start_position)
+{
+  flush_pending_text();
+  write_unsigned_event(SCREEN_EVENT_ERASE_LINE, start_position);
+  flush_if_buffer_full();
+}
+
+
+static void event_show_status(z_ucs *room_description, int status_line_mode,
+    int16_t parameter1, int16_t parameter2)
+{
+  size_t len = z_ucs_len(room_description);
+  uint8_t *ptr;
+
+  flush_pending_text();
+
+  ptr = reserve_event_space(
+      1 + 4 * SCREEN_EVENT_MAX_VARINT_SIZE + 4 * len);
+  *(ptr++) = SCREEN_EVENT_STATUS;
+  ptr = write_text(ptr, room_description, len);
+  ptr = write_screen_event_signed(ptr, status_line_mode);
+  ptr = write_screen_event_signed(ptr, parameter1);
+  ptr = write_screen_event_signed(ptr, parameter2);
+  commit_event(ptr);
+
+  flush_if_buffer_full();
+}
+
+
+static int16_t event_read_line(zscii *dest, uint16_t maximum_length,
+    uint16_t tenth_seconds, uint32_t verification_routine,
+    uint8_t preloaded_input, int *tenth_seconds_elapsed,
+    bool disable_command_history, bool return_on_escape)
+{
+  flush_screen_events();
+
+  return host->read_line(dest, maximum_length, tenth_seconds,
+      verification_routine, preloaded_input, tenth_seconds_elapsed,
+      disable_command_history, return_on_escape);
+}
+
+
+static int event_read_char(uint16_t tenth_seconds,
+    uint32_t verification_routine, int *tenth_seconds_elapsed)
+{
+  flush_screen_events();
+
+  return host->read_char(
+      tenth_seconds, verification_routine, tenth_seconds_elapsed);
+}
+
+
+static void reset_encoder_state(void)
+{
+  pending_text_len = 0;
+  attributes_sent = false;
+  requested_style = Z_STYLE_ROMAN;
+  requested_font = Z_FONT_NORMAL;
+  requested_colours[COLOUR_FOREGROUND] = Z_COLOUR_UNDEFINED;
+  requested_colours[COLOUR_BACKGROUND] = Z_COLOUR_UNDEFINED;
+  requested_colours[COLOUR_WINDOW] = 0;
+  active_window = 0;
+#ifndef DISABLE_BLOCKBUFFER
+  invalidate_upper_window_snapshot();
+#endif // DISABLE_BLOCKBUFFER
+}
+
+
+static void event_reset_interface()
+{
+  flush_screen_events();
+  reset_encoder_state();
+  host->reset_interface();
+}
+
+
+static void event_game_was_restored_and_history_modified()
+{
+  uint8_t *ptr;
+
+  flush_pending_text();
+  ptr = reserve_event_space(1);
+  *(ptr++) = SCREEN_EVENT_RESTORED;
+  commit_event(ptr);
+#ifndef DISABLE_BLOCKBUFFER
+  invalidate_upper_window_snapshot();
+#endif // DISABLE_BLOCKBUFFER
+
+  if (host->game_was_restored_and_history_modified != NULL)
+    host->game_was_restored_and_history_modified();
+}
+
+
+static int event_close_interface(z_ucs *error_message)
+{
+  size_t len = error_message != NULL ? z_ucs_len(error_message) : 0;
+  uint8_t *ptr;
+
+  flush_pending_text();
+#ifndef DISABLE_BLOCKBUFFER
+  send_upper_window_changes();
+#endif // DISABLE_BLOCKBUFFER
+
+  ptr = reserve_event_space(1 + SCREEN_EVENT_MAX_VARINT_SIZE + 4 * len);
+  *(ptr++) = SCREEN_EVENT_CLOSE;
+  commit_event(write_text(ptr, error_message, len));
+  flush_screen_events();
+
+  return host->close_interface(error_message);
+}
+
+
+// Returns an interface which encodes all output and passes everything else
+// on to "host_interface". The encoded events are handed to "event_sink".
+// There is only a single event interface at any time.
+struct z_screen_interface *create_screen_event_interface(
+    struct z_screen_interface *host_interface,
+    void (*event_sink)(uint8_t *data, size_t len, void *parameter),
+    void *parameter)
+{
+  host = host_interface;
+  sink = event_sink;
+  sink_parameter = parameter;
+  event_buffer_index = 0;
+  cursor_line = 0;
+  cursor_column = 0;
+  reset_encoder_state();
+
+  event_interface = *host_interface;
+  event_interface.set_buffer_mode = &event_set_buffer_mode;
+  event_interface.z_ucs_output = &event_z_ucs_output;
+  event_interface.z_ucs_output_with_length = &event_z_ucs_output_with_length;
+  event_interface.read_line = &event_read_line;
+  event_interface.read_char = &event_read_char;
+  event_interface.show_status = &event_show_status;
+  event_interface.set_text_style = &event_set_text_style;
+  event_interface.set_colour = &event_set_colour;
+  event_interface.set_font = &event_set_font;
+  event_interface.split_window = &event_split_window;
+  event_interface.set_window = &event_set_window;
+  event_interface.erase_window = &event_erase_window;
+  event_interface.set_cursor = &event_set_cursor;
+  event_interface.erase_line_value = &event_erase_line_value;
+  event_interface.reset_interface = &event_reset_interface;
+  event_interface.close_interface = &event_close_interface;
+  event_interface.game_was_restored_and_history_modified
+    = &event_game_was_restored_and_history_modified;
+
+  return &event_interface;
+}
+
+
+void destroy_screen_event_interface(void)
+{
+  flush_screen_events();
+
+  if (event_buffer != NULL)
+  {
+    free(event_buffer);
+    event_buffer = NULL;
+  }
+  event_buffer_size = 0;
+
+  if (pending_text != NULL)
+  {
+    free(pending_text);
+    pending_text = NULL;
+  }
+  pending_text_size = 0;
+
+#ifndef DISABLE_BLOCKBUFFER
+  if (upper_window_snapshot != NULL)
+  {
+    free(upper_window_snapshot);
+    upper_window_snapshot = NULL;
+  }
+  snapshot_width = 0;
+  snapshot_height = 0;
+#endif // DISABLE_BLOCKBUFFER
+
+  host = NULL;
+  sink = NULL;
+}
+
+#endif /* screvenc_c_INCLUDED */
+
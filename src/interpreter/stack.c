@@ -43,6 +43,8 @@
 #include "routine.h"
 #include "variable.h"
 #include "fizmo.h"
+#include "allocator.h"
+#include "memstat.h"
 #include "../locales/libfizmo_locales.h"
 
 
@@ -83,7 +85,7 @@ static void resize_z_stack(int32_t added_capacity)
 
   // Initially, z_stack is NULL. If realloc() is called with a pointer to
   // null it works like malloc() which suits just fine.
-  z_stack = (uint16_t*)fizmo_realloc(
+  z_stack = (uint16_t*)fizmo_session_realloc(
           z_stack,
           current_z_stack_size * sizeof(uint16_t));
 
@@ -99,6 +101,8 @@ static void resize_z_stack(int32_t added_capacity)
   TRACE_LOG("Z-Stack now at %p (element behind: %p, z_stack_index: %p).\n",
       z_stack, behind_z_stack, z_stack_index);
   TRACE_LOG("new stack size: %d.\n", current_z_stack_size);
+
+  update_subsystem_memory_stats(MEMORY_STATS_Z_STACK);
 }
 
 
@@ -223,6 +227,7 @@ void drop_z_stack_words(int word_counter)
   z_stack_index = NULL;
   behind_z_stack = NULL;
   stack_words_from_active_routine = 0;
+  update_subsystem_memory_stats(MEMORY_STATS_Z_STACK);
 
   return current_z_stack_data;
 }
@@ -234,14 +239,28 @@ void delete_stack_container(struct z_stack_container *stack_data)
     return;
 
   if (stack_data->z_stack != NULL)
-    free(stack_data->z_stack);
+    fizmo_session_free(stack_data->z_stack);
   free(stack_data);
 }
 
 
+void free_z_stack_memory(void)
+{
+  fizmo_session_free(z_stack);
+
+  current_z_stack_size = 0;
+  z_stack = NULL;
+  z_stack_index = NULL;
+  behind_z_stack = NULL;
+  local_variable_storage_index = NULL;
+  stack_words_from_active_routine = 0;
+  update_subsystem_memory_stats(MEMORY_STATS_Z_STACK);
+}
+
+
 void restore_old_stack(/*@only@*/ struct z_stack_container *old_z_stack_data)
 {
-  free(z_stack);
+  fizmo_session_free(z_stack);
 
   current_z_stack_size = old_z_stack_data->current_z_stack_size;
   z_stack = old_z_stack_data->z_stack;
@@ -251,6 +270,7 @@ void restore_old_stack(/*@only@*/ struct z_stack_container *old_z_stack_data)
     = old_z_stack_data->stack_words_from_active_routine;
 
   free(old_z_stack_data);
+  update_subsystem_memory_stats(MEMORY_STATS_Z_STACK);
 }
 
 
@@ -67,6 +67,7 @@ void drop_z_stack_words(int byte_counter);
 /*@only@*/ struct z_stack_container *create_new_stack();
 void delete_stack_container(struct z_stack_container *stack_data);
 /*@dependent@*/ uint16_t *allocate_z_stack_words(uint32_t byte_counter);
+void free_z_stack_memory(void);
 void restore_old_stack(/*@only@*/ struct z_stack_container *old_stack_data);
 void store_first_stack_frame();
 void store_followup_stack_frame_header(uint8_t number_of_locals,
@@ -0,0 +1,827 @@
+
+/* storyidx.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// Indexes derived from the story file which speed up dictionary lookups,
+// property lookups and the output of abbreviations. They only depend on
+// the story file and may thus be stored in a warm image.
+//
+// All index data is kept in a single block, so that it can be used right
+// out of a mapped file. Numbers are stored in native byte order and all
+// addresses are offsets from the start of the story memory.
+//
+// Some of the tables the indexes are derived from may be located in
+// dynamic memory. The bytes of these which the indexes depend on are
+// marked in a bitmap, and the block also holds their original values. In
+// case the story modifies one of them, all indexes are disabled until a
+// restore, undo or restart brings back the original values.
+
+#ifndef storyidx_c_INCLUDED
+#define storyidx_c_INCLUDED
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../tools/tracelog.h"
+#include "../tools/types.h"
+#include "storyidx.h"
+#include "fizmo.h"
+#include "text.h"
+#include "zpu.h"
+
+#define STORY_INDEX_NO_ABBREVIATION 0xffffffff
+#define STORY_INDEX_MAXIMUM_ABBREVIATION_WORDS 128
+#define STORY_INDEX_MAXIMUM_PROPERTIES_PER_OBJECT 256
+
+
+struct story_index_header
+{
+  uint32_t length;
+  uint32_t dynamic_memory_size;
+
+  uint32_t dictionary_start;
+  uint32_t nof_dictionary_entries;
+  uint32_t dictionary_entry_length;
+  uint32_t nof_dictionary_buckets;
+  uint32_t nof_objects;
+  uint32_t nof_properties;
+  uint32_t abbreviation_text_length;
+
+  // Offsets from the start of the index data.
+  uint32_t dictionary_buckets;
+  uint32_t objects;
+  uint32_t properties;
+  uint32_t abbreviations;
+  uint32_t abbreviation_text;
+  uint32_t dependencies;
+  uint32_t original_bytes;
+};
+
+static uint8_t *index_data = NULL;
+static bool index_data_allocated = false;
+static bool indexes_enabled = false;
+static struct story_index_header *header;
+
+// Entry number plus one for every bucket, 0 for empty buckets.
+static uint32_t *dictionary_buckets;
+
+// Three words per object: a bitmap of the property numbers from 63 to 32,
+// one for the numbers from 31 to 0 and the position of the object's first
+// entry in "properties". These hold the properties' addresses in
+// descending order of their numbers.
+static uint32_t *objects;
+static uint32_t *properties;
+
+// Start and length in "abbreviation_text" for every abbreviation.
+static uint32_t *abbreviations;
+static zscii *abbreviation_text;
+
+static uint8_t *dependencies;
+static uint8_t *original_bytes;
+
+
+static uint32_t count_bits(uint32_t value)
+{
+  value = value - ((value >> 1) & 0x55555555);
+  value = (value & 0x33333333) + ((value >> 2) & 0x33333333);
+  return (((value + (value >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+}
+
+
+static uint32_t get_dictionary_word_hash(uint8_t *word, int word_length)
+{
+  // FNV-1a
+  uint32_t hash = 2166136261U;
+  int i;
+
+  for (i=0; i<word_length; i++)
+  {
+    hash ^= word[i];
+    hash *= 16777619U;
+  }
+
+  return hash;
+}
+
+
+static void set_index_pointers(void)
+{
+  header = (struct story_index_header*)index_data;
+  dictionary_buckets
+    = (uint32_t*)(index_data + header->dictionary_buckets);
+  objects = (uint32_t*)(index_data + header->objects);
+  properties = (uint32_t*)(index_data + header->properties);
+  abbreviations = (uint32_t*)(index_data + header->abbreviations);
+  abbreviation_text = index_data + header->abbreviation_text;
+  dependencies = index_data + header->dependencies;
+  original_bytes = index_data + header->original_bytes;
+}
+
+
+static bool dependencies_match(void)
+{
+  uint32_t i;
+
+  for (i=0; i<header->dynamic_memory_size; i++)
+    if (
+        ((dependencies[i >> 3] & (1 << (i & 7))) != 0)
+        &&
+        (z_mem[i] != original_bytes[i])
+       )
+      return false;
+
+  return true;
+}
+
+
+static void mark_dependency(uint8_t *deps, uint32_t dynamic_memory_size,
+    uint32_t address, uint32_t length)
+{
+  for (; (length > 0) && (address < dynamic_memory_size); address++, length--)
+    deps[address >> 3] |= 1 << (address & 7);
+}
+
+
+// Returns the number of dictionary buckets or 0 in case the dictionary
+// can't be indexed.
+static uint32_t index_dictionary(uint32_t story_size, uint8_t *deps,
+    uint32_t dynamic_memory_size, uint32_t **result_buckets,
+    uint32_t *result_start, uint32_t *result_nof_entries,
+    uint32_t *result_entry_length)
+{
+  uint32_t dictionary = active_z_story->dictionary_table - z_mem;
+  int word_length = ver >= 4 ? 6 : 4;
+  uint32_t nof_input_codes, entry_length, nof_entries, start;
+  uint32_t nof_buckets, i, bucket;
+  uint32_t *buckets;
+  int16_t stored_nof_entries;
+  bool is_unsorted;
+
+  if (dictionary + 1 > story_size)
+    return 0;
+  nof_input_codes = z_mem[dictionary];
+  if (dictionary + nof_input_codes + 4 > story_size)
+    return 0;
+
+  entry_length = z_mem[dictionary + nof_input_codes + 1];
+  stored_nof_entries
+    = (int16_t)load_word(z_mem + dictionary + nof_input_codes + 2);
+  is_unsorted = stored_nof_entries < 0;
+  nof_entries
+    = (uint32_t)(is_unsorted ? -stored_nof_entries : stored_nof_entries);
+  start = dictionary + nof_input_codes + 4;
+
+  if (
+      (nof_entries == 0)
+      ||
+      (entry_length < (uint32_t)word_length)
+      ||
+      (start + nof_entries * entry_length > story_size)
+     )
+    return 0;
+
+  // The index has to find the same entry as the binary search for sorted
+  // dictionaries, so these have to be strictly ascending.
+  if (is_unsorted == false)
+    for (i=1; i<nof_entries; i++)
+      if (memcmp(
+            z_mem + start + (i - 1) * entry_length,
+            z_mem + start + i * entry_length,
+            word_length) >= 0)
+      {
+        TRACE_LOG("Dictionary entry %d is out of order.\n", i);
+        return 0;
+      }
+
+  nof_buckets = 16;
+  while (nof_buckets < nof_entries * 2)
+    nof_buckets *= 2;
+
+  buckets = (uint32_t*)fizmo_malloc(nof_buckets * sizeof(uint32_t));
+  memset(buckets, 0, nof_buckets * sizeof(uint32_t));
+
+  // For unsorted dictionaries the search returns the last matching entry,
+  // so later entries replace earlier ones.
+  for (i=0; i<nof_entries; i++)
+  {
+    bucket = get_dictionary_word_hash(z_mem + start + i * entry_length,
+        word_length) & (nof_buckets - 1);
+
+    while (
+        (buckets[bucket] != 0)
+        &&
+        (memcmp(
+          z_mem + start + (buckets[bucket] - 1) * entry_length,
+          z_mem + start + i * entry_length,
+          word_length) != 0)
+        )
+      bucket = (bucket + 1) & (nof_buckets - 1);
+
+    buckets[bucket] = i + 1;
+    mark_dependency(deps, dynamic_memory_size, start + i * entry_length,
+        word_length);
+  }
+
+  mark_dependency(deps, dynamic_memory_size, dictionary + nof_input_codes + 1,
+      3);
+
+  *result_buckets = buckets;
+  *result_start = start;
+  *result_nof_entries = nof_entries;
+  *result_entry_length = entry_length;
+  return nof_buckets;
+}
+
+
+// Walks the property tables in the same way get_object_property does.
+// Returns the number of objects indexed, which is 0 in case any of the
+// tables doesn't fit into the story.
+static uint32_t index_properties(uint32_t story_size, uint8_t *deps,
+    uint32_t dynamic_memory_size, uint32_t **result_objects,
+    uint32_t **result_properties, uint32_t *result_nof_properties)
+{
+  uint32_t object_tree = active_z_story->object_tree - z_mem;
+  uint32_t object_size = active_z_story->object_size;
+  uint32_t tables_start = story_size;
+  uint32_t objects_size = 0, properties_size = 0;
+  uint32_t nof_objects = 0, nof_properties = 0;
+  uint32_t *object_data = NULL, *property_data = NULL;
+  uint32_t first_occurrence[64];
+  uint32_t object_number, table, entry, number, length, code_size, n;
+  uint8_t size_byte;
+
+  for (
+      object_number = 1;
+      (object_number <= active_z_story->maximum_object_number)
+      && (object_tree + (object_number + 1) * object_size <= tables_start);
+      object_number++)
+  {
+    entry = object_tree + object_number * object_size;
+    table = load_word(z_mem + entry + active_z_story->object_property_index);
+
+    if (table >= story_size)
+      break;
+    if (table < tables_start)
+    {
+      tables_start = table;
+      if (entry + object_size > tables_start)
+        break;
+    }
+
+    mark_dependency(deps, dynamic_memory_size,
+        entry + active_z_story->object_property_index, 2);
+    mark_dependency(deps, dynamic_memory_size, table, 1);
+    table += z_mem[table] * 2 + 1;
+
+    memset(first_occurrence, 0, sizeof(first_occurrence));
+
+    for (n=0; ; n++)
+    {
+      if (
+          (table >= story_size)
+          ||
+          (n == STORY_INDEX_MAXIMUM_PROPERTIES_PER_OBJECT)
+         )
+        break;
+
+      size_byte = z_mem[table];
+      if (size_byte == 0)
+      {
+        mark_dependency(deps, dynamic_memory_size, table, 1);
+        break;
+      }
+
+      if (ver <= 3)
+      {
+        number = size_byte & 0x1f;
+        length = (size_byte >> 5) + 1;
+        code_size = 1;
+      }
+      else
+      {
+        number = size_byte & 0x3f;
+        if ((size_byte & 0x80) != 0)
+        {
+          if (table + 1 >= story_size)
+            break;
+          if ((length = z_mem[table + 1] & 0x3f) == 0)
+            length = 64;
+          code_size = 2;
+        }
+        else
+        {
+          length = (size_byte & 0x40) != 0 ? 2 : 1;
+          code_size = 1;
+        }
+      }
+
+      mark_dependency(deps, dynamic_memory_size, table, code_size);
+      if (first_occurrence[number] == 0)
+        first_occurrence[number] = table;
+      table += code_size + length;
+    }
+
+    if ( (table >= story_size) || (z_mem[table] != 0) )
+    {
+      TRACE_LOG("Property table of object %d isn't terminated.\n",
+          object_number);
+      free(object_data);
+      free(property_data);
+      return 0;
+    }
+
+    if (nof_objects == objects_size)
+    {
+      objects_size = objects_size == 0 ? 256 : objects_size * 2;
+      object_data = (uint32_t*)fizmo_realloc(
+          object_data, objects_size * 3 * sizeof(uint32_t));
+    }
+
+    object_data[nof_objects * 3] = 0;
+    object_data[nof_objects * 3 + 1] = 0;
+    object_data[nof_objects * 3 + 2] = nof_properties;
+
+    for (number=64; number>0; number--)
+      if (first_occurrence[number - 1] != 0)
+      {
+        if (number > 32)
+          object_data[nof_objects * 3] |= 1U << (number - 33);
+        else
+          object_data[nof_objects * 3 + 1] |= 1U << (number - 1);
+
+        if (nof_properties == properties_size)
+        {
+          properties_size = properties_size == 0 ? 1024 : properties_size * 2;
+          property_data = (uint32_t*)fizmo_realloc(
+              property_data, properties_size * sizeof(uint32_t));
+        }
+        property_data[nof_properties++] = first_occurrence[number - 1];
+      }
+
+    nof_objects++;
+  }
+
+  *result_objects = object_data;
+  *result_properties = property_data;
+  *result_nof_properties = nof_properties;
+  return nof_objects;
+}
+
+
+// Returns the total length of the abbreviations' texts.
+static uint32_t index_abbreviations(uint32_t story_size, uint8_t *deps,
+    uint32_t dynamic_memory_size, uint32_t *abbreviation_data,
+    zscii **result_text)
+{
+  uint32_t nof_abbreviations = ver >= 3 ? 96 : ver == 2 ? 32 : 0;
+  uint32_t table = active_z_story->abbreviations_table - z_mem;
+  uint32_t text_length = 0, text_size = 0;
+  uint32_t i, j, string, end, nof_words;
+  uint16_t word;
+  uint8_t zchar;
+  bool is_cacheable;
+  z_ucs buf[STORY_INDEX_MAXIMUM_ABBREVIATION_WORDS * 3 + 1];
+  zscii *text = NULL;
+  int len;
+
+  for (i=0; i<STORY_INDEX_NOF_ABBREVIATIONS; i++)
+  {
+    abbreviation_data[i * 2] = 0;
+    abbreviation_data[i * 2 + 1] = STORY_INDEX_NO_ABBREVIATION;
+  }
+
+  if (table + nof_abbreviations * 2 > story_size)
+    return 0;
+
+  for (i=0; i<nof_abbreviations; i++)
+  {
+    string = load_word(z_mem + table + i * 2) * 2;
+    is_cacheable = false;
+
+    // Abbreviations containing further abbreviations are left to the
+    // regular decoding, which reports these.
+    for (end=string, nof_words=0;
+        (end + 2 <= story_size)
+        && (nof_words < STORY_INDEX_MAXIMUM_ABBREVIATION_WORDS);
+        end+=2, nof_words++)
+    {
+      word = load_word(z_mem + end);
+      for (j=0; j<3; j++)
+      {
+        zchar = (word >> ((2 - j) * 5)) & 0x1f;
+        if ( (zchar == 1) || ( (ver >= 3) && (zchar <= 3) && (zchar != 0) ) )
+          break;
+      }
+      if (j != 3)
+        break;
+      if ((word & 0x8000) != 0)
+      {
+        is_cacheable = true;
+        break;
+      }
+    }
+
+    if (is_cacheable == false)
+    {
+      TRACE_LOG("Not indexing abbreviation %d.\n", i);
+      continue;
+    }
+
+    if ((len = decode_zchar_string_to_zscii(
+            buf,
+            STORY_INDEX_MAXIMUM_ABBREVIATION_WORDS * 3 + 1,
+            z_mem + string)) < 0)
+      continue;
+
+    if (text_length + len > text_size)
+    {
+      text_size = text_length + len + 1024;
+      text = (zscii*)fizmo_realloc(text, text_size);
+    }
+
+    abbreviation_data[i * 2] = text_length;
+    abbreviation_data[i * 2 + 1] = len;
+    for (j=0; j<(uint32_t)len; j++)
+      text[text_length++] = (zscii)buf[j];
+
+    mark_dependency(deps, dynamic_memory_size, table + i * 2, 2);
+    mark_dependency(deps, dynamic_memory_size, string, end + 2 - string);
+  }
+
+  if (
+      (active_z_story->alphabet_table >= z_mem)
+      &&
+      (active_z_story->alphabet_table <= active_z_story->high_memory_end)
+     )
+    mark_dependency(deps, dynamic_memory_size,
+        active_z_story->alphabet_table - z_mem, 26 * 3);
+
+  *result_text = text;
+  return text_length;
+}
+
+
+static uint32_t align_index_offset(uint32_t offset)
+{
+  return (offset + 7) & ~7;
+}
+
+
+void build_story_indexes(void)
+{
+  uint32_t story_size = active_z_story->high_memory_end - z_mem + 1;
+  uint32_t dynamic_memory_size = active_z_story->dynamic_memory_end - z_mem + 1;
+  uint32_t deps_size = (dynamic_memory_size + 7) / 8;
+  uint32_t abbreviation_data[STORY_INDEX_NOF_ABBREVIATIONS * 2];
+  uint32_t *bucket_data = NULL, *object_data = NULL, *property_data = NULL;
+  uint32_t dictionary_start = 0, nof_dictionary_entries = 0;
+  uint32_t dictionary_entry_length = 0, nof_dictionary_buckets;
+  uint32_t nof_objects, nof_properties = 0, abbreviation_text_length;
+  struct story_index_header new_header;
+  zscii *text = NULL;
+  uint8_t *deps;
+
+  free_story_indexes();
+
+  deps = (uint8_t*)fizmo_malloc(deps_size);
+  memset(deps, 0, deps_size);
+
+  nof_dictionary_buckets = index_dictionary(story_size, deps,
+      dynamic_memory_size, &bucket_data, &dictionary_start,
+      &nof_dictionary_entries, &dictionary_entry_length);
+
+  nof_objects = index_properties(story_size, deps, dynamic_memory_size,
+      &object_data, &property_data, &nof_properties);
+
+  abbreviation_text_length = index_abbreviations(story_size, deps,
+      dynamic_memory_size, abbreviation_data, &text);
+
+  memset(&new_header, 0, sizeof(new_header));
+  new_header.dynamic_memory_size = dynamic_memory_size;
+  new_header.dictionary_start = dictionary_start;
+  new_header.nof_dictionary_entries = nof_dictionary_entries;
+  new_header.dictionary_entry_length = dictionary_entry_length;
+  new_header.nof_dictionary_buckets = nof_dictionary_buckets;
+  new_header.nof_objects = nof_objects;
+  new_header.nof_properties = nof_properties;
+  new_header.abbreviation_text_length = abbreviation_text_length;
+
+  new_header.dictionary_buckets = align_index_offset(sizeof(new_header));
+  new_header.objects = align_index_offset(new_header.dictionary_buckets
+      + nof_dictionary_buckets * sizeof(uint32_t));
+  new_header.properties = align_index_offset(new_header.objects
+      + nof_objects * 3 * sizeof(uint32_t));
+  new_header.abbreviations = align_index_offset(new_header.properties
+      + nof_properties * sizeof(uint32_t));
+  new_header.abbreviation_text = align_index_offset(new_header.abbreviations
+      + sizeof(abbreviation_data));
+  new_header.dependencies = align_index_offset(new_header.abbreviation_text
+      + abbreviation_text_length);
+  new_header.original_bytes = align_index_offset(new_header.dependencies
+      + deps_size);
+  new_header.length = align_index_offset(new_header.original_bytes
+      + dynamic_memory_size);
+
+  index_data = (uint8_t*)fizmo_malloc(new_header.length);
+  memset(index_data, 0, new_header.length);
+  index_data_allocated = true;
+
+  memcpy(index_data, &new_header, sizeof(new_header));
+  if (bucket_data != NULL)
+    memcpy(index_data + new_header.dictionary_buckets, bucket_data,
+        nof_dictionary_buckets * sizeof(uint32_t));
+  if (object_data != NULL)
+    memcpy(index_data + new_header.objects, object_data,
+        nof_objects * 3 * sizeof(uint32_t));
+  if (property_data != NULL)
+    memcpy(index_data + new_header.properties, property_data,
+        nof_properties * sizeof(uint32_t));
+  memcpy(index_data + new_header.abbreviations, abbreviation_data,
+      sizeof(abbreviation_data));
+  if (text != NULL)
+    memcpy(index_data + new_header.abbreviation_text, text,
+        abbreviation_text_length);
+  memcpy(index_data + new_header.dependencies, deps, deps_size);
+  memcpy(index_data + new_header.original_bytes, z_mem, dynamic_memory_size);
+
+  free(bucket_data);
+  free(object_data);
+  free(property_data);
+  free(text);
+  free(deps);
+
+  set_index_pointers();
+  indexes_enabled = true;
+
+  TRACE_LOG("Built story indexes: %d dictionary buckets, %d objects, "
+      "%d properties, %d bytes of abbreviations.\n",
+      nof_dictionary_buckets, nof_objects, nof_properties,
+      abbreviation_text_length);
+}
+
+
+static bool index_offset_is_valid(uint32_t offset, uint32_t size,
+    uint32_t length)
+{
+  return ((offset & 3) == 0) && (offset <= length) && (size <= length - offset);
+}
+
+
+int use_story_index_data(uint8_t *data, size_t length)
+{
+  struct story_index_header *data_header = (struct story_index_header*)data;
+  uint32_t story_size = active_z_story->high_memory_end - z_mem + 1;
+  uint32_t dynamic_memory_size = active_z_story->dynamic_memory_end - z_mem + 1;
+  uint32_t len = (uint32_t)length;
+
+  free_story_indexes();
+
+  if (
+      (length < sizeof(struct story_index_header))
+      ||
+      (((uintptr_t)data & 7) != 0)
+      ||
+      (data_header->length != len)
+      ||
+      (data_header->dynamic_memory_size != dynamic_memory_size)
+      ||
+      (data_header->dictionary_start > story_size)
+      ||
+      (data_header->nof_dictionary_buckets > 65536)
+      ||
+      ( (data_header->nof_dictionary_buckets
+         & (data_header->nof_dictionary_buckets - 1)) != 0)
+      ||
+      (!index_offset_is_valid(data_header->dictionary_buckets,
+        data_header->nof_dictionary_buckets * sizeof(uint32_t), len))
+      ||
+      (data_header->nof_objects > 65535)
+      ||
+      (data_header->nof_properties > len)
+      ||
+      (!index_offset_is_valid(data_header->objects,
+        data_header->nof_objects * 3 * sizeof(uint32_t), len))
+      ||
+      (!index_offset_is_valid(data_header->properties,
+        data_header->nof_properties * sizeof(uint32_t), len))
+      ||
+      (!index_offset_is_valid(data_header->abbreviations,
+        STORY_INDEX_NOF_ABBREVIATIONS * 2 * sizeof(uint32_t), len))
+      ||
+      (!index_offset_is_valid(data_header->abbreviation_text,
+        data_header->abbreviation_text_length, len))
+      ||
+      (!index_offset_is_valid(data_header->dependencies,
+        (dynamic_memory_size + 7) / 8, len))
+      ||
+      (!index_offset_is_valid(data_header->original_bytes,
+        dynamic_memory_size, len))
+     )
+  {
+    TRACE_LOG("Story index data doesn't match the story.\n");
+    build_story_indexes();
+    return -1;
+  }
+
+  index_data = data;
+  index_data_allocated = false;
+  set_index_pointers();
+  indexes_enabled = dependencies_match();
+
+  TRACE_LOG("Using stored story indexes, enabled: %d.\n", indexes_enabled);
+  return 0;
+}
+
+
+uint8_t *get_story_index_data(size_t *length)
+{
+  if (index_data == NULL)
+    return NULL;
+
+  *length = header->length;
+  return index_data;
+}
+
+
+size_t get_story_index_memory_size(void)
+{
+  return index_data_allocated == true ? header->length : 0;
+}
+
+
+void free_story_indexes(void)
+{
+  if (index_data_allocated == true)
+    free(index_data);
+
+  index_data = NULL;
+  index_data_allocated = false;
+  indexes_enabled = false;
+}
+
+
+void story_indexes_memory_written(uint8_t *address, size_t length)
+{
+  uint32_t offset, end;
+
+  if ( (indexes_enabled == false) || (address < z_mem) )
+    return;
+
+  offset = address - z_mem;
+  end = offset + length > header->dynamic_memory_size
+    ? header->dynamic_memory_size
+    : offset + length;
+
+  for (; offset<end; offset++)
+    if (
+        ((dependencies[offset >> 3] & (1 << (offset & 7))) != 0)
+        &&
+        (z_mem[offset] != original_bytes[offset])
+       )
+    {
+      TRACE_LOG("Write to $%x disables story indexes.\n", offset);
+      indexes_enabled = false;
+      return;
+    }
+}
+
+
+void story_indexes_memory_replaced(void)
+{
+  if (index_data != NULL)
+  {
+    indexes_enabled = dependencies_match();
+    TRACE_LOG("Story indexes enabled: %d.\n", indexes_enabled);
+  }
+}
+
+
+int find_indexed_dictionary_entry(uint8_t *dictionary_start,
+    int16_t number_of_dictionary_entries, uint8_t dictionary_entry_length,
+    uint8_t *word)
+{
+  int word_length = ver >= 4 ? 6 : 4;
+  uint32_t bucket, entry;
+
+  if (
+      (indexes_enabled == false)
+      ||
+      (header->nof_dictionary_buckets == 0)
+      ||
+      (dictionary_start != z_mem + header->dictionary_start)
+      ||
+      ((uint32_t)number_of_dictionary_entries
+       != header->nof_dictionary_entries)
+      ||
+      (dictionary_entry_length != header->dictionary_entry_length)
+     )
+    return STORY_INDEX_NOT_INDEXED;
+
+  bucket = get_dictionary_word_hash(word, word_length)
+    & (header->nof_dictionary_buckets - 1);
+
+  while ((entry = dictionary_buckets[bucket]) != 0)
+  {
+    if (memcmp(dictionary_start + (entry - 1) * dictionary_entry_length,
+          word, word_length) == 0)
+      return (int)(entry - 1);
+    bucket = (bucket + 1) & (header->nof_dictionary_buckets - 1);
+  }
+
+  return -1;
+}
+
+
+int find_indexed_property(uint16_t object_number, uint16_t property_number,
+    uint8_t **result)
+{
+  uint32_t *object;
+  uint32_t position;
+
+  if (
+      (indexes_enabled == false)
+      ||
+      (object_number == 0)
+      ||
+      (object_number > header->nof_objects)
+     )
+    return STORY_INDEX_NOT_INDEXED;
+
+  object = objects + (object_number - 1) * 3;
+
+  if (property_number >= 32)
+  {
+    if (
+        (property_number > 63)
+        ||
+        ((object[0] & (1U << (property_number - 32))) == 0)
+       )
+    {
+      *result = NULL;
+      return 0;
+    }
+
+    position = count_bits(
+        property_number == 63 ? 0 : object[0] >> (property_number - 31));
+  }
+  else
+  {
+    if ((object[1] & (1U << property_number)) == 0)
+    {
+      *result = NULL;
+      return 0;
+    }
+
+    position = count_bits(object[0]) + count_bits(
+        property_number == 31 ? 0 : object[1] >> (property_number + 1));
+  }
+
+  *result = z_mem + properties[object[2] + position];
+  return 0;
+}
+
+
+zscii *get_indexed_abbreviation(int abbreviation_number, size_t *length)
+{
+  if (
+      (indexes_enabled == false)
+      ||
+      (abbreviations[abbreviation_number * 2 + 1]
+       == STORY_INDEX_NO_ABBREVIATION)
+     )
+    return NULL;
+
+  *length = abbreviations[abbreviation_number * 2 + 1];
+  return abbreviation_text + abbreviations[abbreviation_number * 2];
+}
+
+#endif /* storyidx_c_INCLUDED */
+
@@ -0,0 +1,88 @@
+
+/* storyidx.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef storyidx_h_INCLUDED
+#define storyidx_h_INCLUDED
+
+#include "../tools/types.h"
+
+#define STORY_INDEX_NOF_ABBREVIATIONS 96
+
+// Lookup results for tables which are not covered by the indexes. The
+// caller then has to search the story memory itself.
+#define STORY_INDEX_NOT_INDEXED -2
+
+// Builds the indexes for the active story. "z_mem", "ver" and
+// "active_z_story" have to be set up, and the story memory has to be
+// unmodified since it was read from the story file.
+void build_story_indexes(void);
+
+// Uses the "length" bytes at "data" -- as returned by get_story_index_data
+// in an earlier session -- instead of building the indexes. The data is not
+// copied and has to stay valid until free_story_indexes() is invoked.
+// Returns -1 if the data can't be used, in which case the indexes are built.
+int use_story_index_data(uint8_t *data, size_t length);
+
+uint8_t *get_story_index_data(size_t *length);
+size_t get_story_index_memory_size(void);
+void free_story_indexes(void);
+
+// Invoked by "dynamic_memory_written" in zpu.c. Parts of the story the
+// indexes depend on may be located in dynamic memory, modifying these
+// disables the indexes.
+void story_indexes_memory_written(uint8_t *address, size_t length);
+
+// Invoked by "dynamic_memory_replaced" in zpu.c. The indexes are enabled again in case all the parts
+// they depend on match the story file again.
+void story_indexes_memory_replaced(void);
+
+// Returns the number of the dictionary entry for the encoded word at
+// "word", 0 for the first entry, or -1 if the word isn't in the
+// dictionary. Returns STORY_INDEX_NOT_INDEXED in case the dictionary
+// starting at "dictionary_start" with the given layout isn't indexed.
+int find_indexed_dictionary_entry(uint8_t *dictionary_start,
+    int16_t number_of_dictionary_entries, uint8_t dictionary_entry_length,
+    uint8_t *word);
+
+// Stores the address of the object's property "property_number" -- the
+// first one in case the table lists it more than once -- or NULL if the
+// object doesn't have it in "result" and returns 0. Returns
+// STORY_INDEX_NOT_INDEXED for objects not covered by the index.
+int find_indexed_property(uint16_t object_number, uint16_t property_number,
+    uint8_t **result);
+
+// Returns the ZSCII output of abbreviation "abbreviation_number", decoded
+// starting in alphabet A0, or NULL if the abbreviation isn't indexed.
+zscii *get_indexed_abbreviation(int abbreviation_number, size_t *length);
+
+#endif /* storyidx_h_INCLUDED */
+
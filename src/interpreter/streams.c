@@ -44,6 +44,11 @@
 #include "../tools/filesys.h"
 #include "streams.h"
 #include "config.h"
+#include "turnstat.h"
+#include "replay.h"
+#ifdef ENABLE_ASYNC_STREAMS
+#include "bgwriter.h"
+#endif // ENABLE_ASYNC_STREAMS
 #include "fizmo.h"
 #include "wordwrap.h"
 #include "text.h"
@@ -78,6 +83,13 @@ static bool script_wrapper_active = true;
 static uint8_t *stream_3_start[MAXIMUM_STREAM_3_DEPTH];
 static uint8_t *stream_3_index[MAXIMUM_STREAM_3_DEPTH];
 static int stream_3_current_depth = -1;
+// The length of the current stream 3 table is counted here and only written
+// back to the table's length word on "output_stream -3" or when the story
+// may access memory, see flush_stream_3_length(). Once flushed, the count is
+// read from the table again on the next output, so that writes to the length
+// word by the story and restored memory are taken into account.
+static uint16_t stream_3_length[MAXIMUM_STREAM_3_DEPTH];
+static bool stream_3_length_pending = false;
 z_file *stream_4 = NULL;
 /*@only@*/ static char *stream_4_filename;
 static size_t stream_4_filename_size = 0;
@@ -104,6 +116,17 @@ static bool stream_2_init_underway = false;
 static bool stream_4_was_already_active = false;
 static bool stream_2_wrapping_disabled;
 static int stream2margin;
+#ifdef ENABLE_ASYNC_STREAMS
+// In case "async-stream-writes" is set, streams 2 and 4 are written by
+// background writers, see bgwriter.c.
+static BG_WRITER *stream_2_writer = NULL;
+static BG_WRITER *stream_4_writer = NULL;
+// Once a background write has failed, all streams are written synchronously
+// for the rest of the session. Since the failure may be noticed while a
+// stream is being written, it's reported with the next regular output.
+static bool async_writes_failed = false;
+static int async_write_error_stream = 0;
+#endif // ENABLE_ASYNC_STREAMS
 
 
 
@@ -115,11 +138,120 @@ void open_streams()
 }
 
 
+#ifdef ENABLE_ASYNC_STREAMS
+static void async_write_failed(z_file *file)
+{
+  TRACE_LOG("Background write to %p failed.\n", file);
+
+  async_writes_failed = true;
+  if (async_write_error_stream == 0)
+    async_write_error_stream = file == stream_4 ? 4 : 2;
+}
+
+
+static void report_async_write_error(void)
+{
+  int stream_number = async_write_error_stream;
+
+  if (stream_number == 0)
+    return;
+
+  // Reset first, since the message itself passes through here again.
+  async_write_error_stream = 0;
+
+  (void)streams_latin1_output("\n");
+  (void)i18n_translate(
+      libfizmo_module_name,
+      i18n_libfizmo_ERROR_WRITING_TO_OUTPUT_STREAM_P0D,
+      stream_number);
+  (void)streams_latin1_output("\n");
+}
+
+
+// Returns a background writer for the given file, creating it if
+// necessary, or NULL in case the file should be written synchronously.
+static BG_WRITER *get_async_writer(BG_WRITER **writer, z_file *file)
+{
+  if (*writer != NULL)
+  {
+    if (bg_writer_error_occurred(*writer) == false)
+      return *writer;
+
+    // Destroying the writer writes the data kept since the failure, so
+    // the following synchronous writes continue where it left off. In
+    // case that fails as well or data had to be dropped, it's reported
+    // once more like any other failed write.
+    TRACE_LOG("Background writer failed, writing synchronously.\n");
+    if (bg_writer_destroy(*writer) != 0)
+      async_write_failed(file);
+    *writer = NULL;
+    return NULL;
+  }
+
+  if ( (async_writes_failed == true)
+      || (strcmp(get_configuration_value("async-stream-writes"), "true")
+        != 0) )
+    return NULL;
+
+  return (*writer = bg_writer_new(file, &async_write_failed));
+}
+
+
+static void destroy_async_writer(BG_WRITER **writer)
+{
+  z_file *file;
+
+  if (*writer != NULL)
+  {
+    file = (*writer)->file;
+    if (bg_writer_destroy(*writer) != 0)
+    {
+      TRACE_LOG("Background writer reported an error.\n");
+      async_write_failed(file);
+    }
+    *writer = NULL;
+  }
+}
+
+
+static void async_write_z_ucs(BG_WRITER *writer, z_ucs *z_ucs_output)
+{
+  char buf[1024];
+  size_t len = z_ucs_len(z_ucs_output), chars_consumed, bytes_written;
+
+  while (len > 0)
+  {
+    bytes_written = z_ucs_to_utf8(
+        buf, sizeof(buf), z_ucs_output, len, &chars_consumed);
+    (void)bg_writer_write(writer, buf, bytes_written);
+    z_ucs_output += chars_consumed;
+    len -= chars_consumed;
+  }
+}
+#endif // ENABLE_ASYNC_STREAMS
+
+
 static void stream_2_output_destination(z_ucs *z_ucs_output,
     void *UNUSED(dummy))
 {
+#ifdef ENABLE_ASYNC_STREAMS
+  BG_WRITER *writer;
+#endif // ENABLE_ASYNC_STREAMS
+
   if (*z_ucs_output != 0)
   {
+#ifdef ENABLE_ASYNC_STREAMS
+    if (
+        (strcmp(get_configuration_value("sync-transcript"), "true") != 0)
+        &&
+        ((writer = get_async_writer(&stream_2_writer, stream_2)) != NULL)
+       )
+    {
+      async_write_z_ucs(writer, z_ucs_output);
+      return;
+    }
+#endif // ENABLE_ASYNC_STREAMS
+
     fsi->writeucsstring(z_ucs_output, stream_2);
     if (strcmp(get_configuration_value("sync-transcript"), "true") == 0)
       fsi->flushfile(stream_2);
@@ -377,6 +509,9 @@ z_file *get_stream_2(void)
 void restore_stream_2(z_file *str)
 {
   if (stream_2) {
+#ifdef ENABLE_ASYNC_STREAMS
+    destroy_async_writer(&stream_2_writer);
+#endif // ENABLE_ASYNC_STREAMS
     (void)fsi->closefile(stream_2);
     stream_2 = NULL;
     z_mem[0x11] &= 0xfe;
@@ -640,12 +775,12 @@ void ask_for_stream2_filename()
 }
 
 
-static void stream_2_output_write(z_ucs *z_ucs_output)
+static void stream_2_output_write(z_ucs_view output)
 {
   if (stream_2_wrapping_disabled == true)
-    stream_2_buffer_output(z_ucs_output);
+    stream_2_buffer_output(output.ptr);
   else
-    wordwrap_wrap_z_ucs(stream_2_wrapper, z_ucs_output);
+    wordwrap_wrap_z_ucs_view(stream_2_wrapper, output);
 }
 
 
@@ -653,8 +788,8 @@ static void stream_2_print_header()
 {
   z_ucs dashes[] = { '-', '-', '-', '\n', '\n', 0 };
 
-  stream_2_output_write(z_ucs_newline_string);
-  stream_2_output_write(dashes);
+  stream_2_output_write(z_ucs_view_of(z_ucs_newline_string));
+  stream_2_output_write(z_ucs_view_of(dashes));
 }
 
 
@@ -670,7 +805,7 @@ void stream_2_remove_chars(size_t nof_chars_to_remove) {
 }
 
 
-static void stream_2_output(z_ucs *z_ucs_output)
+static void stream_2_output(z_ucs_view output)
 {
   int return_code;
   z_file *transcript_stream = NULL;
@@ -735,7 +870,7 @@ static void stream_2_output(z_ucs *z_ucs_output)
       flush_stream_2_buffer_output();
       script_wrapper_active = true;
     }
-    stream_2_output_write(z_ucs_output);
+    stream_2_output_write(output);
   }
   else
   {
@@ -745,7 +880,7 @@ static void stream_2_output(z_ucs *z_ucs_output)
         wordwrap_flush_output(stream_2_wrapper);
       script_wrapper_active = false;
     }
-    stream_2_buffer_output(z_ucs_output);
+    stream_2_buffer_output(output.ptr);
   }
 }
 
@@ -926,6 +1061,15 @@ void stream_4_latin1_output(char *latin1_output)
           FILEACCESS_APPEND);
     }
 
+#ifdef ENABLE_ASYNC_STREAMS
+    if (get_async_writer(&stream_4_writer, stream_4) != NULL)
+    {
+      (void)bg_writer_write(
+          stream_4_writer, latin1_output, strlen(latin1_output));
+      return;
+    }
+#endif // ENABLE_ASYNC_STREAMS
+
     fsi->writechars(latin1_output, strlen(latin1_output), stream_4);
   }
 }
@@ -933,12 +1077,17 @@ void stream_4_latin1_output(char *latin1_output)
 
 void stream_4_z_ucs_output(z_ucs *z_ucs_output)
 {
-  char buf[128];
+  char buf[1024];
+  size_t len = z_ucs_len(z_ucs_output), chars_consumed, bytes_written;
 
-  while (*z_ucs_output != 0)
+  while (len > 0)
   {
-    zucs_string_to_utf8_string(buf, &z_ucs_output, 128);
+    bytes_written = z_ucs_to_utf8(
+        buf, sizeof(buf) - 1, z_ucs_output, len, &chars_consumed);
+    buf[bytes_written] = '\0';
     stream_4_latin1_output(buf);
+    z_ucs_output += chars_consumed;
+    len -= chars_consumed;
   }
 }
 
@@ -953,6 +1102,9 @@ static void close_script_file()
       wordwrap_flush_output(stream_2_wrapper);
     else
       flush_stream_2_buffer_output();
+#ifdef ENABLE_ASYNC_STREAMS
+    destroy_async_writer(&stream_2_writer);
+#endif // ENABLE_ASYNC_STREAMS
     fsi->writechar('\n', stream_2);
     (void)fsi->closefile(stream_2);
     stream_2 = NULL;
@@ -960,38 +1112,57 @@ static void close_script_file()
 }
 
 
-static void send_to_stream1_targets(z_ucs *z_ucs_output)
+static void send_to_stream1_targets(z_ucs_view output)
 {
 #ifndef DISABLE_OUTPUT_HISTORY
   if ((active_window_number == 0) && (outputhistory[0] != NULL) ) {
-    store_z_ucs_output_in_history(
+    store_z_ucs_view_in_history(
         outputhistory[0],
-        z_ucs_output);
+        output);
   }
 #endif /* DISABLE_OUTPUT_HISTORY */
 #ifndef DISABLE_BLOCKBUFFER
   if (active_window_number == 1) {
     store_z_ucs_output_in_blockbuffer(
-        upper_window_buffer, z_ucs_output);
+        upper_window_buffer, output.ptr);
   }
 #endif /* DISABLE_BLOCKBUFFER */
   if (active_interface != NULL) {
-    active_interface->z_ucs_output(z_ucs_output);
+    if (active_interface->z_ucs_output_with_length != NULL)
+      active_interface->z_ucs_output_with_length(output.ptr, output.len);
+    else
+      active_interface->z_ucs_output(output.ptr);
   }
 }
 
 
+// Writes the pending stream 3 length to the current table's length word.
+// This has to be called before the story gets a chance to read or write
+// memory while stream 3 is still active, and before memory is restored.
+void flush_stream_3_length(void)
+{
+  if (stream_3_length_pending == false)
+    return;
+
+  store_word(stream_3_start[stream_3_current_depth],
+      stream_3_length[stream_3_current_depth]);
+  dynamic_memory_written(stream_3_start[stream_3_current_depth], 2);
+  TRACE_LOG("Stored current stream-3-length %d.\n",
+      stream_3_length[stream_3_current_depth]);
+
+  stream_3_length_pending = false;
+}
+
+
 static int _streams_z_ucs_output(z_ucs *z_ucs_output, bool is_user_input)
 {
-  int16_t conversion_result;
-  zscii zscii_char;
-  z_ucs *src;
   uint16_t len;
   z_ucs font3_conversion_buf[FONT3_CONVERSION_BUF_SIZE];
   z_ucs char_to_convert, converted_char;
   int font3_buf_index;
   z_ucs *processed_output, *output_pos, *processed_output_pos;
   z_ucs *next_newline_pos;
+  z_ucs_view output_view, line_view;
   //int size;
   int parameter1, parameter2;
   bool font_conversion_active
@@ -1011,41 +1182,32 @@ static int _streams_z_ucs_output(z_ucs *z_ucs_output, bool is_user_input)
       (bool_equal(is_user_input, false))
      )
   {
-    src = z_ucs_output;
-
-    while (*src != 0)
-    {
-      conversion_result
-        = (int16_t)unicode_char_to_zscii_input_char(*src);
-
-      if (conversion_result == 10)
-        zscii_char = (zscii)13;
-      else if (conversion_result == -1)
-        zscii_char = (zscii)'?';
-      else
-        zscii_char = (zscii)conversion_result;
-
-      *(stream_3_index[stream_3_current_depth]++) = zscii_char;
-      TRACE_LOG("Writing ZSCII '%c' / %d to %ld.\n",
-          zscii_char,
-          zscii_char,
-          (long int)(stream_3_index[stream_3_current_depth] - z_mem));
-
-      src++;
-    }
+    if (stream_3_length_pending == false)
+      stream_3_length[stream_3_current_depth]
+        = load_word(stream_3_start[stream_3_current_depth]);
 
-    len = load_word(stream_3_start[stream_3_current_depth]);
-    TRACE_LOG("Loaded current stream-3-length %d.\n", len);
+    len = (uint16_t)z_ucs_string_to_zscii(
+        stream_3_index[stream_3_current_depth], z_ucs_output);
+    dynamic_memory_written(stream_3_index[stream_3_current_depth], len);
 
-    len += (src - z_ucs_output);
+    stream_3_index[stream_3_current_depth] += len;
+    stream_3_length[stream_3_current_depth] += len;
+    stream_3_length_pending = true;
 
-    store_word(stream_3_start[stream_3_current_depth], len);
-    TRACE_LOG("Stored current stream-3-length %d.\n", len);
+    TRACE_LOG("Current stream-3-length %d.\n",
+        stream_3_length[stream_3_current_depth]);
   }
   else
   {
+    // The length is determined once here and handed down to the
+    // history, the transcript wrapper and the statistics.
+    output_view = z_ucs_view_of(z_ucs_output);
+
     if (bool_equal(is_user_input, false))
+    {
       stream_output_has_occured = true;
+      turn_statistics_add_output(output_view.len);
+    }
 
     if (
         (active_z_story != NULL)
@@ -1058,7 +1220,7 @@ static int _streams_z_ucs_output(z_ucs *z_ucs_output, bool is_user_input)
            "disable-external-streams"), "true") != 0)
        )
     {
-      stream_2_output(z_ucs_output);
+      stream_2_output(output_view);
     }
     else if (stream_2 != NULL)
     {
@@ -1289,9 +1451,15 @@ static int _streams_z_ucs_output(z_ucs *z_ucs_output, bool is_user_input)
           char_to_convert = *output_pos;
         }
         font3_conversion_buf[font3_buf_index] = 0;
+        output_view.ptr = font3_conversion_buf;
+        output_view.len = (size_t)font3_buf_index;
       }
 
-      if (bool_equal(stream_1_active, true))
+      if (
+          (bool_equal(stream_1_active, true))
+          &&
+          (bool_equal(replay_output_suppressed, false))
+         )
       {
 #ifndef DISABLE_OUTPUT_HISTORY
         if (active_window_number == 0)
@@ -1363,7 +1531,7 @@ static int _streams_z_ucs_output(z_ucs *z_ucs_output, bool is_user_input)
         if (strcasecmp(get_configuration_value("flush-output-on-newline"),
                       "true") != 0) {
           // No split required, process all at once.
-          send_to_stream1_targets(processed_output);
+          send_to_stream1_targets(output_view);
         }
         else {
           // Split output in newlines and process one by one.
@@ -1377,7 +1545,9 @@ static int _streams_z_ucs_output(z_ucs *z_ucs_output, bool is_user_input)
           while ((next_newline_pos
                 = z_ucs_chr(processed_output_pos, Z_UCS_NEWLINE)) != NULL) {
             *next_newline_pos = 0;
-            send_to_stream1_targets(processed_output_pos);
+            line_view.ptr = processed_output_pos;
+            line_view.len = (size_t)(next_newline_pos - processed_output_pos);
+            send_to_stream1_targets(line_view);
             *next_newline_pos = Z_UCS_NEWLINE;
             processed_output_pos = next_newline_pos;
 #ifndef DISABLE_OUTPUT_HISTORY
@@ -1398,7 +1568,7 @@ static int _streams_z_ucs_output(z_ucs *z_ucs_output, bool is_user_input)
               }
 
               // Write newline and advance stream accordingly.
-              send_to_stream1_targets(z_ucs_newline_string);
+              send_to_stream1_targets(z_ucs_view_of(z_ucs_newline_string));
               processed_output_pos++;
 
               paragraph_attribute_function(&parameter1, &parameter2);
@@ -1412,7 +1582,10 @@ static int _streams_z_ucs_output(z_ucs *z_ucs_output, bool is_user_input)
             }
 #endif /* DISABLE_OUTPUT_HISTORY */
           }
-          send_to_stream1_targets(processed_output_pos);
+          line_view.ptr = processed_output_pos;
+          line_view.len = output_view.len
+            - (size_t)(processed_output_pos - output_view.ptr);
+          send_to_stream1_targets(line_view);
         }
       }
 
@@ -1436,6 +1609,9 @@ static int _streams_z_ucs_output(z_ucs *z_ucs_output, bool is_user_input)
       {
         if (stream_4 != NULL)
         {
+#ifdef ENABLE_ASYNC_STREAMS
+          destroy_async_writer(&stream_4_writer);
+#endif // ENABLE_ASYNC_STREAMS
           (void)fsi->closefile(stream_4);
           stream_4 = NULL;
 	      }
@@ -1455,6 +1631,10 @@ static int _streams_z_ucs_output(z_ucs *z_ucs_output, bool is_user_input)
 
 int streams_z_ucs_output(z_ucs *z_ucs_output)
 {
+#ifdef ENABLE_ASYNC_STREAMS
+  report_async_write_error();
+#endif // ENABLE_ASYNC_STREAMS
+
   return _streams_z_ucs_output(z_ucs_output, false);
 }
 
@@ -1527,6 +1707,8 @@ void opcode_output_stream(void)
 
   else if (stream_number == 3)
   {
+    flush_stream_3_length();
+
     if (++stream_3_current_depth == MAXIMUM_STREAM_3_DEPTH)
       i18n_translate_and_exit(
           libfizmo_module_name,
@@ -1538,6 +1720,8 @@ void opcode_output_stream(void)
     stream_3_index[stream_3_current_depth] = z_mem + op[1] + 2;
 
     store_word(stream_3_start[stream_3_current_depth], 0);
+    dynamic_memory_written(stream_3_start[stream_3_current_depth], 2);
+    stream_3_length[stream_3_current_depth] = 0;
 
     TRACE_LOG("stream-3 depth: %d.\n", stream_3_current_depth);
 
@@ -1550,6 +1734,7 @@ void opcode_output_stream(void)
     if (stream_3_current_depth >= 0)
     {
       TRACE_LOG("stream-3 depth: %d.\n", stream_3_current_depth);
+      flush_stream_3_length();
       stream_3_current_depth--;
     }
   }
@@ -1581,6 +1766,9 @@ void close_streams(z_ucs *error_message)
 
   if (stream_4 != NULL)
   {
+#ifdef ENABLE_ASYNC_STREAMS
+    destroy_async_writer(&stream_4_writer);
+#endif // ENABLE_ASYNC_STREAMS
     (void)fsi->closefile(stream_4);
     stream_4 = NULL;
   }
@@ -1607,6 +1795,7 @@ void close_input_stream_1(void)
 {
   if (input_stream_1 != NULL)
   {
+    free_replay_commands();
     fsi->closefile(input_stream_1);
     input_stream_1 = NULL;
   }
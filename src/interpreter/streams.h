@@ -42,6 +42,7 @@ int streams_z_ucs_output(z_ucs *z_ucs_output);
 int streams_z_ucs_output_user_input(z_ucs *z_ucs_output);
 int streams_latin1_output(char *latin1_output);
 void opcode_output_stream(void);
+void flush_stream_3_length(void);
 void open_streams(void);
 void close_streams(/*@null@*/ z_ucs *error_message);
 void opcode_input_stream(void);
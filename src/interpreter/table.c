@@ -38,6 +38,7 @@
 #include "table.h"
 #include "zpu.h"
 #include "variable.h"
+#include "streams.h"
 
 
 void opcode_scan_table(void)
@@ -50,6 +51,8 @@ void opcode_scan_table(void)
 
   TRACE_LOG("Opcode: SCAN_TABLE.\n");
 
+  flush_stream_3_length();
+
   if (number_of_operands != 4)
   {
     entry_size = 2;
@@ -115,12 +118,16 @@ void opcode_copy_table(void)
   uint8_t *src, *dest, *last;
 
   TRACE_LOG("Opcode: COPY_TABLE.\n");
+
+  flush_stream_3_length();
+
   if (op[1] == 0)
   {
     if (size > 0)
     {
       TRACE_LOG("Zeroing first %d bytes from %ud.\n", size, op[0]);
       memset(z_mem + op[0], 0, size);
+      dynamic_memory_written(z_mem + op[0], size);
     }
   }
   else
@@ -128,6 +135,8 @@ void opcode_copy_table(void)
     src = z_mem + op[0];
     dest  = z_mem + op[1];
 
+    dynamic_memory_written(dest, abs(size));
+
     if ( (size < 0) || (op[0] > op[1]) )
     {
       size = abs(size);
@@ -33,6 +33,7 @@
 #ifndef text_c_INCLUDED
 #define text_c_INCLUDED
 
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 
@@ -58,12 +59,20 @@
 #include "savegame.h"
 #include "streams.h"
 #include "undo.h"
+#include "turnstat.h"
+#include "replay.h"
+#include "vclock.h"
+#include "storyidx.h"
 #include "../locales/libfizmo_locales.h"
 
 #ifdef ENABLE_DEBUGGER
 #include "debugger.h"
 #endif // ENABLE_DEBUGGER
 
+#ifdef ENABLE_ASYNC_AUTOSAVE
+#include "autosave.h"
+#endif // ENABLE_ASYNC_AUTOSAVE
+
 #ifndef DISABLE_COMMAND_HISTORY
 #include "cmd_hst.h"
 #endif /* DISABLE_COMMAND_HISTORY */
@@ -88,6 +97,31 @@ static uint8_t zchar_to_z_ucs_current_z_char[MAX_ABBREVIATION_DEPTH + 1];
 static uint8_t zchar_to_z_ucs_multibyte_stage[MAX_ABBREVIATION_DEPTH + 1];
 static uint8_t zchar_to_z_ucs_multi_z_char[MAX_ABBREVIATION_DEPTH + 1];
 static int zchar_to_z_ucs_abbreviation_level;
+// Makes zchar_to_z_ucs store ZSCII instead of unicode chars.
+static bool zchar_to_z_ucs_output_zscii = false;
+static size_t zchar_to_z_ucs_output_length;
+
+struct tokenise_cache_entry
+{
+  bool in_use;
+  uint32_t last_use;
+  uint32_t hash;
+  uint8_t *dictionary;
+  uint8_t maximum_words;
+  uint8_t input_length;
+  uint8_t input[TOKENISE_CACHE_MAXIMUM_INPUT_LENGTH];
+  uint8_t number_of_words;
+  uint16_t parse_data_length;
+  uint8_t parse_data[TOKENISE_CACHE_MAXIMUM_WORDS * 4];
+  bool first_word_found;
+};
+
+static struct tokenise_cache_entry tokenise_cache[TOKENISE_CACHE_SIZE];
+static uint32_t tokenise_cache_use_counter = 0;
+// Memory range covering all cached dictionaries residing in dynamic memory.
+// Writes into this range invalidate the cache.
+static uint8_t *tokenise_cache_watch_start = NULL;
+static uint8_t *tokenise_cache_watch_end = NULL;
 
 static uint32_t number_of_commands = 0;
 static uint8_t first_word_found;
@@ -127,6 +161,27 @@ uint8_t alphabet_table_after_v1[] =
 };
 
 
+// ZSCII codes 155-251 may be defined by the unicode translation table.
+#define NUMBER_OF_ZSCII_EXTRA_CHARS 97
+#define ZSCII_TABLE_INVALID_ENTRY ((z_ucs)0xffffffff)
+
+struct unicode_to_zscii_entry
+{
+  z_ucs unicode_char;
+  zscii zscii_char;
+};
+
+// Precomputed translation tables, built by init_zscii_unicode_tables().
+static z_ucs zscii_output_to_z_ucs_table[256];
+static z_ucs zscii_input_to_z_ucs_table[256];
+static zscii unicode_ascii_to_zscii_table[128];
+static struct unicode_to_zscii_entry
+  unicode_to_zscii_table[NUMBER_OF_ZSCII_EXTRA_CHARS];
+static int unicode_to_zscii_table_size = 0;
+static uint8_t *unicode_table_address_word = NULL;
+static uint16_t active_unicode_table_address = 0;
+static bool zscii_unicode_tables_initialized = false;
+
 static uint8_t default_extra_char_to_unicode_table[] =
 {
     69,
@@ -423,38 +478,164 @@ static void store_ZSCII_as_zchar(zscii zscii_char)
 }
 
 
-static z_ucs zscii_extra_char_to_unicode(zscii zscii_extra_char)
+static int compare_unicode_to_zscii_entries(const void *a, const void *b)
 {
-  uint8_t *unicode_table = get_current_unicode_table_address();
-  uint8_t table_index = zscii_extra_char - 155;
+  const struct unicode_to_zscii_entry *entry_a = a;
+  const struct unicode_to_zscii_entry *entry_b = b;
+
+  if (entry_a->unicode_char != entry_b->unicode_char)
+    return entry_a->unicode_char < entry_b->unicode_char ? -1 : 1;
+  else
+    return (int)entry_a->zscii_char - (int)entry_b->zscii_char;
+}
 
-  TRACE_LOG("Extra-char-translation: %d, %p, %d.\n",
-      *unicode_table - 1, unicode_table, table_index);
 
-  if (table_index > *unicode_table - 1)
+// Builds the ZSCII->UCS tables for input and output and the sorted
+// UCS->ZSCII map from the currently active unicode translation table. This
+// has to be called once the story is loaded and whenever the dynamic memory
+// has been replaced (restart, restore, restore_undo), since the unicode
+// table may reside in dynamic memory. Changes of the table address in the
+// header extension are detected automatically by the conversion functions.
+void init_zscii_unicode_tables()
+{
+  uint8_t *unicode_table;
+  int number_of_table_entries;
+  z_ucs extra_char;
+  int i, j;
+
+  if (
+      (ver >= 5)
+      &&
+      (header_extension_table != NULL)
+      &&
+      (header_extension_table_size >= 3)
+     )
   {
-    TRACE_LOG("too large\n");
-    return latin1_char_to_zucs_char('?');
+    unicode_table_address_word = header_extension_table + 0x6;
+    active_unicode_table_address = load_word(unicode_table_address_word);
   }
   else
-    return (z_ucs)load_word(unicode_table + 1 + (table_index * 2));
+  {
+    unicode_table_address_word = NULL;
+    active_unicode_table_address = 0;
+  }
+
+  unicode_table = get_current_unicode_table_address();
+  number_of_table_entries = *unicode_table;
+  if (number_of_table_entries > NUMBER_OF_ZSCII_EXTRA_CHARS)
+    number_of_table_entries = NUMBER_OF_ZSCII_EXTRA_CHARS;
+
+  TRACE_LOG("Building ZSCII translation tables from %p, %d entries.\n",
+      unicode_table, number_of_table_entries);
+
+  for (i=0; i<256; i++)
+  {
+    zscii_output_to_z_ucs_table[i] = ZSCII_TABLE_INVALID_ENTRY;
+    zscii_input_to_z_ucs_table[i] = ZSCII_TABLE_INVALID_ENTRY;
+  }
+
+  zscii_output_to_z_ucs_table[0] = 0;
+  zscii_output_to_z_ucs_table[9] = latin1_char_to_zucs_char('\t');
+  zscii_output_to_z_ucs_table[11] = latin1_char_to_zucs_char('.');
+  zscii_output_to_z_ucs_table[13] = Z_UCS_NEWLINE;
+
+  zscii_input_to_z_ucs_table[0] = 0;
+  zscii_input_to_z_ucs_table[8] = 8; // Delete
+  zscii_input_to_z_ucs_table[13] = Z_UCS_NEWLINE;
+  zscii_input_to_z_ucs_table[27] = 27; // Escape
+
+  memset(unicode_ascii_to_zscii_table, 0, sizeof(unicode_ascii_to_zscii_table));
+  unicode_ascii_to_zscii_table[8] = 8;
+  unicode_ascii_to_zscii_table[10] = 13;
+  unicode_ascii_to_zscii_table[13] = 13;
+  unicode_ascii_to_zscii_table[27] = 27;
+
+  // Identical to ASCII in this range.
+  for (i=32; i<=126; i++)
+  {
+    zscii_output_to_z_ucs_table[i] = (z_ucs)i;
+    zscii_input_to_z_ucs_table[i] = (z_ucs)i;
+    unicode_ascii_to_zscii_table[i] = (zscii)i;
+  }
+
+  // cursor, f1-f12, keypad
+  for (i=129; i<=154; i++)
+    zscii_input_to_z_ucs_table[i] = (z_ucs)i;
+
+  // mouse-clicks
+  for (i=252; i<=254; i++)
+    zscii_input_to_z_ucs_table[i] = (z_ucs)i;
+
+  j = 0;
+  for (i=0; i<NUMBER_OF_ZSCII_EXTRA_CHARS; i++)
+  {
+    if (i < number_of_table_entries)
+    {
+      extra_char = (z_ucs)load_word(unicode_table + 1 + (i * 2));
+      unicode_to_zscii_table[j].unicode_char = extra_char;
+      unicode_to_zscii_table[j].zscii_char = (zscii)(i + 155);
+      j++;
+    }
+    else
+      extra_char = latin1_char_to_zucs_char('?');
+
+    zscii_output_to_z_ucs_table[i + 155] = extra_char;
+    zscii_input_to_z_ucs_table[i + 155] = extra_char;
+  }
+
+  // Sort by unicode value and drop duplicates, keeping the lowest ZSCII
+  // code for each unicode char, just as a linear search would do.
+  qsort(unicode_to_zscii_table, j, sizeof(struct unicode_to_zscii_entry),
+      compare_unicode_to_zscii_entries);
+
+  unicode_to_zscii_table_size = 0;
+  for (i=0; i<j; i++)
+    if (
+        (unicode_to_zscii_table_size == 0)
+        ||
+        (unicode_to_zscii_table[unicode_to_zscii_table_size - 1].unicode_char
+         != unicode_to_zscii_table[i].unicode_char)
+       )
+      unicode_to_zscii_table[unicode_to_zscii_table_size++]
+        = unicode_to_zscii_table[i];
+
+  zscii_unicode_tables_initialized = true;
 }
 
 
-static zscii find_zscii_extra_char_in_unicode_table(uint16_t unicode_char)
+static void ensure_zscii_unicode_tables_are_current()
 {
-  uint8_t *unicode_table = get_current_unicode_table_address();
-  uint8_t *unicode_data = unicode_table + 1;
-  int number_of_table_entries = (int)(*unicode_table - 1);
-  int table_index = 0;
+  if (
+      (zscii_unicode_tables_initialized == false)
+      ||
+      (
+       (unicode_table_address_word != NULL)
+       &&
+       (load_word(unicode_table_address_word) != active_unicode_table_address)
+      )
+     )
+    init_zscii_unicode_tables();
+}
+
+
+static zscii find_zscii_extra_char_in_unicode_table(z_ucs unicode_char)
+{
+  int lower = 0;
+  int upper = unicode_to_zscii_table_size - 1;
+  int middle;
 
   TRACE_LOG("Looking for extra-char %d in unicode table.\n", unicode_char);
 
-  while (table_index <= number_of_table_entries)
+  while (lower <= upper)
   {
-    if (load_word(unicode_data + (table_index * 2)) == unicode_char)
-      return (zscii)(table_index + 155);
-    table_index++;
+    middle = (lower + upper) / 2;
+
+    if (unicode_to_zscii_table[middle].unicode_char == unicode_char)
+      return unicode_to_zscii_table[middle].zscii_char;
+    else if (unicode_to_zscii_table[middle].unicode_char < unicode_char)
+      lower = middle + 1;
+    else
+      upper = middle - 1;
   }
 
   return 0xff;
@@ -465,7 +646,9 @@ zscii unicode_char_to_zscii_input_char(z_ucs unicode_char)
 {
   zscii result;
 
-  if (unicode_char == 8)
+  if ((unicode_char >= 32) && (unicode_char <= 126))
+    result = (uint8_t)unicode_char;
+  else if (unicode_char == 8)
     result = 8;
   else if (unicode_char == 10)
     result = 13;
@@ -473,13 +656,12 @@ zscii unicode_char_to_zscii_input_char(z_ucs unicode_char)
     result = 13;
   else if (unicode_char == 27)
     result = 27;
-  else if ((unicode_char >= 32) && (unicode_char <= 126))
-    result = (uint8_t)unicode_char;
   else
   {
     // In case we haven't found out input yet, there's still a change that
     // this unicode character has been defined in the translation table, thus
     // we try to look it up there.
+    ensure_zscii_unicode_tables_are_current();
     result = find_zscii_extra_char_in_unicode_table(unicode_char);
   }
 
@@ -487,6 +669,37 @@ zscii unicode_char_to_zscii_input_char(z_ucs unicode_char)
 }
 
 
+// Converts the zero-terminated string "src" to ZSCII, as required for
+// output stream 3, and returns the number of chars written to "dest".
+// Characters not representable in ZSCII are stored as '?'.
+size_t z_ucs_string_to_zscii(zscii *dest, z_ucs *src)
+{
+  zscii *dest_start = dest;
+  zscii zscii_char;
+
+  ensure_zscii_unicode_tables_are_current();
+
+  while (*src != 0)
+  {
+    if (
+        (*src < 128)
+        &&
+        ((zscii_char = unicode_ascii_to_zscii_table[*src]) != 0)
+       )
+      *(dest++) = zscii_char;
+    else if (
+        (zscii_char = find_zscii_extra_char_in_unicode_table(*src)) != 0xff)
+      *(dest++) = zscii_char;
+    else
+      *(dest++) = (zscii)'?';
+
+    src++;
+  }
+
+  return (size_t)(dest - dest_start);
+}
+
+
 // This will write into(!) the provided textbuffer!
 static uint8_t locate_dictionary_entry(
     uint8_t *text_buffer,
@@ -502,7 +715,7 @@ static uint8_t locate_dictionary_entry(
   uint8_t *dictionary_index = dictionary_start;
   uint16_t i,j;
   uint16_t word_length;
-  int16_t word_found_at_index = -1;
+  int16_t word_found_at_index;
   int search_mid_index, search_end_index;
 
   // "Dictionarize" entry.
@@ -543,8 +756,20 @@ static uint8_t locate_dictionary_entry(
 
   TRACE_LOG("dict-start: %x\n", dictionary_start - z_mem);
 
-  if (dictionary_is_unsorted == true)
+  word_found_at_index = find_indexed_dictionary_entry(
+      dictionary_start,
+      number_of_dictionary_entries,
+      dictionary_entry_length,
+      text_buffer);
+
+  if (word_found_at_index != STORY_INDEX_NOT_INDEXED)
   {
+    TRACE_LOG("Dictionary index returned %d.\n", word_found_at_index);
+  }
+  else if (dictionary_is_unsorted == true)
+  {
+    word_found_at_index = -1;
+
     for (i=0; i<number_of_dictionary_entries; i++)
     {
       for (j=0; j<word_length; j++) {
@@ -562,6 +787,7 @@ static uint8_t locate_dictionary_entry(
   }
   else
   {
+    word_found_at_index = -1;
     i = 0;
     search_end_index = number_of_dictionary_entries;
 
@@ -652,6 +878,139 @@ static uint8_t locate_dictionary_entry(
 }
 
 
+size_t get_tokenise_cache_size()
+{
+  return sizeof(tokenise_cache);
+}
+
+
+void invalidate_tokenise_cache()
+{
+  int i;
+
+  TRACE_LOG("Invalidating tokenise cache.\n");
+
+  for (i=0; i<TOKENISE_CACHE_SIZE; i++)
+    tokenise_cache[i].in_use = false;
+
+  tokenise_cache_watch_start = NULL;
+  tokenise_cache_watch_end = NULL;
+}
+
+
+// Invoked by "dynamic_memory_written" in zpu.c.
+void tokenise_cache_memory_written(uint8_t *address, size_t length)
+{
+  if (
+      (tokenise_cache_watch_start != NULL)
+      &&
+      (address < tokenise_cache_watch_end)
+      &&
+      (address + length > tokenise_cache_watch_start)
+     )
+    invalidate_tokenise_cache();
+}
+
+
+static uint32_t get_tokenise_cache_hash(uint8_t *input, uint8_t input_length)
+{
+  // FNV-1a
+  uint32_t hash = 2166136261U;
+  int i;
+
+  for (i=0; i<input_length; i++)
+  {
+    hash ^= input[i];
+    hash *= 16777619U;
+  }
+
+  return hash;
+}
+
+
+static struct tokenise_cache_entry *find_tokenise_cache_entry(
+    uint8_t *dictionary, uint8_t maximum_words, uint8_t *input,
+    uint8_t input_length, uint32_t hash)
+{
+  int i;
+
+  for (i=0; i<TOKENISE_CACHE_SIZE; i++)
+    if (
+        (tokenise_cache[i].in_use == true)
+        &&
+        (tokenise_cache[i].hash == hash)
+        &&
+        (tokenise_cache[i].dictionary == dictionary)
+        &&
+        (tokenise_cache[i].maximum_words == maximum_words)
+        &&
+        (tokenise_cache[i].input_length == input_length)
+        &&
+        (memcmp(tokenise_cache[i].input, input, input_length) == 0)
+       )
+    {
+      tokenise_cache[i].last_use = ++tokenise_cache_use_counter;
+      return &tokenise_cache[i];
+    }
+
+  return NULL;
+}
+
+
+static void store_tokenise_cache_entry(uint8_t *dictionary,
+    uint8_t *dictionary_end, uint8_t maximum_words, uint8_t *input,
+    uint8_t input_length, uint32_t hash, uint8_t *z_parse_buffer,
+    uint16_t parse_data_length, bool word_found)
+{
+  struct tokenise_cache_entry *entry = &tokenise_cache[0];
+  int i;
+
+  if (parse_data_length > TOKENISE_CACHE_MAXIMUM_WORDS * 4)
+    return;
+
+  // Replace the least recently used entry.
+  for (i=0; i<TOKENISE_CACHE_SIZE; i++)
+  {
+    if (tokenise_cache[i].in_use == false)
+    {
+      entry = &tokenise_cache[i];
+      break;
+    }
+    else if (tokenise_cache[i].last_use < entry->last_use)
+      entry = &tokenise_cache[i];
+  }
+
+  entry->in_use = true;
+  entry->last_use = ++tokenise_cache_use_counter;
+  entry->hash = hash;
+  entry->dictionary = dictionary;
+  entry->maximum_words = maximum_words;
+  entry->input_length = input_length;
+  memcpy(entry->input, input, input_length);
+  entry->number_of_words = z_parse_buffer[1];
+  entry->parse_data_length = parse_data_length;
+  memcpy(entry->parse_data, z_parse_buffer + 2, parse_data_length);
+  entry->first_word_found = word_found;
+
+  if (dictionary <= active_z_story->dynamic_memory_end)
+  {
+    if (
+        (tokenise_cache_watch_start == NULL)
+        ||
+        (dictionary < tokenise_cache_watch_start)
+       )
+      tokenise_cache_watch_start = dictionary;
+
+    if (
+        (tokenise_cache_watch_end == NULL)
+        ||
+        (dictionary_end > tokenise_cache_watch_end)
+       )
+      tokenise_cache_watch_end = dictionary_end;
+  }
+}
+
+
 static void tokenise(
     uint8_t *z_text_buffer,
     uint8_t z_text_buffer_offset,
@@ -683,6 +1042,14 @@ static void tokenise(
   uint8_t *parse_buffer_index = z_parse_buffer + 2;
   uint8_t i;
 
+  uint8_t *dictionary_address = dictionary;
+  uint8_t *cache_input = z_text_buffer + z_text_buffer_offset;
+  size_t cache_input_length;
+  uint32_t cache_hash = 0;
+  struct tokenise_cache_entry *cache_entry;
+  bool use_cache = false;
+  uint8_t first_word_found_before = first_word_found;
+
   TRACE_LOG("Parse buffer at %lx, %d bytes for tokenize_buffer at %x.\n",
     (unsigned long int)(z_parse_buffer - z_mem), tokenize_buffer_length,
     &tokenize_buffer);
@@ -692,6 +1059,42 @@ static void tokenise(
 
   TRACE_LOG("Maximum number of parsed words: %d.\n", maximum_words);
 
+  // Since the "dont_write_unrecognized_words" mode only partly overwrites
+  // the parse buffer, results are only cached for regular tokenising.
+  if (dont_write_unrecognized_words_to_parse_buffer == false)
+  {
+    cache_input_length
+      = ver >= 5
+      ? input_length
+      : strlen((char*)cache_input);
+
+    if (cache_input_length <= TOKENISE_CACHE_MAXIMUM_INPUT_LENGTH)
+    {
+      use_cache = true;
+      cache_hash
+        = get_tokenise_cache_hash(cache_input, (uint8_t)cache_input_length);
+
+      if ((cache_entry = find_tokenise_cache_entry(
+              dictionary_address,
+              maximum_words,
+              cache_input,
+              (uint8_t)cache_input_length,
+              cache_hash)) != NULL)
+      {
+        TRACE_LOG("Found tokenised input in cache.\n");
+        z_parse_buffer[1] = cache_entry->number_of_words;
+        memcpy(z_parse_buffer + 2, cache_entry->parse_data,
+            cache_entry->parse_data_length);
+        if (cache_entry->first_word_found == true)
+          first_word_found = 1;
+        return;
+      }
+    }
+  }
+
+  // Reset the flag so we can tell whether this run found the first word.
+  first_word_found = 0;
+
   number_of_input_codes = *(dictionary++);
   input_codes = dictionary;
   dictionary += number_of_input_codes;
@@ -871,6 +1274,22 @@ static void tokenise(
       (unsigned long int)(z_parse_buffer + 1 - z_mem));
 
   z_parse_buffer[1] = number_of_words_found;
+
+  if (use_cache == true)
+    store_tokenise_cache_entry(
+        dictionary_address,
+        dictionary_start
+        + (number_of_dictionary_entries * dictionary_entry_length),
+        maximum_words,
+        cache_input,
+        (uint8_t)cache_input_length,
+        cache_hash,
+        z_parse_buffer,
+        (uint16_t)(parse_buffer_index - (z_parse_buffer + 2)),
+        first_word_found == 1 ? true : false);
+
+  if (first_word_found_before != 0)
+    first_word_found = 1;
 }
 
 
@@ -899,6 +1318,8 @@ static void tokenise(
   uint8_t next_char_alphabet = 0;
   uint8_t abbreviation_block = 0xff;
   uint8_t *abbreviation_entry;
+  zscii *abbreviation_expansion;
+  size_t abbreviation_expansion_length, j;
   uint8_t i;
   uint16_t output_data = 0; // init to inhibit compiler warning
   int output_data_ready = 0;
@@ -1020,7 +1441,33 @@ static void tokenise(
     TRACE_LOG("%d/%d/%d/%d\n",
         ver, current_zchar, current_alphabet, current_zchar);
 
-    if (abbreviation_block != 0xff)
+    // Abbreviations are decoded starting in alphabet A0, so in case no
+    // shift is pending the story index' expansion can be used instead --
+    // as long as it fits into the output buffer completely.
+    if (
+        (abbreviation_block != 0xff)
+        &&
+        (next_char_alphabet == 0)
+        &&
+        (zchar_to_z_ucs_abbreviation_level + 1 <= MAX_ABBREVIATION_DEPTH)
+        &&
+        ((abbreviation_expansion = get_indexed_abbreviation(
+            (abbreviation_block << 5) + current_zchar,
+            &abbreviation_expansion_length)) != NULL)
+        &&
+        (abbreviation_expansion_length
+         <= (size_t)(z_ucs_dest_last_valid_index - z_ucs_dest_index))
+       )
+    {
+      for (j=0; j<abbreviation_expansion_length; j++)
+        *(z_ucs_dest_index++)
+          = zscii_output_char_to_z_ucs(abbreviation_expansion[j]);
+
+      abbreviation_block = 0xff;
+      i++;
+    }
+
+    else if (abbreviation_block != 0xff)
     {
       if (zchar_to_z_ucs_abbreviation_level + 1 > MAX_ABBREVIATION_DEPTH)
         (void)i18n_translate_and_exit(
@@ -1185,7 +1632,10 @@ static void tokenise(
     if (output_data_ready != 0)
     {
       /*@-usedef@*/
-      *z_ucs_dest_index = zscii_output_char_to_z_ucs(output_data);
+      *z_ucs_dest_index
+        = zchar_to_z_ucs_output_zscii == true
+        ? (zscii)output_data
+        : zscii_output_char_to_z_ucs(output_data);
       /*@+usedef@*/
 
       z_ucs_dest_index++;
@@ -1202,6 +1652,7 @@ static void tokenise(
   }
 
   *z_ucs_dest_index = 0;
+  zchar_to_z_ucs_output_length = z_ucs_dest_index - z_ucs_dest;
 
   TRACE_LOG("Finished conversion at %p.\n", zchar_src);
 
@@ -1209,6 +1660,22 @@ static void tokenise(
 }
 
 
+// Decodes the complete Z-char string at "zchar_src" into ZSCII, which is
+// stored in "dest" one char per z_ucs. Returns the number of chars or -1
+// in case the string doesn't fit into "dest_length" - 1 chars.
+int decode_zchar_string_to_zscii(z_ucs *dest, uint16_t dest_length,
+    uint8_t *zchar_src)
+{
+  uint8_t *result;
+
+  zchar_to_z_ucs_output_zscii = true;
+  result = zchar_to_z_ucs(dest, dest_length, zchar_src);
+  zchar_to_z_ucs_output_zscii = false;
+
+  return result != NULL ? (int)zchar_to_z_ucs_output_length : -1;
+}
+
+
 /*@dependent@*/ static uint8_t *output_zchar_to_streams(uint8_t *zchar_src)
 {
   TRACE_LOG("Converting zchars from %lx.\n",
@@ -1245,6 +1712,8 @@ void opcode_tokenise(void)
 
   TRACE_LOG("Opcode: TOKENISE.\n");
 
+  flush_stream_3_length();
+
   if (number_of_operands > 2)
   {
     if (op[2] != 0)
@@ -1274,6 +1743,7 @@ void opcode_tokenise(void)
       z_mem + op[1],
       dictionary_table,
       dont_write_unrecognized_words_to_parse_buffer);
+  dynamic_memory_written(z_mem + op[1], 2 + *(z_mem + op[1]) * 4);
 }
 
 
@@ -1306,27 +1776,14 @@ z_ucs zscii_input_char_to_z_ucs(zscii zscii_input)
 {
   // The result will fit into a 16 bit-wide space, since the Z-Spec 1.0
   // only defines 16-bit unicode characters.
-  z_ucs result = -1; // init to inhibit compiler warning
+  z_ucs result;
 
   TRACE_LOG("Converting ZSCII-Input(!)-Char %d to UCS-4.\n", zscii_input);
 
-  if (zscii_input == 0)
-    result = (z_ucs)0;
-  else if (zscii_input == 8)
-    result = (z_ucs)8; // Delete
-  else if (zscii_input == 13)
-    result = Z_UCS_NEWLINE;
-  else if (zscii_input == 27)
-    result = (z_ucs)27; // Escape
-  else if ((zscii_input >= 32) && (zscii_input <= 126))
-    result = (z_ucs)zscii_input; // Identical to ASCII in this range.
-  else if ((zscii_input >= 129) && (zscii_input <= 154))
-    result = (z_ucs)zscii_input; // cursor, f1-f12, keypad
-  else if ((zscii_input >= 155) && (zscii_input <= 251))
-    result = zscii_extra_char_to_unicode(zscii_input);
-  else if ((zscii_input >= 252) && (zscii_input <= 254))
-    result = (z_ucs)zscii_input; // mouse-clicks
-  else
+  ensure_zscii_unicode_tables_are_current();
+
+  if ((result = zscii_input_to_z_ucs_table[zscii_input])
+      == ZSCII_TABLE_INVALID_ENTRY)
     i18n_translate_and_exit(
         libfizmo_module_name,
         i18n_libfizmo_INVALID_ZSCII_INPUT_CODE_P0D,
@@ -1362,23 +1819,14 @@ bool is_valid_zscii_output_char(zscii zscii_output)
 
 z_ucs zscii_output_char_to_z_ucs(zscii zscii_output)
 {
-  z_ucs result = -1; // init for compiler warning
+  z_ucs result;
 
   TRACE_LOG("Converting ZSCII-Output(!)-Char %d to UCS-4.\n", zscii_output);
 
-  if (zscii_output == 0)
-    result = 0;
-  else if (zscii_output == 9)
-    result = latin1_char_to_zucs_char('\t');
-  else if (zscii_output == 11)
-    result = latin1_char_to_zucs_char('.');
-  else if (zscii_output == 13)
-    result = Z_UCS_NEWLINE;
-  else if ((zscii_output >= 32) && (zscii_output <= 126))
-    result = (z_ucs)zscii_output; // Identical to ASCII in this range.
-  else if ((zscii_output >= 155) && (zscii_output <= 251))
-    result = zscii_extra_char_to_unicode(zscii_output);
-  else
+  ensure_zscii_unicode_tables_are_current();
+
+  if ((result = zscii_output_to_z_ucs_table[zscii_output])
+      == ZSCII_TABLE_INVALID_ENTRY)
     i18n_translate_and_exit(
         libfizmo_module_name,
         i18n_libfizmo_INVALID_ZSCII_OUTPUT_CODE_P0D,
@@ -1397,6 +1845,8 @@ void opcode_print_paddr(void)
 
   TRACE_LOG("Opcode: PRINT_PADDR.\n");
 
+  flush_stream_3_length();
+
   TRACE_LOG("Printing string at %x.\n", (unsigned)unpacked_address);
 
   (void)output_zchar_to_streams(z_mem + unpacked_address);
@@ -1794,20 +2244,41 @@ int save_and_quit_if_required(bool force_save)
     TRACE_LOG("current_instruction_location: %lx\n",
       (unsigned long int)(current_instruction_location - z_mem));
 
-    filename = fizmo_strdup(autosave_filename);
+    save_and_quit_file
+      = get_configuration_value("save-and-quit-file-before-read");
+
+#ifdef ENABLE_ASYNC_AUTOSAVE
+    // Background saving is not used when quitting right afterwards. In
+    // case it's not used, save_game waits for any background write still
+    // in progress, which would otherwise replace the savegame afterwards.
+    if (
+        (strcmp(get_configuration_value("background-autosave"), "true") != 0)
+        ||
+        (
+         (save_and_quit_file != NULL)
+         &&
+         (strcmp(save_and_quit_file, "true") == 0)
+        )
+        ||
+        (queue_background_autosave(
+          autosave_filename,
+          (uint16_t)(active_z_story->dynamic_memory_end - z_mem + 1)) != 0)
+       )
+#endif // ENABLE_ASYNC_AUTOSAVE
+    {
+      filename = fizmo_strdup(autosave_filename);
 
-    save_game(
-      0,
-      (uint16_t)(active_z_story->dynamic_memory_end - z_mem + 1),
-      filename,
-      true,
-      false,
-      NULL);
+      save_game(
+          0,
+          (uint16_t)(active_z_story->dynamic_memory_end - z_mem + 1),
+          filename,
+          true,
+          false,
+          NULL);
+    }
 
     pc = pc_buf;
 
-    save_and_quit_file
-      = get_configuration_value("save-and-quit-file-before-read");
     if (
         (save_and_quit_file != NULL)
         &&
@@ -1835,9 +2306,12 @@ int read_command_from_file(zscii *input_buffer, int input_buffer_size,
   int res;
   int return_code;
   z_ucs unicode_input;
+  bool stream_opened = false;
 
   if (input_stream_1 == NULL)
   {
+      stream_opened = true;
+
       return_code = active_interface->prompt_for_filename(
           "transcript",
           &input_stream_1,
@@ -1873,6 +2347,33 @@ int read_command_from_file(zscii *input_buffer, int input_buffer_size,
       }
   }
 
+  if (
+      (stream_opened == true)
+      &&
+      (strcmp(get_configuration_value("fast-replay"), "true") == 0)
+     )
+    (void)load_replay_commands(input_stream_1);
+
+  if (replay_commands_loaded() == true)
+  {
+    input_length = get_next_replay_command(
+        input_buffer, input_buffer_size, input_delay_tenth_seconds);
+
+    TRACE_LOG("Read %d input chars from replay.\n", input_length);
+
+    // Like below, the stream is closed as soon as the last command has
+    // been read.
+    if (get_nof_remaining_replay_commands() == 0)
+    {
+      free_replay_commands();
+      fsi->closefile(input_stream_1);
+      input_stream_1_active = false;
+      input_stream_1 = NULL;
+    }
+
+    return input_length;
+  }
+
   filepos = fsi->getfilepos(input_stream_1);
 
   // Parse "(Waited for <n> ms)".
@@ -1959,6 +2460,10 @@ void opcode_read(void)
 
   TRACE_LOG("Opcode: READ.\n");
 
+  flush_stream_3_length();
+
+  turn_statistics_input_requested();
+
   if (save_and_quit_if_required(false) != 0)
     return;
 
@@ -2066,26 +2571,32 @@ void opcode_read(void)
         {
           TRACE_LOG("1/10s to wait: %d\n", tenth_seconds_to_delay);
           stream_output_has_occured = false;
-          while ((tenth_seconds_to_delay -= tenth_seconds) >= 0)
-          {
-            TRACE_LOG(
-                "Invoking verification routine, 1/10s counter: %d(%d).\n",
-                tenth_seconds_to_delay , tenth_seconds);
-            if ((interpret_from_call(
-                    get_packed_routinecall_address(timed_routine_offset))) !=0 )
-            {
-              TRACE_LOG("verification routine returned != 0.\n");
-              verification_error_occured = true;
-              break;
-            }
-          }
+          verification_error_occured = advance_virtual_clock(
+              tenth_seconds_to_delay,
+              tenth_seconds,
+              get_packed_routinecall_address(timed_routine_offset),
+              &tenth_seconds_elapsed);
         }
       }
 
       if ( (bool_equal(verification_error_occured, false))
           && (input_length == -1) ) {
 
-        if (active_interface->is_timed_keyboard_input_available() == false)
+        if (virtual_clock_enabled() == true)
+          // No time passes on the virtual clock while waiting for the
+          // interface, so the input is read without a timeout.
+          input_length
+            = active_interface->read_line(
+                z_text_buffer + 2,
+                maximum_length,
+                0,
+                0,
+                z_text_buffer[1],
+                NULL,
+                false,
+                false);
+        else if (active_interface->is_timed_keyboard_input_available()
+            == false)
           i18n_translate_and_exit(
               libfizmo_module_name,
               i18n_libfizmo_TIMED_INPUT_NOT_IMPLEMENTED_IN_INTERFACE_P0S,
@@ -2164,6 +2675,9 @@ void opcode_read(void)
 #endif /* DISABLE_COMMAND_HISTORY */
     }
 
+    // The input and its length have been stored in the text buffer.
+    dynamic_memory_written(z_text_buffer, maximum_length + 2);
+
     bytes_required = (input_length + 1) * sizeof(z_ucs);
     if (bytes_required > (size_t)interpreter_command_buffer_size)
     {
@@ -2243,6 +2757,9 @@ void opcode_read(void)
             z_mem + parsebuffer_offset,
             active_z_story->dictionary_table,
             false);
+        dynamic_memory_written(
+            z_mem + parsebuffer_offset,
+            2 + z_mem[parsebuffer_offset] * 4);
       }
 
 #ifndef DISABLE_PREFIX_COMMANDS
@@ -2278,6 +2795,9 @@ void opcode_read(void)
   while (interpreter_command_found != false);
 
   number_of_commands++;
+
+  turn_statistics_input_received(
+      z_text_buffer + (ver >= 5 ? 2 : 1), input_length);
 }
 
 
@@ -2287,6 +2807,8 @@ void opcode_print_obj(void)
 
   TRACE_LOG("Opcode: PRINT_OBJ.\n");
 
+  flush_stream_3_length();
+
   (void)output_zchar_to_streams(object_property_table + 1);
 }
 
@@ -2307,6 +2829,8 @@ void opcode_print_addr(void)
 {
   TRACE_LOG("Opcode: PRINT_ADDR.\n");
 
+  flush_stream_3_length();
+
   TRACE_LOG("Printing string at %x.\n", op[0]);
   (void)output_zchar_to_streams(z_mem + op[0]);
 }
@@ -2334,6 +2858,8 @@ void opcode_read_char(void)
 
   TRACE_LOG("Opcode: READ_CHAR.\n");
 
+  turn_statistics_input_requested();
+
   read_z_result_variable();
 
   // FIXME: Check for first parameter which must be 1.
@@ -2361,31 +2887,27 @@ void opcode_read_char(void)
     if (input_delay_tenth_seconds > 0) {
       TRACE_LOG("1/10s to wait: %d\n", input_delay_tenth_seconds);
       stream_output_has_occured = false;
-      while ((input_delay_tenth_seconds -= tenth_seconds) >= 0) {
-        TRACE_LOG(
-            "Invoking verification routine, 1/10s counter: %d(%d).\n",
-            input_delay_tenth_seconds, tenth_seconds);
-        if ((interpret_from_call(get_packed_routinecall_address(op[2]))) !=0 )
-        {
-          TRACE_LOG("verification routine returned != 0.\n");
-          verification_error_occured = true;
-          break;
-        }
+      verification_error_occured = advance_virtual_clock(
+          input_delay_tenth_seconds,
+          tenth_seconds,
+          get_packed_routinecall_address(op[2]),
+          &tenth_seconds_elapsed);
 
-        if (terminate_interpreter != INTERPRETER_QUIT_NONE)
-          return;
-      }
+      if (terminate_interpreter != INTERPRETER_QUIT_NONE)
+        return;
     }
 
-    if (bool_equal(verification_error_occured, false)) {
-      input_char
-        = (input_length == -1)
-        ? active_interface->read_char(
-            op[1],
-            get_packed_routinecall_address(op[2]),
-            &tenth_seconds_elapsed)
-        : command_input;
-    }
+    if (bool_equal(verification_error_occured, true))
+      input_char = -1;
+    else if (input_length != -1)
+      input_char = command_input;
+    else if (virtual_clock_enabled() == true)
+      input_char = active_interface->read_char(0, 0, NULL);
+    else
+      input_char = active_interface->read_char(
+          op[1],
+          get_packed_routinecall_address(op[2]),
+          &tenth_seconds_elapsed);
 
     if (terminate_interpreter != INTERPRETER_QUIT_NONE)
       return;
@@ -2473,6 +2995,9 @@ void opcode_read_char(void)
 
   if (active_sound_interface != NULL)
     active_sound_interface->keyboard_input_has_occurred();
+
+  command_input = (zscii)input_char;
+  turn_statistics_input_received(&command_input, 1);
 }
 
 
@@ -2490,6 +3015,8 @@ void opcode_print_table(void)
 
   TRACE_LOG("Opcode: PRINT_TABLE.\n");
 
+  flush_stream_3_length();
+
   if ( (ver != 6) && (active_window_number != 1) ) {
     // The Z-Spec from 2014-06-07 declares that "Version 5 games must only
     // ue print_table in the upper window. Its behaviour in the lower window
@@ -2557,6 +3084,8 @@ void opcode_encode_text(void)
 
   TRACE_LOG("Opcode: ENCODE_TEXT.\n");
 
+  flush_stream_3_length();
+
   // "encode_text" is only valid for version >= 5, so the length of the
   // buffer must always be fixed at 6 bytes.
   zchar_storage_start(dest, 6);
@@ -2579,6 +3108,7 @@ void opcode_encode_text(void)
 
   zchar_storage_finish();
   zchar_storage_clear();
+  dynamic_memory_written(dest, 6);
 }
 
 
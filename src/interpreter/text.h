@@ -47,9 +47,16 @@ extern uint8_t alphabet_table_after_v1[];
 extern z_ucs z_ucs_newline_string[];
 #endif /* text_c_INCLUDED */
 
+void init_zscii_unicode_tables();
+void invalidate_tokenise_cache();
+size_t get_tokenise_cache_size();
+void tokenise_cache_memory_written(uint8_t *address, size_t length);
+int decode_zchar_string_to_zscii(z_ucs *dest, uint16_t dest_length,
+    uint8_t *zchar_src);
 z_ucs zscii_input_char_to_z_ucs(zscii zscii_input);
 z_ucs zscii_output_char_to_z_ucs(zscii zscii_output);
 zscii unicode_char_to_zscii_input_char(z_ucs unicode_char);
+size_t z_ucs_string_to_zscii(zscii *dest, z_ucs *src);
 void opcode_print_paddr(void);
 void opcode_read(void);
 void opcode_print(void);
@@ -0,0 +1,249 @@
+
+/* turnstat.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef turnstat_c_INCLUDED
+#define turnstat_c_INCLUDED
+
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "../tools/tracelog.h"
+#include "../tools/types.h"
+#include "turnstat.h"
+#include "zpu.h"
+
+
+static void (*turn_statistics_function)(struct z_turn_statistics *stats)
+  = NULL;
+static struct z_turn_statistics current_turn;
+static struct z_turn_statistics last_turn;
+static struct z_turn_statistics_histogram histogram;
+static bool turn_is_active = false;
+static uint32_t number_of_turns = 0;
+static unsigned long total_allocations = 0;
+static uint32_t turn_start_step_number;
+static int64_t turn_start_wall_time;
+static clock_t turn_start_cpu_time;
+static struct z_startup_phase startup_phases[STARTUP_PHASES_MAXIMUM];
+static int nof_startup_phases = 0;
+static int64_t startup_time;
+static bool first_output_seen = false;
+static bool first_input_seen = false;
+
+
+void fizmo_register_turn_statistics_function(
+    void (*new_turn_statistics_function)(struct z_turn_statistics *stats))
+{
+  turn_statistics_function = new_turn_statistics_function;
+}
+
+
+// Returns the current time in microseconds. The seconds since the epoch
+// times 10^6 don't fit into a 32 bit long, so 64 bits are used.
+int64_t turn_statistics_get_timestamp()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+
+  return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+static int get_histogram_bucket(uint64_t value)
+{
+  int result = 0;
+
+  while ( (value != 0) && (result < TURN_STATISTICS_HISTOGRAM_SIZE - 1) )
+  {
+    value >>= 1;
+    result++;
+  }
+
+  return result;
+}
+
+
+// Invoked once the input for a "read" or "read_char" opcode has been
+// accepted. This starts the accounting for a new turn.
+void turn_statistics_input_received(zscii *input, int input_length)
+{
+  memset(&current_turn, 0, sizeof(struct z_turn_statistics));
+
+  if (input_length > TURN_STATISTICS_COMMAND_LENGTH)
+    input_length = TURN_STATISTICS_COMMAND_LENGTH;
+  if (input_length > 0)
+    memcpy(current_turn.command, input, input_length);
+  current_turn.command[input_length > 0 ? input_length : 0] = 0;
+
+  current_turn.turn_number = ++number_of_turns;
+  turn_start_step_number = (uint32_t)zpu_step_number;
+  turn_start_cpu_time = clock();
+  turn_start_wall_time = turn_statistics_get_timestamp();
+  turn_is_active = true;
+}
+
+
+// Invoked when the story asks for input. Finishes the current turn, in
+// case there is one, and reports its statistics.
+void turn_statistics_input_requested()
+{
+  if (first_input_seen == false)
+  {
+    first_input_seen = true;
+    startup_phase_completed("first-input");
+  }
+
+  if (turn_is_active == false)
+    return;
+
+  current_turn.wall_time
+    = (long)(turn_statistics_get_timestamp() - turn_start_wall_time);
+  current_turn.cpu_time
+    = (long)((clock() - turn_start_cpu_time)
+        * (1000000.0 / CLOCKS_PER_SEC));
+  current_turn.instructions
+    = (uint32_t)zpu_step_number - turn_start_step_number;
+  turn_is_active = false;
+
+  TRACE_LOG("Turn %d: %d instructions, %ld us.\n",
+      current_turn.turn_number, current_turn.instructions,
+      current_turn.wall_time);
+
+  histogram.number_of_turns++;
+  histogram.wall_time[get_histogram_bucket(current_turn.wall_time)]++;
+  histogram.cpu_time[get_histogram_bucket(current_turn.cpu_time)]++;
+  histogram.instructions[get_histogram_bucket(current_turn.instructions)]++;
+  histogram.total_wall_time += current_turn.wall_time;
+  histogram.total_cpu_time += current_turn.cpu_time;
+  histogram.total_instructions += current_turn.instructions;
+  if (current_turn.wall_time > histogram.maximum_wall_time)
+    histogram.maximum_wall_time = current_turn.wall_time;
+
+  memcpy(&last_turn, &current_turn, sizeof(struct z_turn_statistics));
+
+  if (turn_statistics_function != NULL)
+    turn_statistics_function(&last_turn);
+}
+
+
+void turn_statistics_add_output(size_t nof_characters)
+{
+  if ( (first_output_seen == false) && (nof_characters > 0) )
+  {
+    first_output_seen = true;
+    startup_phase_completed("first-output");
+  }
+
+  current_turn.characters_output += nof_characters;
+}
+
+
+void turn_statistics_add_undo_time(long microseconds)
+{
+  current_turn.undo_time += microseconds;
+}
+
+
+void turn_statistics_add_save_time(long microseconds)
+{
+  current_turn.save_time += microseconds;
+}
+
+
+void turn_statistics_count_allocation()
+{
+  current_turn.allocations++;
+  total_allocations++;
+}
+
+
+// Returns the number of allocations counted since the interpreter was
+// started, independent of turns. Used by the microbenchmarks.
+unsigned long turn_statistics_get_total_allocations()
+{
+  return total_allocations;
+}
+
+
+// Returns the statistics of the last completed turn or NULL in case no
+// turn has been completed yet.
+struct z_turn_statistics *get_last_turn_statistics()
+{
+  return last_turn.turn_number != 0 ? &last_turn : NULL;
+}
+
+
+struct z_turn_statistics_histogram *get_turn_statistics_histogram()
+{
+  return &histogram;
+}
+
+
+void reset_turn_statistics()
+{
+  memset(&histogram, 0, sizeof(struct z_turn_statistics_histogram));
+  memset(&last_turn, 0, sizeof(struct z_turn_statistics));
+  turn_is_active = false;
+  number_of_turns = 0;
+  nof_startup_phases = 0;
+  first_output_seen = false;
+  first_input_seen = false;
+  startup_time = turn_statistics_get_timestamp();
+}
+
+
+void startup_phase_completed(char *name)
+{
+  if (nof_startup_phases == STARTUP_PHASES_MAXIMUM)
+    return;
+
+  startup_phases[nof_startup_phases].name = name;
+  startup_phases[nof_startup_phases].elapsed_time
+    = (long)(turn_statistics_get_timestamp() - startup_time);
+
+  TRACE_LOG("Startup phase \"%s\" completed after %ld us.\n",
+      name, startup_phases[nof_startup_phases].elapsed_time);
+
+  nof_startup_phases++;
+}
+
+
+struct z_startup_phase *get_startup_phases(int *nof_phases)
+{
+  *nof_phases = nof_startup_phases;
+  return startup_phases;
+}
+
+#endif /* turnstat_c_INCLUDED */
+
@@ -0,0 +1,100 @@
+
+/* turnstat.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef turnstat_h_INCLUDED
+#define turnstat_h_INCLUDED
+
+#include "../tools/types.h"
+
+#define TURN_STATISTICS_COMMAND_LENGTH 64
+#define TURN_STATISTICS_HISTOGRAM_SIZE 32
+#define STARTUP_PHASES_MAXIMUM 16
+
+// A "turn" spans the time from the moment the input of a "read" or
+// "read_char" opcode has been accepted until the story asks for the next
+// input. All times are given in microseconds.
+struct z_turn_statistics
+{
+  uint32_t turn_number;
+  zscii command[TURN_STATISTICS_COMMAND_LENGTH + 1];
+  uint32_t instructions;
+  long wall_time;
+  long cpu_time;
+  size_t characters_output;
+  long undo_time;
+  long save_time;
+  uint32_t allocations;
+};
+
+// The histograms count the turns by magnitude: Bucket n holds the number
+// of turns with a value v with 2^(n-1) <= v < 2^n, bucket 0 those turns
+// where v == 0.
+struct z_turn_statistics_histogram
+{
+  uint32_t number_of_turns;
+  uint32_t wall_time[TURN_STATISTICS_HISTOGRAM_SIZE];
+  uint32_t cpu_time[TURN_STATISTICS_HISTOGRAM_SIZE];
+  uint32_t instructions[TURN_STATISTICS_HISTOGRAM_SIZE];
+  uint64_t total_wall_time;
+  uint64_t total_cpu_time;
+  uint64_t total_instructions;
+  long maximum_wall_time;
+};
+
+// Startup is split into phases, each of which is recorded with the time
+// from the start of "fizmo_start" to its end. The last two phases are
+// "first-output", once the story has printed something, and "first-input",
+// once the story asks for input for the first time.
+struct z_startup_phase
+{
+  char *name;
+  long elapsed_time;
+};
+
+void fizmo_register_turn_statistics_function(
+    void (*new_turn_statistics_function)(struct z_turn_statistics *stats));
+void turn_statistics_input_received(zscii *input, int input_length);
+void turn_statistics_input_requested();
+void turn_statistics_add_output(size_t nof_characters);
+void turn_statistics_add_undo_time(long microseconds);
+void turn_statistics_add_save_time(long microseconds);
+void turn_statistics_count_allocation();
+unsigned long turn_statistics_get_total_allocations();
+int64_t turn_statistics_get_timestamp();
+struct z_turn_statistics *get_last_turn_statistics();
+struct z_turn_statistics_histogram *get_turn_statistics_histogram();
+void reset_turn_statistics();
+void startup_phase_completed(char *name);
+struct z_startup_phase *get_startup_phases(int *nof_phases);
+
+#endif /* turnstat_h_INCLUDED */
+
@@ -41,8 +41,13 @@
 #include "zpu.h"
 #include "variable.h"
 #include "fizmo.h"
+#include "allocator.h"
 #include "stack.h"
 #include "config.h"
+#include "text.h"
+#include "streams.h"
+#include "turnstat.h"
+#include "memstat.h"
 
 
 struct undo_frame
@@ -68,10 +73,10 @@ static void delete_undo_frame(struct undo_frame *frame)
   if (frame != NULL)
   {
     if (frame->dynamic_memory != NULL)
-      free(frame->dynamic_memory);
+      fizmo_session_free(frame->dynamic_memory);
     if (frame->stack != NULL)
-      free(frame->stack);
-    free(frame);
+      fizmo_session_free(frame->stack);
+    fizmo_session_free(frame);
   }
 }
 
@@ -94,23 +99,28 @@ int set_max_undo_steps(int new_max_steps)
   {
     if (undo_frames)
     {
-      free(undo_frames);
+      fizmo_session_free(undo_frames);
       undo_frames = NULL;
     }
     max_undo_steps = 0;
     undo_index = 0;
+    update_subsystem_memory_stats(MEMORY_STATS_UNDO);
     return -1;
   }
 
-  if ((realloced_undo_frames = (struct undo_frame**)realloc(
+  if ((realloced_undo_frames = (struct undo_frame**)fizmo_session_try_realloc(
           undo_frames, new_max_steps * sizeof(struct undo_frame*))) != NULL)
   {
     undo_frames = realloced_undo_frames;
     max_undo_steps = new_max_steps;
+    update_subsystem_memory_stats(MEMORY_STATS_UNDO);
     return 0;
   }
   else
+  {
+    update_subsystem_memory_stats(MEMORY_STATS_UNDO);
     return 1;
+  }
 }
 
 
@@ -118,7 +128,8 @@ static struct undo_frame *create_new_undo_frame()
 {
   struct undo_frame *result;
 
-  if ((result = (struct undo_frame*)malloc(sizeof(struct undo_frame))) == NULL)
+  if ((result = (struct undo_frame*)fizmo_session_try_malloc(
+          sizeof(struct undo_frame))) == NULL)
     return NULL;
 
   result->dynamic_memory = NULL;
@@ -134,9 +145,12 @@ void opcode_save_undo(void)
   struct undo_frame *new_undo_frame;
   int result;
   size_t nof_stack_bytes_in_use;
+  int64_t start_time = turn_statistics_get_timestamp();
 
   TRACE_LOG("Opcode: SAVE_UNDO.\n");
 
+  flush_stream_3_length();
+
   if (max_undo_steps <= 0)
   {
     result = 0;
@@ -158,7 +172,8 @@ void opcode_save_undo(void)
         dynamic_memory_size = (size_t)(
             active_z_story->dynamic_memory_end - z_mem + 1 );
 
-        if ( (new_undo_frame->dynamic_memory = malloc(dynamic_memory_size))
+        if ( (new_undo_frame->dynamic_memory
+              = fizmo_session_try_malloc(dynamic_memory_size))
             == NULL)
         {
           delete_undo_frame(new_undo_frame);
@@ -169,7 +184,8 @@ void opcode_save_undo(void)
           nof_stack_bytes_in_use = (z_stack_index - z_stack) * sizeof(uint16_t);
 
           if ((new_undo_frame->stack
-                = (uint16_t*)malloc(nof_stack_bytes_in_use)) == NULL)
+                = (uint16_t*)fizmo_session_try_malloc(nof_stack_bytes_in_use))
+              == NULL)
           {
             delete_undo_frame(new_undo_frame);
             result = 0;
@@ -210,6 +226,7 @@ void opcode_save_undo(void)
               = number_of_locals_from_function_call;
 
             undo_frames[undo_index++] = new_undo_frame;
+            update_subsystem_memory_stats(MEMORY_STATS_UNDO);
 
             result = 1;
           }
@@ -218,6 +235,9 @@ void opcode_save_undo(void)
     }
   }
 
+  turn_statistics_add_undo_time(
+      (long)(turn_statistics_get_timestamp() - start_time));
+
   read_z_result_variable();
   set_variable(z_res_var, (uint16_t)result, false);
 }
@@ -228,9 +248,12 @@ void opcode_restore_undo(void)
   int result;
   size_t dynamic_memory_size;
   struct undo_frame *frame_to_restore;
+  int64_t start_time = turn_statistics_get_timestamp();
 
   TRACE_LOG("Opcode: RESTORE_UNDO.\n");
 
+  flush_stream_3_length();
+
   if (undo_index > 0)
   {
     undo_index--;
@@ -269,8 +292,11 @@ void opcode_restore_undo(void)
         dynamic_memory_size);
 
     delete_undo_frame(frame_to_restore);
+    update_subsystem_memory_stats(MEMORY_STATS_UNDO);
 
     write_interpreter_info_into_header();
+    init_zscii_unicode_tables();
+    dynamic_memory_replaced();
 
     result = 2;
   }
@@ -279,6 +305,9 @@ void opcode_restore_undo(void)
     result = 0;
   }
 
+  turn_statistics_add_undo_time(
+      (long)(turn_statistics_get_timestamp() - start_time));
+
   read_z_result_variable();
   set_variable(z_res_var, (uint16_t)result, false);
 }
@@ -309,10 +338,11 @@ void free_undo_memory(void)
       undo_index--;
       delete_undo_frame(undo_frames[undo_index]);
     }
-    free(undo_frames);
+    fizmo_session_free(undo_frames);
     undo_frames = NULL;
   }
   max_undo_steps = 0;
+  update_subsystem_memory_stats(MEMORY_STATS_UNDO);
 }
 
 #endif /* undo_c_INCLUDED */
@@ -39,6 +39,7 @@
 #include "stack.h"
 #include "zpu.h"
 #include "config.h"
+#include "streams.h"
 #include "../locales/libfizmo_locales.h"
 
 
@@ -92,6 +93,8 @@ void set_variable(uint8_t variable_number, uint16_t data,
         /*@-nullderef@*/ active_z_story->global_variables /*@-nullderef@*/
         +(variable_number*2),
         data);
+    dynamic_memory_written(
+        active_z_story->global_variables + (variable_number*2), 2);
   }
 }
 
@@ -156,6 +159,8 @@ void opcode_pull(void)
 
   TRACE_LOG("Opcode: PULL.\n");
 
+  flush_stream_3_length();
+
   if (ver == 6)
     (void)read_z_result_variable();
 
@@ -185,6 +190,7 @@ void opcode_pull(void)
     spare_slots++;
     value = load_word(user_stack + spare_slots);
     store_word(user_stack, spare_slots);
+    dynamic_memory_written(user_stack, 2);
   }
 
   if (ver == 6)
@@ -219,14 +225,18 @@ void opcode_push_user_stack(void)
 
   TRACE_LOG("Opcode: PUSH_USER_STACK.\n");
 
+  flush_stream_3_length();
+
   (void)read_z_result_variable();
   user_stack = z_mem + (uint16_t)op[1];
 
   if ((spare_slots = load_word(user_stack)) > 0)
   {
     store_word(user_stack + spare_slots, (uint16_t)op[0]);
+    dynamic_memory_written(user_stack + spare_slots, 2);
     spare_slots--;
     store_word(user_stack, spare_slots);
+    dynamic_memory_written(user_stack, 2);
     evaluate_branch((uint8_t)1);
   }
   else
@@ -251,6 +261,8 @@ void opcode_storew(void)
 
   TRACE_LOG("Opcode: STOREW.\n");
 
+  flush_stream_3_length();
+
   if (address > active_z_story->dynamic_memory_end)
   {
     TRACE_LOG("Trying to storew to %x which is above dynamic memory.\n",
@@ -260,6 +272,7 @@ void opcode_storew(void)
   {
     TRACE_LOG("Storing %x to %x.\n", op[2], address);
     store_word(z_mem + (uint16_t)(op[0] + ((int16_t)op[1])*2), op[2]);
+    dynamic_memory_written(address, 2);
   }
 }
 
@@ -271,6 +284,8 @@ void opcode_loadw(void)
 
   TRACE_LOG("Opcode: LOADW.\n");
 
+  flush_stream_3_length();
+
   read_z_result_variable();
 
   if (address > active_z_story->static_memory_end)
@@ -294,6 +309,8 @@ void opcode_storeb(void)
 
   TRACE_LOG("Opcode: STOREB.\n");
 
+  flush_stream_3_length();
+
   if (address > active_z_story->dynamic_memory_end)
   {
     TRACE_LOG("Trying to storeb to %x which is above dynamic memory.", address);
@@ -302,6 +319,7 @@ void opcode_storeb(void)
   {
     TRACE_LOG("Storing %x to %x.\n", op[2], address);
     *(z_mem + (uint16_t)(op[0] + (int16_t)op[1])) = op[2];
+    dynamic_memory_written(address, 1);
   }
 }
 
@@ -312,6 +330,8 @@ void opcode_loadb(void)
 
   TRACE_LOG("Opcode: LOADB.\n");
 
+  flush_stream_3_length();
+
   read_z_result_variable();
 
   if (address > active_z_story->static_memory_end)
@@ -0,0 +1,92 @@
+
+/* vclock.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// The virtual clock is the interpreter's own time source for timed input.
+// It is only advanced by the delays recorded in input stream 1, so timed
+// routines run on simulated ticks instead of waiting for real time to
+// pass. In case "virtual-clock" is set, input from the screen interface is
+// also read without a timeout, so replays and test runs of real-time
+// stories don't depend on wall-clock time at all.
+
+#ifndef vclock_c_INCLUDED
+#define vclock_c_INCLUDED
+
+#include <string.h>
+
+#include "../tools/tracelog.h"
+#include "../tools/types.h"
+#include "vclock.h"
+#include "config.h"
+#include "zpu.h"
+
+
+bool virtual_clock_enabled(void)
+{
+  char *value = get_configuration_value("virtual-clock");
+
+  return (value != NULL) && (strcmp(value, "true") == 0);
+}
+
+
+bool advance_virtual_clock(int tenth_seconds, uint16_t interval,
+    uint32_t routine_address, int *tenth_seconds_elapsed)
+{
+  int elapsed = 0;
+
+  TRACE_LOG("Advancing virtual clock by %d/10s in steps of %d/10s.\n",
+      tenth_seconds, interval);
+
+  while ( (interval != 0) && (elapsed + interval <= tenth_seconds) )
+  {
+    elapsed += interval;
+
+    TRACE_LOG("Invoking timed routine at %d/10s.\n", elapsed);
+    if (interpret_from_call(routine_address) != 0)
+    {
+      TRACE_LOG("Timed routine returned != 0.\n");
+      if (tenth_seconds_elapsed != NULL)
+        *tenth_seconds_elapsed = elapsed;
+      return true;
+    }
+
+    if (terminate_interpreter != INTERPRETER_QUIT_NONE)
+      break;
+  }
+
+  if (tenth_seconds_elapsed != NULL)
+    *tenth_seconds_elapsed = tenth_seconds;
+
+  return false;
+}
+
+#endif /* vclock_c_INCLUDED */
+
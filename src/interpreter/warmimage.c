@@ -0,0 +1,366 @@
+
+/* warmimage.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// A warm image holds a story's memory as read from the story file plus
+// the story indexes and the results of the story list lookup, so that a
+// later start can skip all of these. The image is used right out of the
+// mapped file. It is laid out as follows, all numbers big-endian:
+//
+//  0  "FzWI"
+//  4  format version
+//  8  story size
+// 12  story file execution offset
+// 16  length of title, blorb filename and language, 4 bytes each,
+//     0xffffffff for NULL
+// 28  0x01020304 in native byte order, since the indexes are stored in
+//     native byte order
+// 32  hash of everything from offset 48 to the end of the image
+// 40  length of the story indexes
+// 44  reserved
+// 48  story memory, followed by the story indexes at the next multiple
+//     of eight and the strings without terminating zeros.
+
+#ifndef warmimage_c_INCLUDED
+#define warmimage_c_INCLUDED
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../tools/tracelog.h"
+#include "../tools/types.h"
+#include "../tools/filesys.h"
+#include "warmimage.h"
+#include "fizmo.h"
+
+#define WARM_IMAGE_FORMAT_VERSION 2
+#define WARM_IMAGE_PREAMBLE_SIZE 48
+#define WARM_IMAGE_NULL_STRING 0xffffffff
+#define WARM_IMAGE_BYTE_ORDER_MARK 0x01020304
+
+static uint8_t warm_image_magic[] = { 'F', 'z', 'W', 'I' };
+
+
+static uint32_t read_uint32(uint8_t *src)
+{
+  return ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16)
+    | ((uint32_t)src[2] << 8) | (uint32_t)src[3];
+}
+
+
+static void write_uint32(uint8_t *dest, uint32_t value)
+{
+  dest[0] = (uint8_t)(value >> 24);
+  dest[1] = (uint8_t)(value >> 16);
+  dest[2] = (uint8_t)(value >> 8);
+  dest[3] = (uint8_t)value;
+}
+
+
+// 64-bit FNV-1a, fed eight bytes at a time so that verifying the image
+// costs only a small fraction of reading the story.
+static uint64_t hash_image_data(uint8_t *data, size_t len)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  uint64_t word;
+  size_t i;
+
+  for (i=0; i+8<=len; i+=8)
+  {
+    memcpy(&word, data + i, 8);
+    hash = (hash ^ word) * 0x100000001b3ULL;
+  }
+
+  for (; i<len; i++)
+    hash = (hash ^ data[i]) * 0x100000001b3ULL;
+
+  return hash;
+}
+
+
+static void write_hash(uint8_t *dest, uint64_t hash)
+{
+  write_uint32(dest, (uint32_t)(hash >> 32));
+  write_uint32(dest + 4, (uint32_t)hash);
+}
+
+
+static uint64_t read_hash(uint8_t *src)
+{
+  return ((uint64_t)read_uint32(src) << 32) | read_uint32(src + 4);
+}
+
+
+static size_t get_index_data_offset(long story_size)
+{
+  return (WARM_IMAGE_PREAMBLE_SIZE + (size_t)story_size + 7) & ~(size_t)7;
+}
+
+
+// Returns a copy of the "len" bytes at "src" or NULL for a NULL string.
+static char *read_image_string(uint8_t *src, uint32_t len)
+{
+  char *result;
+
+  if (len == WARM_IMAGE_NULL_STRING)
+    return NULL;
+
+  result = fizmo_malloc(len + 1);
+  memcpy(result, src, len);
+  result[len] = 0;
+  return result;
+}
+
+
+struct warm_image *load_warm_image(char *filename, z_file *story_file,
+    long story_file_exec_offset, long story_size,
+    struct warm_image_metadata *metadata)
+{
+  z_file *image_file;
+  struct warm_image *result;
+  uint8_t *image, *ptr;
+  uint8_t story_header[WARM_IMAGE_HEADER_SIZE];
+  size_t image_len, header_len, index_offset, index_len = 0;
+  size_t strings_len = 0;
+  uint32_t string_lengths[3];
+  uint32_t byte_order_mark = 0;
+  int i;
+
+  metadata->title = NULL;
+  metadata->blorb_filename = NULL;
+  metadata->language = NULL;
+
+  if ((image_file = fsi->openfile(filename, FILETYPE_DATA, FILEACCESS_READ))
+      == NULL)
+  {
+    TRACE_LOG("No warm image at \"%s\".\n", filename);
+    return NULL;
+  }
+
+  image = fsi_map_file(image_file, &image_len);
+  fsi->closefile(image_file);
+  if (image == NULL)
+    return NULL;
+
+  header_len = story_size < WARM_IMAGE_HEADER_SIZE
+    ? (size_t)story_size
+    : WARM_IMAGE_HEADER_SIZE;
+  index_offset = get_index_data_offset(story_size);
+
+  if (image_len >= WARM_IMAGE_PREAMBLE_SIZE)
+  {
+    for (i=0; i<3; i++)
+    {
+      string_lengths[i] = read_uint32(image + 16 + i*4);
+      if (string_lengths[i] != WARM_IMAGE_NULL_STRING)
+        strings_len += string_lengths[i];
+    }
+    memcpy(&byte_order_mark, image + 28, 4);
+    index_len = read_uint32(image + 40);
+  }
+
+  if (
+      (image_len < WARM_IMAGE_PREAMBLE_SIZE)
+      ||
+      (memcmp(image, warm_image_magic, 4) != 0)
+      ||
+      (read_uint32(image + 4) != WARM_IMAGE_FORMAT_VERSION)
+      ||
+      (byte_order_mark != WARM_IMAGE_BYTE_ORDER_MARK)
+      ||
+      (read_uint32(image + 8) != (uint32_t)story_size)
+      ||
+      (read_uint32(image + 12) != (uint32_t)story_file_exec_offset)
+      ||
+      (image_len != index_offset + index_len + strings_len)
+     )
+  {
+    TRACE_LOG("Warm image \"%s\" doesn't match story.\n", filename);
+  }
+
+  // The story's header carries release, serial number and checksum, so
+  // comparing it catches a replaced story file without reading all of it.
+  else if (
+      (fsi->setfilepos(story_file, story_file_exec_offset, SEEK_SET) != 0)
+      ||
+      (fsi->readchars(story_header, header_len, story_file) != header_len)
+      ||
+      (memcmp(story_header, image + WARM_IMAGE_PREAMBLE_SIZE, header_len)
+       != 0)
+     )
+  {
+    TRACE_LOG("Warm image \"%s\" was made from another story.\n", filename);
+  }
+
+  else if (hash_image_data(
+        image + WARM_IMAGE_PREAMBLE_SIZE,
+        image_len - WARM_IMAGE_PREAMBLE_SIZE)
+      != read_hash(image + 32))
+  {
+    TRACE_LOG("Warm image \"%s\" is damaged.\n", filename);
+  }
+
+  else
+  {
+    result = (struct warm_image*)fizmo_malloc(sizeof(struct warm_image));
+    result->data = image;
+    result->length = image_len;
+    result->memory = image + WARM_IMAGE_PREAMBLE_SIZE;
+    result->index_data = image + index_offset;
+    result->index_data_length = index_len;
+
+    ptr = image + index_offset + index_len;
+    metadata->title = read_image_string(ptr, string_lengths[0]);
+    if (string_lengths[0] != WARM_IMAGE_NULL_STRING)
+      ptr += string_lengths[0];
+    metadata->blorb_filename = read_image_string(ptr, string_lengths[1]);
+    if (string_lengths[1] != WARM_IMAGE_NULL_STRING)
+      ptr += string_lengths[1];
+    metadata->language = read_image_string(ptr, string_lengths[2]);
+
+    TRACE_LOG("Loaded warm image \"%s\".\n", filename);
+    return result;
+  }
+
+  fsi_unmap_file(image, image_len);
+  return NULL;
+}
+
+
+void free_warm_image(struct warm_image *image)
+{
+  fsi_unmap_file(image->data, image->length);
+  free(image);
+}
+
+
+int save_warm_image(char *filename, uint8_t *memory,
+    long story_file_exec_offset, long story_size, uint8_t *original_header,
+    uint8_t *index_data, size_t index_data_length,
+    struct warm_image_metadata *metadata)
+{
+  char *strings[3];
+  uint32_t string_lengths[3];
+  uint32_t byte_order_mark = WARM_IMAGE_BYTE_ORDER_MARK;
+  size_t image_len, index_offset, strings_len = 0;
+  uint8_t *image, *ptr;
+  char *tmp_filename;
+  z_file *image_file;
+  int i, result = -1;
+
+  strings[0] = metadata->title;
+  strings[1] = metadata->blorb_filename;
+  strings[2] = metadata->language;
+
+  for (i=0; i<3; i++)
+  {
+    string_lengths[i] = strings[i] != NULL
+      ? (uint32_t)strlen(strings[i])
+      : WARM_IMAGE_NULL_STRING;
+    if (strings[i] != NULL)
+      strings_len += string_lengths[i];
+  }
+
+  index_offset = get_index_data_offset(story_size);
+  image_len = index_offset + index_data_length + strings_len;
+  image = fizmo_malloc(image_len);
+  memset(image, 0, index_offset);
+
+  memcpy(image, warm_image_magic, 4);
+  write_uint32(image + 4, WARM_IMAGE_FORMAT_VERSION);
+  write_uint32(image + 8, (uint32_t)story_size);
+  write_uint32(image + 12, (uint32_t)story_file_exec_offset);
+  for (i=0; i<3; i++)
+    write_uint32(image + 16 + i*4, string_lengths[i]);
+  memcpy(image + 28, &byte_order_mark, 4);
+  write_uint32(image + 40, (uint32_t)index_data_length);
+
+  ptr = image + WARM_IMAGE_PREAMBLE_SIZE;
+  memcpy(ptr, memory, (size_t)story_size);
+  memcpy(ptr, original_header, story_size < WARM_IMAGE_HEADER_SIZE
+      ? (size_t)story_size : WARM_IMAGE_HEADER_SIZE);
+
+  ptr = image + index_offset;
+  if (index_data_length > 0)
+    memcpy(ptr, index_data, index_data_length);
+  ptr += index_data_length;
+
+  for (i=0; i<3; i++)
+    if (strings[i] != NULL)
+    {
+      memcpy(ptr, strings[i], string_lengths[i]);
+      ptr += string_lengths[i];
+    }
+
+  write_hash(image + 32, hash_image_data(
+        image + WARM_IMAGE_PREAMBLE_SIZE,
+        image_len - WARM_IMAGE_PREAMBLE_SIZE));
+
+  // Like the page store, the image is written to a temporary file first,
+  // so that a process starting concurrently never maps a partial image.
+  if ((image_file = fsi_open_temp_file(filename, FILETYPE_DATA,
+          &tmp_filename)) != NULL)
+  {
+    if (fsi->writechars(image, image_len, image_file) == image_len)
+      result = 0;
+
+    if (fsi->closefile(image_file) != 0)
+      result = -1;
+
+    if (result == 0)
+      result = fsi_rename_file(tmp_filename, filename) == 0 ? 0 : -1;
+
+    if (result != 0)
+      (void)fsi_remove_file(tmp_filename);
+
+    free(tmp_filename);
+  }
+
+  TRACE_LOG("Wrote warm image \"%s\", result: %d.\n", filename, result);
+
+  free(image);
+  return result;
+}
+
+
+void free_warm_image_metadata(struct warm_image_metadata *metadata)
+{
+  free(metadata->title);
+  free(metadata->blorb_filename);
+  free(metadata->language);
+  metadata->title = NULL;
+  metadata->blorb_filename = NULL;
+  metadata->language = NULL;
+}
+
+#endif /* warmimage_c_INCLUDED */
+
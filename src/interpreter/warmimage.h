@@ -0,0 +1,85 @@
+
+/* warmimage.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef warmimage_h_INCLUDED
+#define warmimage_h_INCLUDED
+
+#include "../tools/types.h"
+
+#define WARM_IMAGE_HEADER_SIZE 64
+
+// Story data which is otherwise looked up in the story list at startup.
+// All strings are allocated using fizmo_malloc and may be NULL.
+struct warm_image_metadata
+{
+  char *title;
+  char *blorb_filename;
+  char *language;
+};
+
+struct warm_image
+{
+  uint8_t *data;
+  size_t length;
+
+  // Both point into "data".
+  uint8_t *memory;
+  uint8_t *index_data;
+  size_t index_data_length;
+};
+
+// Maps the warm image "filename" and verifies that it was made from the
+// story file "story_file" -- same size, execution offset and header,
+// including the header's checksum -- and that the image is intact. On
+// success, "metadata" is filled in and the mapped image is returned. Its
+// story memory may be used as the story's memory directly, since changes
+// to the mapping never reach the file. Returns NULL in case the image
+// doesn't exist, is outdated or damaged.
+struct warm_image *load_warm_image(char *filename, z_file *story_file,
+    long story_file_exec_offset, long story_size,
+    struct warm_image_metadata *metadata);
+
+void free_warm_image(struct warm_image *image);
+
+// Writes a warm image for the "story_size" bytes at "memory" and the
+// story indexes at "index_data". Since the loader patches the header for
+// the running interface, "original_header" has to contain the first
+// WARM_IMAGE_HEADER_SIZE bytes as they were read from the story file.
+int save_warm_image(char *filename, uint8_t *memory,
+    long story_file_exec_offset, long story_size, uint8_t *original_header,
+    uint8_t *index_data, size_t index_data_length,
+    struct warm_image_metadata *metadata);
+
+void free_warm_image_metadata(struct warm_image_metadata *metadata);
+
+#endif /* warmimage_h_INCLUDED */
+
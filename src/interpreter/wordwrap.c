@@ -49,6 +49,7 @@
 #include "wordwrap.h"
 #include "fizmo.h"
 #include "hyphenation.h"
+#include "memstat.h"
 
 
 // static z_ucs word_split_chars[] = {
@@ -71,6 +72,9 @@
 
 static z_ucs word_split_chars[] = { Z_UCS_SPACE, Z_UCS_NEWLINE, 0 };
 
+// Sum of all wrappers' memory, including the ones created by interfaces.
+static size_t allocated_wordwrap_memory = 0;
+
 
 WORDWRAP *wordwrap_new_wrapper(size_t line_length,
     void (*wrapped_text_output_destination)(z_ucs *output, void *parameter),
@@ -105,18 +109,43 @@ WORDWRAP *wordwrap_new_wrapper(size_t line_length,
   result->metadata_size = 0;
   result->metadata_index = 0;
 
+  allocated_wordwrap_memory += wordwrap_get_allocated_memory_size(result);
+  update_subsystem_memory_stats(MEMORY_STATS_WORDWRAP);
+
   return result;
 }
 
 
 void wordwrap_destroy_wrapper(WORDWRAP *wrapper_to_destroy)
 {
+  allocated_wordwrap_memory
+    -= wordwrap_get_allocated_memory_size(wrapper_to_destroy);
+
   free(wrapper_to_destroy->input_buffer);
   if (wrapper_to_destroy->padding_buffer != NULL)
     free(wrapper_to_destroy->padding_buffer);
   if (wrapper_to_destroy->metadata != NULL)
     free(wrapper_to_destroy->metadata);
   free(wrapper_to_destroy);
+
+  update_subsystem_memory_stats(MEMORY_STATS_WORDWRAP);
+}
+
+
+size_t wordwrap_get_allocated_memory_size(WORDWRAP *wrapper)
+{
+  return sizeof(WORDWRAP)
+    + wrapper->input_buffer_size * sizeof(z_ucs)
+    + (wrapper->padding_buffer != NULL
+        ? (wrapper->left_side_padding + 1) * sizeof(z_ucs)
+        : 0)
+    + wrapper->metadata_size * sizeof(struct wordwrap_metadata);
+}
+
+
+size_t wordwrap_get_total_allocated_memory_size(void)
+{
+  return allocated_wordwrap_memory;
 }
 
 
@@ -588,10 +617,17 @@ static void flush_input_buffer(WORDWRAP *wrapper, bool force_flush)
 
 
 void wordwrap_wrap_z_ucs(WORDWRAP *wrapper, z_ucs *input)
+{
+  wordwrap_wrap_z_ucs_view(wrapper, z_ucs_view_of(input));
+}
+
+
+void wordwrap_wrap_z_ucs_view(WORDWRAP *wrapper, z_ucs_view input_view)
 {
   size_t len, chars_to_copy, space_in_buffer;
+  z_ucs *input = input_view.ptr;
 
-  len = z_ucs_len(input);
+  len = input_view.len;
 
   while (len > 0)
   {
@@ -634,7 +670,15 @@ void wordwrap_wrap_z_ucs(WORDWRAP *wrapper, z_ucs *input)
     {
       flush_input_buffer(wrapper, false);
 
-      //FIXME: Increase buffer size in case flush not possible.
+      // In case hyphenation waits for the end of a word longer than the
+      // buffer nothing could be flushed, so there has to be more room.
+      if (wrapper->input_index == wrapper->input_buffer_size - 1)
+      {
+        wrapper->input_buffer_size *= 2;
+        wrapper->input_buffer = (z_ucs*)fizmo_realloc(
+            wrapper->input_buffer,
+            sizeof(z_ucs) * wrapper->input_buffer_size);
+      }
     }
   }
 }
@@ -666,6 +710,8 @@ void wordwrap_insert_metadata(WORDWRAP *wrapper,
         wrapper->metadata, bytes_to_allocate);
 
     wrapper->metadata_size += 32;
+    allocated_wordwrap_memory += 32 * sizeof(struct wordwrap_metadata);
+    update_subsystem_memory_stats(MEMORY_STATS_WORDWRAP);
 
     TRACE_LOG("Wordwrap-metadata at %p.\n", wrapper->metadata);
   }
@@ -695,6 +741,16 @@ void wordwrap_insert_metadata(WORDWRAP *wrapper,
 void wordwrap_adjust_line_length(WORDWRAP *wrapper, size_t new_line_length)
 {
   wrapper->line_length = new_line_length;
+
+  // The buffer has to hold more than a line, otherwise it may fill up
+  // without any line being complete.
+  if (wrapper->input_buffer_size < (long)new_line_length * 4)
+  {
+    wrapper->input_buffer_size = (long)new_line_length * 4;
+    wrapper->input_buffer = (z_ucs*)fizmo_realloc(
+        wrapper->input_buffer,
+        sizeof(z_ucs) * wrapper->input_buffer_size);
+  }
 }
 
 
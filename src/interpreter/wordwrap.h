@@ -34,6 +34,7 @@
 #define wordwrap_h_INCLUDED
 
 #include "../tools/types.h"
+#include "../tools/z_ucs.h"
 
 
 struct wordwrap_metadata
@@ -86,7 +87,10 @@ WORDWRAP *wordwrap_new_wrapper(size_t line_length,
     void *destination_parameter, bool add_newline_after_full_line,
     int left_side_padding, bool flush_after_newline, bool enable_hyphenation);
 void wordwrap_destroy_wrapper(WORDWRAP *wrapper_to_destroy);
+size_t wordwrap_get_allocated_memory_size(WORDWRAP *wrapper);
+size_t wordwrap_get_total_allocated_memory_size(void);
 void wordwrap_wrap_z_ucs(WORDWRAP *wrapper, z_ucs *input);
+void wordwrap_wrap_z_ucs_view(WORDWRAP *wrapper, z_ucs_view input);
 void wordwrap_flush_output(WORDWRAP *wrapper);
 void wordwrap_insert_metadata(WORDWRAP *wrapper,
     void (*metadata_output)(void *ptr_parameter, uint32_t int_parameter),
@@ -51,6 +51,7 @@
 #include "stack.h"
 #include "table.h"
 #include "undo.h"
+#include "storyidx.h"
 #include "../locales/libfizmo_locales.h"
 
 #ifdef ENABLE_DEBUGGER
@@ -635,6 +636,25 @@ void store_word(uint8_t *dest, uint16_t data)
 }
 
 
+// Has to be invoked for every write into dynamic memory which happens on
+// behalf of the story, so that the tokenise cache and the story indexes
+// can drop whatever depends on the bytes written.
+void dynamic_memory_written(uint8_t *address, size_t length)
+{
+  tokenise_cache_memory_written(address, length);
+  story_indexes_memory_written(address, length);
+}
+
+
+// Has to be invoked once dynamic memory has been replaced as a whole by a
+// restore, undo or restart.
+void dynamic_memory_replaced(void)
+{
+  invalidate_tokenise_cache();
+  story_indexes_memory_replaced();
+}
+
+
 #ifdef ENABLE_TRACING
 void dump_dynamic_memory_to_tracelog()
 {
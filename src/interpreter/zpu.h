@@ -83,6 +83,8 @@ void evaluate_branch(uint8_t test_result);
 void parse_branch_bytes(void);
 uint16_t load_word(uint8_t *ptr);
 void store_word(uint8_t *dest, uint16_t data);
+void dynamic_memory_written(uint8_t *address, size_t length);
+void dynamic_memory_replaced(void);
 void init_opcode_functions(void);
 void dump_stack(void);
 void dump_locals(void);
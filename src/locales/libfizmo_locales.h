@@ -117,6 +117,7 @@
 #define i18n_libfizmo_FIZMO_VERSION_P0S 81
 #define i18n_libfizmo_SUPPLIED_BLORB_FILE_PROVIDES_NO_ZCOD_CHUNK 82
 #define i18n_libfizmo_SUPPLIED_FILE_IS_NOT_A_VALID_Z_MACHINE_FILE 83
+#define i18n_libfizmo_ERROR_WRITING_TO_OUTPUT_STREAM_P0D 84
 
 extern z_ucs libfizmo_module_name[];
 extern z_ucs default_locale_name[];
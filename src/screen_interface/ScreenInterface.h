@@ -27,70 +27,482 @@
  * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Header-only binding for front-ends written in C++. A front-end class
+ * derives from ScreenInterface<FrontEnd> and defines the methods it wants
+ * to implement under the same names, everything else falls back to the
+ * defaults below:
+ *
+ *   class TerminalInterface : public ScreenInterface<TerminalInterface>
+ *   {
+ *     public:
+ *       void z_ucs_output(ZUcsSpan output) { ... }
+ *       ...
+ *   };
+ *
+ *   TerminalInterface terminal;
+ *   fizmo_register_screen_interface(
+ *       ScreenInterface<TerminalInterface>::bind(&terminal));
+ *
+ * bind() returns a struct z_screen_interface whose entries call the
+ * front-end's methods directly. There are no virtual functions involved,
+ * so the compiler may inline the methods into the entries. Since the C
+ * interface passes no context, one instance per front-end class can be
+ * bound at a time. Methods must be public and must not throw.
+ *
+ * Story output is passed as ZUcsSpan, a view of the interpreter's buffer
+ * along the lines of std::u32string_view, without copying it or looking
+ * for its end.
+ *
  */
 
 
 #ifndef ScreenInterface_h_INCLUDED 
 #define ScreenInterface_h_INCLUDED
 
-#include "types.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+extern "C"
+{
+#include "screen_interface.h"
+#include "../tools/z_ucs.h"
+#include "../interpreter/text.h"
+#include "../interpreter/zpu.h"
+}
 
 
-class ScreenInterface {
+class ZUcsSpan
+{
   public:
-    virtual ~ScreenInterface();
-    virtual char *get_interface_name();
-    virtual bool is_status_line_available();
-    virtual bool is_split_screen_available();
-    virtual bool is_variable_pitch_font_default();
-    virtual bool is_color_available();
-    virtual bool is_picture_displaying_available();
-    virtual bool is_bold_face_available();
-    virtual bool is_italic_available();
-    virtual bool is_fixed_space_font_available();
-    virtual bool is_timed_keyboard_available();
-    virtual bool is_preloaded_input_available();
-    virtual bool is_character_graphics_font_availiable();
-    virtual bool is_picture_font_availiable();
-    virtual uint8_t get_screen_height();
-    virtual uint8_t get_screen_width();
-    virtual uint8_t get_screen_width_in_units();
-    virtual uint8_t get_screen_height_in_units();
-    virtual uint8_t get_font_width_in_units();
-    virtual uint8_t get_font_height_in_units();
-    virtual z_colour get_default_foreground_colour();
-    virtual z_colour get_default_background_colour();
-    virtual uint8_t get_total_width_in_pixels_of_text_sent_to_output_stream_3();
-    virtual int parse_config_parameter(char *key, char *value);
-    virtual char *get_config_value(char *key);
-    virtual char **get_config_option_names();
-    virtual void link_interface_to_story(struct z_story *story);
-    virtual void reset_interface();
-    virtual int close_interface(z_ucs *error_message);
-    virtual void set_buffer_mode(uint8_t new_buffer_mode);
-    virtual void z_ucs_output(z_ucs *z_ucs_output);
-    virtual int16_t read_line(zscii *dest, uint16_t maximum_length,
+    ZUcsSpan(z_ucs *data, size_t size) : data_(data), size_(size) { }
+
+    z_ucs *data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    z_ucs *begin() const { return data_; }
+    z_ucs *end() const { return data_ + size_; }
+    z_ucs operator[](size_t index) const { return data_[index]; }
+
+  private:
+    z_ucs *data_;
+    size_t size_;
+};
+
+
+template <class FrontEnd>
+class ScreenInterface
+{
+  public:
+    static struct z_screen_interface *bind(FrontEnd *front_end)
+    {
+      static struct z_screen_interface table = create_table();
+
+      bound_front_end() = front_end;
+
+      return &table;
+    }
+
+    char *get_interface_name() { return (char*)"c++"; }
+    bool is_status_line_available() { return false; }
+    bool is_split_screen_available() { return false; }
+    bool is_variable_pitch_font_default() { return false; }
+    bool is_colour_available() { return false; }
+    bool is_picture_displaying_available() { return false; }
+    bool is_bold_face_available() { return false; }
+    bool is_italic_available() { return false; }
+    bool is_fixed_space_font_available() { return false; }
+    bool is_timed_keyboard_input_available() { return false; }
+    bool is_preloaded_input_available() { return false; }
+    bool is_character_graphics_font_availiable() { return false; }
+    bool is_picture_font_availiable() { return false; }
+    uint16_t get_screen_height_in_lines() { return 25; }
+    uint16_t get_screen_width_in_characters() { return 80; }
+    uint16_t get_screen_width_in_units() { return 80; }
+    uint16_t get_screen_height_in_units() { return 25; }
+    uint8_t get_font_width_in_units() { return 1; }
+    uint8_t get_font_height_in_units() { return 1; }
+    z_colour get_default_foreground_colour() { return Z_COLOUR_BLACK; }
+    z_colour get_default_background_colour() { return Z_COLOUR_WHITE; }
+    uint8_t get_total_width_in_pixels_of_text_sent_to_output_stream_3()
+    { return 0; }
+    int parse_config_parameter(char *, char *) { return -2; }
+    char *get_config_value(char *) { return NULL; }
+    char **get_config_option_names() { return NULL; }
+    void link_interface_to_story(struct z_story *) { }
+    void reset_interface() { }
+    int close_interface(z_ucs *) { return 0; }
+    void set_buffer_mode(uint8_t) { }
+    int read_char(uint16_t, uint32_t, int *) { return 0; }
+    void show_status(z_ucs *, int, int16_t, int16_t) { }
+    void set_text_style(z_style) { }
+    void set_colour(z_colour, z_colour, int16_t) { }
+    void set_font(z_font) { }
+    void split_window(int16_t) { }
+    void set_window(int16_t) { }
+    void erase_window(int16_t) { }
+    void set_cursor(int16_t, int16_t, int16_t) { }
+    uint16_t get_cursor_row() { return 0; }
+    uint16_t get_cursor_column() { return 0; }
+    void erase_line_value(uint16_t) { }
+    void erase_line_pixels(uint16_t) { }
+    void output_interface_info() { }
+    bool input_must_be_repeated_by_story() { return false; }
+    void game_was_restored_and_history_modified() { }
+    int prompt_for_filename(char *, z_file **, char *, int, int) { return -3; }
+    int do_autosave() { return 0; }
+    int restore_autosave(z_file *) { return 0; }
+
+    // Writes the output to stdout as UTF-8.
+    void z_ucs_output(ZUcsSpan output)
+    {
+      char buf[1024];
+      z_ucs *ptr = output.data();
+      size_t len = output.size(), chars_consumed, bytes_written;
+
+      while (len > 0)
+      {
+        bytes_written
+          = z_ucs_to_utf8(buf, sizeof(buf), ptr, len, &chars_consumed);
+        fwrite(buf, 1, bytes_written, stdout);
+        ptr += chars_consumed;
+        len -= chars_consumed;
+      }
+    }
+
+    // Reads a line of UTF-8 from stdin, the story is quit at the end of
+    // input. Malformed or truncated sequences are read as U+FFFD.
+    int16_t read_line(zscii *dest, uint16_t maximum_length, uint16_t,
+        uint32_t, uint8_t preloaded_input, int *, bool, bool)
+    {
+      int16_t input_size = preloaded_input;
+      char buf[256];
+      z_ucs chars[sizeof(buf)];
+      size_t buf_len = 0, nof_chars, bytes_consumed, i;
+      int input;
+      bool end_of_line = false;
+      zscii input_zscii;
+
+      dest += preloaded_input;
+
+      while (end_of_line == false)
+      {
+        if ((input = fgetc(stdin)) == EOF)
+        {
+          terminate_interpreter = INTERPRETER_QUIT_ALL;
+          return 0;
+        }
+
+        if ((input == '\n') || (input == '\r'))
+          end_of_line = true;
+        else
+          buf[buf_len++] = (char)input;
+
+        if ( (end_of_line == false) && (buf_len < sizeof(buf)) )
+          continue;
+
+        nof_chars = utf8_to_z_ucs(
+            chars, sizeof(buf), buf, buf_len, &bytes_consumed);
+
+        // A sequence cut off at the end of the line can't be completed.
+        if ( (end_of_line == true) && (bytes_consumed < buf_len) )
+        {
+          chars[nof_chars++] = Z_UCS_REPLACEMENT_CHAR;
+          bytes_consumed = buf_len;
+        }
+
+        memmove(buf, buf + bytes_consumed, buf_len - bytes_consumed);
+        buf_len -= bytes_consumed;
+
+        for (i=0; (i<nof_chars) && (input_size<maximum_length); i++)
+        {
+          input_zscii = unicode_char_to_zscii_input_char(chars[i]);
+
+          if ((input_zscii == 0xff) || (input_zscii == 27))
+            input_zscii = '?';
+
+          *(dest++) = input_zscii;
+          input_size++;
+        }
+      }
+
+      return input_size;
+    }
+
+  protected:
+    ScreenInterface() { }
+    ~ScreenInterface() { }
+
+  private:
+    static FrontEnd *&bound_front_end()
+    {
+      static FrontEnd *front_end = NULL;
+      return front_end;
+    }
+
+    static FrontEnd &front_end() { return *bound_front_end(); }
+
+    // Autosave support is optional, the table's entries remain NULL unless
+    // the front-end implements it.
+    template <typename Method>
+    static bool is_implemented(Method)
+    {
+      return !std::is_same<Method, int (ScreenInterface::*)()>::value
+        && !std::is_same<Method, int (ScreenInterface::*)(z_file *)>::value;
+    }
+
+    static struct z_screen_interface create_table()
+    {
+      struct z_screen_interface table;
+
+      table.get_interface_name = &call_get_interface_name;
+      table.is_status_line_available = &call_is_status_line_available;
+      table.is_split_screen_available = &call_is_split_screen_available;
+      table.is_variable_pitch_font_default
+        = &call_is_variable_pitch_font_default;
+      table.is_colour_available = &call_is_colour_available;
+      table.is_picture_displaying_available
+        = &call_is_picture_displaying_available;
+      table.is_bold_face_available = &call_is_bold_face_available;
+      table.is_italic_available = &call_is_italic_available;
+      table.is_fixed_space_font_available = &call_is_fixed_space_font_available;
+      table.is_timed_keyboard_input_available
+        = &call_is_timed_keyboard_input_available;
+      table.is_preloaded_input_available = &call_is_preloaded_input_available;
+      table.is_character_graphics_font_availiable
+        = &call_is_character_graphics_font_availiable;
+      table.is_picture_font_availiable = &call_is_picture_font_availiable;
+      table.get_screen_height_in_lines = &call_get_screen_height_in_lines;
+      table.get_screen_width_in_characters
+        = &call_get_screen_width_in_characters;
+      table.get_screen_width_in_units = &call_get_screen_width_in_units;
+      table.get_screen_height_in_units = &call_get_screen_height_in_units;
+      table.get_font_width_in_units = &call_get_font_width_in_units;
+      table.get_font_height_in_units = &call_get_font_height_in_units;
+      table.get_default_foreground_colour = &call_get_default_foreground_colour;
+      table.get_default_background_colour = &call_get_default_background_colour;
+      table.get_total_width_in_pixels_of_text_sent_to_output_stream_3
+        = &call_get_total_width_in_pixels_of_text_sent_to_output_stream_3;
+      table.parse_config_parameter = &call_parse_config_parameter;
+      table.get_config_value = &call_get_config_value;
+      table.get_config_option_names = &call_get_config_option_names;
+      table.link_interface_to_story = &call_link_interface_to_story;
+      table.reset_interface = &call_reset_interface;
+      table.close_interface = &call_close_interface;
+      table.set_buffer_mode = &call_set_buffer_mode;
+      table.z_ucs_output = &call_z_ucs_output;
+      table.read_line = &call_read_line;
+      table.read_char = &call_read_char;
+      table.show_status = &call_show_status;
+      table.set_text_style = &call_set_text_style;
+      table.set_colour = &call_set_colour;
+      table.set_font = &call_set_font;
+      table.split_window = &call_split_window;
+      table.set_window = &call_set_window;
+      table.erase_window = &call_erase_window;
+      table.set_cursor = &call_set_cursor;
+      table.get_cursor_row = &call_get_cursor_row;
+      table.get_cursor_column = &call_get_cursor_column;
+      table.erase_line_value = &call_erase_line_value;
+      table.erase_line_pixels = &call_erase_line_pixels;
+      table.output_interface_info = &call_output_interface_info;
+      table.input_must_be_repeated_by_story
+        = &call_input_must_be_repeated_by_story;
+      table.game_was_restored_and_history_modified
+        = &call_game_was_restored_and_history_modified;
+      table.prompt_for_filename = &call_prompt_for_filename;
+      table.do_autosave
+        = is_implemented(&FrontEnd::do_autosave) ? &call_do_autosave : NULL;
+      table.restore_autosave
+        = is_implemented(&FrontEnd::restore_autosave)
+        ? &call_restore_autosave
+        : NULL;
+      table.z_ucs_output_with_length = &call_z_ucs_output_with_length;
+
+      return table;
+    }
+
+    static void call_z_ucs_output(z_ucs *output)
+    { front_end().z_ucs_output(ZUcsSpan(output, z_ucs_len(output))); }
+
+    static void call_z_ucs_output_with_length(z_ucs *output, size_t len)
+    { front_end().z_ucs_output(ZUcsSpan(output, len)); }
+
+    static char *call_get_interface_name()
+    { return front_end().get_interface_name(); }
+
+    static bool call_is_status_line_available()
+    { return front_end().is_status_line_available(); }
+
+    static bool call_is_split_screen_available()
+    { return front_end().is_split_screen_available(); }
+
+    static bool call_is_variable_pitch_font_default()
+    { return front_end().is_variable_pitch_font_default(); }
+
+    static bool call_is_colour_available()
+    { return front_end().is_colour_available(); }
+
+    static bool call_is_picture_displaying_available()
+    { return front_end().is_picture_displaying_available(); }
+
+    static bool call_is_bold_face_available()
+    { return front_end().is_bold_face_available(); }
+
+    static bool call_is_italic_available()
+    { return front_end().is_italic_available(); }
+
+    static bool call_is_fixed_space_font_available()
+    { return front_end().is_fixed_space_font_available(); }
+
+    static bool call_is_timed_keyboard_input_available()
+    { return front_end().is_timed_keyboard_input_available(); }
+
+    static bool call_is_preloaded_input_available()
+    { return front_end().is_preloaded_input_available(); }
+
+    static bool call_is_character_graphics_font_availiable()
+    { return front_end().is_character_graphics_font_availiable(); }
+
+    static bool call_is_picture_font_availiable()
+    { return front_end().is_picture_font_availiable(); }
+
+    static uint16_t call_get_screen_height_in_lines()
+    { return front_end().get_screen_height_in_lines(); }
+
+    static uint16_t call_get_screen_width_in_characters()
+    { return front_end().get_screen_width_in_characters(); }
+
+    static uint16_t call_get_screen_width_in_units()
+    { return front_end().get_screen_width_in_units(); }
+
+    static uint16_t call_get_screen_height_in_units()
+    { return front_end().get_screen_height_in_units(); }
+
+    static uint8_t call_get_font_width_in_units()
+    { return front_end().get_font_width_in_units(); }
+
+    static uint8_t call_get_font_height_in_units()
+    { return front_end().get_font_height_in_units(); }
+
+    static z_colour call_get_default_foreground_colour()
+    { return front_end().get_default_foreground_colour(); }
+
+    static z_colour call_get_default_background_colour()
+    { return front_end().get_default_background_colour(); }
+
+    static uint8_t
+    call_get_total_width_in_pixels_of_text_sent_to_output_stream_3()
+    {
+      return front_end()
+        .get_total_width_in_pixels_of_text_sent_to_output_stream_3();
+    }
+
+    static int call_parse_config_parameter(char *key, char *value)
+    { return front_end().parse_config_parameter(key, value); }
+
+    static char *call_get_config_value(char *key)
+    { return front_end().get_config_value(key); }
+
+    static char **call_get_config_option_names()
+    { return front_end().get_config_option_names(); }
+
+    static void call_link_interface_to_story(struct z_story *story)
+    { front_end().link_interface_to_story(story); }
+
+    static void call_reset_interface()
+    { front_end().reset_interface(); }
+
+    static int call_close_interface(z_ucs *error_message)
+    { return front_end().close_interface(error_message); }
+
+    static void call_set_buffer_mode(uint8_t new_buffer_mode)
+    { front_end().set_buffer_mode(new_buffer_mode); }
+
+    static int16_t call_read_line(zscii *dest, uint16_t maximum_length,
         uint16_t tenth_seconds, uint32_t verification_routine,
         uint8_t preloaded_input, int *tenth_seconds_elapsed,
-        bool disable_command_history, bool return_on_escape);
-    virtual int read_char(uint16_t tenth_seconds,
-        uint32_t verification_routine, int *tenth_seconds_elapsed);
-    virtual void show_status(z_ucs *room_description, int status_line_mode,
-        int16_t parameter1, int16_t parameter2);
-    virtual void set_text_style(z_style text_style);
-    virtual void set_colour(z_colour foreground, z_colour background,
-        int16_t window);
-    virtual void set_font(z_font font_type);
-    virtual void split_window(int16_t nof_lines);
-    virtual void set_window(int16_t window_number);
-    virtual void erase_window(int16_t window_number);
-    virtual void set_cursor(int16_t line, int16_t column, int16_t window);
-    virtual uint16_t get_cursor_row();
-    virtual uint16_t get_cursor_column();
-    virtual void erase_line_value(uint16_t start_position);
-    virtual void erase_line_pixels(uint16_t start_position);
-    virtual void output_interface_info();
-    virtual bool input_must_be_repeated_by_story();
+        bool disable_command_history, bool return_on_escape)
+    {
+      return front_end().read_line(dest, maximum_length, tenth_seconds,
+          verification_routine, preloaded_input, tenth_seconds_elapsed,
+          disable_command_history, return_on_escape);
+    }
+
+    static int call_read_char(uint16_t tenth_seconds,
+        uint32_t verification_routine, int *tenth_seconds_elapsed)
+    {
+      return front_end().read_char(tenth_seconds, verification_routine,
+          tenth_seconds_elapsed);
+    }
+
+    static void call_show_status(z_ucs *room_description, int status_line_mode,
+        int16_t parameter1, int16_t parameter2)
+    {
+      front_end().show_status(room_description, status_line_mode, parameter1,
+          parameter2);
+    }
+
+    static void call_set_text_style(z_style text_style)
+    { front_end().set_text_style(text_style); }
+
+    static void call_set_colour(z_colour foreground, z_colour background,
+        int16_t window)
+    { front_end().set_colour(foreground, background, window); }
+
+    static void call_set_font(z_font font_type)
+    { front_end().set_font(font_type); }
+
+    static void call_split_window(int16_t nof_lines)
+    { front_end().split_window(nof_lines); }
+
+    static void call_set_window(int16_t window_number)
+    { front_end().set_window(window_number); }
+
+    static void call_erase_window(int16_t window_number)
+    { front_end().erase_window(window_number); }
+
+    static void call_set_cursor(int16_t line, int16_t column, int16_t window)
+    { front_end().set_cursor(line, column, window); }
+
+    static uint16_t call_get_cursor_row()
+    { return front_end().get_cursor_row(); }
+
+    static uint16_t call_get_cursor_column()
+    { return front_end().get_cursor_column(); }
+
+    static void call_erase_line_value(uint16_t start_position)
+    { front_end().erase_line_value(start_position); }
+
+    static void call_erase_line_pixels(uint16_t start_position)
+    { front_end().erase_line_pixels(start_position); }
+
+    static void call_output_interface_info()
+    { front_end().output_interface_info(); }
+
+    static bool call_input_must_be_repeated_by_story()
+    { return front_end().input_must_be_repeated_by_story(); }
+
+    static void call_game_was_restored_and_history_modified()
+    { front_end().game_was_restored_and_history_modified(); }
+
+    static int call_prompt_for_filename(char *filename_suggestion,
+        z_file **result_file, char *directory, int filetype_or_mode,
+        int fileaccess)
+    {
+      return front_end().prompt_for_filename(filename_suggestion, result_file,
+          directory, filetype_or_mode, fileaccess);
+    }
+
+    static int call_do_autosave()
+    { return front_end().do_autosave(); }
+
+    static int call_restore_autosave(z_file *savefile)
+    { return front_end().restore_autosave(savefile); }
 };
 
 #endif /* ScreenInterface_h_INCLUDED */
@@ -127,6 +127,11 @@ struct z_screen_interface
   // interface custom procedures for autosave (at @read time) and restore
   int (*do_autosave)(); // optional
   int (*restore_autosave)(z_file *savefile); // optional
+
+  // Optional. Same as z_ucs_output, but also receives the output's length,
+  // which the interpreter has at hand anyway. If set, it's used for all
+  // story output instead of z_ucs_output.
+  void (*z_ucs_output_with_length)(z_ucs *z_ucs_output, size_t len);
 };
 
 #endif /* screen_interface_h_INCLUDED */
@@ -0,0 +1,581 @@
+
+/* batchreplay.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// Runs a batch of recorded sessions in parallel. The manifest lists one
+// job per line -- story file, command script and random seed, separated
+// by whitespace; empty lines and lines starting with '#' are skipped:
+//
+// stories/etude.z5 scripts/etude-0001.cmd 4711
+//
+// Every job is run in a worker process of its own, which starts the story
+// with the command script as input stream 1 and records the output in a
+// stream 2 transcript. Delays recorded in the script are run on the
+// interpreter's virtual clock, so timed input is replayed without waiting
+// and with the same result on every run. Once the script is exhausted the
+// story is quit. Up to one worker per core is active at any time, the next
+// job from the queue is started as soon as a worker finishes. When all
+// jobs are done, the summary file receives one JSON object per job, in
+// manifest order:
+//
+// {"job":1,"story":"stories/etude.z5","script":"scripts/etude-0001.cmd",
+//  "seed":4711,"exit_status":0,"ms":84.2,
+//  "transcript":"out/job-00001.transcript","hash":"8a1c0b3f62d4e715"}
+//
+// The hash is the 64 bit FNV-1a hash of the transcript, so sessions can be
+// compared against a previous run without keeping all transcripts around.
+//
+// Usage: batchreplay [-j workers] [-l locale-directory] [-d output-directory]
+//        manifest summary-file
+
+
+#ifndef batchreplay_c_INCLUDED
+#define batchreplay_c_INCLUDED
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "../interpreter/fizmo.h"
+#include "../interpreter/config.h"
+#include "../interpreter/zpu.h"
+#include "../screen_interface/screen_interface.h"
+#include "../tools/filesys.h"
+#include "../tools/z_ucs.h"
+#include "../tools/unused.h"
+
+#define MAXIMUM_MANIFEST_LINE_LENGTH 4096
+#define JOBS_INCREMENT 1024
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+
+struct replay_job
+{
+  char *story;
+  char *script;
+  long seed;
+  char *transcript;
+  pid_t pid;
+  long start_ns;
+  long elapsed_ns;
+  int exit_status;
+};
+
+static struct replay_job *jobs = NULL;
+static int nof_jobs = 0;
+static int jobs_size = 0;
+static char *output_directory = ".";
+static char *locale_directory = NULL;
+
+
+static long get_time_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+
+static char *duplicate_string(char *src)
+{
+  char *result;
+
+  if ((result = malloc(strlen(src) + 1)) == NULL)
+  {
+    fprintf(stderr, "Out of memory.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return strcpy(result, src);
+}
+
+
+static int read_manifest(char *filename)
+{
+  FILE *in;
+  char line[MAXIMUM_MANIFEST_LINE_LENGTH];
+  char *story, *script, *seed, *endptr;
+  struct replay_job *job;
+  int line_number = 0;
+  size_t len;
+
+  if ((in = fopen(filename, "r")) == NULL)
+  {
+    fprintf(stderr, "Could not open \"%s\": %s.\n", filename, strerror(errno));
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), in) != NULL)
+  {
+    line_number++;
+
+    if ((story = strtok(line, " \t\r\n")) == NULL || (*story == '#'))
+      continue;
+
+    if ((script = strtok(NULL, " \t\r\n")) == NULL)
+    {
+      fprintf(stderr, "%s:%d: Missing command script.\n",
+          filename, line_number);
+      fclose(in);
+      return -1;
+    }
+
+    if ((seed = strtok(NULL, " \t\r\n")) == NULL)
+      seed = "0";
+
+    if (nof_jobs == jobs_size)
+    {
+      jobs_size += JOBS_INCREMENT;
+      if ((jobs = realloc(jobs, jobs_size * sizeof(struct replay_job)))
+          == NULL)
+      {
+        fprintf(stderr, "Out of memory.\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    job = jobs + nof_jobs;
+    job->seed = strtol(seed, &endptr, 10);
+    if (*endptr != 0)
+    {
+      fprintf(stderr, "%s:%d: Invalid seed \"%s\".\n",
+          filename, line_number, seed);
+      fclose(in);
+      return -1;
+    }
+
+    job->story = duplicate_string(story);
+    job->script = duplicate_string(script);
+    len = strlen(output_directory) + 32;
+    if ((job->transcript = malloc(len)) == NULL)
+    {
+      fprintf(stderr, "Out of memory.\n");
+      exit(EXIT_FAILURE);
+    }
+    snprintf(job->transcript, len, "%s/job-%05d.transcript",
+        output_directory, nof_jobs + 1);
+    job->pid = 0;
+    job->elapsed_ns = 0;
+    job->exit_status = -1;
+    nof_jobs++;
+  }
+
+  fclose(in);
+  return 0;
+}
+
+
+// The worker's screen interface: Output is discarded, since the
+// transcript is written by stream 2, and the story is quit as soon as it
+// asks for input after the command script has been used up.
+
+static char *get_interface_name() { return "batchreplay"; }
+static bool return_true() { return true; }
+static bool return_false() { return false; }
+static uint16_t get_screen_height() { return 25; }
+static uint16_t get_screen_width() { return 80; }
+static uint8_t return_one() { return 1; }
+static uint8_t return_zero() { return 0; }
+static uint16_t return_one_16() { return 1; }
+static z_colour get_default_foreground_colour() { return Z_COLOUR_BLACK; }
+static z_colour get_default_background_colour() { return Z_COLOUR_WHITE; }
+static int parse_config_parameter(char *UNUSED(key), char *UNUSED(value))
+{ return -2; }
+static char *get_config_value(char *UNUSED(key)) { return NULL; }
+static char **get_config_option_names() { return NULL; }
+static void link_interface_to_story(struct z_story *UNUSED(story)) { }
+static void do_nothing() { }
+static void set_buffer_mode(uint8_t UNUSED(mode)) { }
+static void z_ucs_output(z_ucs *UNUSED(output)) { }
+static void set_text_style(z_style UNUSED(style)) { }
+static void set_font(z_font UNUSED(font)) { }
+static void int16_nop(int16_t UNUSED(value)) { }
+static void uint16_nop(uint16_t UNUSED(value)) { }
+
+static void set_colour(z_colour UNUSED(foreground),
+    z_colour UNUSED(background), int16_t UNUSED(window)) { }
+
+static void set_cursor(int16_t UNUSED(line), int16_t UNUSED(column),
+    int16_t UNUSED(window)) { }
+
+static void show_status(z_ucs *UNUSED(room_description),
+    int UNUSED(status_line_mode), int16_t UNUSED(parameter1),
+    int16_t UNUSED(parameter2)) { }
+
+static int prompt_for_filename(char *UNUSED(filename_suggestion),
+    z_file **UNUSED(result_file), char *UNUSED(directory),
+    int UNUSED(filetype_or_mode), int UNUSED(fileaccess))
+{ return -3; }
+
+
+static int close_batchreplay_interface(z_ucs *error_message)
+{
+  char buf[256];
+
+  if (error_message != NULL)
+  {
+    zucs_string_to_utf8_string(buf, &error_message, sizeof(buf));
+    fprintf(stderr, "%s\n", buf);
+  }
+
+  return 0;
+}
+
+
+static int16_t read_line(zscii *UNUSED(dest), uint16_t UNUSED(maximum_length),
+    uint16_t UNUSED(tenth_seconds), uint32_t UNUSED(verification_routine),
+    uint8_t UNUSED(preloaded_input), int *UNUSED(tenth_seconds_elapsed),
+    bool UNUSED(disable_command_history), bool UNUSED(return_on_escape))
+{
+  terminate_interpreter = INTERPRETER_QUIT_ALL;
+  return 0;
+}
+
+
+static int read_char(uint16_t UNUSED(tenth_seconds),
+    uint32_t UNUSED(verification_routine),
+    int *UNUSED(tenth_seconds_elapsed))
+{
+  terminate_interpreter = INTERPRETER_QUIT_ALL;
+  return 0;
+}
+
+
+static struct z_screen_interface batchreplay_interface =
+{
+  &get_interface_name,
+  &return_true,
+  &return_true,
+  &return_false,
+  &return_true,
+  &return_false,
+  &return_true,
+  &return_true,
+  &return_true,
+  &return_false,
+  &return_false,
+  &return_false,
+  &return_false,
+  &get_screen_height,
+  &get_screen_width,
+  &get_screen_width,
+  &get_screen_height,
+  &return_one,
+  &return_one,
+  &get_default_foreground_colour,
+  &get_default_background_colour,
+  &return_zero,
+  &parse_config_parameter,
+  &get_config_value,
+  &get_config_option_names,
+  &link_interface_to_story,
+  &do_nothing,
+  &close_batchreplay_interface,
+  &set_buffer_mode,
+  &z_ucs_output,
+  &read_line,
+  &read_char,
+  &show_status,
+  &set_text_style,
+  &set_colour,
+  &set_font,
+  &int16_nop,
+  &int16_nop,
+  &int16_nop,
+  &set_cursor,
+  &return_one_16,
+  &return_one_16,
+  &uint16_nop,
+  &uint16_nop,
+  &do_nothing,
+  &return_false,
+  &do_nothing,
+  &prompt_for_filename,
+  NULL,
+  NULL,
+  NULL
+};
+
+
+// Executed in the worker process, does not return.
+static void run_job(struct replay_job *job)
+{
+  z_file *story_file;
+  char seed[32];
+
+  if (locale_directory != NULL)
+    set_configuration_value("i18n-search-path", locale_directory);
+
+  // Stream 2 appends to an existing file, but the transcript must only
+  // contain this job's output.
+  if ( (unlink(job->transcript) != 0) && (errno != ENOENT) )
+  {
+    fprintf(stderr, "Could not remove \"%s\": %s.\n",
+        job->transcript, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  snprintf(seed, sizeof(seed), "%ld", job->seed);
+  set_configuration_value("random-mode", "predictable");
+  set_configuration_value("random-seed", seed);
+  set_configuration_value("input-command-filename", job->script);
+  set_configuration_value("start-file-input-when-story-starts", "true");
+  set_configuration_value("fast-replay", "true");
+  set_configuration_value("replay-suppress-output", "true");
+  set_configuration_value("transcript-filename", job->transcript);
+  set_configuration_value("start-script-when-story-starts", "true");
+  set_configuration_value("disable-stream-2-hyphenation", "true");
+  set_configuration_value("virtual-clock", "true");
+
+  fizmo_register_screen_interface(&batchreplay_interface);
+
+  if ((story_file = fsi->openfile(
+          job->story, FILETYPE_DATA, FILEACCESS_READ)) == NULL)
+  {
+    fprintf(stderr, "Could not open \"%s\".\n", job->story);
+    exit(EXIT_FAILURE);
+  }
+
+  fizmo_start(story_file, NULL, NULL);
+
+  exit(EXIT_SUCCESS);
+}
+
+
+static int start_job(struct replay_job *job)
+{
+  pid_t pid;
+
+  // Anything still buffered would otherwise be written by the worker, too.
+  fflush(stdout);
+  fflush(stderr);
+
+  job->start_ns = get_time_ns();
+
+  if ((pid = fork()) == -1)
+  {
+    fprintf(stderr, "fork() failed: %s.\n", strerror(errno));
+    return -1;
+  }
+  else if (pid == 0)
+    run_job(job);
+
+  job->pid = pid;
+  return 0;
+}
+
+
+static struct replay_job *wait_for_job()
+{
+  pid_t pid;
+  int status, i;
+
+  for (;;)
+  {
+    if ((pid = waitpid(-1, &status, 0)) == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      return NULL;
+    }
+
+    for (i=0; i<nof_jobs; i++)
+    {
+      if (jobs[i].pid == pid)
+      {
+        jobs[i].elapsed_ns = get_time_ns() - jobs[i].start_ns;
+        jobs[i].exit_status
+          = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        jobs[i].pid = 0;
+        return jobs + i;
+      }
+    }
+  }
+}
+
+
+static unsigned long long hash_file(char *filename)
+{
+  unsigned long long hash = FNV_OFFSET_BASIS;
+  unsigned char buf[8192];
+  size_t len, i;
+  FILE *in;
+
+  if ((in = fopen(filename, "rb")) == NULL)
+    return 0;
+
+  while ((len = fread(buf, 1, sizeof(buf), in)) > 0)
+    for (i=0; i<len; i++)
+    {
+      hash ^= buf[i];
+      hash *= FNV_PRIME;
+    }
+
+  fclose(in);
+  return hash;
+}
+
+
+static void write_json_string(FILE *out, char *str)
+{
+  fputc('"', out);
+  for (; *str != 0; str++)
+  {
+    if ( (*str == '"') || (*str == '\\') )
+      fputc('\\', out);
+    fputc(*str, out);
+  }
+  fputc('"', out);
+}
+
+
+static int write_summary(char *filename)
+{
+  FILE *out;
+  int i;
+
+  if ((out = fopen(filename, "w")) == NULL)
+  {
+    fprintf(stderr, "Could not open \"%s\": %s.\n", filename, strerror(errno));
+    return -1;
+  }
+
+  for (i=0; i<nof_jobs; i++)
+  {
+    fprintf(out, "{\"job\":%d,\"story\":", i + 1);
+    write_json_string(out, jobs[i].story);
+    fprintf(out, ",\"script\":");
+    write_json_string(out, jobs[i].script);
+    fprintf(out, ",\"seed\":%ld,\"exit_status\":%d,\"ms\":%.1f,"
+        "\"transcript\":", jobs[i].seed, jobs[i].exit_status,
+        jobs[i].elapsed_ns / 1000000.0);
+    write_json_string(out, jobs[i].transcript);
+    fprintf(out, ",\"hash\":\"%016llx\"}\n", hash_file(jobs[i].transcript));
+  }
+
+  return fclose(out) == 0 ? 0 : -1;
+}
+
+
+static void print_usage(char *program_name)
+{
+  fprintf(stderr,
+      "Usage: %s [-j workers] [-l locale-directory] [-d output-directory]\n"
+      "       manifest summary-file\n",
+      program_name);
+}
+
+
+int main(int argc, char *argv[])
+{
+  long nof_workers = sysconf(_SC_NPROCESSORS_ONLN);
+  int next_job = 0, running = 0, failed = 0;
+  struct replay_job *job;
+  long start_ns;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "j:l:d:")) != -1)
+  {
+    if (opt == 'j')
+      nof_workers = atol(optarg);
+    else if (opt == 'l')
+      locale_directory = optarg;
+    else if (opt == 'd')
+      output_directory = optarg;
+    else
+    {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc - 2)
+  {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (nof_workers < 1)
+    nof_workers = 1;
+
+  if (read_manifest(argv[optind]) != 0)
+    return EXIT_FAILURE;
+
+  start_ns = get_time_ns();
+
+  while ( (next_job < nof_jobs) || (running > 0) )
+  {
+    while ( (running < nof_workers) && (next_job < nof_jobs) )
+    {
+      if (start_job(jobs + next_job) != 0)
+        break;
+      next_job++;
+      running++;
+    }
+
+    if (running == 0)
+      return EXIT_FAILURE;
+
+    if ((job = wait_for_job()) == NULL)
+    {
+      fprintf(stderr, "waitpid() failed: %s.\n", strerror(errno));
+      return EXIT_FAILURE;
+    }
+    running--;
+
+    if (job->exit_status != 0)
+    {
+      fprintf(stderr, "Job %d (%s, %s) failed with exit status %d.\n",
+          (int)(job - jobs) + 1, job->story, job->script, job->exit_status);
+      failed++;
+    }
+  }
+
+  if (write_summary(argv[optind + 1]) != 0)
+    return EXIT_FAILURE;
+
+  fprintf(stderr, "%d jobs, %d failed, %ld workers, %.1f s.\n",
+      nof_jobs, failed, nof_workers, (get_time_ns() - start_ns) / 1e9);
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif /* batchreplay_c_INCLUDED */
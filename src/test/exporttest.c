@@ -0,0 +1,496 @@
+
+/* exporttest.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// Round trip test for "export_savegame_to_quetzal" in src/interpreter/
+// savegame.c. The story is run with the commands from the script as input,
+// one line per read_line or one character per read_char, while an autosave
+// is written to a page store before every read_line. At every read_line
+// the autosave is exported to a standard Quetzal file, which must not
+// contain an "FzPg" chunk any longer, and both files are restored in turn:
+//
+// - Restoring the autosave from the page store has to result in the same
+//   dynamic memory and stack as the running story.
+// - Restoring the exported file, without access to the page store, has to
+//   result in the same dynamic memory, stack and PC.
+//
+// All files are kept in a temporary directory below the current one, which
+// is removed again afterwards. Stories which only read single characters
+// are not checked. Once the script is used up the story is quit. The exit
+// status is zero in case no differences were found.
+//
+// Usage: exporttest [-l locale-directory] story command-script
+
+
+#ifndef exporttest_c_INCLUDED
+#define exporttest_c_INCLUDED
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "../interpreter/fizmo.h"
+#include "../interpreter/config.h"
+#include "../interpreter/zpu.h"
+#include "../interpreter/stack.h"
+#include "../interpreter/iff.h"
+#include "../interpreter/savegame.h"
+#include "../interpreter/zscii.h"
+#include "../screen_interface/screen_interface.h"
+#include "../tools/filesys.h"
+#include "../tools/z_ucs.h"
+#include "../tools/unused.h"
+
+#define MAXIMUM_COMMAND_LENGTH 1024
+#define MAXIMUM_PATH_LENGTH 1024
+
+
+// The state of the running story, compared against restored states.
+struct story_state
+{
+  uint8_t *memory;
+  uint16_t *stack;
+  size_t stack_words;
+  uint32_t pc;
+};
+
+static FILE *commands;
+static char command[MAXIMUM_COMMAND_LENGTH];
+static char *next_command_char = NULL;
+static char work_directory[] = "exporttest-XXXXXX";
+static char page_store[MAXIMUM_PATH_LENGTH];
+static char autosave_filename[MAXIMUM_PATH_LENGTH];
+static char export_filename[MAXIMUM_PATH_LENGTH];
+static struct story_state live_state;
+static struct story_state restored_state;
+static long nof_checks = 0;
+static int nof_errors = 0;
+
+
+static void *allocate(void *ptr, size_t size)
+{
+  if ((ptr = realloc(ptr, size)) == NULL)
+  {
+    fprintf(stderr, "Out of memory.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return ptr;
+}
+
+
+static void report_error(char *message)
+{
+  fprintf(stderr, "Check %ld: %s.\n", nof_checks, message);
+  nof_errors++;
+}
+
+
+static uint16_t get_dynamic_memory_length(void)
+{
+  return (uint16_t)(active_z_story->dynamic_memory_end - z_mem + 1);
+}
+
+
+static void record_state(struct story_state *state)
+{
+  uint16_t length = get_dynamic_memory_length();
+
+  state->memory = allocate(state->memory, length);
+  memcpy(state->memory, z_mem, length);
+  state->stack_words = z_stack_index - z_stack;
+  state->stack = allocate(
+      state->stack, state->stack_words * sizeof(uint16_t) + 1);
+  memcpy(state->stack, z_stack, state->stack_words * sizeof(uint16_t));
+  state->pc = (uint32_t)(pc - z_mem);
+}
+
+
+// The PC isn't compared against the running story, since savegames store
+// the location of the current instruction instead.
+static bool states_equal(struct story_state *state1,
+    struct story_state *state2, bool compare_pc)
+{
+  return (memcmp(state1->memory, state2->memory,
+        get_dynamic_memory_length()) == 0)
+    && (state1->stack_words == state2->stack_words)
+    && (memcmp(state1->stack, state2->stack,
+          state1->stack_words * sizeof(uint16_t)) == 0)
+    && ( (compare_pc == false) || (state1->pc == state2->pc) );
+}
+
+
+static bool contains_chunk(char *filename, char *id)
+{
+  z_file *iff_file;
+  bool result;
+
+  if ((iff_file = open_simple_iff_file(filename, IFF_MODE_READ_SAVEGAME))
+      == NULL)
+    return false;
+
+  result = find_chunk(id, iff_file) == 0;
+  fsi->closefile(iff_file);
+
+  return result;
+}
+
+
+static int restore_file(char *filename)
+{
+  z_file *iff_file;
+
+  if ((iff_file = open_simple_iff_file(filename, IFF_MODE_READ_SAVEGAME))
+      == NULL)
+    return -1;
+
+  return restore_game_from_stream(
+      0, get_dynamic_memory_length(), iff_file, false) == 2 ? 0 : -1;
+}
+
+
+// Called at every read_line, right after the autosave has been written.
+static void check_export(void)
+{
+  uint8_t *pc_before_restore = pc;
+
+  nof_checks++;
+  record_state(&live_state);
+
+  if (export_savegame_to_quetzal(
+        autosave_filename, export_filename, page_store) != 0)
+  {
+    report_error("Export failed");
+    return;
+  }
+
+  if (contains_chunk(export_filename, "FzPg") == true)
+    report_error("Exported file contains a page manifest");
+
+  if (
+      (contains_chunk(export_filename, "CMem") == false)
+      &&
+      (contains_chunk(export_filename, "UMem") == false)
+     )
+    report_error("Exported file contains no memory");
+
+  if (restore_file(autosave_filename) != 0)
+    report_error("Restoring the autosave failed");
+  else
+  {
+    record_state(&restored_state);
+
+    if (states_equal(&live_state, &restored_state, false) == false)
+      report_error("Autosave differs from running story");
+
+    if (restore_file(export_filename) != 0)
+      report_error("Restoring the exported file failed");
+    else
+    {
+      record_state(&live_state);
+
+      if (states_equal(&live_state, &restored_state, true) == false)
+        report_error("Exported file differs from autosave");
+    }
+  }
+
+  // The restored state is the one of the read in progress, which is
+  // continued after this function returns.
+  pc = pc_before_restore;
+}
+
+
+static void remove_work_directory(void)
+{
+  char filename[MAXIMUM_PATH_LENGTH];
+  struct dirent *dir_ent;
+  DIR *dir;
+
+  if ((dir = opendir(page_store)) != NULL)
+  {
+    while ((dir_ent = readdir(dir)) != NULL)
+    {
+      if (dir_ent->d_name[0] == '.')
+        continue;
+      snprintf(filename, sizeof(filename), "%s/%s",
+          page_store, dir_ent->d_name);
+      unlink(filename);
+    }
+    closedir(dir);
+    rmdir(page_store);
+  }
+
+  unlink(autosave_filename);
+  unlink(export_filename);
+  rmdir(work_directory);
+}
+
+
+// Output is discarded, input is taken from the command script.
+
+static char *get_interface_name() { return "exporttest"; }
+static bool return_true() { return true; }
+static bool return_false() { return false; }
+static uint16_t get_screen_height() { return 25; }
+static uint16_t get_screen_width() { return 80; }
+static uint8_t return_one() { return 1; }
+static uint8_t return_zero() { return 0; }
+static uint16_t return_one_16() { return 1; }
+static z_colour get_default_foreground_colour() { return Z_COLOUR_BLACK; }
+static z_colour get_default_background_colour() { return Z_COLOUR_WHITE; }
+static int parse_config_parameter(char *UNUSED(key), char *UNUSED(value))
+{ return -2; }
+static char *get_config_value(char *UNUSED(key)) { return NULL; }
+static char **get_config_option_names() { return NULL; }
+static void link_interface_to_story(struct z_story *UNUSED(story)) { }
+static void do_nothing() { }
+static void set_buffer_mode(uint8_t UNUSED(mode)) { }
+static void z_ucs_output(z_ucs *UNUSED(output)) { }
+static void set_text_style(z_style UNUSED(style)) { }
+static void set_font(z_font UNUSED(font)) { }
+static void int16_nop(int16_t UNUSED(value)) { }
+static void uint16_nop(uint16_t UNUSED(value)) { }
+
+static void set_colour(z_colour UNUSED(foreground),
+    z_colour UNUSED(background), int16_t UNUSED(window)) { }
+
+static void set_cursor(int16_t UNUSED(line), int16_t UNUSED(column),
+    int16_t UNUSED(window)) { }
+
+static void show_status(z_ucs *UNUSED(room_description),
+    int UNUSED(status_line_mode), int16_t UNUSED(parameter1),
+    int16_t UNUSED(parameter2)) { }
+
+static int prompt_for_filename(char *UNUSED(filename_suggestion),
+    z_file **UNUSED(result_file), char *UNUSED(directory),
+    int UNUSED(filetype_or_mode), int UNUSED(fileaccess))
+{ return -3; }
+
+
+static int close_exporttest_interface(z_ucs *error_message)
+{
+  char buf[256];
+
+  if (error_message != NULL)
+  {
+    zucs_string_to_utf8_string(buf, &error_message, sizeof(buf));
+    fprintf(stderr, "%s\n", buf);
+  }
+
+  return 0;
+}
+
+
+static bool read_command(void)
+{
+  if (fgets(command, sizeof(command), commands) == NULL)
+  {
+    terminate_interpreter = INTERPRETER_QUIT_ALL;
+    return false;
+  }
+
+  next_command_char = command;
+  return true;
+}
+
+
+static int16_t read_line(zscii *dest, uint16_t maximum_length,
+    uint16_t UNUSED(tenth_seconds), uint32_t UNUSED(verification_routine),
+    uint8_t preloaded_input, int *UNUSED(tenth_seconds_elapsed),
+    bool UNUSED(disable_command_history), bool UNUSED(return_on_escape))
+{
+  size_t len;
+
+  check_export();
+
+  if (read_command() == false)
+    return 0;
+
+  next_command_char = NULL;
+  len = strcspn(command, "\r\n");
+  if (len > (size_t)(maximum_length - preloaded_input))
+    len = maximum_length - preloaded_input;
+  memcpy(dest + preloaded_input, command, len);
+
+  return preloaded_input + len;
+}
+
+
+static int read_char(uint16_t UNUSED(tenth_seconds),
+    uint32_t UNUSED(verification_routine),
+    int *UNUSED(tenth_seconds_elapsed))
+{
+  char c;
+
+  if ( (next_command_char == NULL) || (*next_command_char == 0) )
+    if (read_command() == false)
+      return 0;
+
+  c = *(next_command_char++);
+
+  return c == '\n' ? ZSCII_NEWLINE : c;
+}
+
+
+static struct z_screen_interface exporttest_interface =
+{
+  &get_interface_name,
+  &return_true,
+  &return_true,
+  &return_false,
+  &return_true,
+  &return_false,
+  &return_true,
+  &return_true,
+  &return_true,
+  &return_false,
+  &return_false,
+  &return_false,
+  &return_false,
+  &get_screen_height,
+  &get_screen_width,
+  &get_screen_width,
+  &get_screen_height,
+  &return_one,
+  &return_one,
+  &get_default_foreground_colour,
+  &get_default_background_colour,
+  &return_zero,
+  &parse_config_parameter,
+  &get_config_value,
+  &get_config_option_names,
+  &link_interface_to_story,
+  &do_nothing,
+  &close_exporttest_interface,
+  &set_buffer_mode,
+  &z_ucs_output,
+  &read_line,
+  &read_char,
+  &show_status,
+  &set_text_style,
+  &set_colour,
+  &set_font,
+  &int16_nop,
+  &int16_nop,
+  &int16_nop,
+  &set_cursor,
+  &return_one_16,
+  &return_one_16,
+  &uint16_nop,
+  &uint16_nop,
+  &do_nothing,
+  &return_false,
+  &do_nothing,
+  &prompt_for_filename,
+  NULL,
+  NULL,
+  NULL
+};
+
+
+static void print_usage(char *program_name)
+{
+  fprintf(stderr,
+      "Usage: %s [-l locale-directory] story command-script\n",
+      program_name);
+}
+
+
+int main(int argc, char *argv[])
+{
+  z_file *story_file;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "l:")) != -1)
+  {
+    if (opt == 'l')
+      set_configuration_value("i18n-search-path", optarg);
+    else
+    {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc - 2)
+  {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if ((commands = fopen(argv[optind + 1], "r")) == NULL)
+  {
+    fprintf(stderr, "Could not open \"%s\".\n", argv[optind + 1]);
+    return EXIT_FAILURE;
+  }
+
+  if (mkdtemp(work_directory) == NULL)
+  {
+    fprintf(stderr, "Could not create \"%s\".\n", work_directory);
+    return EXIT_FAILURE;
+  }
+
+  snprintf(page_store, sizeof(page_store), "%s/pages", work_directory);
+  snprintf(autosave_filename, sizeof(autosave_filename),
+      "%s/autosave.qut", work_directory);
+  snprintf(export_filename, sizeof(export_filename),
+      "%s/exported.qut", work_directory);
+
+  set_configuration_value("savegame-page-store", page_store);
+  set_configuration_value("autosave-filename", autosave_filename);
+
+  fizmo_register_screen_interface(&exporttest_interface);
+
+  if ((story_file = fsi->openfile(
+          argv[optind], FILETYPE_DATA, FILEACCESS_READ)) == NULL)
+  {
+    fprintf(stderr, "Could not open \"%s\".\n", argv[optind]);
+    remove_work_directory();
+    return EXIT_FAILURE;
+  }
+
+  fizmo_start(story_file, NULL, NULL);
+
+  fclose(commands);
+  remove_work_directory();
+
+  fprintf(stderr, "%s: %ld checks, %d errors.\n",
+      argv[optind], nof_checks, nof_errors);
+
+  return nof_errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif /* exporttest_c_INCLUDED */
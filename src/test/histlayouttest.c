@@ -0,0 +1,489 @@
+/* histlayouttest.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// Comparison of the paragraph layouts cached by the output history against
+// fresh runs of the wrappers the front-ends use. Random paragraphs made up
+// of short and long words, dashes and runs of spaces are stored in a
+// history, split into several calls to "store_data_in_history" and mixed
+// with metadata. Some are taken back partially through
+// "remove_chars_from_history" right after having been laid out and replaced
+// by other text. At regular intervals the screen is resized through
+// "set_history_screen_size", cycling through a few widths so that layouts
+// cached for a width are used again later, and the layouts of the most
+// recent paragraphs are rendered into lines. These have to be identical to
+// the lines a new WORDWRAP -- or a new LINEWRAP in case a glyph-width
+// function is set -- produces for the paragraph's text. Trailing spaces are
+// ignored, since layouts leave them out.
+//
+// This is done for a history which never wraps around and for some which
+// wrap around frequently. Hyphenated layouts are only tested in case the
+// hyphenation patterns can be found in the locale directory given by "-l".
+// The exit status is zero in case no differences were found.
+//
+// Usage: histlayouttest [-v] [-l locale-directory]
+
+
+#ifndef histlayouttest_c_INCLUDED
+#define histlayouttest_c_INCLUDED
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../interpreter/history.h"
+#include "../interpreter/hyphenation.h"
+#include "../interpreter/linewrap.h"
+#include "../interpreter/wordwrap.h"
+#include "../interpreter/config.h"
+#include "../interpreter/allocator.h"
+#include "../tools/types.h"
+#include "../tools/unused.h"
+#include "../tools/z_ucs.h"
+
+#define MAXIMUM_NOF_WORDS 60
+#define PARAGRAPHS_PER_CHECK 150
+#define SCREEN_HEIGHT 25
+
+
+struct test_configuration
+{
+  char *name;
+  int nof_paragraphs;
+  int nof_checked_paragraphs;
+  size_t maximum_buffer_size;
+  int margin;
+  bool enable_hyphenation;
+  bool glyph_widths;
+};
+
+static struct test_configuration configurations[] =
+{
+  { "no wraparound", 3000, 300, 4 * 1024 * 1024, 0, false, false },
+  { "wraparound", 3000, 300, 32 * 1024, 2, false, false },
+  // Hyphenating is slow, so fewer layouts are checked.
+  { "wraparound, hyphenation", 600, 10, 32 * 1024, 0, true, false },
+  { "wraparound, glyph widths", 3000, 300, 32 * 1024, 1, false, true }
+};
+
+static int screen_widths[] = { 40, 13, 79, 40, 8, 13, 79, 24 };
+
+static char *words[] =
+{
+  "a", "an", "the", "of", "to", "in", "it", "is", "you", "lamp", "door",
+  "north", "brass", "little", "cave", "stream", "building", "forest-road",
+  "twenty-three", "-", "--", "adventure", "information", "interpreter",
+  "particularly", "hyphenation", "unbelievably", "extraordinarily",
+  "characteristically", "incomprehensibilities",
+  "supercalifragilisticexpialidocious"
+};
+
+static z_ucs paragraph[MAXIMUM_NOF_WORDS * 40];
+static z_ucs *paragraph_text = NULL;
+static size_t paragraph_text_size = 0;
+static z_ucs *expected = NULL;
+static size_t expected_len, expected_size;
+static z_ucs *received = NULL;
+static size_t received_len, received_size;
+
+static struct test_configuration *configuration;
+static unsigned long random_state;
+static bool verbose = false;
+static bool hyphenation_available = false;
+static int nof_checks, nof_failures;
+
+
+// A small generator of its own keeps the stored text independent of the
+// C library.
+static unsigned int get_random(unsigned int limit)
+{
+  random_state = random_state * 1103515245 + 12345;
+  return (unsigned int)((random_state >> 16) & 0x7fff) % limit;
+}
+
+
+static int glyph_width(z_ucs c, void *UNUSED(parameter))
+{
+  return ( (c == 'm') || (c == 'w') || (c == Z_UCS_SPACE) ) ? 2 : 1;
+}
+
+
+static void append(z_ucs **buffer, size_t *len, size_t *size, z_ucs *text,
+    size_t text_len)
+{
+  if (*len + text_len + 1 > *size)
+  {
+    *size = (*len + text_len + 1) * 2;
+    *buffer = realloc(*buffer, sizeof(z_ucs) * *size);
+  }
+
+  memcpy(*buffer + *len, text, sizeof(z_ucs) * text_len);
+  *len += text_len;
+  (*buffer)[*len] = 0;
+}
+
+
+// Lines are collected separated by newlines, without trailing spaces.
+static void end_line(z_ucs **buffer, size_t *len, size_t *size)
+{
+  z_ucs newline = Z_UCS_NEWLINE;
+
+  while ( (*len > 0) && ((*buffer)[*len - 1] == Z_UCS_SPACE) )
+    (*len)--;
+
+  append(buffer, len, size, &newline, 1);
+}
+
+
+static void wordwrap_output(z_ucs *output, void *UNUSED(parameter))
+{
+  for (; *output != 0; output++)
+    if (*output == Z_UCS_NEWLINE)
+      end_line(&expected, &expected_len, &expected_size);
+    else
+      append(&expected, &expected_len, &expected_size, output, 1);
+}
+
+
+static void linewrap_output(z_ucs *output, size_t len,
+    void *UNUSED(parameter))
+{
+  append(&expected, &expected_len, &expected_size, output, len);
+}
+
+
+static void linewrap_line_end(bool UNUSED(line_was_wrapped),
+    void *UNUSED(parameter))
+{
+  end_line(&expected, &expected_len, &expected_size);
+}
+
+
+// Wraps "text", which has to be followed by a newline, the way a front-end
+// does.
+static void wrap_paragraph(z_ucs *text, int line_width)
+{
+  WORDWRAP *wordwrapper;
+  LINEWRAP *linewrapper;
+
+  expected_len = 0;
+
+  if (configuration->glyph_widths == true)
+  {
+    linewrapper = linewrap_new_wrapper(
+        line_width,
+        &glyph_width,
+        &linewrap_output,
+        &linewrap_line_end,
+        NULL);
+    linewrap_wrap_z_ucs(linewrapper, text);
+    linewrap_flush_output(linewrapper);
+    linewrap_destroy_wrapper(linewrapper);
+  }
+  else
+  {
+    wordwrapper = wordwrap_new_wrapper(
+        line_width,
+        &wordwrap_output,
+        NULL,
+        true,
+        0,
+        false,
+        configuration->enable_hyphenation);
+    wordwrap_wrap_z_ucs(wordwrapper, text);
+    wordwrap_flush_output(wordwrapper);
+    wordwrap_destroy_wrapper(wordwrapper);
+  }
+}
+
+
+static void render_layout(struct history_paragraph_layout *layout,
+    z_ucs *text)
+{
+  z_ucs minus = Z_UCS_MINUS;
+  int i;
+
+  received_len = 0;
+
+  for (i=0; i<layout->nof_lines; i++)
+  {
+    append(&received, &received_len, &received_size,
+        text + layout->lines[i].start,
+        layout->lines[i].end - layout->lines[i].start);
+    if (layout->lines[i].hyphenated == true)
+      append(&received, &received_len, &received_size, &minus, 1);
+    end_line(&received, &received_len, &received_size);
+  }
+}
+
+
+static void print_lines(char *label, z_ucs *lines)
+{
+  char buf[1024];
+  z_ucs *ptr = lines;
+
+  printf("  %s:\n", label);
+  while (*ptr != 0)
+  {
+    zucs_string_to_utf8_string(buf, &ptr, sizeof(buf));
+    printf("%s", buf);
+  }
+}
+
+
+// Checks the layouts of the "nof_checked_paragraphs" most recent paragraphs.
+static void check_layouts(int paragraph_number, int screen_width,
+    int nof_checked_paragraphs)
+{
+  history_output *output;
+  struct history_paragraph_layout *layout;
+  int line_width = screen_width - configuration->margin;
+  int nof_paragraphs = 0;
+  size_t len;
+  z_ucs *end;
+
+  // As done by "fizmo_new_screen_size", this lays out the paragraphs at
+  // the bottom of the screen for the new width.
+  set_history_screen_size(
+      outputhistory[0], screen_width, SCREEN_HEIGHT);
+
+  if ((output = init_history_output(
+          outputhistory[0], NULL, Z_HISTORY_OUTPUT_WITHOUT_VALIDATION))
+      == NULL)
+    return;
+
+  while (
+      (nof_paragraphs++ < nof_checked_paragraphs)
+      &&
+      (output_rewind_paragraph(output, NULL, NULL, NULL) == 0)
+      )
+  {
+    if ((layout = get_rewound_paragraph_layout(output, line_width)) == NULL)
+    {
+      printf("%s, paragraph %d: No layout.\n",
+          configuration->name, paragraph_number);
+      nof_failures++;
+      continue;
+    }
+
+    len = copy_history_paragraph_text(
+        outputhistory[0],
+        output->current_paragraph_index,
+        &paragraph_text,
+        &paragraph_text_size,
+        &end);
+    render_layout(layout, paragraph_text);
+
+    paragraph_text[len] = Z_UCS_NEWLINE;
+    paragraph_text[len + 1] = 0;
+    wrap_paragraph(paragraph_text, line_width);
+
+    nof_checks++;
+    if (z_ucs_cmp(expected, received) != 0)
+    {
+      nof_failures++;
+      printf("%s, paragraph %d, width %d: Lines differ.\n",
+          configuration->name, paragraph_number, line_width);
+      if (verbose == true)
+      {
+        print_lines("wrapper", expected);
+        print_lines("layout", received);
+      }
+    }
+  }
+
+  destroy_history_output(output);
+}
+
+
+static size_t create_paragraph()
+{
+  size_t len = 0;
+  int nof_words = get_random(MAXIMUM_NOF_WORDS), i;
+  char *word;
+
+  for (i=0; i<nof_words; i++)
+  {
+    if (i > 0)
+      paragraph[len++] = Z_UCS_SPACE;
+    if (get_random(8) == 0)
+      paragraph[len++] = Z_UCS_SPACE;
+
+    for (word = words[get_random(sizeof(words) / sizeof(char*))];
+        *word != 0;
+        word++)
+      paragraph[len++] = (z_ucs)*word;
+  }
+
+  return len;
+}
+
+
+static void store_paragraph(int paragraph_number, int screen_width)
+{
+  size_t len = create_paragraph(), split = get_random(len + 1);
+  z_ucs newline = Z_UCS_NEWLINE;
+  z_ucs replacement[] = { 'w', 'w', Z_UCS_SPACE, 'w', 'w' };
+
+  if (paragraph_number % 7 == 3)
+    store_metadata_in_history(
+        outputhistory[0], HISTORY_METADATA_TYPE_STYLE, 1);
+  store_data_in_history(outputhistory[0], paragraph, split, true);
+  if (paragraph_number % 5 == 1)
+    store_metadata_in_history(
+        outputhistory[0], HISTORY_METADATA_TYPE_COLOUR, 3, 4);
+
+  // The unterminated paragraph is laid out before its remainder arrives.
+  if (paragraph_number % PARAGRAPHS_PER_CHECK == 11)
+    check_layouts(paragraph_number, screen_width,
+        configuration->nof_checked_paragraphs);
+
+  store_data_in_history(
+      outputhistory[0], paragraph + split, len - split, true);
+
+  // Echoed input is taken back after it has been laid out and replaced
+  // by other text of the same length, so the paragraph ends at the same
+  // position as before.
+  if ( (paragraph_number % 13 == 5) && (len > 10) )
+  {
+    if (paragraph_number % 65 == 5)
+      check_layouts(paragraph_number, screen_width, 2);
+    remove_chars_from_history(outputhistory[0], 5);
+    store_data_in_history(outputhistory[0], replacement, 5, true);
+    if (paragraph_number % 65 == 5)
+      check_layouts(paragraph_number, screen_width, 2);
+  }
+
+  // Taking back a newline joins two paragraphs again.
+  if (paragraph_number % 29 == 7)
+  {
+    store_data_in_history(outputhistory[0], &newline, 1, true);
+    if (paragraph_number % PARAGRAPHS_PER_CHECK == 65)
+      check_layouts(paragraph_number, screen_width,
+          configuration->nof_checked_paragraphs);
+    remove_chars_from_history(outputhistory[0], 1);
+  }
+
+  store_data_in_history(outputhistory[0], &newline, 1, true);
+}
+
+
+static void run_configuration()
+{
+  int paragraph_number, screen_width = screen_widths[0];
+  int failures_before = nof_failures;
+
+  if (
+      (configuration->enable_hyphenation == true)
+      &&
+      (hyphenation_available == false)
+     )
+  {
+    printf("%s: Skipped, no hyphenation patterns.\n", configuration->name);
+    return;
+  }
+
+  outputhistory[0] = create_outputhistory(
+      0, configuration->maximum_buffer_size, 1024, 1, 1, 1, 0);
+  set_history_layout_metrics(
+      outputhistory[0],
+      configuration->margin,
+      configuration->enable_hyphenation,
+      configuration->glyph_widths == true ? &glyph_width : NULL,
+      NULL);
+
+  random_state = 5;
+
+  for (paragraph_number=0;
+      paragraph_number<configuration->nof_paragraphs;
+      paragraph_number++)
+  {
+    store_paragraph(paragraph_number, screen_width);
+
+    if (paragraph_number % PARAGRAPHS_PER_CHECK == PARAGRAPHS_PER_CHECK - 1)
+    {
+      check_layouts(paragraph_number, screen_width,
+          configuration->nof_checked_paragraphs);
+      screen_width = screen_widths[
+        (paragraph_number / PARAGRAPHS_PER_CHECK + 1)
+          % (sizeof(screen_widths) / sizeof(int))];
+      check_layouts(paragraph_number, screen_width,
+          configuration->nof_checked_paragraphs);
+    }
+  }
+
+  printf("%s: %d failures.\n",
+      configuration->name, nof_failures - failures_before);
+
+  destroy_outputhistory(outputhistory[0]);
+  outputhistory[0] = NULL;
+}
+
+
+int main(int argc, char *argv[])
+{
+  size_t i;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "vl:")) != -1)
+  {
+    if (opt == 'v')
+      verbose = true;
+    else if (opt == 'l')
+    {
+      set_configuration_value("i18n-search-path", optarg);
+      hyphenation_available = preload_hyphenation_patterns() == 0;
+    }
+    else
+    {
+      fprintf(stderr, "Usage: %s [-v] [-l locale-directory]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  for (i=0; i<sizeof(configurations) / sizeof(struct test_configuration); i++)
+  {
+    configuration = &configurations[i];
+    run_configuration();
+  }
+
+  fizmo_session_free(paragraph_text);
+  free(expected);
+  free(received);
+
+  printf("%d layouts checked, %d failures.\n", nof_checks, nof_failures);
+
+  return nof_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif /* histlayouttest_c_INCLUDED */
@@ -0,0 +1,436 @@
+/* histsearchtest.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// Comparison of the history search index in src/interpreter/histidx.c
+// against a linear scan over all paragraphs. Random paragraphs are stored
+// in a history, split into several calls to "store_data_in_history" and
+// mixed with metadata. Some paragraphs are shortened again through
+// "remove_chars_from_history", as done when input is echoed and taken back.
+// At regular intervals random patterns -- some taken from recently stored
+// paragraphs, some with their case changed -- are searched for using
+// "search_history" and by rewinding through the whole history, and both
+// lists of paragraph positions have to be identical.
+//
+// This is done for a history which never wraps around, for some which wrap
+// around frequently, and for one which only gets a search index once it
+// already contains text. The exit status is zero in case no differences
+// were found.
+//
+// Usage: histsearchtest [-v]
+
+
+#ifndef histsearchtest_c_INCLUDED
+#define histsearchtest_c_INCLUDED
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../interpreter/history.h"
+#include "../interpreter/histidx.h"
+#include "../interpreter/allocator.h"
+#include "../tools/types.h"
+#include "../tools/z_ucs.h"
+
+#define NOF_PARAGRAPHS 8000
+#define MAXIMUM_PARAGRAPH_LENGTH 280
+#define NOF_RECENT_PARAGRAPHS 64
+#define MAXIMUM_PATTERN_LENGTH 8
+#define MAXIMUM_RESULTS 50
+#define SEARCHES_PER_CHECK 30
+#define PARAGRAPHS_PER_CHECK 1000
+
+
+struct test_configuration
+{
+  char *name;
+  size_t maximum_buffer_size;
+  int index_enabled_at_paragraph;
+};
+
+static struct test_configuration configurations[] =
+{
+  { "no wraparound", 4 * 1024 * 1024, 0 },
+  { "wraparound", 256 * 1024, 0 },
+  { "frequent wraparound", 32 * 1024, 0 },
+  { "index enabled late", 256 * 1024, NOF_PARAGRAPHS / 2 }
+};
+
+static z_ucs recent_paragraphs
+  [NOF_RECENT_PARAGRAPHS][MAXIMUM_PARAGRAPH_LENGTH];
+static size_t recent_paragraph_lengths[NOF_RECENT_PARAGRAPHS];
+
+// All paragraphs in the history, most recent first, as collected by
+// "collect_paragraphs" for the linear scan. The text of paragraph "i"
+// starts at "paragraph_texts + paragraph_offsets[i]".
+static z_ucs *paragraph_text = NULL;
+static size_t paragraph_text_size = 0;
+static z_ucs *paragraph_texts = NULL;
+static size_t paragraph_texts_size = 0;
+static size_t *paragraph_offsets = NULL;
+static uint64_t *paragraph_positions = NULL;
+static size_t paragraphs_size = 0;
+static size_t nof_paragraphs;
+static unsigned long random_state;
+static bool verbose = false;
+static int nof_searches, nof_results, nof_failures;
+
+
+// A small generator of its own keeps the stored text independent of the
+// C library.
+static unsigned int get_random(unsigned int limit)
+{
+  random_state = random_state * 1103515245 + 12345;
+  return (unsigned int)((random_state >> 16) & 0x7fff) % limit;
+}
+
+
+// The same folding as in histidx.c: ASCII and Latin-1 letters only.
+static z_ucs fold_case(z_ucs c)
+{
+  if ( ( (c >= 'A') && (c <= 'Z') )
+      || ( (c >= 0xc0) && (c <= 0xde) && (c != 0xd7) ) )
+    return c + 0x20;
+  else
+    return c;
+}
+
+
+static z_ucs get_random_char()
+{
+  unsigned int r = get_random(12);
+
+  if (r == 0)
+    return Z_UCS_SPACE;
+  else if (r == 1)
+    return 'A' + get_random(26);
+  else if (r == 2)
+    return 0xc0 + get_random(0x3f);
+  else
+    // Only few different letters so that trigrams repeat often.
+    return 'a' + get_random(6) + get_random(3) * 6;
+}
+
+
+static bool paragraph_contains(z_ucs *text, size_t len, z_ucs *pattern,
+    size_t pattern_len)
+{
+  size_t i, j;
+
+  for (i=0; i+pattern_len<=len; i++)
+  {
+    for (j=0; j<pattern_len; j++)
+      if (fold_case(text[i+j]) != fold_case(pattern[j]))
+        break;
+
+    if (j == pattern_len)
+      return true;
+  }
+
+  return false;
+}
+
+
+// Rewinding evaluates the metadata of every paragraph again, so the
+// paragraphs are collected once for all searches of a check.
+static void collect_paragraphs(OUTPUTHISTORY *h)
+{
+  history_output *output;
+  size_t len, offset = 0;
+  z_ucs *end;
+
+  nof_paragraphs = 0;
+
+  if ((output = init_history_output(
+          h, NULL, Z_HISTORY_OUTPUT_WITHOUT_VALIDATION)) == NULL)
+    return;
+
+  while (output_rewind_paragraph(output, NULL, NULL, NULL) == 0)
+  {
+    len = copy_history_paragraph_text(
+        h,
+        output->current_paragraph_index,
+        &paragraph_text,
+        &paragraph_text_size,
+        &end);
+
+    if (nof_paragraphs == paragraphs_size)
+    {
+      paragraphs_size += 1024;
+      paragraph_offsets = realloc(
+          paragraph_offsets, sizeof(size_t) * (paragraphs_size + 1));
+      paragraph_positions = realloc(
+          paragraph_positions, sizeof(uint64_t) * paragraphs_size);
+    }
+
+    if (offset + len > paragraph_texts_size)
+    {
+      paragraph_texts_size = (offset + len) * 2;
+      paragraph_texts = realloc(
+          paragraph_texts, sizeof(z_ucs) * paragraph_texts_size);
+    }
+
+    memcpy(paragraph_texts + offset, paragraph_text, sizeof(z_ucs) * len);
+    paragraph_offsets[nof_paragraphs] = offset;
+    paragraph_positions[nof_paragraphs]
+      = get_rewound_paragraph_position(output);
+    offset += len;
+    nof_paragraphs++;
+  }
+  paragraph_offsets[nof_paragraphs] = offset;
+
+  destroy_history_output(output);
+}
+
+
+static int search_history_linearly(z_ucs *pattern, uint64_t *results,
+    int max_results)
+{
+  size_t pattern_len = z_ucs_len(pattern), i;
+  int result = 0;
+
+  for (i=0; (i<nof_paragraphs) && (result < max_results); i++)
+    if (paragraph_contains(
+          paragraph_texts + paragraph_offsets[i],
+          paragraph_offsets[i + 1] - paragraph_offsets[i],
+          pattern,
+          pattern_len) == true)
+      results[result++] = paragraph_positions[i];
+
+  return result;
+}
+
+
+static void print_results(char *label, uint64_t *results, int nof_results)
+{
+  int i;
+
+  printf("  %s:", label);
+  for (i=0; i<nof_results; i++)
+    printf(" %lu", (unsigned long)results[i]);
+  printf("\n");
+}
+
+
+static void create_pattern(z_ucs *pattern)
+{
+  size_t pattern_len = 1 + get_random(MAXIMUM_PATTERN_LENGTH);
+  size_t offset, i;
+  int r = get_random(NOF_RECENT_PARAGRAPHS);
+
+  if ( (recent_paragraph_lengths[r] > pattern_len)
+      && (get_random(4) != 0) )
+  {
+    offset = get_random(recent_paragraph_lengths[r] - pattern_len);
+    for (i=0; i<pattern_len; i++)
+      pattern[i] = recent_paragraphs[r][offset + i];
+
+    if (get_random(2) != 0)
+      pattern[0]
+        = ( (pattern[0] >= 'a') && (pattern[0] <= 'z') )
+        ? pattern[0] - 0x20
+        : pattern[0];
+  }
+  else
+    for (i=0; i<pattern_len; i++)
+      pattern[i] = get_random_char();
+
+  pattern[pattern_len] = 0;
+}
+
+
+static void check_searches(OUTPUTHISTORY *h, char *name, int paragraph)
+{
+  z_ucs pattern[MAXIMUM_PATTERN_LENGTH + 1];
+  char pattern_utf8[MAXIMUM_PATTERN_LENGTH * 4 + 1];
+  uint64_t index_results[MAXIMUM_RESULTS];
+  uint64_t linear_results[MAXIMUM_RESULTS];
+  int nof_index_results, nof_linear_results, i;
+  z_ucs *ptr;
+
+  collect_paragraphs(h);
+
+  for (i=0; i<SEARCHES_PER_CHECK; i++)
+  {
+    create_pattern(pattern);
+
+    nof_index_results
+      = search_history(h, pattern, index_results, MAXIMUM_RESULTS);
+    nof_linear_results
+      = search_history_linearly(pattern, linear_results, MAXIMUM_RESULTS);
+
+    nof_searches++;
+    if (nof_index_results > 0)
+      nof_results += nof_index_results;
+
+    if (
+        (nof_index_results != nof_linear_results)
+        ||
+        (memcmp(
+          index_results,
+          linear_results,
+          sizeof(uint64_t) * nof_linear_results) != 0)
+       )
+    {
+      nof_failures++;
+      ptr = pattern;
+      zucs_string_to_utf8_string(pattern_utf8, &ptr, sizeof(pattern_utf8));
+      printf("%s, paragraph %d: Results for \"%s\" differ.\n",
+          name, paragraph, pattern_utf8);
+      if (verbose == true)
+      {
+        print_results("index", index_results, nof_index_results);
+        print_results("linear", linear_results, nof_linear_results);
+      }
+    }
+  }
+}
+
+
+static void store_paragraph(OUTPUTHISTORY *h, int paragraph)
+{
+  z_ucs *text = recent_paragraphs[paragraph % NOF_RECENT_PARAGRAPHS];
+  size_t len = get_random(MAXIMUM_PARAGRAPH_LENGTH), i;
+  z_ucs taken_back[] = { 'q', 'r', Z_UCS_NEWLINE };
+  z_ucs newline = Z_UCS_NEWLINE;
+
+  for (i=0; i<len; i++)
+    text[i] = get_random_char();
+  recent_paragraph_lengths[paragraph % NOF_RECENT_PARAGRAPHS] = len;
+
+  // The text is split at a random point, so trigrams span calls.
+  if (paragraph % 7 == 3)
+    store_metadata_in_history(h, HISTORY_METADATA_TYPE_STYLE, 1);
+  store_data_in_history(h, text, len / 2, true);
+  if (paragraph % 5 == 1)
+    store_metadata_in_history(h, HISTORY_METADATA_TYPE_COLOUR, 3, 4);
+  store_data_in_history(h, text + len / 2, len - len / 2, true);
+
+  // Echoed input is taken back and written again.
+  if ( (paragraph % 13 == 5) && (len > 10) )
+  {
+    remove_chars_from_history(h, 5);
+    store_data_in_history(h, text + len - 5, 5, true);
+  }
+
+  // Taking back a newline joins two paragraphs again.
+  if (paragraph % 29 == 7)
+  {
+    store_data_in_history(h, taken_back, 3, true);
+    remove_chars_from_history(h, 3);
+  }
+
+  store_data_in_history(h, &newline, 1, true);
+}
+
+
+static void run_configuration(struct test_configuration *configuration)
+{
+  OUTPUTHISTORY *h;
+  int paragraph, failures_before = nof_failures;
+
+  h = create_outputhistory(
+      0, configuration->maximum_buffer_size, 1024, 1, 1, 1, 0);
+
+  random_state = 3;
+  memset(recent_paragraph_lengths, 0, sizeof(recent_paragraph_lengths));
+
+  if (configuration->index_enabled_at_paragraph == 0)
+    enable_history_search_index(h);
+
+  for (paragraph=0; paragraph<NOF_PARAGRAPHS; paragraph++)
+  {
+    store_paragraph(h, paragraph);
+
+    if (paragraph + 1 == configuration->index_enabled_at_paragraph)
+      enable_history_search_index(h);
+
+    if (
+        (paragraph % PARAGRAPHS_PER_CHECK == PARAGRAPHS_PER_CHECK - 1)
+        &&
+        (paragraph >= configuration->index_enabled_at_paragraph)
+       )
+      check_searches(h, configuration->name, paragraph);
+
+    // Also search right after text has been taken back.
+    else if (
+        (paragraph % PARAGRAPHS_PER_CHECK == PARAGRAPHS_PER_CHECK / 2)
+        &&
+        (paragraph >= configuration->index_enabled_at_paragraph)
+        )
+    {
+      remove_chars_from_history(h, 1);
+      check_searches(h, configuration->name, paragraph);
+      store_data_in_history(h, (z_ucs[]) { Z_UCS_NEWLINE }, 1, true);
+    }
+  }
+
+  printf("%s: %d failures.\n",
+      configuration->name, nof_failures - failures_before);
+
+  destroy_outputhistory(h);
+}
+
+
+int main(int argc, char *argv[])
+{
+  size_t i;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "v")) != -1)
+  {
+    if (opt == 'v')
+      verbose = true;
+    else
+    {
+      fprintf(stderr, "Usage: %s [-v]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  for (i=0; i<sizeof(configurations) / sizeof(struct test_configuration); i++)
+    run_configuration(&configurations[i]);
+
+  fizmo_session_free(paragraph_text);
+  free(paragraph_texts);
+  free(paragraph_offsets);
+  free(paragraph_positions);
+
+  printf("%d searches, %d results, %d failures.\n",
+      nof_searches, nof_results, nof_failures);
+
+  return nof_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif /* histsearchtest_c_INCLUDED */
@@ -0,0 +1,564 @@
+/* linewraptest.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// Comparison of the line wrapper in src/interpreter/linewrap.c against a
+// straightforward reference. Random texts -- words of various lengths,
+// dashes, newlines, wide and zero-width characters -- are sent to a
+// LINEWRAP in randomly split chunks, with metadata inserted at some of the
+// splits. The lines and line ends received have to be the same as the ones
+// laid out by the reference, which sees the whole text at once, and every
+// metadata entry has to arrive between the same characters it was inserted
+// between. Each chunk is copied to a buffer of its own which is cleared
+// after the call, so text kept back by the wrapper beyond a call would
+// show up as a difference.
+//
+// "make check-linewrap" runs this once with and once without SSE2. The exit
+// status is zero in case no differences were found.
+//
+// Usage: linewraptest [-v]
+
+
+#ifndef linewraptest_c_INCLUDED
+#define linewraptest_c_INCLUDED
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../interpreter/linewrap.h"
+#include "../tools/types.h"
+#include "../tools/unused.h"
+#include "../tools/z_ucs.h"
+
+#define NOF_TEXTS 3000
+#define MAXIMUM_TEXT_LENGTH 400
+#define MAXIMUM_NOF_SPLITS 12
+
+// Values besides characters in the collected output.
+#define LINE_WRAPPED -1
+#define LINE_BROKEN -2
+#define METADATA(n) (-16 - (n))
+
+// Characters in the range of "WIDE_CHAR" are two units wide, the ones in
+// the range of "WIDER_CHAR" are three units wide. Both ranges map onto the
+// same entries of the wrapper's cache for non-Latin-1 characters.
+#define WIDE_CHAR 0x4e00
+#define WIDER_CHAR (WIDE_CHAR + LINEWRAP_WIDE_CACHE_SIZE)
+#define COMBINING_CHAR 0x301
+
+
+struct output_buffer
+{
+  int *data;
+  size_t len;
+  size_t size;
+};
+
+static int line_widths[] = { 1, 2, 3, 5, 8, 13, 21, 40, 79 };
+
+static z_ucs text[MAXIMUM_TEXT_LENGTH];
+static size_t text_len;
+static size_t splits[MAXIMUM_NOF_SPLITS];
+static bool split_has_metadata[MAXIMUM_NOF_SPLITS];
+static int nof_splits;
+static bool emitted[MAXIMUM_TEXT_LENGTH];
+
+static struct output_buffer wrapper_output;
+static struct output_buffer reference_output;
+static struct output_buffer expected;
+static struct output_buffer received;
+
+static int reference_line_width;
+static int reference_line_position;
+static bool reference_line_was_wrapped;
+static bool proportional;
+
+static unsigned long random_state = 1;
+static bool verbose = false;
+static int nof_checks, nof_failures;
+
+
+// A small generator of its own keeps the texts independent of the C
+// library.
+static unsigned int get_random(unsigned int limit)
+{
+  random_state = random_state * 1103515245 + 12345;
+  return (unsigned int)((random_state >> 16) & 0x7fff) % limit;
+}
+
+
+static void append(struct output_buffer *buffer, int value)
+{
+  if (buffer->len == buffer->size)
+  {
+    buffer->size += 1024;
+    buffer->data = realloc(buffer->data, sizeof(int) * buffer->size);
+  }
+
+  buffer->data[buffer->len++] = value;
+}
+
+
+static int glyph_width(z_ucs c, void *UNUSED(parameter))
+{
+  if (c == COMBINING_CHAR)
+    return 0;
+  else if ( (c >= WIDER_CHAR) && (c < WIDER_CHAR + 16) )
+    return 3;
+  else if ( (c >= WIDE_CHAR) && (c < WIDE_CHAR + 16) )
+    return 2;
+  else if ( (c == Z_UCS_SPACE) || (c == 'm') || (c == 'w') )
+    return 2;
+  else
+    return 1;
+}
+
+
+static int get_width(z_ucs c)
+{
+  return proportional == true ? glyph_width(c, NULL) : 1;
+}
+
+
+static void text_output(z_ucs *output, size_t len, void *parameter)
+{
+  size_t i;
+
+  if (parameter != &wrapper_output)
+    return;
+
+  for (i=0; i<len; i++)
+    append(&wrapper_output, (int)output[i]);
+}
+
+
+static void line_end(bool line_was_wrapped, void *parameter)
+{
+  if (parameter == &wrapper_output)
+    append(&wrapper_output,
+        line_was_wrapped == true ? LINE_WRAPPED : LINE_BROKEN);
+}
+
+
+static void metadata_output(void *ptr_parameter, uint32_t int_parameter)
+{
+  append((struct output_buffer*)ptr_parameter, METADATA((int)int_parameter));
+}
+
+
+static z_ucs get_random_char()
+{
+  unsigned int r = get_random(40);
+
+  if (r < 8)
+    return Z_UCS_SPACE;
+  else if (r == 8)
+    return Z_UCS_NEWLINE;
+  else if (r < 11)
+    return Z_UCS_MINUS;
+  else if (r < 13)
+    return WIDE_CHAR + get_random(16);
+  else if (r == 13)
+    return WIDER_CHAR + get_random(16);
+  else if (r == 14)
+    return COMBINING_CHAR;
+  else if (r == 15)
+    return 'm' + get_random(2) * ('w' - 'm');
+  else
+    return 'a' + get_random(12);
+}
+
+
+static void create_text()
+{
+  size_t i, split;
+  int j;
+
+  text_len = get_random(MAXIMUM_TEXT_LENGTH + 1);
+  for (i=0; i<text_len; i++)
+  {
+    text[i] = get_random_char();
+
+    // Some long words to be broken at the line end.
+    if ( (get_random(50) == 0) && (text_len - i > 30) )
+      for (j=get_random(30); j>0; j--)
+        text[++i] = 'a' + get_random(12);
+  }
+
+  nof_splits = get_random(MAXIMUM_NOF_SPLITS + 1);
+  for (j=0; j<nof_splits; j++)
+  {
+    splits[j] = get_random((unsigned int)text_len + 1);
+    split_has_metadata[j] = get_random(2) == 0;
+  }
+
+  // Ascending, equal splits send empty chunks.
+  for (j=1; j<nof_splits; j++)
+    if (splits[j] < splits[j-1])
+    {
+      split = splits[j];
+      splits[j] = splits[j-1];
+      splits[j-1] = split;
+      j = 0;
+    }
+}
+
+
+static void reference_end_line(bool line_was_wrapped)
+{
+  append(&reference_output,
+      line_was_wrapped == true ? LINE_WRAPPED : LINE_BROKEN);
+  reference_line_position = 0;
+  reference_line_was_wrapped = line_was_wrapped;
+}
+
+
+static void reference_emit(size_t index)
+{
+  append(&reference_output, (int)text[index]);
+  reference_line_position += get_width(text[index]);
+  emitted[index] = true;
+}
+
+
+// Spaces which don't fit on the line anymore are dropped.
+static void reference_spaces(size_t start, size_t len)
+{
+  size_t i;
+
+  for (i=start; i<start+len; i++)
+  {
+    if (
+        (reference_line_position > 0)
+        &&
+        (reference_line_position + get_width(Z_UCS_SPACE)
+         > reference_line_width)
+       )
+      return;
+
+    reference_emit(i);
+  }
+}
+
+
+// The word goes on a new line in case it doesn't fit on the current one
+// together with the spaces before it. Spaces at the start of a wrapped
+// line are dropped, words wider than a line are broken at its end.
+static void reference_word(size_t spaces_start, size_t nof_spaces,
+    size_t start, size_t end)
+{
+  int width = 0;
+  size_t i;
+
+  for (i=start; i<end; i++)
+    width += get_width(text[i]);
+
+  if (
+      (reference_line_position > 0)
+      &&
+      (reference_line_position
+       + get_width(Z_UCS_SPACE) * (int)nof_spaces + width
+       > reference_line_width)
+     )
+    reference_end_line(true);
+  else if (
+      (reference_line_position > 0)
+      ||
+      (reference_line_was_wrapped == false)
+      )
+    reference_spaces(spaces_start, nof_spaces);
+
+  for (i=start; i<end; i++)
+  {
+    if (
+        (reference_line_position > 0)
+        &&
+        (reference_line_position + get_width(text[i])
+         > reference_line_width)
+       )
+      reference_end_line(true);
+
+    reference_emit(i);
+  }
+}
+
+
+static void reference_wrap(int line_width)
+{
+  size_t i = 0, end, nof_spaces = 0;
+
+  reference_output.len = 0;
+  reference_line_width = line_width;
+  reference_line_position = 0;
+  reference_line_was_wrapped = false;
+  memset(emitted, 0, sizeof(emitted));
+
+  while (i < text_len)
+  {
+    if (text[i] == Z_UCS_SPACE)
+    {
+      nof_spaces++;
+      i++;
+    }
+    else if (text[i] == Z_UCS_NEWLINE)
+    {
+      reference_spaces(i - nof_spaces, nof_spaces);
+      nof_spaces = 0;
+      reference_end_line(false);
+      i++;
+    }
+    else
+    {
+      // Words end at spaces and newlines, or behind a dash.
+      end = i;
+      while (
+          (end < text_len)
+          &&
+          (text[end] != Z_UCS_SPACE)
+          &&
+          (text[end] != Z_UCS_NEWLINE)
+          &&
+          (text[end] != Z_UCS_MINUS)
+          )
+        end++;
+      if ( (end < text_len) && (text[end] == Z_UCS_MINUS) )
+        end++;
+
+      reference_word(i - nof_spaces, nof_spaces, i, end);
+      nof_spaces = 0;
+      i = end;
+    }
+  }
+
+  reference_spaces(text_len - nof_spaces, nof_spaces);
+}
+
+
+static void wrap_in_chunks(int line_width)
+{
+  LINEWRAP *wrapper;
+  z_ucs *chunk;
+  size_t start = 0, end;
+  int i;
+
+  wrapper_output.len = 0;
+
+  wrapper = linewrap_new_wrapper(
+      line_width,
+      proportional == true ? &glyph_width : NULL,
+      &text_output,
+      &line_end,
+      &wrapper_output);
+
+  for (i=0; i<=nof_splits; i++)
+  {
+    end = i < nof_splits ? splits[i] : text_len;
+
+    chunk = malloc(sizeof(z_ucs) * (end - start + 1));
+    memcpy(chunk, text + start, sizeof(z_ucs) * (end - start));
+    linewrap_wrap_z_ucs_view(
+        wrapper, (z_ucs_view) { chunk, end - start });
+    memset(chunk, 0, sizeof(z_ucs) * (end - start + 1));
+    free(chunk);
+
+    if ( (i < nof_splits) && (split_has_metadata[i] == true) )
+      linewrap_insert_metadata(
+          wrapper, &metadata_output, &wrapper_output, (uint32_t)i);
+
+    start = end;
+  }
+
+  linewrap_flush_output(wrapper);
+  linewrap_destroy_wrapper(wrapper);
+}
+
+
+static void print_values(char *name, struct output_buffer *buffer)
+{
+  size_t i;
+  int value;
+
+  printf("%s:\n", name);
+  for (i=0; i<buffer->len; i++)
+  {
+    value = buffer->data[i];
+    if (value == LINE_WRAPPED)
+      printf("|\n");
+    else if (value == LINE_BROKEN)
+      printf("$\n");
+    else if (value <= METADATA(0))
+      printf("{%d}", METADATA(0) - value);
+    else if (value < 0x80)
+      putchar(value);
+    else
+      printf("<%x>", value);
+  }
+  printf("\n");
+}
+
+
+static void report_failure(int line_width, char *what)
+{
+  int i;
+
+  nof_failures++;
+
+  if (verbose == false)
+    return;
+
+  printf("%s differ for line width %d, %s widths, splits:",
+      what, line_width, proportional == true ? "proportional" : "fixed");
+  for (i=0; i<nof_splits; i++)
+    printf(" %ld%s", (long)splits[i], split_has_metadata[i] ? "*" : "");
+  printf("\n");
+  print_values("Expected", &expected);
+  print_values("Received", &received);
+}
+
+
+static bool buffers_equal(struct output_buffer *b1,
+    struct output_buffer *b2)
+{
+  return
+    (b1->len == b2->len)
+    &&
+    (memcmp(b1->data, b2->data, sizeof(int) * b1->len) == 0);
+}
+
+
+static void check_text(int line_width)
+{
+  size_t i;
+  int j;
+
+  reference_wrap(line_width);
+  wrap_in_chunks(line_width);
+  nof_checks++;
+
+  // Lines and line ends, without the metadata.
+  received.len = 0;
+  for (i=0; i<wrapper_output.len; i++)
+    if (wrapper_output.data[i] > METADATA(0))
+      append(&received, wrapper_output.data[i]);
+
+  if (buffers_equal(&reference_output, &received) == false)
+  {
+    expected.len = 0;
+    for (i=0; i<reference_output.len; i++)
+      append(&expected, reference_output.data[i]);
+    report_failure(line_width, "Lines");
+    return;
+  }
+
+  // The metadata between the characters which were output, without the
+  // line ends.
+  expected.len = 0;
+  j = 0;
+  for (i=0; i<=text_len; i++)
+  {
+    for (; (j < nof_splits) && (splits[j] == i); j++)
+      if (split_has_metadata[j] == true)
+        append(&expected, METADATA(j));
+
+    if ( (i < text_len) && (emitted[i] == true) )
+      append(&expected, (int)text[i]);
+  }
+
+  received.len = 0;
+  for (i=0; i<wrapper_output.len; i++)
+    if (
+        (wrapper_output.data[i] != LINE_WRAPPED)
+        &&
+        (wrapper_output.data[i] != LINE_BROKEN)
+       )
+      append(&received, wrapper_output.data[i]);
+
+  if (buffers_equal(&expected, &received) == false)
+    report_failure(line_width, "Metadata positions");
+}
+
+
+int main(int argc, char *argv[])
+{
+  size_t i;
+  int n, opt;
+
+  while ((opt = getopt(argc, argv, "v")) != -1)
+  {
+    if (opt == 'v')
+      verbose = true;
+    else
+    {
+      fprintf(stderr, "Usage: %s [-v]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+#ifdef __SSE2__
+  printf("Testing the SSE2 line wrapper.\n");
+#else
+  printf("Testing the scalar line wrapper.\n");
+#endif // __SSE2__
+
+  for (n=0; n<NOF_TEXTS; n++)
+  {
+    create_text();
+
+    for (i=0; i<sizeof(line_widths) / sizeof(int); i++)
+    {
+      proportional = false;
+      check_text(line_widths[i]);
+      proportional = true;
+      check_text(line_widths[i]);
+    }
+  }
+
+  if (linewrap_get_total_allocated_memory_size() != 0)
+  {
+    printf("Memory of destroyed wrappers is still accounted for.\n");
+    nof_failures++;
+  }
+
+  free(wrapper_output.data);
+  free(reference_output.data);
+  free(expected.data);
+  free(received.data);
+
+  printf("%d texts, %d checks, %d failures.\n",
+      NOF_TEXTS, nof_checks, nof_failures);
+
+  return nof_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif /* linewraptest_c_INCLUDED */
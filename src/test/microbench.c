@@ -0,0 +1,809 @@
+
+/* microbench.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// Microbenchmarks for the interpreter's main kernels. The story given on
+// the command line is started and run until it asks for input for the
+// first time, at which point the fixtures are extracted from the story
+// (dictionary words, object names and the output printed so far) and the
+// benchmarks are run. Results are written to stdout, one JSON object per
+// line, for example:
+//
+// {"story":"etude.z5","benchmark":"tokenise","iterations":262144,
+//  "ns_per_op":412.3,"allocations_per_op":0.00}
+//
+// Kernels which are static to their module -- Z-character decoding,
+// tokenising and dictionary lookup, the object and property accessors --
+// are measured through the opcodes that invoke them.
+//
+// Usage: microbench [-l locale-directory] [-t milliseconds] story-file
+
+
+#ifndef microbench_c_INCLUDED
+#define microbench_c_INCLUDED
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../interpreter/fizmo.h"
+#include "../interpreter/config.h"
+#include "../interpreter/zpu.h"
+#include "../interpreter/text.h"
+#include "../interpreter/object.h"
+#include "../interpreter/property.h"
+#include "../interpreter/streams.h"
+#include "../interpreter/savegame.h"
+#include "../interpreter/hyphenation.h"
+#include "../interpreter/undo.h"
+#include "../interpreter/variable.h"
+#include "../interpreter/wordwrap.h"
+#include "../interpreter/linewrap.h"
+#ifndef DISABLE_OUTPUT_HISTORY
+#include "../interpreter/history.h"
+#endif // DISABLE_OUTPUT_HISTORY
+#include "../interpreter/turnstat.h"
+#include "../screen_interface/screen_interface.h"
+#include "../tools/filesys.h"
+#include "../tools/z_ucs.h"
+#include "../tools/unused.h"
+
+#define MAXIMUM_FIXTURES 256
+#define MAXIMUM_WORD_LENGTH 16
+#define MAXIMUM_SENTENCE_LENGTH 60
+#define MAXIMUM_PARAGRAPH_LENGTH 1024
+#define CAPTURE_BUFFER_SIZE 65536
+#define MAXIMUM_BENCHMARKED_OBJECTS 32767
+#define DEFAULT_MINIMUM_BENCHMARK_TIME_MS 200
+#define BENCHMARK_WRAP_WIDTH 60
+#define BENCHMARK_HISTORY_SIZE 65536
+#define BENCHMARK_HISTORY_INCREMENT 4096
+
+// Global variable 239, used as the result variable and as the branch
+// target of the benchmarked opcodes. A one-byte branch offset of 2 does
+// not move the program counter.
+#define RESULT_VARIABLE 0xff
+#define BRANCH_BYTE_NO_JUMP 0xc2
+
+
+static char *story_name;
+static long minimum_benchmark_time_ms = DEFAULT_MINIMUM_BENCHMARK_TIME_MS;
+static bool benchmarks_done = false;
+
+static z_ucs captured_output[CAPTURE_BUFFER_SIZE];
+static size_t captured_output_length = 0;
+
+static zscii words[MAXIMUM_FIXTURES][MAXIMUM_WORD_LENGTH + 1];
+static z_ucs words_z_ucs[MAXIMUM_FIXTURES][MAXIMUM_WORD_LENGTH + 1];
+static int nof_words = 0;
+static zscii sentences[MAXIMUM_FIXTURES][MAXIMUM_SENTENCE_LENGTH + 1];
+static int nof_sentences = 0;
+static z_ucs *paragraphs[MAXIMUM_FIXTURES];
+static size_t paragraph_lengths[MAXIMUM_FIXTURES];
+static int nof_paragraphs = 0;
+static uint16_t nof_objects = 0;
+static int64_t startup_time_ns = 0;
+static unsigned long startup_allocations = 0;
+
+static uint16_t text_buffer = 0;
+static uint16_t parse_buffer = 0;
+static uint8_t opcode_tail[2];
+static WORDWRAP *wrapper;
+static LINEWRAP *line_wrapper;
+#ifndef DISABLE_OUTPUT_HISTORY
+static OUTPUTHISTORY *history;
+#endif // DISABLE_OUTPUT_HISTORY
+static char savegame_filename[] = "/tmp/fizmo-microbench-XXXXXX";
+
+
+static int64_t get_time_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static void report_result(char *name, long iterations, int64_t elapsed,
+    unsigned long allocations)
+{
+  printf("{\"story\":\"%s\",\"benchmark\":\"%s\",\"iterations\":%ld,"
+      "\"ns_per_op\":%.1f,\"allocations_per_op\":%.2f}\n",
+      story_name,
+      name,
+      iterations,
+      (double)elapsed / iterations,
+      (double)allocations / iterations);
+  fflush(stdout);
+}
+
+
+// Runs "kernel" with increasing iteration counts until a run takes at
+// least minimum_benchmark_time_ms, then reports the last run.
+static void run_benchmark(char *name, void (*kernel)(int index))
+{
+  long iterations = 1;
+  int64_t start, elapsed;
+  long i;
+  unsigned long allocations;
+
+  kernel(0);
+
+  for (;;)
+  {
+    allocations = turn_statistics_get_total_allocations();
+    start = get_time_ns();
+    for (i=0; i<iterations; i++)
+      kernel((int)i);
+    elapsed = get_time_ns() - start;
+    allocations = turn_statistics_get_total_allocations() - allocations;
+
+    if ( (elapsed >= (int64_t)minimum_benchmark_time_ms * 1000000)
+        || (iterations >= (1L << 30)) )
+      break;
+
+    iterations *= 2;
+  }
+
+  report_result(name, iterations, elapsed, allocations);
+}
+
+
+static void set_operands(int count, uint16_t op0, uint16_t op1)
+{
+  number_of_operands = (uint8_t)count;
+  op[0] = op0;
+  op[1] = op1;
+  opcode_tail[0] = RESULT_VARIABLE;
+  opcode_tail[1] = BRANCH_BYTE_NO_JUMP;
+  pc = opcode_tail;
+}
+
+
+static void write_text_buffer(zscii *text)
+{
+  uint8_t *dest = z_mem + text_buffer;
+  size_t len = strlen((char*)text);
+  size_t capacity = *dest;
+
+  // Before version 5 the last byte is reserved for the terminating zero.
+  if ( (ver < 5) && (capacity > 0) )
+    capacity--;
+
+  if (len > capacity)
+    len = capacity;
+
+  if (ver >= 5)
+  {
+    dest[1] = (uint8_t)len;
+    memcpy(dest + 2, text, len);
+  }
+  else
+  {
+    memcpy(dest + 1, text, len);
+    dest[len + 1] = 0;
+  }
+}
+
+
+static void bench_decode_object_name(int index)
+{
+  set_operands(1, (uint16_t)(index % nof_objects + 1), 0);
+  opcode_print_obj();
+}
+
+
+static void bench_tokenise(int index)
+{
+  write_text_buffer(sentences[index % nof_sentences]);
+  invalidate_tokenise_cache();
+  set_operands(2, text_buffer, parse_buffer);
+  opcode_tokenise();
+}
+
+
+static void bench_tokenise_cached(int index)
+{
+  write_text_buffer(sentences[index % 8 % nof_sentences]);
+  set_operands(2, text_buffer, parse_buffer);
+  opcode_tokenise();
+}
+
+
+static void bench_dictionary_lookup(int index)
+{
+  write_text_buffer(words[index % nof_words]);
+  invalidate_tokenise_cache();
+  set_operands(2, text_buffer, parse_buffer);
+  opcode_tokenise();
+}
+
+
+static void bench_hyphenate(int index)
+{
+  free(hyphenate(words_z_ucs[index % nof_words]));
+}
+
+
+static void discard_output(z_ucs *UNUSED(output), void *UNUSED(parameter))
+{
+}
+
+
+static void bench_wordwrap(int index)
+{
+  wordwrap_wrap_z_ucs(wrapper, paragraphs[index % nof_paragraphs]);
+  wordwrap_flush_output(wrapper);
+}
+
+
+static int get_glyph_width(z_ucs c, void *UNUSED(parameter))
+{
+  return c >= 0x1100 ? 2 : 1;
+}
+
+
+static void discard_text(z_ucs *UNUSED(text), size_t UNUSED(len),
+    void *UNUSED(parameter))
+{
+}
+
+
+static void discard_line_end(bool UNUSED(line_was_wrapped),
+    void *UNUSED(parameter))
+{
+}
+
+
+static void bench_linewrap(int index)
+{
+  linewrap_wrap_z_ucs_view(line_wrapper, z_ucs_view_of(
+        paragraphs[index % nof_paragraphs]));
+  linewrap_flush_output(line_wrapper);
+}
+
+
+#ifndef DISABLE_OUTPUT_HISTORY
+static void bench_store_history(int index)
+{
+  store_data_in_history(
+      history,
+      paragraphs[index % nof_paragraphs],
+      paragraph_lengths[index % nof_paragraphs],
+      true);
+}
+#endif // DISABLE_OUTPUT_HISTORY
+
+
+static void bench_get_parent(int index)
+{
+  set_operands(1, (uint16_t)(index % nof_objects + 1), 0);
+  opcode_get_parent();
+}
+
+
+static void bench_get_child(int index)
+{
+  set_operands(1, (uint16_t)(index % nof_objects + 1), 0);
+  opcode_get_child();
+}
+
+
+static void bench_test_attr(int index)
+{
+  set_operands(2, (uint16_t)(index % nof_objects + 1), (uint16_t)(index % 32));
+  pc = opcode_tail + 1;
+  opcode_test_attr();
+}
+
+
+static void bench_get_prop_addr(int index)
+{
+  set_operands(2, (uint16_t)(index % nof_objects + 1),
+      (uint16_t)(index % active_z_story->maximum_property_number + 1));
+  opcode_get_prop_addr();
+}
+
+
+static void bench_get_next_prop(int index)
+{
+  set_operands(2, (uint16_t)(index % nof_objects + 1), 0);
+  opcode_get_next_prop();
+}
+
+
+// Re-inserts the object into its current parent, which moves it to the
+// front of the parent's child list without changing the tree's shape.
+static void bench_insert_object(int index)
+{
+  uint16_t object = (uint16_t)(index % nof_objects + 1);
+  uint16_t parent;
+
+  set_operands(1, object, 0);
+  opcode_get_parent();
+  if ((parent = get_variable(RESULT_VARIABLE, false)) == 0)
+    return;
+  set_operands(2, object, parent);
+  opcode_insert_obj();
+}
+
+
+static void bench_save_undo(int UNUSED(index))
+{
+  set_operands(0, 0, 0);
+  opcode_save_undo();
+}
+
+
+static void bench_save_game(int UNUSED(index))
+{
+  z_file *out;
+
+  if ((out = fsi->openfile(
+          savegame_filename, FILETYPE_SAVEGAME, FILEACCESS_WRITE)) == NULL)
+    return;
+  // The stream is closed by save_game_to_stream().
+  save_game_to_stream(0, 0, out, false);
+}
+
+
+static void bench_restore_game(int UNUSED(index))
+{
+  z_file *in;
+
+  if ((in = fsi->openfile(
+          savegame_filename, FILETYPE_SAVEGAME, FILEACCESS_READ)) == NULL)
+    return;
+  // The stream is closed by restore_game_from_stream().
+  restore_game_from_stream(0, 0, in, false);
+}
+
+
+static uint16_t count_objects()
+{
+  uint8_t *first_object
+    = active_z_story->object_tree + active_z_story->object_size;
+  uint8_t *first_property_table = z_mem + load_word(
+      first_object + active_z_story->object_property_index);
+  long result;
+
+  result = (first_property_table - first_object) / active_z_story->object_size;
+
+  if (result < 0)
+    return 0;
+  else if (result > MAXIMUM_BENCHMARKED_OBJECTS)
+    return MAXIMUM_BENCHMARKED_OBJECTS;
+  else
+    return (uint16_t)result;
+}
+
+
+// Decodes the dictionary's words which consist of alphabet A0 characters
+// only, this is sufficient for building tokeniser and hyphenation input.
+static void extract_dictionary_words()
+{
+  uint8_t *dictionary = active_z_story->dictionary_table;
+  uint8_t *entry;
+  int entry_length, nof_entries, i, j, k, len;
+  int encoded_words = (ver >= 4 ? 3 : 2);
+  uint16_t data;
+  uint8_t zchar;
+  bool word_ok;
+
+  entry = dictionary + *dictionary + 1;
+  entry_length = *entry;
+  nof_entries = (int16_t)load_word(entry + 1);
+  entry += 3;
+
+  if (nof_entries < 0)
+    nof_entries = -nof_entries;
+
+  for (i=0; (i<nof_entries) && (nof_words<MAXIMUM_FIXTURES); i++)
+  {
+    len = 0;
+    word_ok = true;
+    for (j=0; (j<encoded_words) && (word_ok == true); j++)
+    {
+      data = load_word(entry + i*entry_length + j*2);
+      for (k=2; k>=0; k--)
+      {
+        zchar = (data >> (k*5)) & 0x1f;
+        if (zchar == 5)
+          break;
+        else if ( (zchar < 6) || (len == MAXIMUM_WORD_LENGTH) )
+        {
+          word_ok = false;
+          break;
+        }
+        words[nof_words][len++] = active_z_story->alphabet_table[zchar - 6];
+      }
+    }
+
+    if ( (word_ok == true) && (len > 0) )
+    {
+      words[nof_words][len] = 0;
+      for (j=0; j<=len; j++)
+        words_z_ucs[nof_words][j] = words[nof_words][j];
+      nof_words++;
+    }
+  }
+}
+
+
+static void build_sentences()
+{
+  int i, len, word_index = 0;
+  size_t word_len;
+
+  for (i=0; (i<MAXIMUM_FIXTURES) && (nof_words>0); i++)
+  {
+    len = 0;
+    while (len < MAXIMUM_SENTENCE_LENGTH / 2)
+    {
+      word_len = strlen((char*)words[word_index % nof_words]);
+      if (len + word_len + 1 > MAXIMUM_SENTENCE_LENGTH)
+        break;
+      if (len > 0)
+        sentences[i][len++] = ' ';
+      memcpy(sentences[i] + len, words[word_index % nof_words], word_len);
+      len += word_len;
+      word_index += 7;
+    }
+    sentences[i][len] = 0;
+  }
+
+  nof_sentences = i;
+}
+
+
+// Splits the captured story output into newline-terminated paragraphs.
+static void extract_paragraphs()
+{
+  z_ucs *start = captured_output, *ptr;
+  size_t len;
+
+  captured_output[captured_output_length] = 0;
+
+  while ( (*start != 0) && (nof_paragraphs < MAXIMUM_FIXTURES) )
+  {
+    ptr = start;
+    while ( (*ptr != 0) && (*ptr != Z_UCS_NEWLINE)
+        && (ptr - start < MAXIMUM_PARAGRAPH_LENGTH) )
+      ptr++;
+    if (*ptr == Z_UCS_NEWLINE)
+      ptr++;
+
+    if ((len = (size_t)(ptr - start)) > 1)
+    {
+      paragraphs[nof_paragraphs] = fizmo_malloc((len + 1) * sizeof(z_ucs));
+      memcpy(paragraphs[nof_paragraphs], start, len * sizeof(z_ucs));
+      paragraphs[nof_paragraphs][len] = 0;
+      paragraph_lengths[nof_paragraphs] = len;
+      nof_paragraphs++;
+    }
+
+    start = ptr;
+  }
+}
+
+
+static void run_benchmarks(bool line_input_available)
+{
+  int fd, i, nof_phases;
+  bool stream_1_active_buf;
+  struct z_startup_phase *phases;
+  char phase_name[64];
+
+  benchmarks_done = true;
+
+  report_result("startup-to-first-input", 1,
+      get_time_ns() - startup_time_ns,
+      turn_statistics_get_total_allocations() - startup_allocations);
+
+  phases = get_startup_phases(&nof_phases);
+  for (i=0; i<nof_phases; i++)
+  {
+    snprintf(phase_name, sizeof(phase_name), "startup-phase-%s",
+        phases[i].name);
+    report_result(phase_name, 1, (int64_t)phases[i].elapsed_time * 1000, 0);
+  }
+
+  extract_dictionary_words();
+  build_sentences();
+  extract_paragraphs();
+  nof_objects = count_objects();
+
+  if (nof_objects > 0)
+  {
+    stream_1_active_buf = stream_1_active;
+    stream_1_active = false;
+    run_benchmark("decode-object-name", &bench_decode_object_name);
+    stream_1_active = stream_1_active_buf;
+
+    run_benchmark("get-parent", &bench_get_parent);
+    run_benchmark("get-child", &bench_get_child);
+    run_benchmark("test-attr", &bench_test_attr);
+    run_benchmark("get-prop-addr", &bench_get_prop_addr);
+    run_benchmark("get-next-prop", &bench_get_next_prop);
+    run_benchmark("insert-object", &bench_insert_object);
+  }
+
+  if ( (line_input_available == true) && (nof_sentences > 0) )
+  {
+    run_benchmark("tokenise", &bench_tokenise);
+    run_benchmark("tokenise-cached", &bench_tokenise_cached);
+    run_benchmark("dictionary-lookup", &bench_dictionary_lookup);
+  }
+
+  if (nof_words > 0)
+    run_benchmark("hyphenate", &bench_hyphenate);
+
+  if (nof_paragraphs > 0)
+  {
+    wrapper = wordwrap_new_wrapper(BENCHMARK_WRAP_WIDTH, &discard_output,
+        NULL, true, 0, false, false);
+    run_benchmark("wordwrap", &bench_wordwrap);
+    wordwrap_destroy_wrapper(wrapper);
+
+    wrapper = wordwrap_new_wrapper(BENCHMARK_WRAP_WIDTH, &discard_output,
+        NULL, true, 0, false, true);
+    run_benchmark("wordwrap-hyphenated", &bench_wordwrap);
+    wordwrap_destroy_wrapper(wrapper);
+
+    line_wrapper = linewrap_new_wrapper(BENCHMARK_WRAP_WIDTH, NULL,
+        &discard_text, &discard_line_end, NULL);
+    run_benchmark("linewrap", &bench_linewrap);
+    linewrap_destroy_wrapper(line_wrapper);
+
+    line_wrapper = linewrap_new_wrapper(BENCHMARK_WRAP_WIDTH,
+        &get_glyph_width, &discard_text, &discard_line_end, NULL);
+    run_benchmark("linewrap-glyph-widths", &bench_linewrap);
+    linewrap_destroy_wrapper(line_wrapper);
+
+#ifndef DISABLE_OUTPUT_HISTORY
+    history = create_outputhistory(0, BENCHMARK_HISTORY_SIZE,
+        BENCHMARK_HISTORY_INCREMENT, Z_COLOUR_BLACK, Z_COLOUR_WHITE,
+        Z_FONT_NORMAL, Z_STYLE_ROMAN);
+    run_benchmark("store-history", &bench_store_history);
+    destroy_outputhistory(history);
+#endif // DISABLE_OUTPUT_HISTORY
+  }
+
+  run_benchmark("save-undo", &bench_save_undo);
+
+  if ((fd = mkstemp(savegame_filename)) != -1)
+  {
+    close(fd);
+    run_benchmark("save-game", &bench_save_game);
+    run_benchmark("restore-game", &bench_restore_game);
+    unlink(savegame_filename);
+  }
+}
+
+
+static char *get_interface_name() { return "microbench"; }
+static bool return_true() { return true; }
+static bool return_false() { return false; }
+static uint16_t get_screen_height() { return 25; }
+static uint16_t get_screen_width() { return 80; }
+static uint8_t return_one() { return 1; }
+static uint8_t return_zero() { return 0; }
+static uint16_t return_one_16() { return 1; }
+static z_colour get_default_foreground_colour() { return Z_COLOUR_BLACK; }
+static z_colour get_default_background_colour() { return Z_COLOUR_WHITE; }
+static int parse_config_parameter(char *UNUSED(key), char *UNUSED(value))
+{ return -2; }
+static char *get_config_value(char *UNUSED(key)) { return NULL; }
+static char **get_config_option_names() { return NULL; }
+static void link_interface_to_story(struct z_story *UNUSED(story)) { }
+static void do_nothing() { }
+static void set_buffer_mode(uint8_t UNUSED(mode)) { }
+static void set_text_style(z_style UNUSED(style)) { }
+static void set_font(z_font UNUSED(font)) { }
+static void int16_nop(int16_t UNUSED(value)) { }
+static void uint16_nop(uint16_t UNUSED(value)) { }
+
+static void set_colour(z_colour UNUSED(foreground),
+    z_colour UNUSED(background), int16_t UNUSED(window)) { }
+
+static void set_cursor(int16_t UNUSED(line), int16_t UNUSED(column),
+    int16_t UNUSED(window)) { }
+
+static void show_status(z_ucs *UNUSED(room_description),
+    int UNUSED(status_line_mode), int16_t UNUSED(parameter1),
+    int16_t UNUSED(parameter2)) { }
+
+static int prompt_for_filename(char *UNUSED(filename_suggestion),
+    z_file **UNUSED(result_file), char *UNUSED(directory),
+    int UNUSED(filetype_or_mode), int UNUSED(fileaccess))
+{ return -3; }
+
+
+static int close_microbench_interface(z_ucs *error_message)
+{
+  char buf[256];
+
+  if (error_message != NULL)
+  {
+    zucs_string_to_utf8_string(buf, &error_message, sizeof(buf));
+    fprintf(stderr, "%s\n", buf);
+  }
+
+  return 0;
+}
+
+
+static void z_ucs_output(z_ucs *output)
+{
+  while ( (*output != 0) && (captured_output_length < CAPTURE_BUFFER_SIZE-1) )
+    captured_output[captured_output_length++] = *(output++);
+}
+
+
+static int16_t read_line(zscii *UNUSED(dest), uint16_t UNUSED(maximum_length),
+    uint16_t UNUSED(tenth_seconds), uint32_t UNUSED(verification_routine),
+    uint8_t UNUSED(preloaded_input), int *UNUSED(tenth_seconds_elapsed),
+    bool UNUSED(disable_command_history), bool UNUSED(return_on_escape))
+{
+  text_buffer = op[0];
+  parse_buffer = op[1];
+
+  if (benchmarks_done == false)
+    run_benchmarks(true);
+
+  exit(0);
+}
+
+
+static int read_char(uint16_t UNUSED(tenth_seconds),
+    uint32_t UNUSED(verification_routine),
+    int *UNUSED(tenth_seconds_elapsed))
+{
+  if (benchmarks_done == false)
+    run_benchmarks(false);
+
+  exit(0);
+}
+
+
+static struct z_screen_interface microbench_interface =
+{
+  &get_interface_name,
+  &return_true,
+  &return_true,
+  &return_false,
+  &return_true,
+  &return_false,
+  &return_true,
+  &return_true,
+  &return_true,
+  &return_false,
+  &return_false,
+  &return_false,
+  &return_false,
+  &get_screen_height,
+  &get_screen_width,
+  &get_screen_width,
+  &get_screen_height,
+  &return_one,
+  &return_one,
+  &get_default_foreground_colour,
+  &get_default_background_colour,
+  &return_zero,
+  &parse_config_parameter,
+  &get_config_value,
+  &get_config_option_names,
+  &link_interface_to_story,
+  &do_nothing,
+  &close_microbench_interface,
+  &set_buffer_mode,
+  &z_ucs_output,
+  &read_line,
+  &read_char,
+  &show_status,
+  &set_text_style,
+  &set_colour,
+  &set_font,
+  &int16_nop,
+  &int16_nop,
+  &int16_nop,
+  &set_cursor,
+  &return_one_16,
+  &return_one_16,
+  &uint16_nop,
+  &uint16_nop,
+  &do_nothing,
+  &return_false,
+  &do_nothing,
+  &prompt_for_filename,
+  NULL,
+  NULL,
+  NULL
+};
+
+
+int main(int argc, char *argv[])
+{
+  z_file *story_file;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "l:t:")) != -1)
+  {
+    if (opt == 'l')
+      set_configuration_value("i18n-search-path", optarg);
+    else if (opt == 't')
+      minimum_benchmark_time_ms = atol(optarg);
+    else
+    {
+      fprintf(stderr,
+          "Usage: %s [-l locale-directory] [-t milliseconds] story-file\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  if (optind != argc - 1)
+  {
+    fprintf(stderr,
+        "Usage: %s [-l locale-directory] [-t milliseconds] story-file\n",
+        argv[0]);
+    return 1;
+  }
+
+  story_name = strrchr(argv[optind], '/') != NULL
+    ? strrchr(argv[optind], '/') + 1
+    : argv[optind];
+
+  set_configuration_value("random-mode", "predictable");
+  fizmo_register_screen_interface(&microbench_interface);
+
+  if ((story_file = fsi->openfile(
+          argv[optind], FILETYPE_DATA, FILEACCESS_READ)) == NULL)
+  {
+    fprintf(stderr, "Could not open \"%s\".\n", argv[optind]);
+    return 1;
+  }
+
+  startup_allocations = turn_statistics_get_total_allocations();
+  startup_time_ns = get_time_ns();
+  fizmo_start(story_file, NULL, NULL);
+
+  return 0;
+}
+
+#endif /* microbench_c_INCLUDED */
+
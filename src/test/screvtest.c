@@ -0,0 +1,654 @@
+
+/* screvtest.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// Round trip test for the screen event encoder in src/interpreter/
+// screvenc.c and the decoder in src/tools/screvent.c. The story is run
+// through the event interface with the commands from the script as input,
+// one line per read_line or one character per read_char. The events are
+// decoded right away and checked against what the interpreter has sent:
+//
+// - Text for all windows but the upper one has to come out unchanged and
+//   in the same style, font and colours it has been written with.
+// - Whenever input is read and when the interface is closed, the upper
+//   window rebuilt from the UPPER_WINDOW and ERASE_WINDOW events has to
+//   match the blockbuffer cell by cell.
+// - Every event has to be reported as incomplete for all of its proper
+//   prefixes, so a front-end may decode data as it arrives.
+//
+// Once the script is used up the story is quit. The exit status is zero
+// in case no differences were found.
+//
+// Usage: screvtest [-l locale-directory] story command-script
+
+
+#ifndef screvtest_c_INCLUDED
+#define screvtest_c_INCLUDED
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../interpreter/fizmo.h"
+#include "../interpreter/config.h"
+#include "../interpreter/zpu.h"
+#include "../interpreter/screvenc.h"
+#include "../interpreter/zscii.h"
+#include "../screen_interface/screen_interface.h"
+#include "../tools/filesys.h"
+#include "../tools/screvent.h"
+#include "../tools/z_ucs.h"
+#include "../tools/unused.h"
+
+#define MAXIMUM_COMMAND_LENGTH 1024
+#define TEXT_CELLS_INCREMENT 4096
+
+
+// Text outside the upper window, as written by the interpreter or as
+// decoded from the events.
+struct text_record
+{
+  struct blockbuf_char *cells;
+  size_t len;
+  size_t size;
+  z_style style;
+  z_font font;
+  z_colour foreground_colour;
+  z_colour background_colour;
+  int16_t window;
+};
+
+static struct text_record sent_text;
+static struct text_record decoded_text;
+static struct z_screen_interface *event_interface;
+static struct z_screen_interface test_interface;
+static SCREEN_EVENT_DECODER *decoder;
+static SCREEN_EVENT_DECODER *prefix_decoder;
+static FILE *commands;
+static char command[MAXIMUM_COMMAND_LENGTH];
+static char *next_command_char = NULL;
+static struct blockbuf_char *upper_window = NULL;
+static int upper_window_width = 0;
+static int upper_window_height = 0;
+static long nof_events = 0;
+static long nof_bytes = 0;
+static long nof_checks = 0;
+static int nof_errors = 0;
+static bool close_received = false;
+
+
+static void *allocate(void *ptr, size_t size)
+{
+  if ((ptr = realloc(ptr, size)) == NULL)
+  {
+    fprintf(stderr, "Out of memory.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return ptr;
+}
+
+
+static void report_error(char *message, long position)
+{
+  fprintf(stderr, "Check %ld: %s at %ld.\n", nof_checks, message, position);
+  nof_errors++;
+}
+
+
+static void init_text_record(struct text_record *record)
+{
+  memset(record, 0, sizeof(struct text_record));
+  record->style = Z_STYLE_ROMAN;
+  record->font = Z_FONT_NORMAL;
+  record->foreground_colour = Z_COLOUR_UNDEFINED;
+  record->background_colour = Z_COLOUR_UNDEFINED;
+}
+
+
+static void append_text(struct text_record *record, z_ucs *text, size_t len)
+{
+  struct blockbuf_char *cell;
+  size_t i;
+
+  if (record->window == 1)
+    return;
+
+  if (record->len + len > record->size)
+  {
+    record->size = record->len + len + TEXT_CELLS_INCREMENT;
+    record->cells = allocate(
+        record->cells, sizeof(struct blockbuf_char) * record->size);
+  }
+
+  cell = record->cells + record->len;
+  for (i=0; i<len; i++)
+  {
+    cell->character = text[i];
+    cell->style = record->style;
+    cell->font = record->font;
+    cell->foreground_colour = record->foreground_colour;
+    cell->background_colour = record->background_colour;
+    cell++;
+  }
+  record->len += len;
+}
+
+
+static bool cells_equal(struct blockbuf_char *c1, struct blockbuf_char *c2)
+{
+  return (c1->character == c2->character)
+    && (c1->style == c2->style)
+    && (c1->font == c2->font)
+    && (c1->foreground_colour == c2->foreground_colour)
+    && (c1->background_colour == c2->background_colour);
+}
+
+
+static void erase_upper_window(void)
+{
+#ifndef DISABLE_BLOCKBUFFER
+  int i;
+
+  if (upper_window_buffer == NULL)
+    return;
+
+  for (i=0; i<upper_window_width * upper_window_height; i++)
+  {
+    upper_window[i].character = Z_UCS_SPACE;
+    upper_window[i].style = upper_window_buffer->default_style;
+    upper_window[i].font = upper_window_buffer->default_font;
+    upper_window[i].foreground_colour
+      = upper_window_buffer->default_foreground_colour;
+    upper_window[i].background_colour
+      = upper_window_buffer->default_background_colour;
+  }
+#endif // DISABLE_BLOCKBUFFER
+}
+
+
+static void apply_upper_window_event(struct screen_event *event)
+{
+  struct screen_event_run *run;
+  struct blockbuf_char *cell;
+  size_t i, j;
+
+  // All cells are sent again after the upper window has been resized.
+  if (
+      (event->parameter[0] != upper_window_width)
+      ||
+      (event->parameter[1] != upper_window_height)
+     )
+  {
+    upper_window_width = event->parameter[0];
+    upper_window_height = event->parameter[1];
+    upper_window = allocate(upper_window, sizeof(struct blockbuf_char)
+        * upper_window_width * upper_window_height);
+    memset(upper_window, 0, sizeof(struct blockbuf_char)
+        * upper_window_width * upper_window_height);
+  }
+
+  for (i=0; i<event->nof_runs; i++)
+  {
+    run = event->runs + i;
+    cell = upper_window + run->row * upper_window_width + run->column;
+    for (j=0; j<run->len; j++)
+    {
+      cell->character = run->text[j];
+      cell->style = run->style;
+      cell->font = run->font;
+      cell->foreground_colour = run->foreground_colour;
+      cell->background_colour = run->background_colour;
+      cell++;
+    }
+  }
+}
+
+
+static void apply_event(struct screen_event *event)
+{
+  switch (event->type)
+  {
+    case SCREEN_EVENT_TEXT:
+      append_text(&decoded_text, event->text, event->text_len);
+      break;
+
+    case SCREEN_EVENT_STYLE:
+      decoded_text.style = event->parameter[0];
+      break;
+
+    case SCREEN_EVENT_FONT:
+      decoded_text.font = event->parameter[0];
+      break;
+
+    case SCREEN_EVENT_COLOUR:
+      decoded_text.foreground_colour = event->parameter[0];
+      decoded_text.background_colour = event->parameter[1];
+      break;
+
+    case SCREEN_EVENT_SET_WINDOW:
+      decoded_text.window = event->parameter[0];
+      break;
+
+    case SCREEN_EVENT_ERASE_WINDOW:
+      if ( (event->parameter[0] == 1) || (event->parameter[0] < 0) )
+        erase_upper_window();
+      break;
+
+    case SCREEN_EVENT_UPPER_WINDOW:
+      apply_upper_window_event(event);
+      break;
+
+    case SCREEN_EVENT_CLOSE:
+      close_received = true;
+      break;
+  }
+}
+
+
+static void receive_events(uint8_t *data, size_t len,
+    void *UNUSED(parameter))
+{
+  struct screen_event event;
+  long event_len, i;
+
+  nof_bytes += len;
+
+  while (len > 0)
+  {
+    if ((event_len = decode_screen_event(decoder, data, len, &event)) <= 0)
+    {
+      report_error("Undecodable event", nof_bytes - (long)len);
+      exit(EXIT_FAILURE);
+    }
+
+    for (i=0; i<event_len; i++)
+      if (decode_screen_event(prefix_decoder, data, (size_t)i, &event) != 0)
+      {
+        report_error("Incomplete event decoded", nof_bytes - (long)len);
+        break;
+      }
+
+    // The prefix decoder may have overwritten the event's text and runs.
+    decode_screen_event(decoder, data, len, &event);
+    apply_event(&event);
+    nof_events++;
+    data += event_len;
+    len -= (size_t)event_len;
+  }
+}
+
+
+// Called whenever the event interface has handed all events to the sink.
+static void compare_screens(void)
+{
+  size_t i;
+#ifndef DISABLE_BLOCKBUFFER
+  int nof_cells;
+#endif // DISABLE_BLOCKBUFFER
+
+  nof_checks++;
+
+  for (i=0; (i < sent_text.len) && (i < decoded_text.len); i++)
+    if (cells_equal(sent_text.cells + i, decoded_text.cells + i) == false)
+    {
+      report_error("Text differs", (long)i);
+      break;
+    }
+
+  if (sent_text.len != decoded_text.len)
+    report_error("Text length differs", (long)decoded_text.len);
+
+  // Text already compared isn't needed any longer.
+  sent_text.len = 0;
+  decoded_text.len = 0;
+
+#ifndef DISABLE_BLOCKBUFFER
+  if ( (upper_window_buffer == NULL) || (ver < 3) || (ver == 6) )
+    return;
+
+  nof_cells = upper_window_buffer->width * upper_window_buffer->height;
+  if (nof_cells == 0)
+    return;
+
+  if (
+      (upper_window_width != upper_window_buffer->width)
+      ||
+      (upper_window_height != upper_window_buffer->height)
+     )
+  {
+    report_error("Upper window size differs", 0);
+    return;
+  }
+
+  for (i=0; i<(size_t)nof_cells; i++)
+    if (cells_equal(upper_window_buffer->content + i, upper_window + i)
+        == false)
+    {
+      report_error("Upper window differs", (long)i);
+      return;
+    }
+#endif // DISABLE_BLOCKBUFFER
+}
+
+
+// The test interface records what the interpreter sends before passing it
+// on to the event interface.
+
+static void test_z_ucs_output_with_length(z_ucs *z_ucs_output, size_t len)
+{
+  append_text(&sent_text, z_ucs_output, len);
+  event_interface->z_ucs_output_with_length(z_ucs_output, len);
+}
+
+
+static void test_z_ucs_output(z_ucs *z_ucs_output)
+{
+  test_z_ucs_output_with_length(z_ucs_output, z_ucs_len(z_ucs_output));
+}
+
+
+static void test_set_text_style(z_style text_style)
+{
+  sent_text.style = text_style;
+  event_interface->set_text_style(text_style);
+}
+
+
+static void test_set_colour(z_colour foreground, z_colour background,
+    int16_t window)
+{
+  sent_text.foreground_colour = foreground;
+  sent_text.background_colour = background;
+  event_interface->set_colour(foreground, background, window);
+}
+
+
+static void test_set_font(z_font font_type)
+{
+  sent_text.font = font_type;
+  event_interface->set_font(font_type);
+}
+
+
+static void test_set_window(int16_t window_number)
+{
+  sent_text.window = window_number;
+  event_interface->set_window(window_number);
+}
+
+
+// The host interface behind the event interface: Output has been encoded
+// already, input is taken from the command script.
+
+static char *get_interface_name() { return "screvtest"; }
+static bool return_true() { return true; }
+static bool return_false() { return false; }
+static uint16_t get_screen_height() { return 25; }
+static uint16_t get_screen_width() { return 80; }
+static uint8_t return_one() { return 1; }
+static uint8_t return_zero() { return 0; }
+static uint16_t return_one_16() { return 1; }
+static z_colour get_default_foreground_colour() { return Z_COLOUR_BLACK; }
+static z_colour get_default_background_colour() { return Z_COLOUR_WHITE; }
+static int parse_config_parameter(char *UNUSED(key), char *UNUSED(value))
+{ return -2; }
+static char *get_config_value(char *UNUSED(key)) { return NULL; }
+static char **get_config_option_names() { return NULL; }
+static void link_interface_to_story(struct z_story *UNUSED(story)) { }
+static void do_nothing() { }
+static void set_buffer_mode(uint8_t UNUSED(mode)) { }
+static void z_ucs_output(z_ucs *UNUSED(output)) { }
+static void set_text_style(z_style UNUSED(style)) { }
+static void set_font(z_font UNUSED(font)) { }
+static void int16_nop(int16_t UNUSED(value)) { }
+static void uint16_nop(uint16_t UNUSED(value)) { }
+
+static void set_colour(z_colour UNUSED(foreground),
+    z_colour UNUSED(background), int16_t UNUSED(window)) { }
+
+static void set_cursor(int16_t UNUSED(line), int16_t UNUSED(column),
+    int16_t UNUSED(window)) { }
+
+static void show_status(z_ucs *UNUSED(room_description),
+    int UNUSED(status_line_mode), int16_t UNUSED(parameter1),
+    int16_t UNUSED(parameter2)) { }
+
+static int prompt_for_filename(char *UNUSED(filename_suggestion),
+    z_file **UNUSED(result_file), char *UNUSED(directory),
+    int UNUSED(filetype_or_mode), int UNUSED(fileaccess))
+{ return -3; }
+
+
+static int close_screvtest_interface(z_ucs *error_message)
+{
+  char buf[256];
+
+  compare_screens();
+
+  if (error_message != NULL)
+  {
+    zucs_string_to_utf8_string(buf, &error_message, sizeof(buf));
+    fprintf(stderr, "%s\n", buf);
+  }
+
+  return 0;
+}
+
+
+static bool read_command(void)
+{
+  if (fgets(command, sizeof(command), commands) == NULL)
+  {
+    terminate_interpreter = INTERPRETER_QUIT_ALL;
+    return false;
+  }
+
+  next_command_char = command;
+  return true;
+}
+
+
+static int16_t read_line(zscii *dest, uint16_t maximum_length,
+    uint16_t UNUSED(tenth_seconds), uint32_t UNUSED(verification_routine),
+    uint8_t preloaded_input, int *UNUSED(tenth_seconds_elapsed),
+    bool UNUSED(disable_command_history), bool UNUSED(return_on_escape))
+{
+  size_t len;
+
+  compare_screens();
+
+  if (read_command() == false)
+    return 0;
+
+  next_command_char = NULL;
+  len = strcspn(command, "\r\n");
+  if (len > (size_t)(maximum_length - preloaded_input))
+    len = maximum_length - preloaded_input;
+  memcpy(dest + preloaded_input, command, len);
+
+  return preloaded_input + len;
+}
+
+
+static int read_char(uint16_t UNUSED(tenth_seconds),
+    uint32_t UNUSED(verification_routine),
+    int *UNUSED(tenth_seconds_elapsed))
+{
+  char c;
+
+  compare_screens();
+
+  if ( (next_command_char == NULL) || (*next_command_char == 0) )
+    if (read_command() == false)
+      return 0;
+
+  c = *(next_command_char++);
+
+  return c == '\n' ? ZSCII_NEWLINE : c;
+}
+
+
+static struct z_screen_interface screvtest_interface =
+{
+  &get_interface_name,
+  &return_true,
+  &return_true,
+  &return_false,
+  &return_true,
+  &return_false,
+  &return_true,
+  &return_true,
+  &return_true,
+  &return_false,
+  &return_false,
+  &return_false,
+  &return_false,
+  &get_screen_height,
+  &get_screen_width,
+  &get_screen_width,
+  &get_screen_height,
+  &return_one,
+  &return_one,
+  &get_default_foreground_colour,
+  &get_default_background_colour,
+  &return_zero,
+  &parse_config_parameter,
+  &get_config_value,
+  &get_config_option_names,
+  &link_interface_to_story,
+  &do_nothing,
+  &close_screvtest_interface,
+  &set_buffer_mode,
+  &z_ucs_output,
+  &read_line,
+  &read_char,
+  &show_status,
+  &set_text_style,
+  &set_colour,
+  &set_font,
+  &int16_nop,
+  &int16_nop,
+  &int16_nop,
+  &set_cursor,
+  &return_one_16,
+  &return_one_16,
+  &uint16_nop,
+  &uint16_nop,
+  &do_nothing,
+  &return_false,
+  &do_nothing,
+  &prompt_for_filename,
+  NULL,
+  NULL,
+  NULL
+};
+
+
+static void print_usage(char *program_name)
+{
+  fprintf(stderr,
+      "Usage: %s [-l locale-directory] story command-script\n",
+      program_name);
+}
+
+
+int main(int argc, char *argv[])
+{
+  z_file *story_file;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "l:")) != -1)
+  {
+    if (opt == 'l')
+      set_configuration_value("i18n-search-path", optarg);
+    else
+    {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc - 2)
+  {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if ((commands = fopen(argv[optind + 1], "r")) == NULL)
+  {
+    fprintf(stderr, "Could not open \"%s\".\n", argv[optind + 1]);
+    return EXIT_FAILURE;
+  }
+
+  init_text_record(&sent_text);
+  init_text_record(&decoded_text);
+  decoder = create_screen_event_decoder();
+  prefix_decoder = create_screen_event_decoder();
+
+  event_interface = create_screen_event_interface(
+      &screvtest_interface, &receive_events, NULL);
+  test_interface = *event_interface;
+  test_interface.z_ucs_output = &test_z_ucs_output;
+  test_interface.z_ucs_output_with_length = &test_z_ucs_output_with_length;
+  test_interface.set_text_style = &test_set_text_style;
+  test_interface.set_colour = &test_set_colour;
+  test_interface.set_font = &test_set_font;
+  test_interface.set_window = &test_set_window;
+  fizmo_register_screen_interface(&test_interface);
+
+  if ((story_file = fsi->openfile(
+          argv[optind], FILETYPE_DATA, FILEACCESS_READ)) == NULL)
+  {
+    fprintf(stderr, "Could not open \"%s\".\n", argv[optind]);
+    return EXIT_FAILURE;
+  }
+
+  fizmo_start(story_file, NULL, NULL);
+
+  destroy_screen_event_interface();
+  destroy_screen_event_decoder(decoder);
+  destroy_screen_event_decoder(prefix_decoder);
+  fclose(commands);
+
+  if (close_received == false)
+    report_error("No CLOSE event", nof_bytes);
+
+  fprintf(stderr, "%s: %ld events, %ld bytes, %ld checks, %d errors.\n",
+      argv[optind], nof_events, nof_bytes, nof_checks, nof_errors);
+
+  return nof_errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif /* screvtest_c_INCLUDED */
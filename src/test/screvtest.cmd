@@ -0,0 +1,26 @@
+1
+2
+3
+4
+5
+6
+7
+8
+9
+0
+
+
+
+
+look
+inventory
+enter building
+take all
+i
+x lamp
+out
+w
+n
+undo
+quit
+y
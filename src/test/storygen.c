@@ -0,0 +1,811 @@
+
+/* storygen.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2009-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// Generates synthetic Z-machine stories of configurable size for scaling
+// tests. The generated story runs a fixed workload -- object and property
+// accessors, tokenising, deep recursion, undo, stream 3 and printing from
+// high memory -- and then asks for a line of input. This allows running
+// microbench (see microbench.c) on it, which reports the workload's time
+// as "startup-to-first-input" and measures its kernels at the story's
+// scale.
+//
+// All dynamic memory has to reside below 64 KB and the parse buffer can
+// only reference dictionary entries below 64 KB. This limits the number
+// of objects to about 4600 and the number of dictionary words to about
+// 7000, depending on the other settings. Objects may share property
+// tables ("-t") to fit more objects into dynamic memory.
+//
+// Usage: storygen [-v 5|8] [-o objects] [-p properties-per-object]
+//          [-t property-tables] [-w dictionary-words] [-r recursion-depth]
+//          [-d dynamic-memory-size] [-h high-memory-size] [-i iterations]
+//          output-file
+
+
+#ifndef storygen_c_INCLUDED
+#define storygen_c_INCLUDED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#define MAXIMUM_STORY_SIZE (512*1024)
+#define MAXIMUM_DYNAMIC_MEMORY_SIZE 0xffff
+#define MAXIMUM_LABELS 256
+#define MAXIMUM_FIXUPS 1024
+
+#define OPERAND_LARGE 0
+#define OPERAND_SMALL 1
+#define OPERAND_VARIABLE 2
+#define OPERAND_OMITTED 3
+
+#define FIXUP_BRANCH 0
+#define FIXUP_PACKED_ADDRESS 1
+
+#define VARIABLE_STACK 0x00
+#define LOCAL_1 0x01
+#define GLOBAL_COUNTER 0x10
+#define GLOBAL_INNER_COUNTER 0x11
+#define GLOBAL_TEMP 0x12
+#define GLOBAL_TEMP2 0x13
+#define GLOBAL_ADDRESS 0x14
+
+#define NUMBER_OF_PROPERTY_DEFAULTS 63
+#define OBJECT_ENTRY_SIZE 14
+#define NUMBER_OF_GLOBALS 240
+#define DICTIONARY_ENTRY_SIZE 9
+#define DICTIONARY_WORD_LENGTH 6
+#define TEXT_BUFFER_SIZE 100
+#define PARSE_BUFFER_WORDS 20
+#define STREAM_3_TABLE_SIZE 1024
+#define SENTENCE_WORDS 8
+#define HIGH_MEMORY_STRING_LENGTH 64
+#define UNDO_PADDING_STRIDE 512
+#define TEST_ATTRIBUTE 5
+
+struct operand
+{
+  int type;
+  uint16_t value;
+};
+
+struct fixup
+{
+  size_t position;
+  int label;
+  int type;
+};
+
+static struct operand large(uint16_t value)
+{ struct operand result = { OPERAND_LARGE, value }; return result; }
+static struct operand small(uint8_t value)
+{ struct operand result = { OPERAND_SMALL, value }; return result; }
+static struct operand variable(uint8_t value)
+{ struct operand result = { OPERAND_VARIABLE, value }; return result; }
+
+static uint8_t *story;
+static size_t pc = 0;
+static int version = 5;
+static long labels[MAXIMUM_LABELS];
+static int nof_labels = 0;
+static struct fixup fixups[MAXIMUM_FIXUPS];
+static int nof_fixups = 0;
+
+
+static void fail(char *message)
+{
+  fprintf(stderr, "storygen: %s\n", message);
+  exit(EXIT_FAILURE);
+}
+
+
+static void emit_byte(uint8_t value)
+{
+  if (pc >= MAXIMUM_STORY_SIZE)
+    fail("story size exceeds the maximum of 512 KB.");
+
+  story[pc++] = value;
+}
+
+
+static void emit_word(uint16_t value)
+{
+  emit_byte((uint8_t)(value >> 8));
+  emit_byte((uint8_t)(value & 0xff));
+}
+
+
+static void set_word(size_t position, uint16_t value)
+{
+  story[position] = (uint8_t)(value >> 8);
+  story[position + 1] = (uint8_t)(value & 0xff);
+}
+
+
+static void align(size_t alignment)
+{
+  while (pc % alignment != 0)
+    emit_byte(0);
+}
+
+
+static int packing_factor()
+{
+  return version == 8 ? 8 : 4;
+}
+
+
+static int new_label()
+{
+  if (nof_labels == MAXIMUM_LABELS)
+    fail("too many labels.");
+
+  labels[nof_labels] = -1;
+  return nof_labels++;
+}
+
+
+static void place_label(int label)
+{
+  labels[label] = (long)pc;
+}
+
+
+static void add_fixup_at(size_t position, int label, int type)
+{
+  if (nof_fixups == MAXIMUM_FIXUPS)
+    fail("too many fixups.");
+
+  fixups[nof_fixups].position = position;
+  fixups[nof_fixups].label = label;
+  fixups[nof_fixups].type = type;
+  nof_fixups++;
+}
+
+
+static void resolve_fixups()
+{
+  int i;
+  long offset;
+  struct fixup *f;
+
+  for (i=0; i<nof_fixups; i++)
+  {
+    f = &fixups[i];
+
+    if (labels[f->label] < 0)
+      fail("unresolved label.");
+
+    if (f->type == FIXUP_PACKED_ADDRESS)
+      set_word(f->position,
+          (uint16_t)(labels[f->label] / packing_factor()));
+    else
+    {
+      // Branches are relative to the address behind their two-byte
+      // offset, minus two.
+      offset = labels[f->label] - (long)(f->position + 2) + 2;
+
+      if ( (offset < -8192) || (offset > 8191) )
+        fail("branch offset out of range.");
+      story[f->position] |= (uint8_t)((offset >> 8) & 0x3f);
+      story[f->position + 1] = (uint8_t)(offset & 0xff);
+    }
+  }
+
+  nof_fixups = 0;
+}
+
+
+static void emit_operand(struct operand op)
+{
+  if (op.type == OPERAND_LARGE)
+    emit_word(op.value);
+  else
+    emit_byte((uint8_t)op.value);
+}
+
+
+static void emit_types_and_operands(struct operand *ops, int nof_ops)
+{
+  uint8_t types = 0;
+  int i;
+
+  for (i=0; i<4; i++)
+    types = (uint8_t)((types << 2)
+        | (i < nof_ops ? ops[i].type : OPERAND_OMITTED));
+
+  emit_byte(types);
+
+  for (i=0; i<nof_ops; i++)
+    emit_operand(ops[i]);
+}
+
+
+static void emit_0op(uint8_t opcode)
+{
+  emit_byte((uint8_t)(0xb0 | opcode));
+}
+
+
+static void emit_1op(uint8_t opcode, struct operand op)
+{
+  emit_byte((uint8_t)(0x80 | (op.type << 4) | opcode));
+  emit_operand(op);
+}
+
+
+static void emit_2op(uint8_t opcode, struct operand a, struct operand b)
+{
+  struct operand ops[2];
+
+  if ( (a.type != OPERAND_LARGE) && (b.type != OPERAND_LARGE) )
+  {
+    emit_byte((uint8_t)(
+          (a.type == OPERAND_VARIABLE ? 0x40 : 0)
+          | (b.type == OPERAND_VARIABLE ? 0x20 : 0)
+          | opcode));
+    emit_byte((uint8_t)a.value);
+    emit_byte((uint8_t)b.value);
+  }
+  else
+  {
+    ops[0] = a;
+    ops[1] = b;
+    emit_byte((uint8_t)(0xc0 | opcode));
+    emit_types_and_operands(ops, 2);
+  }
+}
+
+
+static void emit_var(uint8_t opcode, struct operand *ops, int nof_ops)
+{
+  emit_byte((uint8_t)(0xe0 | opcode));
+  emit_types_and_operands(ops, nof_ops);
+}
+
+
+static void emit_ext(uint8_t opcode, struct operand *ops, int nof_ops)
+{
+  emit_byte(0xbe);
+  emit_byte(opcode);
+  emit_types_and_operands(ops, nof_ops);
+}
+
+
+static void emit_branch(int label, bool branch_on_true)
+{
+  add_fixup_at(pc, label, FIXUP_BRANCH);
+  emit_byte(branch_on_true == true ? 0x80 : 0x00);
+  emit_byte(0);
+}
+
+
+// Encodes lowercase letters and spaces into Z-characters, padded to
+// "min_zchars" or the next multiple of three.
+static void emit_zstring(char *text, int min_zchars)
+{
+  uint8_t zchars[1024];
+  int n = 0, i;
+  uint16_t word;
+
+  for (; (*text != 0) && (n < 1000); text++)
+    zchars[n++] = (uint8_t)(*text == ' ' ? 0 : *text - 'a' + 6);
+
+  while ( (n < min_zchars) || (n % 3 != 0) || (n == 0) )
+    zchars[n++] = 5;
+
+  for (i=0; i<n; i+=3)
+  {
+    word = (uint16_t)((zchars[i] << 10) | (zchars[i+1] << 5) | zchars[i+2]);
+    if (i + 3 == n)
+      word |= 0x8000;
+    emit_word(word);
+  }
+}
+
+
+static void get_dictionary_word(long index, char *dest)
+{
+  long value = index * 7919;
+  int i;
+
+  for (i=DICTIONARY_WORD_LENGTH-1; i>=0; i--)
+  {
+    dest[i] = (char)('a' + value % 26);
+    value /= 26;
+  }
+  dest[DICTIONARY_WORD_LENGTH] = 0;
+}
+
+
+static void emit_call(int routine_label, struct operand *args, int nof_args,
+    uint8_t result)
+{
+  struct operand ops[4];
+  int i;
+
+  ops[0] = large(0);
+  for (i=0; i<nof_args; i++)
+    ops[i+1] = args[i];
+
+  emit_byte(0xe0);
+  emit_byte(0);
+  for (i=0; i<nof_args+1; i++)
+    story[pc-1] = (uint8_t)((story[pc-1] << 2) | ops[i].type);
+  for (; i<4; i++)
+    story[pc-1] = (uint8_t)((story[pc-1] << 2) | OPERAND_OMITTED);
+  add_fixup_at(pc, routine_label, FIXUP_PACKED_ADDRESS);
+  emit_word(0);
+  for (i=0; i<nof_args; i++)
+    emit_operand(args[i]);
+  emit_byte(result);
+}
+
+
+// Emits "counter = 1; loop: <body>; inc_chk counter limit ?~loop". The
+// body is emitted by the caller between begin_loop() and end_loop().
+static int begin_loop(uint8_t counter)
+{
+  int label = new_label();
+
+  emit_2op(0x0d, small(counter), small(1));
+  place_label(label);
+
+  return label;
+}
+
+
+static void end_loop(int label, uint8_t counter, uint16_t limit)
+{
+  emit_2op(0x05, small(counter), large(limit));
+  emit_branch(label, false);
+}
+
+
+int main(int argc, char *argv[])
+{
+  long nof_objects = 500, nof_properties = 8, nof_property_tables = -1;
+  long nof_words = 1000, recursion_depth = 1000, iterations = 10;
+  long dynamic_memory_size = 0, high_memory_size = 0;
+  long i, j, nof_strings, nof_padding_writes;
+  size_t abbreviations, empty_string, property_defaults, objects;
+  size_t *property_tables, globals, text_buffer, parse_buffer;
+  size_t stream_3_table, padding, static_memory, dictionary;
+  size_t high_memory, strings, story_size;
+  int main_label, recurse_label, strings_label;
+  int loop, skip, opt;
+  struct operand ops[4];
+  char word[DICTIONARY_WORD_LENGTH + 1];
+  char *sentence;
+  uint16_t checksum = 0;
+  FILE *out;
+
+  while ((opt = getopt(argc, argv, "v:o:p:t:w:r:d:h:i:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'v': version = atoi(optarg); break;
+      case 'o': nof_objects = atol(optarg); break;
+      case 'p': nof_properties = atol(optarg); break;
+      case 't': nof_property_tables = atol(optarg); break;
+      case 'w': nof_words = atol(optarg); break;
+      case 'r': recursion_depth = atol(optarg); break;
+      case 'd': dynamic_memory_size = atol(optarg); break;
+      case 'h': high_memory_size = atol(optarg); break;
+      case 'i': iterations = atol(optarg); break;
+      default: optind = argc + 1; break;
+    }
+  }
+
+  if ( (optind != argc - 1)
+      || ( (version != 5) && (version != 8) )
+      || (nof_objects < 2) || (nof_objects > 32767)
+      || (nof_properties < 1) || (nof_properties > 63)
+      || (nof_words < SENTENCE_WORDS) || (nof_words > 32767)
+      || (recursion_depth < 1) || (recursion_depth > 32767)
+      || (iterations < 1) || (iterations > 32767) )
+  {
+    fprintf(stderr, "Usage: %s [-v 5|8] [-o objects] "
+        "[-p properties-per-object]\n"
+        "  [-t property-tables] [-w dictionary-words] "
+        "[-r recursion-depth]\n"
+        "  [-d dynamic-memory-size] [-h high-memory-size] "
+        "[-i iterations]\n"
+        "  output-file\n",
+        argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if ( (nof_property_tables < 1) || (nof_property_tables > nof_objects) )
+    nof_property_tables = nof_objects;
+
+  if ((story = calloc(MAXIMUM_STORY_SIZE, 1)) == NULL)
+    fail("out of memory.");
+  if ((property_tables = malloc(nof_property_tables * sizeof(size_t)))
+      == NULL)
+    fail("out of memory.");
+
+  // Header, filled in at the end.
+  pc = 0x40;
+
+  // Abbreviations, all pointing to an empty string.
+  empty_string = pc;
+  emit_zstring("", 3);
+  abbreviations = pc;
+  for (i=0; i<96; i++)
+    emit_word((uint16_t)(empty_string / 2));
+
+  // Object table: Object 1 is the root, all other objects are its
+  // children, which results in one long sibling chain.
+  property_defaults = pc;
+  for (i=0; i<NUMBER_OF_PROPERTY_DEFAULTS; i++)
+    emit_word(0);
+  objects = pc;
+  pc += nof_objects * OBJECT_ENTRY_SIZE;
+
+  for (i=0; i<nof_property_tables; i++)
+  {
+    property_tables[i] = pc;
+    emit_byte(1);
+    emit_zstring("obj", 3);
+    for (j=nof_properties; j>0; j--)
+    {
+      emit_byte((uint8_t)(0x40 | j));
+      emit_word((uint16_t)(i + j));
+    }
+    emit_byte(0);
+  }
+
+  for (i=0; i<nof_objects; i++)
+  {
+    set_word(objects + i*OBJECT_ENTRY_SIZE + 6, (uint16_t)(i == 0 ? 0 : 1));
+    set_word(objects + i*OBJECT_ENTRY_SIZE + 8,
+        (uint16_t)( (i == 0) || (i == nof_objects-1) ? 0 : i + 2));
+    set_word(objects + i*OBJECT_ENTRY_SIZE + 10, (uint16_t)(i == 0 ? 2 : 0));
+    set_word(objects + i*OBJECT_ENTRY_SIZE + 12,
+        (uint16_t)property_tables[i % nof_property_tables]);
+  }
+
+  globals = pc;
+  pc += NUMBER_OF_GLOBALS * 2;
+
+  // Text buffer, pre-filled with words spread over the dictionary.
+  text_buffer = pc;
+  emit_byte(TEXT_BUFFER_SIZE);
+  emit_byte(0);
+  pc += TEXT_BUFFER_SIZE;
+  sentence = (char*)story + text_buffer + 2;
+  for (i=0; i<SENTENCE_WORDS; i++)
+  {
+    get_dictionary_word(i * (nof_words - 1) / (SENTENCE_WORDS - 1), word);
+    if (i > 0)
+      strcat(sentence, " ");
+    strcat(sentence, word);
+  }
+  story[text_buffer + 1] = (uint8_t)strlen(sentence);
+
+  parse_buffer = pc;
+  emit_byte(PARSE_BUFFER_WORDS);
+  pc += 1 + PARSE_BUFFER_WORDS * 4;
+
+  stream_3_table = pc;
+  pc += 2 + STREAM_3_TABLE_SIZE;
+
+  // Padding to reach the requested dynamic memory size, written to during
+  // the undo part of the workload.
+  align(2);
+  padding = pc;
+  if ((long)pc < dynamic_memory_size)
+    pc = (size_t)dynamic_memory_size;
+  align(2);
+
+  if (pc > MAXIMUM_DYNAMIC_MEMORY_SIZE)
+    fail("dynamic memory exceeds 64 KB, reduce objects or properties.");
+  static_memory = pc;
+
+  // Dictionary, sorted since the words are generated in ascending order.
+  dictionary = pc;
+  emit_byte(3);
+  emit_byte('.');
+  emit_byte(',');
+  emit_byte('"');
+  emit_byte(DICTIONARY_ENTRY_SIZE);
+  emit_word((uint16_t)nof_words);
+  for (i=0; i<nof_words; i++)
+  {
+    get_dictionary_word(i, word);
+    emit_zstring(word, 9);
+    emit_byte(0);
+    emit_byte(0);
+    emit_byte(0);
+  }
+
+  if (pc > 0xfff0)
+    fail("dictionary exceeds 64 KB, reduce words or dynamic memory.");
+
+  // High memory: routines first, then strings.
+  align((size_t)packing_factor());
+  high_memory = pc;
+
+  main_label = new_label();
+  recurse_label = new_label();
+  strings_label = new_label();
+
+  // Recursive routine: "recurse(n) { if (n == 0) rtrue; recurse(n-1); }".
+  align((size_t)packing_factor());
+  place_label(recurse_label);
+  emit_byte(1);
+  emit_1op(0x00, variable(LOCAL_1)); // jz
+  emit_byte(0xc1); // rtrue on branch
+  emit_2op(0x15, variable(LOCAL_1), small(1)); // sub
+  emit_byte(LOCAL_1);
+  ops[0] = variable(LOCAL_1);
+  emit_call(recurse_label, ops, 1, GLOBAL_TEMP);
+  emit_0op(0x00); // rtrue
+  resolve_fixups();
+
+  align((size_t)packing_factor());
+  place_label(main_label);
+  emit_byte(0);
+
+  // Objects and properties.
+  loop = begin_loop(GLOBAL_COUNTER);
+  {
+    int object_loop = begin_loop(GLOBAL_INNER_COUNTER);
+
+    emit_2op(0x18, variable(GLOBAL_INNER_COUNTER),
+        small((uint8_t)nof_properties)); // mod
+    emit_byte(GLOBAL_TEMP);
+    emit_2op(0x14, variable(GLOBAL_TEMP), small(1)); // add
+    emit_byte(GLOBAL_TEMP);
+    emit_2op(0x11, variable(GLOBAL_INNER_COUNTER),
+        variable(GLOBAL_TEMP)); // get_prop
+    emit_byte(GLOBAL_TEMP2);
+    ops[0] = variable(GLOBAL_INNER_COUNTER);
+    ops[1] = variable(GLOBAL_TEMP);
+    ops[2] = variable(GLOBAL_TEMP2);
+    emit_var(0x03, ops, 3); // put_prop
+    emit_2op(0x12, variable(GLOBAL_INNER_COUNTER),
+        small((uint8_t)nof_properties)); // get_prop_addr
+    emit_byte(GLOBAL_TEMP2);
+    emit_2op(0x13, variable(GLOBAL_INNER_COUNTER), small(0)); // get_next_prop
+    emit_byte(GLOBAL_TEMP2);
+    emit_2op(0x0b, variable(GLOBAL_INNER_COUNTER),
+        small(TEST_ATTRIBUTE)); // set_attr
+    skip = new_label();
+    emit_2op(0x0a, variable(GLOBAL_INNER_COUNTER),
+        small(TEST_ATTRIBUTE)); // test_attr
+    emit_branch(skip, false);
+    emit_2op(0x0c, variable(GLOBAL_INNER_COUNTER),
+        small(TEST_ATTRIBUTE)); // clear_attr
+    place_label(skip);
+    emit_1op(0x03, variable(GLOBAL_INNER_COUNTER)); // get_parent
+    emit_byte(GLOBAL_TEMP);
+    skip = new_label();
+    emit_1op(0x00, variable(GLOBAL_TEMP)); // jz
+    emit_branch(skip, true);
+    emit_2op(0x0e, variable(GLOBAL_INNER_COUNTER),
+        variable(GLOBAL_TEMP)); // insert_obj
+    place_label(skip);
+
+    end_loop(object_loop, GLOBAL_INNER_COUNTER, (uint16_t)nof_objects);
+  }
+  end_loop(loop, GLOBAL_COUNTER, (uint16_t)iterations);
+  resolve_fixups();
+
+  // Tokenising. The last two letters of the sentence are varied in every
+  // iteration so that the results are not served from the tokenise cache.
+  loop = begin_loop(GLOBAL_COUNTER);
+  {
+    int tokenise_loop = begin_loop(GLOBAL_INNER_COUNTER);
+
+    emit_2op(0x18, variable(GLOBAL_INNER_COUNTER), small(26)); // mod
+    emit_byte(GLOBAL_TEMP);
+    emit_2op(0x14, variable(GLOBAL_TEMP), small('a')); // add
+    emit_byte(GLOBAL_TEMP);
+    ops[0] = large((uint16_t)text_buffer);
+    ops[1] = small((uint8_t)(story[text_buffer + 1] + 1));
+    ops[2] = variable(GLOBAL_TEMP);
+    emit_var(0x02, ops, 3); // storeb
+    emit_2op(0x17, variable(GLOBAL_INNER_COUNTER), small(26)); // div
+    emit_byte(GLOBAL_TEMP);
+    emit_2op(0x14, variable(GLOBAL_TEMP), small('a')); // add
+    emit_byte(GLOBAL_TEMP);
+    ops[0] = large((uint16_t)text_buffer);
+    ops[1] = small((uint8_t)story[text_buffer + 1]);
+    ops[2] = variable(GLOBAL_TEMP);
+    emit_var(0x02, ops, 3); // storeb
+
+    ops[0] = large((uint16_t)text_buffer);
+    ops[1] = large((uint16_t)parse_buffer);
+    emit_var(0x1b, ops, 2); // tokenise
+
+    end_loop(tokenise_loop, GLOBAL_INNER_COUNTER, 100);
+  }
+  end_loop(loop, GLOBAL_COUNTER, (uint16_t)iterations);
+  resolve_fixups();
+
+  // Recursion.
+  loop = begin_loop(GLOBAL_COUNTER);
+  ops[0] = large((uint16_t)recursion_depth);
+  emit_call(recurse_label, ops, 1, GLOBAL_TEMP);
+  end_loop(loop, GLOBAL_COUNTER, (uint16_t)iterations);
+  resolve_fixups();
+
+  // Undo: Modify the dynamic memory padding, then save the undo state.
+  loop = begin_loop(GLOBAL_COUNTER);
+  nof_padding_writes = (long)(static_memory - padding) / UNDO_PADDING_STRIDE;
+  if (nof_padding_writes > 0)
+  {
+    int padding_loop;
+
+    emit_2op(0x0d, small(GLOBAL_ADDRESS), large((uint16_t)padding)); // store
+    padding_loop = begin_loop(GLOBAL_INNER_COUNTER);
+    ops[0] = variable(GLOBAL_ADDRESS);
+    ops[1] = small(0);
+    ops[2] = variable(GLOBAL_COUNTER);
+    emit_var(0x01, ops, 3); // storew
+    emit_2op(0x14, variable(GLOBAL_ADDRESS),
+        large(UNDO_PADDING_STRIDE)); // add
+    emit_byte(GLOBAL_ADDRESS);
+    end_loop(padding_loop, GLOBAL_INNER_COUNTER, (uint16_t)nof_padding_writes);
+  }
+  emit_ext(0x09, NULL, 0); // save_undo
+  emit_byte(GLOBAL_TEMP);
+  end_loop(loop, GLOBAL_COUNTER, (uint16_t)iterations);
+  resolve_fixups();
+
+  // Stream 3.
+  loop = begin_loop(GLOBAL_COUNTER);
+  {
+    int stream_3_loop = begin_loop(GLOBAL_INNER_COUNTER);
+
+    ops[0] = small(3);
+    ops[1] = large((uint16_t)stream_3_table);
+    emit_var(0x13, ops, 2); // output_stream
+    emit_0op(0x02); // print
+    emit_zstring("the quick brown fox jumps over the lazy dog", 0);
+    ops[0] = large((uint16_t)-3);
+    emit_var(0x13, ops, 1); // output_stream
+    end_loop(stream_3_loop, GLOBAL_INNER_COUNTER, 100);
+  }
+  end_loop(loop, GLOBAL_COUNTER, (uint16_t)iterations);
+  resolve_fixups();
+
+  // Print all high memory strings into stream 3.
+  nof_strings = 0;
+  if (high_memory_size > 0)
+  {
+    nof_strings
+      = (high_memory_size - (long)(pc - high_memory))
+      / HIGH_MEMORY_STRING_LENGTH;
+    if (nof_strings < 1)
+      nof_strings = 1;
+  }
+
+  if (nof_strings > 0)
+  {
+    int string_loop;
+
+    loop = begin_loop(GLOBAL_COUNTER);
+    emit_2op(0x0d, small(GLOBAL_ADDRESS), large(0)); // store
+    add_fixup_at(pc - 2, strings_label, FIXUP_PACKED_ADDRESS);
+    string_loop = begin_loop(GLOBAL_INNER_COUNTER);
+    ops[0] = small(3);
+    ops[1] = large((uint16_t)stream_3_table);
+    emit_var(0x13, ops, 2); // output_stream
+    emit_1op(0x0d, variable(GLOBAL_ADDRESS)); // print_paddr
+    ops[0] = large((uint16_t)-3);
+    emit_var(0x13, ops, 1); // output_stream
+    emit_2op(0x14, variable(GLOBAL_ADDRESS),
+        small(HIGH_MEMORY_STRING_LENGTH / packing_factor())); // add
+    emit_byte(GLOBAL_ADDRESS);
+    end_loop(string_loop, GLOBAL_INNER_COUNTER, (uint16_t)nof_strings);
+    end_loop(loop, GLOBAL_COUNTER, (uint16_t)iterations);
+  }
+
+  // Done, ask for input and quit. The text buffer's length is reset
+  // first, since it would be treated as preloaded input otherwise.
+  ops[0] = large((uint16_t)text_buffer);
+  ops[1] = small(1);
+  ops[2] = small(0);
+  emit_var(0x02, ops, 3); // storeb
+  emit_0op(0x02); // print
+  emit_zstring("ready", 0);
+  emit_0op(0x0b); // new_line
+  ops[0] = large((uint16_t)text_buffer);
+  ops[1] = large((uint16_t)parse_buffer);
+  emit_var(0x04, ops, 2); // aread
+  emit_byte(GLOBAL_TEMP);
+  emit_0op(0x0a); // quit
+
+  // High memory strings of HIGH_MEMORY_STRING_LENGTH bytes each, which
+  // is a multiple of the packing factor.
+  align((size_t)packing_factor());
+  place_label(strings_label);
+  strings = pc;
+  for (i=0; i<nof_strings; i++)
+    emit_zstring("lorem ipsum dolor sit amet consectetur adipiscing elit sed"
+        " do eiusmod tempor incid", HIGH_MEMORY_STRING_LENGTH / 2 * 3);
+  if (pc - strings != (size_t)(nof_strings * HIGH_MEMORY_STRING_LENGTH))
+    fail("unexpected high memory string size.");
+  if ( (nof_strings > 0)
+      && ((strings + (nof_strings-1) * HIGH_MEMORY_STRING_LENGTH)
+        / packing_factor() > 0xffff) )
+    fail("high memory exceeds the addressable range.");
+  resolve_fixups();
+
+  // The length of the file has to be a multiple of the packing factor.
+  align((size_t)packing_factor());
+  story_size = pc;
+  if (story_size > (size_t)(version == 8 ? 512*1024 : 256*1024))
+    fail("story exceeds the maximum size for its version.");
+
+  story[0x00] = (uint8_t)version;
+  set_word(0x02, 1);
+  set_word(0x04, (uint16_t)high_memory);
+  set_word(0x06, (uint16_t)(labels[main_label] + 1));
+  set_word(0x08, (uint16_t)dictionary);
+  set_word(0x0a, (uint16_t)property_defaults);
+  set_word(0x0c, (uint16_t)globals);
+  set_word(0x0e, (uint16_t)static_memory);
+  memcpy(story + 0x12, "000000", 6);
+  set_word(0x18, (uint16_t)abbreviations);
+  set_word(0x1a, (uint16_t)(story_size / packing_factor()));
+  for (i=0x40; i<(long)story_size; i++)
+    checksum = (uint16_t)(checksum + story[i]);
+  set_word(0x1c, checksum);
+
+  if ((out = fopen(argv[optind], "wb")) == NULL)
+    fail("could not open output file.");
+  if (fwrite(story, 1, story_size, out) != story_size)
+    fail("could not write output file.");
+  fclose(out);
+
+  fprintf(stderr, "%s: %ld objects, %ld words, %ld bytes dynamic memory, "
+      "%ld bytes high memory.\n",
+      argv[optind],
+      nof_objects,
+      nof_words,
+      (long)static_memory,
+      (long)(story_size - high_memory));
+
+  free(property_tables);
+  free(story);
+
+  return EXIT_SUCCESS;
+}
+
+#endif /* storygen_c_INCLUDED */
+
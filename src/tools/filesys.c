@@ -34,7 +34,11 @@
 #define filesys_c_INCLUDED
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+#include "filesys.h"
 #include "filesys_c.h"
 
 
@@ -48,5 +52,203 @@ void fizmo_register_filesys_interface(
 }
 
 
+size_t fsi_readv(struct z_iovec *iov, int iovcnt, z_file *fileref)
+{
+  size_t result = 0;
+  size_t len;
+  int i;
+
+  if (fsi->readv != NULL)
+    return fsi->readv(iov, iovcnt, fileref);
+
+  for (i=0; i<iovcnt; i++)
+  {
+    len = fsi->readchars(iov[i].base, iov[i].len, fileref);
+    result += len;
+    if (len != iov[i].len)
+      break;
+  }
+
+  return result;
+}
+
+
+size_t fsi_writev(struct z_iovec *iov, int iovcnt, z_file *fileref)
+{
+  size_t result = 0;
+  size_t len;
+  int i;
+
+  if (fsi->writev != NULL)
+    return fsi->writev(iov, iovcnt, fileref);
+
+  for (i=0; i<iovcnt; i++)
+  {
+    len = fsi->writechars(iov[i].base, iov[i].len, fileref);
+    result += len;
+    if (len != iov[i].len)
+      break;
+  }
+
+  return result;
+}
+
+
+// Reads the complete file into a newly malloc()ed, zero-terminated buffer.
+// The file position is undefined afterwards.
+char *fsi_read_whole_file(z_file *fileref, size_t *length)
+{
+  char *result = NULL;
+  char *new_result;
+  size_t size = 0;
+  size_t buf_size = 0;
+  size_t len;
+
+  if (fsi->readfile != NULL)
+    return fsi->readfile(fileref, length);
+
+  if (fsi->setfilepos(fileref, 0, SEEK_SET) == -1)
+    return NULL;
+
+  do
+  {
+    if (size == buf_size)
+    {
+      buf_size += (buf_size == 0) ? 4096 : buf_size;
+      // Keep space for the terminating zero byte.
+      if ((new_result = realloc(result, buf_size + 1)) == NULL)
+      {
+        free(result);
+        return NULL;
+      }
+      result = new_result;
+    }
+
+    len = fsi->readchars(result + size, buf_size - size, fileref);
+    size += len;
+  }
+  while (len > 0);
+
+  result[size] = '\0';
+  *length = size;
+  return result;
+}
+
+
+// Buffers returned by "fsi_map_file" which were read using
+// "fsi_read_whole_file" instead of being mapped, so "fsi_unmap_file" knows
+// to free() them.
+struct fsi_read_buffer
+{
+  void *addr;
+  struct fsi_read_buffer *next;
+};
+
+static struct fsi_read_buffer *read_buffers = NULL;
+
+
+// Mapping is only used in case the interface provides both "mapfile" and
+// "unmapfile" and mapping succeeds, otherwise the file is read into a
+// malloc()ed buffer.
+void *fsi_map_file(z_file *fileref, size_t *length)
+{
+  struct fsi_read_buffer *read_buffer;
+  void *result;
+
+  if ( (fsi->mapfile != NULL) && (fsi->unmapfile != NULL) )
+  {
+    if ((result = fsi->mapfile(fileref, length)) != NULL)
+      return result;
+  }
+
+  if ((read_buffer = malloc(sizeof(struct fsi_read_buffer))) == NULL)
+    return NULL;
+
+  if ((result = fsi_read_whole_file(fileref, length)) == NULL)
+  {
+    free(read_buffer);
+    return NULL;
+  }
+
+  read_buffer->addr = result;
+  read_buffer->next = read_buffers;
+  read_buffers = read_buffer;
+
+  return result;
+}
+
+
+// Releases memory obtained from "fsi_map_file". Note that the filesys
+// interface must not be changed between mapping and unmapping.
+int fsi_unmap_file(void *addr, size_t length)
+{
+  struct fsi_read_buffer **read_buffer = &read_buffers;
+  struct fsi_read_buffer *next;
+
+  while (*read_buffer != NULL)
+  {
+    if ((*read_buffer)->addr == addr)
+    {
+      next = (*read_buffer)->next;
+      free(*read_buffer);
+      *read_buffer = next;
+      free(addr);
+      return 0;
+    }
+    read_buffer = &(*read_buffer)->next;
+  }
+
+  return fsi->unmapfile(addr, length);
+}
+
+
+// Returns -1 in case the interface doesn't provide "rename_file".
+int fsi_rename_file(char *old_filename, char *new_filename)
+{
+  if (fsi->rename_file == NULL)
+    return -1;
+
+  return fsi->rename_file(old_filename, new_filename);
+}
+
+
+// Returns -1 in case the interface doesn't provide "remove_file".
+int fsi_remove_file(char *filename)
+{
+  if (fsi->remove_file == NULL)
+    return -1;
+
+  return fsi->remove_file(filename);
+}
+
+
+// Opens a new file for writing which is meant to replace "filename" using
+// "fsi_rename_file" once it's complete. The name, stored in a newly
+// malloc()ed "tmp_filename", is unique among all processes, so concurrent
+// writers never share a temporary file. Since a counter is used for this,
+// this function must only be called from the interpreter's thread.
+// Returns NULL in case the file can't be opened.
+z_file *fsi_open_temp_file(char *filename, int filetype, char **tmp_filename)
+{
+  static unsigned long nof_temp_files = 0;
+  z_file *result;
+
+  if ((*tmp_filename = malloc(strlen(filename) + 48)) == NULL)
+    return NULL;
+
+  sprintf(*tmp_filename, "%s.%ld-%lu.tmp",
+      filename, (long)getpid(), nof_temp_files++);
+
+  if ((result = fsi->openfile(*tmp_filename, filetype, FILEACCESS_WRITE))
+      == NULL)
+  {
+    free(*tmp_filename);
+    *tmp_filename = NULL;
+  }
+
+  return result;
+}
+
+
 #endif /* filesys_c_INCLUDED */
 
@@ -43,5 +43,14 @@ extern struct z_filesys_interface *fsi;
 void fizmo_register_filesys_interface(
     struct z_filesys_interface *filesys_interface);
 
+size_t fsi_readv(struct z_iovec *iov, int iovcnt, z_file *fileref);
+size_t fsi_writev(struct z_iovec *iov, int iovcnt, z_file *fileref);
+char *fsi_read_whole_file(z_file *fileref, size_t *length);
+void *fsi_map_file(z_file *fileref, size_t *length);
+int fsi_unmap_file(void *addr, size_t length);
+int fsi_rename_file(char *old_filename, char *new_filename);
+int fsi_remove_file(char *filename);
+z_file *fsi_open_temp_file(char *filename, int filetype, char **tmp_filename);
+
 #endif /* filesys_h_INCLUDED */
 
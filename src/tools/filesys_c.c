@@ -41,6 +41,9 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#if !defined (__WIN32__)
+#include <sys/mman.h>
+#endif // !defined (__WIN32__)
 
 #include "filesys_c.h"
 #include "tracelog.h"
@@ -117,6 +120,114 @@ static size_t readchars_c(void *ptr, size_t len, z_file *fileref)
 }
 
 
+static size_t readv_c(struct z_iovec *iov, int iovcnt, z_file *fileref)
+{
+  size_t result = 0;
+  size_t len;
+  int i;
+
+  // Since the file is accessed via stdio, the descriptor-based readv()
+  // can't be used here without bypassing the stream's buffer.
+  for (i=0; i<iovcnt; i++)
+  {
+    len = fread(iov[i].base, 1, iov[i].len, (FILE*)fileref->file_object);
+    result += len;
+    if (len != iov[i].len)
+      break;
+  }
+
+  return result;
+}
+
+
+static char *readfile_c(z_file *fileref, size_t *length)
+{
+  FILE *in = (FILE*)fileref->file_object;
+  struct stat stat_buf;
+  char *result;
+  size_t len;
+
+  if (fstat(fileno(in), &stat_buf) != 0)
+    return NULL;
+
+  if ((result = malloc(stat_buf.st_size + 1)) == NULL)
+    return NULL;
+
+  if (fseek(in, 0, SEEK_SET) != 0)
+  {
+    free(result);
+    return NULL;
+  }
+
+  if ((len = fread(result, 1, stat_buf.st_size, in))
+      != (size_t)stat_buf.st_size)
+  {
+    TRACE_LOG("Read only %zu of %ld bytes.\n", len, (long)stat_buf.st_size);
+    free(result);
+    return NULL;
+  }
+
+  result[len] = '\0';
+  *length = len;
+  return result;
+}
+
+
+#if !defined (__WIN32__)
+static void *mapfile_c(z_file *fileref, size_t *length)
+{
+  struct stat stat_buf;
+  void *result;
+  int fd = fileno((FILE*)fileref->file_object);
+
+  if (fstat(fd, &stat_buf) != 0)
+    return NULL;
+
+  // mmap() doesn't accept a zero length, so use a heap buffer instead
+  // (which is also what unmapfile_c expects for empty files).
+  if (stat_buf.st_size == 0)
+  {
+    *length = 0;
+    return calloc(1, 1);
+  }
+
+  if ((result = mmap(NULL, stat_buf.st_size, PROT_READ | PROT_WRITE,
+          MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+  {
+    TRACE_LOG("mmap() failed for \"%s\".\n", fileref->filename);
+    return NULL;
+  }
+
+  *length = stat_buf.st_size;
+  return result;
+}
+
+
+static int unmapfile_c(void *addr, size_t length)
+{
+  if (length == 0)
+  {
+    free(addr);
+    return 0;
+  }
+
+  return munmap(addr, length);
+}
+#endif // !defined (__WIN32__)
+
+
+static int rename_file_c(char *old_filename, char *new_filename)
+{
+  return rename(old_filename, new_filename) == 0 ? 0 : -1;
+}
+
+
+static int remove_file_c(char *filename)
+{
+  return remove(filename) == 0 ? 0 : -1;
+}
+
+
 static int writechar_c(int ch, z_file *fileref)
 {
   return putc(ch, (FILE*)fileref->file_object);
@@ -129,6 +240,24 @@ static size_t writechars_c(void *ptr, size_t len, z_file *fileref)
 }
 
 
+static size_t writev_c(struct z_iovec *iov, int iovcnt, z_file *fileref)
+{
+  size_t result = 0;
+  size_t len;
+  int i;
+
+  for (i=0; i<iovcnt; i++)
+  {
+    len = fwrite(iov[i].base, 1, iov[i].len, (FILE*)fileref->file_object);
+    result += len;
+    if (len != iov[i].len)
+      break;
+  }
+
+  return result;
+}
+
+
 int writestring_c(char *s, z_file *fileref)
 {
   return writechars_c(s, strlen(s), fileref);
@@ -137,15 +266,17 @@ int writestring_c(char *s, z_file *fileref)
 
 int writeucsstring_c(z_ucs *s, z_file *fileref)
 {
-  char buf[128];
-  int len;
+  char buf[1024];
+  size_t len = z_ucs_len(s), chars_consumed, bytes_written;
   int res = 0;
 
   // FIMXE: Re-implement for various output charsets.
-  while (*s != 0)
+  while (len > 0)
   {
-    len = zucs_string_to_utf8_string(buf, &s, 128);
-    res += writechars_c(buf, len-1, fileref);
+    bytes_written = z_ucs_to_utf8(buf, sizeof(buf), s, len, &chars_consumed);
+    res += writechars_c(buf, bytes_written, fileref);
+    s += chars_consumed;
+    len -= chars_consumed;
   }
 
   return res;
@@ -340,7 +471,19 @@ struct z_filesys_interface z_filesys_interface_c =
   &close_dir_c,
   &read_dir_c,
   &make_dir_c,
-  &is_filename_directory_c
+  &is_filename_directory_c,
+  &readv_c,
+  &writev_c,
+  &readfile_c,
+#if !defined (__WIN32__)
+  &mapfile_c,
+  &unmapfile_c,
+#else
+  NULL,
+  NULL,
+#endif // !defined (__WIN32__)
+  &rename_file_c,
+  &remove_file_c
 };
 
 
@@ -68,8 +68,10 @@ static char *current_locale_name_in_utf8 = NULL;
 static char *default_locale_name_in_utf8 = NULL;
 static int (*stream_output_function)(z_ucs *output) = NULL;
 static void (*abort_function)(int exit_code, z_ucs *error_message) = NULL;
+static void (*memory_change_function)(void) = NULL;
 static char *locale_search_path = NULL;
 static stringmap *locale_modules = NULL; // indexed by locale_name
+static size_t allocated_locale_module_memory = 0;
 
 #ifdef I18N_DEFAULT_SEARCH_PATH
 char default_search_path[] = I18N_DEFAULT_SEARCH_PATH;
@@ -91,6 +93,15 @@ void register_i18n_abort_function(
 }
 
 
+// The given function is invoked every time a locale module is loaded or
+// deleted, see get_i18n_memory_size().
+void register_i18n_memory_change_function(
+    void (*new_memory_change_function)(void))
+{
+  memory_change_function = new_memory_change_function;
+}
+
+
 static int i18n_send_output(z_ucs *z_ucs_data, int output_mode,
     z_ucs **string_target)
 {
@@ -130,11 +141,11 @@ static int i18n_send_output(z_ucs *z_ucs_data, int output_mode,
 }
 
 
-static z_ucs input_char(z_file *in)
+static z_ucs input_char(char **src, char *end)
 {
   z_ucs input;
 
-  if ((input = parse_utf8_char_from_file(in)) == UEOF)
+  if ((input = parse_utf8_char_from_buffer(src, end)) == UEOF)
   {
     TRACE_LOG("Premature end of file.\n");
     exit(-1);
@@ -151,7 +162,8 @@ static locale_module *parse_locale_file(z_ucs *module_name,
   z_file *in;
   z_ucs *locale_data;
   locale_module *result;
-  int in_char;
+  char *file_data, *file_end, *src;
+  size_t file_length;
   long nof_zucs_chars;
   z_ucs input;
   z_ucs *linestart;
@@ -189,20 +201,26 @@ static locale_module *parse_locale_file(z_ucs *module_name,
     return NULL;
   }
 
-  nof_zucs_chars = 0;
-  while ((parse_utf8_char_from_file(in)) != UEOF)
-    nof_zucs_chars++;
-  nof_zucs_chars++; // Add space for terminating zero (yes, really required).
-
-  if (fsi->setfilepos(in, 0, SEEK_SET) == -1)
+  // open-resource:
+  if ((file_data = fsi_map_file(in, &file_length)) == NULL)
   {
     // exit-point:
-    TRACE_LOG("setfilepos() returned -1.\n");
+    TRACE_LOG("fsi_map_file() returned NULL.\n");
     fsi->closefile(in);
     free(filename);
     return NULL;
   }
 
+  // close-resource:
+  fsi->closefile(in);
+  file_end = file_data + file_length;
+
+  nof_zucs_chars = 0;
+  src = file_data;
+  while ((parse_utf8_char_from_buffer(&src, file_end)) != UEOF)
+    nof_zucs_chars++;
+  nof_zucs_chars++; // Add space for terminating zero (yes, really required).
+
   TRACE_LOG("Allocating space for %ld z_ucs chars.\n", nof_zucs_chars);
 
   // open-resource:
@@ -210,7 +228,7 @@ static locale_module *parse_locale_file(z_ucs *module_name,
   {
     // exit-point:
     TRACE_LOG("malloc(%ld) returned NULL.\n", nof_zucs_chars * sizeof(z_ucs));
-    fsi->closefile(in);
+    fsi_unmap_file(file_data, file_length);
     free(filename);
     return NULL;
   }
@@ -223,7 +241,7 @@ static locale_module *parse_locale_file(z_ucs *module_name,
   {
     // exit-point:
     free(locale_data);
-    fsi->closefile(in);
+    fsi_unmap_file(file_data, file_length);
     free(filename);
     return NULL;
   }
@@ -239,23 +257,22 @@ static locale_module *parse_locale_file(z_ucs *module_name,
   lines = create_list();
   //printf("new list created: %p\n", lines);
 
-  in_char = fsi->readchar(in);
-  while (in_char != EOF)
+  src = file_data;
+  while (src < file_end)
   {
     linestart = locale_data;
 
     // Found a new line.
-    fsi->unreadchar(in_char, in);
 
     for (;;)
     {
-      input = input_char(in);
+      input = input_char(&src, file_end);
 
       if (input == Z_UCS_BACKSLASH)
       {
         //*locale_data++ = input;
 
-        input = input_char(in);
+        input = input_char(&src, file_end);
 
         if (input == Z_UCS_BACKSLASH)
         {
@@ -270,7 +287,7 @@ static locale_module *parse_locale_file(z_ucs *module_name,
           *locale_data++ = Z_UCS_BACKSLASH;
           *locale_data++ = (z_ucs)'{';
 
-          input = input_char(in);
+          input = input_char(&src, file_end);
 
           if ((input < 0x30) && (input > 0x39))
           {
@@ -280,7 +297,7 @@ static locale_module *parse_locale_file(z_ucs *module_name,
 
           *locale_data++ = input;
 
-          input = input_char(in);
+          input = input_char(&src, file_end);
 
           if (
               (input != (z_ucs)'s')
@@ -298,7 +315,7 @@ static locale_module *parse_locale_file(z_ucs *module_name,
 
           *locale_data++ = input;
 
-          input = input_char(in);
+          input = input_char(&src, file_end);
 
           if (input != (z_ucs)'}')
           {
@@ -332,7 +349,6 @@ static locale_module *parse_locale_file(z_ucs *module_name,
     }
 
     //messages_processed++;
-    in_char = fsi->readchar(in);
   }
 
   *locale_data = 0;
@@ -357,15 +373,24 @@ static locale_module *parse_locale_file(z_ucs *module_name,
     free(result->messages);
     free(result);
     free(locale_data);
-    fsi->closefile(in);
+    fsi_unmap_file(file_data, file_length);
     free(filename);
     return NULL;
   }
 
   z_ucs_cpy(result->module_name, module_name);
 
+  result->allocated_size
+    = sizeof(locale_module)
+    + nof_zucs_chars * sizeof(z_ucs)
+    + result->nof_messages * sizeof(z_ucs*)
+    + (z_ucs_len(module_name) + 1) * sizeof(z_ucs);
+  allocated_locale_module_memory += result->allocated_size;
+  if (memory_change_function != NULL)
+    memory_change_function();
+
   // close-resource:
-  fsi->closefile(in);
+  fsi_unmap_file(file_data, file_length);
 
   // close-resource:
   free(filename);
@@ -380,10 +405,15 @@ static void delete_locale_module(locale_module *module)
 {
   TRACE_LOG("Deleting locale module at %p.\n", module);
 
+  allocated_locale_module_memory -= module->allocated_size;
+
   free(module->messages);
   free(module->locale_data);
   free(module->module_name);
   free(module);
+
+  if (memory_change_function != NULL)
+    memory_change_function();
 }
 
 
@@ -1455,6 +1485,12 @@ char *get_i18n_default_search_path(void)
 }
 
 
+size_t get_i18n_memory_size()
+{
+  return allocated_locale_module_memory;
+}
+
+
 void free_i18n_memory(void)
 {
   z_ucs **locale_names, **locale_name;
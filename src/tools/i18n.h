@@ -50,6 +50,7 @@ typedef struct
   z_ucs *module_name;
   z_ucs **messages;
   int nof_messages;
+  size_t allocated_size;
 } locale_module;
 
 
@@ -57,6 +58,8 @@ void register_i18n_stream_output_function(
     int (*new_stream_output_function)(z_ucs *output));
 void register_i18n_abort_function(
     void (*new_abort_function)(int exit_code, z_ucs *error_message));
+void register_i18n_memory_change_function(
+    void (*new_memory_change_function)(void));
 size_t _i18n_va_translate(z_ucs *module_name, int string_code, va_list ap);
 size_t i18n_translate(z_ucs *module_name, int string_code, ...);
 void i18n_translate_and_exit(z_ucs *module_name, int string_code,
@@ -72,6 +75,7 @@ char *get_current_locale_name_in_utf8();
 int set_current_locale_name(char *new_locale_name);
 char **get_available_locale_names();
 char *get_i18n_default_search_path(void);
+size_t get_i18n_memory_size();
 void free_i18n_memory();
 
 #endif /* i18n_h_INCLUDED */
@@ -0,0 +1,170 @@
+
+/* lzss.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2010-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef lzss_c_INCLUDED 
+#define lzss_c_INCLUDED
+
+#include <string.h>
+
+#include "lzss.h"
+
+#define LZSS_WINDOW_SIZE 4096
+#define LZSS_MIN_MATCH 3
+#define LZSS_MAX_MATCH (LZSS_MIN_MATCH + 15)
+#define LZSS_HASH_BITS 12
+#define LZSS_HASH_SIZE (1 << LZSS_HASH_BITS)
+
+
+static unsigned lzss_hash(uint8_t *ptr)
+{
+  return ((ptr[0] << 8) ^ (ptr[1] << 4) ^ ptr[2]) & (LZSS_HASH_SIZE - 1);
+}
+
+
+// Compresses src_len bytes from src into dst, which must provide at least
+// LZSS_MAX_COMPRESSED_SIZE(src_len) bytes. Returns the compressed size.
+// Only the most recent position for each hash value is tried, which is
+// a lot faster than a full search and good enough for text.
+size_t lzss_compress(uint8_t *src, size_t src_len, uint8_t *dst)
+{
+  // Positions are stored +1 so that 0 marks an unused slot.
+  size_t last_pos[LZSS_HASH_SIZE];
+  size_t pos = 0, candidate, match_len, max_len, offset;
+  uint8_t *flag_ptr = dst;
+  uint8_t *out = dst + 1;
+  int flag_bit = 0;
+  unsigned hash;
+
+  memset(last_pos, 0, sizeof(last_pos));
+  *flag_ptr = 0;
+
+  while (pos < src_len)
+  {
+    if (flag_bit == 8)
+    {
+      flag_ptr = out++;
+      *flag_ptr = 0;
+      flag_bit = 0;
+    }
+
+    match_len = 0;
+
+    if (pos + LZSS_MIN_MATCH <= src_len)
+    {
+      hash = lzss_hash(src + pos);
+      candidate = last_pos[hash];
+      last_pos[hash] = pos + 1;
+
+      if ( (candidate != 0) && (pos - (candidate - 1) <= LZSS_WINDOW_SIZE) )
+      {
+        candidate--;
+        max_len = src_len - pos;
+        if (max_len > LZSS_MAX_MATCH)
+          max_len = LZSS_MAX_MATCH;
+
+        while ( (match_len < max_len)
+            && (src[candidate + match_len] == src[pos + match_len]) )
+          match_len++;
+      }
+    }
+
+    if (match_len >= LZSS_MIN_MATCH)
+    {
+      offset = pos - candidate - 1;
+      *flag_ptr |= (1 << flag_bit);
+      *out++ = (uint8_t)(offset >> 4);
+      *out++ = (uint8_t)(((offset & 0x0f) << 4) | (match_len - LZSS_MIN_MATCH));
+      pos += match_len;
+    }
+    else
+      *out++ = src[pos++];
+
+    flag_bit++;
+  }
+
+  return out - dst;
+}
+
+
+// Returns the number of bytes written to dst or -1 in case the compressed
+// data is invalid or doesn't fit into dst_size bytes.
+long lzss_decompress(uint8_t *src, size_t src_len, uint8_t *dst,
+    size_t dst_size)
+{
+  uint8_t *src_end = src + src_len;
+  size_t pos = 0, offset, match_len;
+  uint8_t flags = 0;
+  int flag_bit = 8;
+
+  while (src < src_end)
+  {
+    if (flag_bit == 8)
+    {
+      flags = *src++;
+      flag_bit = 0;
+      continue;
+    }
+
+    if ((flags & (1 << flag_bit)) != 0)
+    {
+      if (src + 2 > src_end)
+        return -1;
+
+      offset = (src[0] << 4) | (src[1] >> 4);
+      match_len = (src[1] & 0x0f) + LZSS_MIN_MATCH;
+      src += 2;
+
+      if ( (offset + 1 > pos) || (pos + match_len > dst_size) )
+        return -1;
+
+      // Source and destination may overlap, so copy bytewise.
+      while (match_len-- > 0)
+      {
+        dst[pos] = dst[pos - offset - 1];
+        pos++;
+      }
+    }
+    else
+    {
+      if (pos == dst_size)
+        return -1;
+      dst[pos++] = *src++;
+    }
+
+    flag_bit++;
+  }
+
+  return pos;
+}
+
+#endif /* lzss_c_INCLUDED */
+
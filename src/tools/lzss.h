@@ -0,0 +1,58 @@
+
+/* lzss.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2010-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * A small LZSS codec used to compress data such as the output history
+ * stored in savegames. Matches are encoded as a 12-bit offset into the
+ * last 4096 bytes and a 4-bit length of 3 to 18 bytes, each group of eight
+ * literals or matches is preceded by a flag byte.
+ *
+ */
+
+
+#ifndef lzss_h_INCLUDED 
+#define lzss_h_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Worst case size of compressed data for "len" input bytes.
+#define LZSS_MAX_COMPRESSED_SIZE(len) ((len) + (len) / 8 + 1)
+
+// Largest possible size of "len" bytes of compressed data after
+// decompression: Every two bytes may expand to a match of 18 bytes.
+#define LZSS_MAX_DECOMPRESSED_SIZE(len) ((len) * 9)
+
+size_t lzss_compress(uint8_t *src, size_t src_len, uint8_t *dst);
+long lzss_decompress(uint8_t *src, size_t src_len, uint8_t *dst,
+    size_t dst_size);
+
+#endif /* lzss_h_INCLUDED */
+
@@ -0,0 +1,386 @@
+
+/* screvent.c
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2010-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef screvent_c_INCLUDED
+#define screvent_c_INCLUDED
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "screvent.h"
+#include "z_ucs.h"
+
+
+uint8_t *write_screen_event_varint(uint8_t *dst, uint32_t value)
+{
+  while (value >= 0x80)
+  {
+    *(dst++) = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  *(dst++) = (uint8_t)value;
+
+  return dst;
+}
+
+
+uint8_t *write_screen_event_signed(uint8_t *dst, int32_t value)
+{
+  return write_screen_event_varint(
+      dst,
+      value < 0
+      ? ~((uint32_t)value << 1)
+      : (uint32_t)value << 1);
+}
+
+
+SCREEN_EVENT_DECODER *create_screen_event_decoder(void)
+{
+  SCREEN_EVENT_DECODER *result;
+
+  if ((result = malloc(sizeof(SCREEN_EVENT_DECODER))) == NULL)
+    return NULL;
+
+  result->cursor_line = 0;
+  result->cursor_column = 0;
+  result->text_buffer = NULL;
+  result->text_buffer_size = 0;
+  result->runs = NULL;
+  result->runs_size = 0;
+
+  return result;
+}
+
+
+void destroy_screen_event_decoder(SCREEN_EVENT_DECODER *decoder)
+{
+  free(decoder->text_buffer);
+  free(decoder->runs);
+  free(decoder);
+}
+
+
+// The read functions below return 1 on success, 0 in case the data ends
+// before the value is complete and -1 for malformed data.
+
+static int read_varint(uint8_t **src, uint8_t *end, uint32_t *result)
+{
+  uint8_t *ptr = *src;
+  uint32_t value = 0;
+  int shift = 0;
+
+  do
+  {
+    if (ptr == end)
+      return 0;
+
+    if (shift == 7 * SCREEN_EVENT_MAX_VARINT_SIZE)
+      return -1;
+
+    value |= (uint32_t)(*ptr & 0x7f) << shift;
+    shift += 7;
+  }
+  while ((*(ptr++) & 0x80) != 0);
+
+  *src = ptr;
+  *result = value;
+
+  return 1;
+}
+
+
+static int read_signed_values(uint8_t **src, uint8_t *end, int32_t *result,
+    int nof_values)
+{
+  uint32_t value;
+  int i, return_code;
+
+  for (i=0; i<nof_values; i++)
+  {
+    if ((return_code = read_varint(src, end, &value)) != 1)
+      return return_code;
+
+    result[i] = (value & 1) != 0
+      ? (int32_t)~(value >> 1)
+      : (int32_t)(value >> 1);
+  }
+
+  return 1;
+}
+
+
+// Decodes a text operand into the decoder's text buffer at *text_index,
+// which is advanced behind the text's terminator. Since the buffer may
+// move while further text is decoded, pointers into it are only set up
+// once the whole event has been read.
+static int read_text(SCREEN_EVENT_DECODER *decoder, uint8_t **src,
+    uint8_t *end, size_t *text_index, size_t *text_len)
+{
+  uint32_t nof_bytes;
+  size_t bytes_consumed, required_size;
+  z_ucs *new_buffer;
+  int return_code;
+
+  if ((return_code = read_varint(src, end, &nof_bytes)) != 1)
+    return return_code;
+
+  if ((size_t)(end - *src) < nof_bytes)
+    return 0;
+
+  // UTF-8 never decodes to more characters than it has bytes.
+  required_size = *text_index + nof_bytes + 1;
+  if (required_size > decoder->text_buffer_size)
+  {
+    if ((new_buffer = realloc(
+            decoder->text_buffer, required_size * sizeof(z_ucs))) == NULL)
+      return -1;
+
+    decoder->text_buffer = new_buffer;
+    decoder->text_buffer_size = required_size;
+  }
+
+  *text_len = utf8_to_z_ucs(
+      decoder->text_buffer + *text_index,
+      nof_bytes,
+      (char*)*src,
+      nof_bytes,
+      &bytes_consumed);
+
+  if (bytes_consumed < nof_bytes)
+    decoder->text_buffer[*text_index + (*text_len)++]
+      = Z_UCS_REPLACEMENT_CHAR;
+
+  decoder->text_buffer[*text_index + *text_len] = 0;
+  *text_index += *text_len + 1;
+  *src += nof_bytes;
+
+  return 1;
+}
+
+
+static int read_runs(SCREEN_EVENT_DECODER *decoder, uint8_t **src,
+    uint8_t *end, struct screen_event *event)
+{
+  uint32_t width, height, nof_runs, skip, flags, i;
+  int32_t attributes[4] = { 0, 0, 0, 0 };
+  struct screen_event_run *run, *new_runs;
+  size_t position = 0, text_index = 0, text_len;
+  int return_code, attribute_index;
+
+  if (
+      ((return_code = read_varint(src, end, &width)) != 1)
+      ||
+      ((return_code = read_varint(src, end, &height)) != 1)
+      ||
+      ((return_code = read_varint(src, end, &nof_runs)) != 1)
+     )
+    return return_code;
+
+  if ( (width > 0xffff) || (height > 0xffff) )
+    return -1;
+
+  // Every run takes at least three bytes, so with more runs than bytes
+  // left the event can't be complete.
+  if (nof_runs > (size_t)(end - *src))
+    return 0;
+
+  if (nof_runs > decoder->runs_size)
+  {
+    if ((new_runs = realloc(decoder->runs,
+            nof_runs * sizeof(struct screen_event_run))) == NULL)
+      return -1;
+
+    decoder->runs = new_runs;
+    decoder->runs_size = nof_runs;
+  }
+
+  for (i=0; i<nof_runs; i++)
+  {
+    run = decoder->runs + i;
+
+    if (
+        ((return_code = read_varint(src, end, &skip)) != 1)
+        ||
+        ((return_code = read_varint(src, end, &flags)) != 1)
+       )
+      return return_code;
+
+    for (attribute_index=0; attribute_index<4; attribute_index++)
+      if ((flags & (1 << attribute_index)) != 0)
+        if ((return_code = read_signed_values(
+                src, end, attributes + attribute_index, 1)) != 1)
+          return return_code;
+
+    if ((return_code = read_text(
+            decoder, src, end, &text_index, &text_len)) != 1)
+      return return_code;
+
+    position += skip;
+    run->row = (int)(position / (width > 0 ? width : 1));
+    run->column = (int)(position % (width > 0 ? width : 1));
+    run->style = (z_style)attributes[0];
+    run->font = (z_font)attributes[1];
+    run->foreground_colour = (z_colour)attributes[2];
+    run->background_colour = (z_colour)attributes[3];
+    run->len = text_len;
+
+    if (
+        ((uint32_t)run->row >= height)
+        ||
+        (run->column + text_len > width)
+       )
+      return -1;
+
+    position += text_len;
+  }
+
+  event->parameter[0] = (int32_t)width;
+  event->parameter[1] = (int32_t)height;
+  event->nof_runs = nof_runs;
+  event->runs = decoder->runs;
+
+  return 1;
+}
+
+
+// Decodes the event at the start of "data" into "event". Returns the
+// number of bytes the event occupies, 0 if "data" doesn't hold a complete
+// event yet and -1 for malformed data or in case memory ran out.
+long decode_screen_event(SCREEN_EVENT_DECODER *decoder, uint8_t *data,
+    size_t len, struct screen_event *event)
+{
+  uint8_t *ptr = data, *end = data + len;
+  size_t text_index = 0, i;
+  uint32_t value;
+  int32_t values[3];
+  int64_t line, column;
+  int return_code;
+
+  if (len == 0)
+    return 0;
+
+  event->type = *(ptr++);
+  event->text = NULL;
+  event->text_len = 0;
+  event->runs = NULL;
+  event->nof_runs = 0;
+
+  switch (event->type)
+  {
+    case SCREEN_EVENT_TEXT:
+    case SCREEN_EVENT_CLOSE:
+      return_code = read_text(
+          decoder, &ptr, end, &text_index, &event->text_len);
+      break;
+
+    case SCREEN_EVENT_STYLE:
+    case SCREEN_EVENT_ERASE_LINE:
+    case SCREEN_EVENT_BUFFER_MODE:
+      if ((return_code = read_varint(&ptr, end, &value)) == 1)
+        event->parameter[0] = (int32_t)value;
+      break;
+
+    case SCREEN_EVENT_FONT:
+    case SCREEN_EVENT_SPLIT_WINDOW:
+    case SCREEN_EVENT_SET_WINDOW:
+    case SCREEN_EVENT_ERASE_WINDOW:
+      return_code = read_signed_values(&ptr, end, event->parameter, 1);
+      break;
+
+    case SCREEN_EVENT_COLOUR:
+      return_code = read_signed_values(&ptr, end, event->parameter, 3);
+      break;
+
+    case SCREEN_EVENT_CURSOR:
+      if ((return_code = read_signed_values(&ptr, end, values, 3)) == 1)
+      {
+        // Positions are relative to the last cursor event; a malformed
+        // stream must not be able to drive them out of the int16 range
+        // the interpreter uses.
+        line = (int64_t)decoder->cursor_line + values[0];
+        column = (int64_t)decoder->cursor_column + values[1];
+        if (
+            (line < INT16_MIN)
+            ||
+            (line > INT16_MAX)
+            ||
+            (column < INT16_MIN)
+            ||
+            (column > INT16_MAX)
+           )
+          return -1;
+        decoder->cursor_line = (int32_t)line;
+        decoder->cursor_column = (int32_t)column;
+        event->parameter[0] = decoder->cursor_line;
+        event->parameter[1] = decoder->cursor_column;
+        event->parameter[2] = values[2];
+      }
+      break;
+
+    case SCREEN_EVENT_STATUS:
+      if ((return_code = read_text(
+              decoder, &ptr, end, &text_index, &event->text_len)) == 1)
+        return_code = read_signed_values(&ptr, end, event->parameter, 3);
+      break;
+
+    case SCREEN_EVENT_UPPER_WINDOW:
+      return_code = read_runs(decoder, &ptr, end, event);
+      break;
+
+    case SCREEN_EVENT_RESTORED:
+      return_code = 1;
+      break;
+
+    default:
+      return -1;
+  }
+
+  if (return_code != 1)
+    return return_code;
+
+  if (event->runs != NULL)
+  {
+    text_index = 0;
+    for (i=0; i<event->nof_runs; i++)
+    {
+      event->runs[i].text = decoder->text_buffer + text_index;
+      text_index += event->runs[i].len + 1;
+    }
+  }
+  else if (text_index > 0)
+    event->text = decoder->text_buffer;
+
+  return (long)(ptr - data);
+}
+
+#endif /* screvent_c_INCLUDED */
+
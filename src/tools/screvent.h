@@ -0,0 +1,163 @@
+
+/* screvent.h
+ *
+ * This file is part of fizmo.
+ *
+ * Copyright (c) 2010-2017 Christoph Ender.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * Screen interface calls encoded as a compact binary event stream, as
+ * written by the event interface in src/interpreter/screvenc.c for remote
+ * front-ends, and a decoder for it.
+ *
+ * Every event is an opcode byte followed by its operands. Unsigned
+ * numbers are LEB128 varints -- seven bits per byte, least significant
+ * group first, the high bit set on all but the last byte. Signed numbers
+ * are zigzag-mapped (0, -1, 1, -2, ... to 0, 1, 2, 3, ...) before. Text is
+ * a varint byte count followed by UTF-8.
+ *
+ *   TEXT          text
+ *   STYLE         style
+ *   COLOUR        signed foreground, signed background, signed window
+ *   FONT          signed font
+ *   CURSOR        signed line delta, signed column delta, signed window
+ *   SPLIT_WINDOW  signed number of lines
+ *   SET_WINDOW    signed window
+ *   ERASE_WINDOW  signed window
+ *   ERASE_LINE    start position
+ *   BUFFER_MODE   mode
+ *   STATUS        text, signed mode, signed parameter 1, signed parameter 2
+ *   UPPER_WINDOW  width, height, number of runs, runs
+ *   RESTORED      -
+ *   CLOSE         text, empty for a regular quit
+ *
+ * CURSOR positions are relative to the previous CURSOR event, the first
+ * one is relative to line 0, column 0.
+ *
+ * UPPER_WINDOW carries the cells of the upper window which have changed
+ * since the previous UPPER_WINDOW event. Changed cells are grouped into
+ * runs of adjacent cells in the same row with equal attributes. A run
+ * consists of the number of cells skipped since the end of the previous
+ * run, counted row by row from the top left cell, a flag byte telling
+ * which attributes differ from the previous run's -- SCREEN_EVENT_RUN_*
+ * -- followed by these attributes in flag order, all signed, and the
+ * run's text, which has one character per cell. For the first run of an
+ * event, all attributes are taken to be zero before. The receiver keeps
+ * the upper window's cells as sent: SPLIT_WINDOW only changes how many of
+ * its lines are visible, ERASE_WINDOW for windows 1, -1 and -2 resets all
+ * cells to spaces.
+ *
+ */
+
+
+#ifndef screvent_h_INCLUDED 
+#define screvent_h_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "types.h"
+
+#define SCREEN_EVENT_TEXT 0x01
+#define SCREEN_EVENT_STYLE 0x02
+#define SCREEN_EVENT_COLOUR 0x03
+#define SCREEN_EVENT_FONT 0x04
+#define SCREEN_EVENT_CURSOR 0x05
+#define SCREEN_EVENT_SPLIT_WINDOW 0x06
+#define SCREEN_EVENT_SET_WINDOW 0x07
+#define SCREEN_EVENT_ERASE_WINDOW 0x08
+#define SCREEN_EVENT_ERASE_LINE 0x09
+#define SCREEN_EVENT_BUFFER_MODE 0x0a
+#define SCREEN_EVENT_STATUS 0x0b
+#define SCREEN_EVENT_UPPER_WINDOW 0x0c
+#define SCREEN_EVENT_RESTORED 0x0d
+#define SCREEN_EVENT_CLOSE 0x0e
+
+#define SCREEN_EVENT_RUN_STYLE 0x01
+#define SCREEN_EVENT_RUN_FONT 0x02
+#define SCREEN_EVENT_RUN_FOREGROUND 0x04
+#define SCREEN_EVENT_RUN_BACKGROUND 0x08
+
+// Maximum number of bytes a varint may occupy.
+#define SCREEN_EVENT_MAX_VARINT_SIZE 5
+
+
+struct screen_event_run
+{
+  int row;
+  int column;
+  z_style style;
+  z_font font;
+  z_colour foreground_colour;
+  z_colour background_colour;
+  z_ucs *text;
+  size_t len;
+};
+
+
+// The meaning of "parameter" depends on the event type:
+//
+//   STYLE, FONT, SPLIT_WINDOW, SET_WINDOW, ERASE_WINDOW, ERASE_LINE and
+//   BUFFER_MODE: parameter[0] holds the single operand.
+//   COLOUR: foreground, background, window.
+//   CURSOR: line, column, window. Line and column are absolute.
+//   STATUS: mode, parameter 1, parameter 2.
+//   UPPER_WINDOW: width, height.
+//
+// "text" is set for TEXT, STATUS and CLOSE, "runs" for UPPER_WINDOW. Both
+// are owned by the decoder and remain valid until the next event is
+// decoded.
+struct screen_event
+{
+  int type;
+  int32_t parameter[3];
+  z_ucs *text;
+  size_t text_len;
+  struct screen_event_run *runs;
+  size_t nof_runs;
+};
+
+
+typedef struct
+{
+  int32_t cursor_line;
+  int32_t cursor_column;
+  z_ucs *text_buffer;
+  size_t text_buffer_size;
+  struct screen_event_run *runs;
+  size_t runs_size;
+} SCREEN_EVENT_DECODER;
+
+
+uint8_t *write_screen_event_varint(uint8_t *dst, uint32_t value);
+uint8_t *write_screen_event_signed(uint8_t *dst, int32_t value);
+SCREEN_EVENT_DECODER *create_screen_event_decoder(void);
+void destroy_screen_event_decoder(SCREEN_EVENT_DECODER *decoder);
+long decode_screen_event(SCREEN_EVENT_DECODER *decoder, uint8_t *data,
+    size_t len, struct screen_event *event);
+
+#endif /* screvent_h_INCLUDED */
+
@@ -33,40 +33,98 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
 
 #include "z_ucs.h"
 #include "types.h"
 #include "filesys.h"
 
+#ifdef __SSE2__
+// Unaligned loads are only used where they can't reach into the next page.
+#define Z_UCS_PAGE_SIZE 4096
+#endif // __SSE2__
 
-size_t z_ucs_len(z_ucs *string)
-{
-  z_ucs *start_index = string;
 
-  if (string == NULL)
-    return 0;
+#ifdef __SSE2__
+// Returns the first position in "string" holding either the terminating
+// zero or "chr". As soon as the pointer is aligned to 16 bytes four
+// characters are examined at once. An aligned load never crosses a page
+// boundary, so looking at the characters behind the terminator inside the
+// final block is safe.
+static z_ucs *find_chr_or_end(z_ucs *string, z_ucs chr)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i needle = _mm_set1_epi32((int)chr);
+  __m128i block;
 
-  while (*string != 0)
+  // In case the string is not aligned to sizeof(z_ucs) this loop simply
+  // runs until the terminator is found.
+  while (((uintptr_t)string & 15) != 0)
   {
+    if ( (*string == 0) || (*string == chr) )
+      return string;
     string++;
   }
 
-  return (size_t)(string - start_index);
+  for (;;)
+  {
+    block = _mm_load_si128((__m128i*)string);
+
+    if (_mm_movemask_epi8(_mm_or_si128(
+            _mm_cmpeq_epi32(block, zero),
+            _mm_cmpeq_epi32(block, needle))) != 0)
+      break;
+
+    string += 4;
+  }
+
+  while ( (*string != 0) && (*string != chr) )
+    string++;
+
+  return string;
+}
+#else
+static z_ucs *find_chr_or_end(z_ucs *string, z_ucs chr)
+{
+  while ( (*string != 0) && (*string != chr) )
+    string++;
+
+  return string;
+}
+#endif // __SSE2__
+
+
+size_t z_ucs_len(z_ucs *string)
+{
+  if (string == NULL)
+    return 0;
+
+  return (size_t)(find_chr_or_end(string, 0) - string);
 }
 
 
 z_ucs *z_ucs_cpy(z_ucs *dst, z_ucs *src)
 {
-  while (*src != 0)
-  {
-    *dst = *src;
-    dst++;
-    src++;
-  }
+  size_t len = z_ucs_len(src);
 
-  *dst = 0;
+  memmove(dst, src, (len + 1) * sizeof(z_ucs));
 
-  return dst;
+  return dst + len;
+}
+
+
+z_ucs_view z_ucs_view_of(z_ucs *string)
+{
+  z_ucs_view result;
+
+  result.ptr = string;
+  result.len = z_ucs_len(string);
+
+  return result;
 }
 
 
@@ -79,6 +137,35 @@ void z_ucs_ncpy(z_ucs *dst, z_ucs *src, size_t len)
 // Returns > 0 in case s1 > s2, 0 if equal and < 0 otherwise.
 int z_ucs_cmp(z_ucs *s1, z_ucs *s2)
 {
+#ifdef __SSE2__
+  __m128i zero = _mm_setzero_si128();
+  __m128i block1, block2;
+
+  // Both strings are compared four characters at a time using unaligned
+  // loads, as long as neither load could touch the following page. Once a
+  // difference or a terminator is found, the scalar loop below determines
+  // the result.
+  while (
+      (((uintptr_t)s1 & (Z_UCS_PAGE_SIZE - 1)) <= Z_UCS_PAGE_SIZE - 16)
+      &&
+      (((uintptr_t)s2 & (Z_UCS_PAGE_SIZE - 1)) <= Z_UCS_PAGE_SIZE - 16)
+      )
+  {
+    block1 = _mm_loadu_si128((__m128i*)s1);
+    block2 = _mm_loadu_si128((__m128i*)s2);
+
+    if (
+        (_mm_movemask_epi8(_mm_cmpeq_epi32(block1, block2)) != 0xffff)
+        ||
+        (_mm_movemask_epi8(_mm_cmpeq_epi32(block1, zero)) != 0)
+       )
+      break;
+
+    s1 += 4;
+    s2 += 4;
+  }
+#endif // __SSE2__
+
   while ( (*s1 != 0) || (*s2 != 0) )
   {
     if (*s1 != *s2)
@@ -94,15 +181,9 @@ int z_ucs_cmp(z_ucs *s1, z_ucs *s2)
 
 z_ucs *z_ucs_chr(z_ucs *s1, z_ucs chr)
 {
-  while (*s1 != 0)
-  {
-    if (*s1 == chr)
-      return s1;
+  s1 = find_chr_or_end(s1, chr);
 
-    s1++;
-  }
-
-  return NULL;
+  return *s1 != 0 ? s1 : NULL;
 }
 
 
@@ -156,24 +237,19 @@ z_ucs *z_ucs_rchrs(z_ucs *s1, z_ucs *chars)
 
 z_ucs *z_ucs_cat(z_ucs *dst, z_ucs *src)
 {
-  dst += z_ucs_len(dst);
-
-  while (*src != 0)
-    *(dst++) = *(src++);
-  *dst = 0;
-
-  return dst;
+  return z_ucs_cpy(dst + z_ucs_len(dst), src);
 }
 
 
 z_ucs *z_ucs_dup(z_ucs *src)
 {
   z_ucs *result;
+  size_t len = z_ucs_len(src);
 
-  if ((result = malloc(sizeof(z_ucs) * (z_ucs_len(src) + 1))) == NULL)
+  if ((result = malloc(sizeof(z_ucs) * (len + 1))) == NULL)
     return NULL;
 
-  z_ucs_cpy(result, src);
+  memcpy(result, src, sizeof(z_ucs) * (len + 1));
 
   return result;
 }
@@ -331,6 +407,59 @@ z_ucs parse_utf8_char_from_file(z_file *in)
 }
 
 
+// Works like parse_utf8_char_from_file, but reads from the buffer at *src
+// which ends at "end". This allows files read via fsi_map_file or
+// fsi_read_whole_file to be parsed without a function call per byte.
+z_ucs parse_utf8_char_from_buffer(char **src, char *end)
+{
+  // FIXME: Fail on overlong UTF-8 characters.
+  uint8_t *ptr = (uint8_t*)*src;
+  uint8_t current_char;
+  int len;
+  z_ucs result;
+
+  if (ptr >= (uint8_t*)end)
+    return UEOF;
+
+  current_char = *ptr++;
+
+  if ((current_char & 0x80) == 0)
+  {
+    *src = (char*)ptr;
+    return (z_ucs)current_char;
+  }
+
+  // Determine sequence length from the number of leading one bits.
+  for (len=2; len<=6; len++)
+    if ((current_char & (0xff << (7 - len)) & 0xff)
+        == ((0xff << (8 - len)) & 0xff))
+      break;
+
+  if (len > 6)
+  {
+    *src = (char*)ptr;
+    return UEOF;
+  }
+
+  result = (z_ucs)(current_char & (0xff >> (len + 1)));
+
+  while (--len > 0)
+  {
+    if (ptr >= (uint8_t*)end)
+    {
+      *src = (char*)ptr;
+      return UEOF;
+    }
+
+    result <<= 6;
+    result |= (*ptr++ & 0x3f);
+  }
+
+  *src = (char*)ptr;
+  return result;
+}
+
+
 z_ucs utf8_char_to_zucs_char(char **src)
 {
   // FIXME: Fail on overlong UTF-8 characters.
@@ -391,171 +520,343 @@ z_ucs utf8_char_to_zucs_char(char **src)
 }
 
 
-char *utf8_string_to_zucs_string(z_ucs *dest, char *src, int max_dest_size)
+// Decodes up to "src_len" bytes of UTF-8 from "src" into at most
+// "dst_size" characters at "dst". Sequences which are malformed (invalid
+// lead or continuation bytes, overlong forms, surrogates or values beyond
+// U+10FFFF) are decoded as U+FFFD. A sequence cut off at the end of "src"
+// is left alone, so it can be completed by the next chunk. Returns the
+// number of characters written and stores the number of bytes consumed in
+// "src_consumed". No terminator is written.
+size_t utf8_to_z_ucs(z_ucs *dst, size_t dst_size, char *src, size_t src_len,
+    size_t *src_consumed)
 {
-  if (max_dest_size < 1)
-    return NULL;
-
-  while (*src != (char)0)
+  uint8_t *in = (uint8_t*)src, *in_end = (uint8_t*)src + src_len;
+  z_ucs *out = dst, *out_end = dst + dst_size;
+  uint8_t lead;
+  int len, i;
+  z_ucs result, minimum;
+  bool truncated = false;
+#ifdef __SSE2__
+  __m128i zero = _mm_setzero_si128();
+  __m128i block, low, high;
+#endif // __SSE2__
+
+  while ( (in < in_end) && (out < out_end) )
   {
-    if (max_dest_size == 1)
+#ifdef __SSE2__
+    // ASCII fast path: sixteen bytes without their high bit set are widened
+    // to characters at once.
+    while ( (in_end - in >= 16) && (out_end - out >= 16) )
     {
-      *dest = 0;
-      return src;
+      block = _mm_loadu_si128((__m128i*)in);
+      if (_mm_movemask_epi8(block) != 0)
+        break;
+
+      low = _mm_unpacklo_epi8(block, zero);
+      high = _mm_unpackhi_epi8(block, zero);
+      _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi16(low, zero));
+      _mm_storeu_si128((__m128i*)(out + 4), _mm_unpackhi_epi16(low, zero));
+      _mm_storeu_si128((__m128i*)(out + 8), _mm_unpacklo_epi16(high, zero));
+      _mm_storeu_si128((__m128i*)(out + 12), _mm_unpackhi_epi16(high, zero));
+
+      in += 16;
+      out += 16;
     }
 
-    *dest = utf8_char_to_zucs_char(&src);
-    max_dest_size--;
-    dest++;
-  }
+    if ( (in == in_end) || (out == out_end) )
+      break;
+#endif // __SSE2__
 
-  *dest = 0;
+    lead = *in;
 
-  return NULL;
-}
+    if (lead < 0x80)
+    {
+      *(out++) = (z_ucs)lead;
+      in++;
+      continue;
+    }
+    else if ( (lead >= 0xc2) && (lead <= 0xdf) )
+    {
+      len = 2;
+      result = lead & 0x1f;
+      minimum = 0x80;
+    }
+    else if ( (lead >= 0xe0) && (lead <= 0xef) )
+    {
+      len = 3;
+      result = lead & 0x0f;
+      minimum = 0x800;
+    }
+    else if ( (lead >= 0xf0) && (lead <= 0xf4) )
+    {
+      len = 4;
+      result = lead & 0x07;
+      minimum = 0x10000;
+    }
+    else
+    {
+      *(out++) = Z_UCS_REPLACEMENT_CHAR;
+      in++;
+      continue;
+    }
 
+    for (i=1; i<len; i++)
+    {
+      if (in + i == in_end)
+      {
+        truncated = true;
+        break;
+      }
 
-z_ucs *dup_utf8_string_to_zucs_string(char *src)
-{
-  int len = 0;
-  char *ptr = src;
-  z_ucs *result;
+      if ((in[i] & 0xc0) != 0x80)
+        break;
 
-  while (*ptr != 0)
-  {
-    utf8_char_to_zucs_char(&ptr);
-    len++;
+      result = (result << 6) | (in[i] & 0x3f);
+    }
+
+    if (truncated == true)
+      break;
+
+    if (
+        (i < len)
+        ||
+        (result < minimum)
+        ||
+        (result > 0x10ffff)
+        ||
+        ( (result >= 0xd800) && (result <= 0xdfff) )
+       )
+    {
+      // The lead byte and all valid continuation bytes are skipped.
+      *(out++) = Z_UCS_REPLACEMENT_CHAR;
+      in += i;
+    }
+    else
+    {
+      *(out++) = result;
+      in += len;
+    }
   }
-  len++;
 
-  if ((result = malloc(sizeof(z_ucs) * len)) == NULL)
-    return NULL;
+  *src_consumed = (size_t)(in - (uint8_t*)src);
+  return (size_t)(out - dst);
+}
 
-  utf8_string_to_zucs_string(result, src, len);
 
-  return result;
+// Surrogates and values beyond U+10FFFF can't be encoded and are written
+// as U+FFFD instead.
+static z_ucs get_encodable_char(z_ucs zucs_char)
+{
+  return ( (zucs_char > 0x10ffff)
+      || ( (zucs_char >= 0xd800) && (zucs_char <= 0xdfff) ) )
+    ? Z_UCS_REPLACEMENT_CHAR
+    : zucs_char;
 }
 
 
 static int get_utf8_code_length(z_ucs zucs_char)
 {
-  if (     (zucs_char & 0xffffff80) == 0)
+  zucs_char = get_encodable_char(zucs_char);
+
+  if (zucs_char < 0x80)
     return 1;
-  else if ((zucs_char & 0xfffff800) == 0)
+  else if (zucs_char < 0x800)
     return 2;
-  else if ((zucs_char & 0xffff0000) == 0)
+  else if (zucs_char < 0x10000)
     return 3;
-  else if ((zucs_char & 0xffe00000) == 0)
-    return 4;
-  else if ((zucs_char & 0xfc000000) == 0)
-    return 5;
-  else if ((zucs_char & 0x80000000) == 0)
-    return 6;
   else
-    return -1;
+    return 4;
 }
 
 
-int zucs_string_to_utf8_string(char *dst, z_ucs **src, size_t max_dst_size)
+// Encodes up to "src_len" characters from "src" as UTF-8 into "dst", which
+// has room for "dst_size" bytes. Encoding stops before the first character
+// which doesn't fit completely. Returns the number of bytes written and
+// stores the number of characters consumed in "src_consumed". No terminator
+// is written.
+size_t z_ucs_to_utf8(char *dst, size_t dst_size, z_ucs *src, size_t src_len,
+    size_t *src_consumed)
 {
-  int len = 0;
-  int char_len;
-  int i;
-  z_ucs mask1;
-  z_ucs mask2;
-  z_ucs src_val;
-
-  if ( (max_dst_size < 1) && (dst != NULL) )
-  {
-    return -1;
-  }
-
-  while (**src != 0)
+  uint8_t *out = (uint8_t*)dst, *out_end = (uint8_t*)dst + dst_size;
+  z_ucs *in = src, *in_end = src + src_len;
+  z_ucs zucs_char;
+#ifdef __SSE2__
+  __m128i non_ascii_bits = _mm_set1_epi32(~0x7f);
+  __m128i zero = _mm_setzero_si128();
+  __m128i block1, block2, packed;
+#endif // __SSE2__
+
+  while (in < in_end)
   {
-    char_len = get_utf8_code_length(**src);
-    if (char_len == -1)
+#ifdef __SSE2__
+    // ASCII fast path: eight characters below 0x80 are narrowed to bytes
+    // at once.
+    while ( (in_end - in >= 8) && (out_end - out >= 8) )
     {
-      printf("Illegal code: %c/%x\n", (char)**src, (unsigned)**src);
-      printf("&0xfffff800: %x.\n", (unsigned)(**src & 0xfffff800));
-      return -1;
+      block1 = _mm_loadu_si128((__m128i*)in);
+      block2 = _mm_loadu_si128((__m128i*)(in + 4));
+
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(
+              _mm_and_si128(_mm_or_si128(block1, block2), non_ascii_bits),
+              zero)) != 0xffff)
+        break;
+
+      packed = _mm_packs_epi32(block1, block2);
+      _mm_storel_epi64((__m128i*)out, _mm_packus_epi16(packed, packed));
+
+      in += 8;
+      out += 8;
     }
 
-    if (dst != NULL)
+    if (in == in_end)
+      break;
+#endif // __SSE2__
+
+    zucs_char = get_encodable_char(*in);
+
+    if (zucs_char < 0x80)
     {
-      if (max_dst_size < (size_t)(char_len + 1))
-      {
-        *dst = (char)0;
-        return len + 1;
-      }
+      if (out_end - out < 1)
+        break;
+      *(out++) = (uint8_t)zucs_char;
+    }
+    else if (zucs_char < 0x800)
+    {
+      if (out_end - out < 2)
+        break;
+      *(out++) = (uint8_t)(0xc0 | (zucs_char >> 6));
+      *(out++) = (uint8_t)(0x80 | (zucs_char & 0x3f));
+    }
+    else if (zucs_char < 0x10000)
+    {
+      if (out_end - out < 3)
+        break;
+      *(out++) = (uint8_t)(0xe0 | (zucs_char >> 12));
+      *(out++) = (uint8_t)(0x80 | ((zucs_char >> 6) & 0x3f));
+      *(out++) = (uint8_t)(0x80 | (zucs_char & 0x3f));
+    }
+    else
+    {
+      if (out_end - out < 4)
+        break;
+      *(out++) = (uint8_t)(0xf0 | (zucs_char >> 18));
+      *(out++) = (uint8_t)(0x80 | ((zucs_char >> 12) & 0x3f));
+      *(out++) = (uint8_t)(0x80 | ((zucs_char >> 6) & 0x3f));
+      *(out++) = (uint8_t)(0x80 | (zucs_char & 0x3f));
+    }
 
-      if (char_len == 1)
-      {
-        *dst = (char)**src;
-        dst++;
-      }
-      else
-      {
-        mask1 = 0x01;
-        mask2 = 0xfc;
-        for (i=0; i<6-char_len; i++)
-        {
-          mask1 <<= 1;
-          mask1 |= 1;
-          mask2 <<= 1; 
-        }
-        mask2 &= 0xff;
-
-        dst += char_len - 1;
-        src_val = **src;
-
-        for (i=0; i<char_len-1; i++)
-        {
-          *dst = (char)((src_val & 0x3f) | 0x80);
-          src_val >>= 6;
-          dst--;
-        }
-
-        *dst = (char)((src_val & mask1) | mask2);
-
-        dst += char_len;
-      }
+    in++;
+  }
+
+  *src_consumed = (size_t)(in - src);
+  return (size_t)(out - (uint8_t*)dst);
+}
+
+
+char *utf8_string_to_zucs_string(z_ucs *dest, char *src, int max_dest_size)
+{
+  size_t src_len, src_consumed, dest_len;
+  char *src_end;
 
-      max_dst_size -= char_len;
+  if (max_dest_size < 1)
+    return NULL;
+
+  // Every character consumes four bytes at most, so there's no need to
+  // look any further for the terminator.
+  src_len = (size_t)(max_dest_size - 1) * 4;
+  if ((src_end = memchr(src, 0, src_len)) != NULL)
+    src_len = (size_t)(src_end - src);
+
+  dest_len = utf8_to_z_ucs(
+      dest, (size_t)(max_dest_size - 1), src, src_len, &src_consumed);
+  src += src_consumed;
+
+  if (
+      (src_end != NULL)
+      &&
+      (src != src_end)
+      &&
+      (dest_len < (size_t)(max_dest_size - 1))
+     )
+  {
+    // The string ends inside a sequence.
+    dest[dest_len++] = Z_UCS_REPLACEMENT_CHAR;
+    src = src_end;
+  }
+
+  dest[dest_len] = 0;
+
+  return *src != 0 ? src : NULL;
+}
+
+
+z_ucs *dup_utf8_string_to_zucs_string(char *src)
+{
+  size_t src_len = strlen(src), src_consumed, len;
+  z_ucs *result;
+
+  // A string never decodes to more characters than it has bytes.
+  if ((result = malloc(sizeof(z_ucs) * (src_len + 1))) == NULL)
+    return NULL;
+
+  len = utf8_to_z_ucs(result, src_len, src, src_len, &src_consumed);
+
+  if (src_consumed < src_len)
+    result[len++] = Z_UCS_REPLACEMENT_CHAR;
+
+  result[len] = 0;
+
+  return result;
+}
+
+
+int zucs_string_to_utf8_string(char *dst, z_ucs **src, size_t max_dst_size)
+{
+  size_t len = 0, src_len = 0, src_consumed;
+
+  if (dst == NULL)
+  {
+    while (**src != 0)
+    {
+      len += get_utf8_code_length(**src);
+      (*src)++;
     }
 
-    (*src)++;
-    len += char_len;
+    return (int)len + 1;
   }
 
-  if (dst != NULL)
-    *dst = (char)0;
+  if (max_dst_size < 1)
+    return -1;
+
+  // Every character requires at least one byte, so there's no need to look
+  // further for the terminator than the buffer is long.
+  while ( (src_len < max_dst_size - 1) && ((*src)[src_len] != 0) )
+    src_len++;
+
+  len = z_ucs_to_utf8(dst, max_dst_size - 1, *src, src_len, &src_consumed);
+  dst[len] = (char)0;
+  *src += src_consumed;
 
-  return len + 1;
+  return (int)len + 1;
 }
 
 
 char *dup_zucs_string_to_utf8_string(z_ucs *src)
 {
   char *dst;
-  z_ucs *src_ptr;
-  size_t len = 0;
+  size_t len = 0, src_len = 0, src_consumed;
 
-  src_ptr = src;
-  while (*src_ptr != 0)
+  while (src[src_len] != 0)
   {
-    len += get_utf8_code_length(*src_ptr);
-    src_ptr++;
+    len += get_utf8_code_length(src[src_len]);
+    src_len++;
   }
 
   if ((dst = malloc(len + 1)) == NULL)
     return NULL;
 
-  src_ptr = src;
-  if ((zucs_string_to_utf8_string(dst, &src_ptr, len + 1)) != (int)(len + 1))
-  {
-    free(dst);
-    return NULL;
-  }
+  (void)z_ucs_to_utf8(dst, len, src, src_len, &src_consumed);
+  dst[len] = (char)0;
 
   return dst;
 }
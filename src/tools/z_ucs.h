@@ -49,6 +49,7 @@
 #define Z_UCS_MINUS ((z_ucs)'-')
 #define Z_UCS_SOFT_HYPEN ((z_ucs)0xad)
 #define Z_UCS_COMMA ((z_ucs)',')
+#define Z_UCS_REPLACEMENT_CHAR ((z_ucs)0xfffd)
 
 typedef struct
 {
@@ -57,6 +58,15 @@ typedef struct
   size_t bytes_allocated;
 } zucs_string;
 
+// A string together with its length, so that code handing output down
+// through several stages doesn't have to search for the terminator again in
+// each of them. The string pointed to is still zero-terminated.
+typedef struct
+{
+  z_ucs *ptr;
+  size_t len;
+} z_ucs_view;
+
 size_t z_ucs_len(z_ucs *string);
 z_ucs *z_ucs_cpy(z_ucs *dst, z_ucs *src);
 void z_ucs_ncpy(z_ucs *dst, z_ucs *src, size_t len);
@@ -67,6 +77,7 @@ z_ucs *z_ucs_rchr(z_ucs *s1, z_ucs chr);
 z_ucs *z_ucs_rchrs(z_ucs *s1, z_ucs *chars);
 z_ucs *z_ucs_cat(z_ucs *dst, z_ucs *src);
 z_ucs *z_ucs_dup(z_ucs *src);
+z_ucs_view z_ucs_view_of(z_ucs *string);
 
 z_ucs latin1_char_to_zucs_char(char c);
 char *latin1_string_to_zucs_string(z_ucs *dest, char *src,
@@ -77,7 +88,12 @@ int z_ucs_cmp_latin1(z_ucs *s1, char *s2);
 z_ucs *dup_latin1_string_to_zucs_string(char *src);
 
 z_ucs parse_utf8_char_from_file(z_file *fileref);
+z_ucs parse_utf8_char_from_buffer(char **src, char *end);
 z_ucs utf8_char_to_zucs_char(char **src);
+size_t utf8_to_z_ucs(z_ucs *dst, size_t dst_size, char *src, size_t src_len,
+    size_t *src_consumed);
+size_t z_ucs_to_utf8(char *dst, size_t dst_size, z_ucs *src, size_t src_len,
+    size_t *src_consumed);
 char *utf8_string_to_zucs_string(z_ucs *dest, char *src, int max_dest_size);
 z_ucs *dup_utf8_string_to_zucs_string(char *src);
 int zucs_string_to_utf8_string(char *dst, z_ucs **src, size_t max_dst_size);